@@ -1,6 +1,97 @@
 #include "assets_manager.h"
 
+#include <chrono>
+#include <cmath>
 #include <cstring>
+#include <cwctype>
+#include <random>
+
+#include "cube_model.h"
+#include "mesh_cache_model.h"
+
+namespace {
+
+const wchar_t* const kVertexStreamLayoutNames[] = {
+  L"interleaved",
+  L"deinterleaved",
+};
+
+// Bounds of the transformed box. model_transform is stored transposed, the way it is uploaded.
+Asset::Model::BoundingBox TransformBoundingBox(const Asset::Model::BoundingBox& bounding_box, const XMFLOAT4X4& model_transform)
+{
+  if (bounding_box.min.x > bounding_box.max.x) {
+    return bounding_box;
+  }
+
+  // Each output axis is the translation plus, per input axis, the smaller or larger product.
+  Asset::Model::BoundingBox transformed_box;
+  const float* box_min = &bounding_box.min.x;
+  const float* box_max = &bounding_box.max.x;
+  float* transformed_min = &transformed_box.min.x;
+  float* transformed_max = &transformed_box.max.x;
+  for (int row = 0; row < 3; ++row) {
+    transformed_min[row] = transformed_max[row] = model_transform.m[row][3];
+    for (int column = 0; column < 3; ++column) {
+      const float a = model_transform.m[row][column] * box_min[column];
+      const float b = model_transform.m[row][column] * box_max[column];
+      transformed_min[row] += std::min(a, b);
+      transformed_max[row] += std::max(a, b);
+    }
+  }
+  return transformed_box;
+}
+
+// Geometry of its own, so every instance is a mesh of its own: a strip of vertex_number vertices.
+class StripModel : public Asset::Model {
+ public:
+  StripModel(size_t vertex_number, float offset) : vertices_(vertex_number), indices_(vertex_number > 2 ? 3 * (vertex_number - 2) : 0) {
+    for (size_t i = 0; i < vertex_number; ++i) {
+      vertices_[i].position = XMFLOAT3(offset + 0.5f * (i / 2), 0.0f, static_cast<float>(i % 2));
+      vertices_[i].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+      vertices_[i].uv = XMFLOAT2(0.0f, 0.0f);
+      vertices_[i].color = XMFLOAT3(1.0f, 1.0f, 1.0f);
+    }
+    for (size_t i = 0; i + 2 < vertex_number; ++i) {
+      indices_[3 * i] = static_cast<DWORD>(i);
+      indices_[3 * i + 1] = static_cast<DWORD>(i + 1 + i % 2);
+      indices_[3 * i + 2] = static_cast<DWORD>(i + 2 - i % 2);
+    }
+  }
+
+  const Vertex* GetVertexData() const override {
+    return vertices_.data();
+  }
+
+  size_t GetVertexDataSize() const override {
+    return vertices_.size() * sizeof(Vertex);
+  }
+
+  size_t GetVertexNumber() const override {
+    return vertices_.size();
+  }
+
+  const DWORD* GetIndexData() const override {
+    return indices_.data();
+  }
+
+  size_t GetIndexDataSize() const override {
+    return indices_.size() * sizeof(DWORD);
+  }
+
+  size_t GetIndexNumber() const override {
+    return indices_.size();
+  }
+
+  const std::string GetTextureImageFileName() const override {
+    return "";
+  }
+
+ private:
+  std::vector<Vertex> vertices_;
+  std::vector<DWORD> indices_;
+};  // class StripModel
+
+}  // namespace
 
 AssetsManager& AssetsManager::GetSharedInstance()
 {
@@ -8,64 +99,493 @@ AssetsManager& AssetsManager::GetSharedInstance()
   return instance;
 }
 
+void AssetsManager::BuildInstanceBatches(const std::vector<DrawArgument>& draw_arguments, const std::vector<UINT>& objects, bool match_textures,
+                                         std::vector<InstanceBatch>& batches, std::vector<UINT>& instance_objects)
+{
+  batches.clear();
+  instance_objects.clear();
+
+  // Counting sort by mesh, which keeps each mesh's objects in their given order.
+  UINT mesh_number = 0;
+  for (UINT object_index : objects) {
+    if (object_index < draw_arguments.size()) {
+      mesh_number = std::max(mesh_number, draw_arguments[object_index].mesh_index + 1);
+    }
+  }
+  std::vector<UINT> mesh_offsets(mesh_number + 1, 0);
+  for (UINT object_index : objects) {
+    if (object_index < draw_arguments.size()) {
+      mesh_offsets[draw_arguments[object_index].mesh_index + 1]++;
+    }
+  }
+  for (UINT mesh_index = 0; mesh_index < mesh_number; ++mesh_index) {
+    mesh_offsets[mesh_index + 1] += mesh_offsets[mesh_index];
+  }
+  instance_objects.resize(mesh_offsets[mesh_number]);
+  std::vector<UINT> mesh_cursors(mesh_offsets.cbegin(), mesh_offsets.cend() - 1);
+  for (UINT object_index : objects) {
+    if (object_index < draw_arguments.size()) {
+      instance_objects[mesh_cursors[draw_arguments[object_index].mesh_index]++] = object_index;
+    }
+  }
+
+  // A mesh drawn with several textures is split into a batch per texture.
+  const auto texture_less = [&draw_arguments](UINT a, UINT b) {
+    return draw_arguments[a].diffuse_texture_index < draw_arguments[b].diffuse_texture_index;
+  };
+  for (UINT mesh_index = 0; mesh_index < mesh_number; ++mesh_index) {
+    const auto mesh_begin = instance_objects.begin() + mesh_offsets[mesh_index];
+    const auto mesh_end = instance_objects.begin() + mesh_offsets[mesh_index + 1];
+    if (match_textures && !std::is_sorted(mesh_begin, mesh_end, texture_less)) {
+      std::stable_sort(mesh_begin, mesh_end, texture_less);
+    }
+    for (auto batch_begin = mesh_begin; batch_begin != mesh_end;) {
+      const auto batch_end = match_textures ? std::upper_bound(batch_begin, mesh_end, *batch_begin, texture_less) : mesh_end;
+      const DrawArgument& draw_argument = draw_arguments[*batch_begin];
+      InstanceBatch batch;
+      batch.index_count = draw_argument.index_count;
+      batch.index_start = draw_argument.index_start;
+      batch.vertex_base = draw_argument.vertex_base;
+      batch.diffuse_texture_index = draw_argument.diffuse_texture_index;
+      batch.first_instance = static_cast<UINT>(batch_begin - instance_objects.begin());
+      batch.instance_number = static_cast<UINT>(batch_end - batch_begin);
+      batches.push_back(batch);
+      batch_begin = batch_end;
+    }
+  }
+}
+
+AssetsManager::InstancingBenchmarkReport AssetsManager::BenchmarkInstancing(size_t object_number, UINT mesh_number, UINT texture_number, UINT iteration_number)
+{
+  InstancingBenchmarkReport report{};
+  report.object_number = object_number;
+  if (object_number == 0 || mesh_number == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  // Each mesh comes with one texture (or none), but a few of its objects swap it for another.
+  std::mt19937 random_engine(static_cast<unsigned int>(object_number));
+  std::uniform_int_distribution<UINT> mesh_distribution(0, mesh_number - 1);
+  std::uniform_int_distribution<UINT> texture_distribution(0, texture_number);
+  std::uniform_int_distribution<UINT> swap_distribution(0, 99);
+  std::vector<DrawArgument> draw_arguments(object_number);
+  std::vector<UINT> objects(object_number);
+  for (size_t i = 0; i < object_number; ++i) {
+    DrawArgument& draw_argument = draw_arguments[i];
+    draw_argument.mesh_index = mesh_distribution(random_engine);
+    draw_argument.index_count = 36;
+    draw_argument.index_start = draw_argument.mesh_index * 36;
+    draw_argument.vertex_base = draw_argument.mesh_index * 24;
+    const UINT texture = swap_distribution(random_engine) == 0 ? texture_distribution(random_engine) : draw_argument.mesh_index % (texture_number + 1);
+    draw_argument.diffuse_texture_index = static_cast<int>(texture) - 1;
+    objects[i] = static_cast<UINT>(i);
+  }
+
+  std::vector<InstanceBatch> batches;
+  std::vector<UINT> instance_objects;
+  BuildInstanceBatches(draw_arguments, objects, false, batches, instance_objects);
+  report.depth_batch_number = batches.size();
+  const auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    BuildInstanceBatches(draw_arguments, objects, true, batches, instance_objects);
+  }
+  report.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+  report.batch_number = batches.size();
+  return report;
+}
+
+bool AssetsManager::ParseVertexStreamLayout(const std::wstring& name, VertexStreamLayout& vertex_stream_layout)
+{
+  for (int i = 0; i < static_cast<int>(sizeof(kVertexStreamLayoutNames) / sizeof(kVertexStreamLayoutNames[0])); ++i) {
+    const std::wstring layout_name = kVertexStreamLayoutNames[i];
+    if (name.size() == layout_name.size() && std::equal(name.begin(), name.end(), layout_name.begin(),
+        [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; })) {
+      vertex_stream_layout = static_cast<VertexStreamLayout>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+AssetsManager::DrawArgumentsBenchmarkReport AssetsManager::BenchmarkDrawArguments(size_t model_number, UINT frame_number)
+{
+  DrawArgumentsBenchmarkReport report{};
+  report.model_number = model_number;
+  if (model_number == 0 || frame_number == 0) {
+    return report;
+  }
+
+  // Cubes on a grid, sharing one mesh.
+  AssetsManager assets_manager;
+  const size_t row_length = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(model_number))));
+  for (size_t i = 0; i < model_number; ++i) {
+    assets_manager.InsertModel(std::make_unique<Asset::CubeModel>(),
+      XMMatrixTranspose(XMMatrixTranslation(2.0f * (i % row_length), 0.0f, 2.0f * (i / row_length))));
+  }
+  size_t checksum = assets_manager.GetModelDrawArguments().size();  // keeps the lookups from being optimized out
+
+  const UINT pass_number = 3;
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    for (UINT pass = 0; pass < pass_number; ++pass) {
+      assets_manager.FillDrawArguments();
+      checksum += assets_manager.draw_arguments_.size();
+    }
+  }
+  report.rebuild_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / frame_number;
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    assets_manager.RebuildModelBvh();
+  }
+  report.bvh_build_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / frame_number;
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    for (UINT pass = 0; pass < pass_number; ++pass) {
+      checksum += assets_manager.GetModelDrawArguments().size();
+    }
+  }
+  report.cached_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / frame_number;
+
+  const size_t moved_model_number = std::max<size_t>(model_number / 100, 1);
+  start_time = std::chrono::steady_clock::now();
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    for (size_t i = 0; i < moved_model_number; ++i) {
+      const size_t model_index = (static_cast<size_t>(frame) * moved_model_number + i) % model_number;
+      const XMFLOAT4X4 model_transform = assets_manager.models_[model_index]->GetModelTransform();
+      assets_manager.SetModelTransform(model_index, XMMatrixMultiply(XMMatrixTranspose(XMMatrixTranslation(0.0f, 0.01f, 0.0f)), XMLoadFloat4x4(&model_transform)));
+    }
+    for (UINT pass = 0; pass < pass_number; ++pass) {
+      checksum += assets_manager.GetModelDrawArguments().size();
+    }
+  }
+  report.patched_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / frame_number;
+  if (checksum == 0) {
+    report.model_number = 0;
+  }
+  return report;
+}
+
+AssetsManager::MergeBenchmarkReport AssetsManager::BenchmarkMerge(size_t mesh_number, size_t vertex_number, UINT iteration_number)
+{
+  MergeBenchmarkReport report{};
+  if (mesh_number == 0 || vertex_number < 3 || iteration_number == 0) {
+    return report;
+  }
+
+  AssetsManager assets_manager;
+  for (size_t i = 0; i < mesh_number; ++i) {
+    assets_manager.InsertModel(std::make_unique<StripModel>(vertex_number, 2.0f * i), XMMatrixIdentity());
+  }
+  const size_t vertex_size = assets_manager.GetTotalModelVertexSize();
+  const size_t index_size = assets_manager.GetTotalModelIndexSize();
+  report.merged_size = vertex_size + index_size;
+  report.direct_peak_size = report.merged_size;
+  report.staged_peak_size = 2 * report.merged_size;
+
+  // Written once before timing, so neither kind pays for first touching its pages.
+  std::vector<Asset::Model::Vertex> vertices(assets_manager.GetTotalModelVertexNumber());
+  std::vector<DWORD> indices(assets_manager.GetTotalModelIndexNumber());
+  assets_manager.CopyMergedVerticesAndIndices(vertices.data(), indices.data());
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    std::unique_ptr<Asset::Model::Vertex[]> staged_vertices;
+    std::unique_ptr<DWORD[]> staged_indices;
+    assets_manager.GetMergedVerticesAndIndices(staged_vertices, staged_indices);
+    std::memcpy(vertices.data(), staged_vertices.get(), vertex_size);
+    std::memcpy(indices.data(), staged_indices.get(), index_size);
+  }
+  report.staged_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    assets_manager.CopyMergedVerticesAndIndices(vertices.data(), indices.data());
+  }
+  report.direct_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+  return report;
+}
+
+AssetsManager::MeshCacheBenchmarkReport AssetsManager::BenchmarkMeshCache(size_t mesh_number, size_t vertex_number, const std::wstring& file_name)
+{
+  MeshCacheBenchmarkReport report{};
+  if (mesh_number == 0 || vertex_number < 3) {
+    return report;
+  }
+
+  std::vector<Asset::Model::Vertex> vertices;
+  std::vector<DWORD> indices;
+  const auto merge = [&vertices, &indices](const AssetsManager& assets_manager) {
+    vertices.resize(assets_manager.GetTotalModelVertexNumber());
+    indices.resize(assets_manager.GetTotalModelIndexNumber());
+    assets_manager.CopyMergedVerticesAndIndices(vertices.data(), indices.data());
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  {
+    AssetsManager assets_manager;
+    for (size_t i = 0; i < mesh_number; ++i) {
+      assets_manager.InsertModel(std::make_unique<StripModel>(vertex_number, 2.0f * i), XMMatrixIdentity());
+    }
+    merge(assets_manager);
+    report.built_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    if (!assets_manager.CookMeshCache(file_name)) {
+      return report;
+    }
+  }
+
+  start_time = std::chrono::steady_clock::now();
+  {
+    AssetsManager assets_manager;
+    if (!assets_manager.LoadMeshCache(file_name)) {
+      return report;
+    }
+    merge(assets_manager);
+    report.cached_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+  }
+  MeshCache mesh_cache;
+  if (mesh_cache.Load(file_name)) {
+    report.file_size = static_cast<size_t>(mesh_cache.GetHeader().file_size);
+  }
+  return report;
+}
+
 void AssetsManager::GetMergedVerticesAndIndices(std::unique_ptr<Asset::Model::Vertex[]>& vertices_data, std::unique_ptr<DWORD[]>& indices_data)
 {
-  auto total_vertex_number = GetTotalModelVertexNumber();
-  vertices_data = std::make_unique<Asset::Model::Vertex[]>(total_vertex_number);
-
-  auto total_index_number = GetTotalModelIndexNumber();
-  indices_data = std::make_unique<DWORD[]>(total_index_number);
-  
-  size_t current_merged_vertex_number = 0;
-  size_t current_merged_index_number = 0;
-  std::for_each(models_.cbegin(), models_.cend(), [&vertices_data, &indices_data, &current_merged_vertex_number, &current_merged_index_number](const std::unique_ptr<Asset::Model>& model) {
-    Asset::Model::Vertex* current_vertex_insert_ptr = vertices_data.get() + current_merged_vertex_number;
-    std::unique_ptr<Asset::Model::Vertex[]> single_model_vertices_data = model->GetVertexData();
-    std::memcpy(current_vertex_insert_ptr, single_model_vertices_data.get(), model->GetVertexDataSize());
-    current_merged_vertex_number += model->GetVertexNumber();
-
-    DWORD* current_index_insert_ptr = indices_data.get() + current_merged_index_number;
-    std::unique_ptr<DWORD[]> single_model_indices_data = model->GetIndexData();
-    std::memcpy(current_index_insert_ptr, single_model_indices_data.get(), model->GetIndexDataSize());
-    current_merged_index_number += model->GetIndexNumber();
+  vertices_data = std::make_unique<Asset::Model::Vertex[]>(GetTotalModelVertexNumber());
+  indices_data = std::make_unique<DWORD[]>(GetTotalModelIndexNumber());
+  CopyMergedVerticesAndIndices(vertices_data.get(), indices_data.get());
+}
+
+void AssetsManager::CopyMergedVerticesAndIndices(Asset::Model::Vertex* vertices_destination, DWORD* indices_destination) const
+{
+  std::for_each(meshes_.cbegin(), meshes_.cend(), [this, &vertices_destination, &indices_destination](const Mesh& mesh) {
+    const std::unique_ptr<Asset::Model>& model = models_[mesh.model_index];
+    std::memcpy(vertices_destination, model->GetVertexData(), model->GetVertexDataSize());
+    vertices_destination += mesh.vertex_number;
+
+    std::memcpy(indices_destination, model->GetIndexData(), model->GetIndexDataSize());
+    indices_destination += mesh.index_number;
   });
 }
 
-void AssetsManager::GetModelDrawArguments(std::vector<DrawArgument>& draw_arguments)
+void AssetsManager::CopyMergedVertexStreamsAndIndices(XMFLOAT3* positions_destination, Asset::Model::VertexAttributes* attributes_destination, DWORD* indices_destination) const
+{
+  std::for_each(meshes_.cbegin(), meshes_.cend(), [this, &positions_destination, &attributes_destination, &indices_destination](const Mesh& mesh) {
+    const std::unique_ptr<Asset::Model>& model = models_[mesh.model_index];
+    const Asset::Model::Vertex* vertices = model->GetVertexData();
+    const size_t vertex_number = mesh.vertex_number;
+    for (size_t i = 0; i < vertex_number; ++i) {
+      positions_destination[i] = vertices[i].position;
+      attributes_destination[i].normal = vertices[i].normal;
+      attributes_destination[i].uv = vertices[i].uv;
+      attributes_destination[i].color = vertices[i].color;
+    }
+    positions_destination += vertex_number;
+    attributes_destination += vertex_number;
+
+    std::memcpy(indices_destination, model->GetIndexData(), model->GetIndexDataSize());
+    indices_destination += mesh.index_number;
+  });
+}
+
+bool AssetsManager::LoadMeshCache(const std::wstring& file_name)
+{
+  std::shared_ptr<MeshCache> mesh_cache = std::make_shared<MeshCache>();
+  if (!mesh_cache->Load(file_name)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < mesh_cache->GetHeader().draw_number; ++i) {
+    InsertModel(std::make_unique<Asset::MeshCacheModel>(mesh_cache, i), XMLoadFloat4x4(&mesh_cache->GetDraws()[i].model_transform));
+  }
+
+  return true;
+}
+
+bool AssetsManager::CookMeshCache(const std::wstring& file_name) const
+{
+  std::vector<Asset::Model::Vertex> vertices(GetTotalModelVertexNumber());
+  std::vector<DWORD> indices(GetTotalModelIndexNumber());
+  CopyMergedVerticesAndIndices(vertices.data(), indices.data());
+
+  // Draws of a shared mesh point at the same range, so they share it again when the cache is loaded.
+  std::vector<MeshCache::Draw> draws(models_.size());
+  std::vector<std::string> texture_file_names;
+  for (size_t i = 0; i < models_.size(); ++i) {
+    const Mesh& mesh = meshes_[model_mesh_indices_[i]];
+    MeshCache::Draw& draw = draws[i];
+    draw = MeshCache::Draw{};
+    draw.vertex_base = mesh.vertex_base;
+    draw.vertex_number = static_cast<uint32_t>(mesh.vertex_number);
+    draw.index_start = mesh.index_start;
+    draw.index_number = static_cast<uint32_t>(mesh.index_number);
+    draw.model_transform = models_[i]->GetModelTransform();
+
+    // Models sharing a texture share its reference.
+    draw.texture_index = -1;
+    const std::string texture_file_name = models_[i]->GetTextureImageFileName();
+    if (!texture_file_name.empty()) {
+      auto found = std::find(texture_file_names.cbegin(), texture_file_names.cend(), texture_file_name);
+      draw.texture_index = static_cast<int32_t>(found - texture_file_names.cbegin());
+      if (found == texture_file_names.cend()) {
+        texture_file_names.push_back(texture_file_name);
+      }
+    }
+  }
+
+  return MeshCache::Write(file_name, vertices.data(), vertices.size(), indices.data(), indices.size(), draws, texture_file_names);
+}
+
+void AssetsManager::RemoveModel(size_t model_index)
+{
+  if (model_index >= models_.size()) {
+    return;
+  }
+
+  models_.erase(models_.begin() + model_index);
+  model_bounding_boxes_.erase(model_bounding_boxes_.begin() + model_index);
+  model_transform_dirty_flags_.erase(model_transform_dirty_flags_.begin() + model_index);
+  model_dynamic_flags_.erase(model_dynamic_flags_.begin() + model_index);
+  RebuildMeshes();
+  draw_arguments_layout_dirty_ = true;
+}
+
+void AssetsManager::SetModelTransform(size_t model_index, const XMMATRIX& model_transform_matrix)
 {
-  if (models_.empty()) {
+  if (model_index >= models_.size()) {
     return;
   }
 
-  draw_arguments.clear();
-  draw_arguments.resize(models_.size());
+  models_[model_index]->SetModelTransform(model_transform_matrix);
+  if (!model_transform_dirty_flags_[model_index]) {
+    model_transform_dirty_flags_[model_index] = 1;
+    dirty_model_indices_.push_back(model_index);
+  }
+}
+
+void AssetsManager::SetModelDynamic(size_t model_index, bool dynamic)
+{
+  if (model_index >= models_.size() || (model_dynamic_flags_[model_index] != 0) == dynamic) {
+    return;
+  }
+
+  model_dynamic_flags_[model_index] = dynamic ? 1 : 0;
+  draw_arguments_layout_dirty_ = true;
+}
+
+const std::vector<AssetsManager::DrawArgument>& AssetsManager::GetModelDrawArguments()
+{
+  RefreshDrawArguments();
+  return draw_arguments_;
+}
 
-  draw_arguments[0].index_count = static_cast<UINT>(models_[0]->GetIndexNumber());
-  draw_arguments[0].index_start = 0;
-  draw_arguments[0].vertex_base = 0;
-  if (models_[0]->GetTextureImageFileName() != "") {
-    draw_arguments[0].diffuse_texture_index = 0;
+void AssetsManager::RefreshDrawArguments()
+{
+  if (draw_arguments_layout_dirty_) {
+    // A full rebuild picks up every transform, pending ones included.
+    RebuildDrawArguments();
+    std::fill(model_transform_dirty_flags_.begin(), model_transform_dirty_flags_.end(), static_cast<uint8_t>(0));
+    dirty_model_indices_.clear();
+    return;
   }
-  draw_arguments[0].model_transform = models_[0]->GetModelTransform();
 
-  UINT accumulated_index_start = static_cast<UINT>(models_[0]->GetIndexNumber());
-  UINT accumulated_vertex_base = static_cast<UINT>(models_[0]->GetVertexNumber());
-  UINT accumulated_diffuse_texture_index = 1;
-  for (auto i = 1; i < draw_arguments.size(); ++i) {
-    draw_arguments[i].index_count = static_cast<UINT>(models_[i]->GetIndexNumber());
-    draw_arguments[i].index_start = accumulated_index_start;
-    draw_arguments[i].vertex_base = accumulated_vertex_base;
+  if (dirty_model_indices_.empty()) {
+    return;
+  }
 
-    accumulated_index_start += static_cast<UINT>(models_[i]->GetIndexNumber());
-    accumulated_vertex_base += static_cast<UINT>(models_[i]->GetVertexNumber());
+  for (size_t model_index : dirty_model_indices_) {
+    draw_arguments_[model_index].model_transform = models_[model_index]->GetModelTransform();
+    draw_arguments_[model_index].world_bounding_box = TransformBoundingBox(model_bounding_boxes_[model_index], draw_arguments_[model_index].model_transform);
+    model_transform_dirty_flags_[model_index] = 0;
+  }
+  RefitModelBvh();
+  dirty_model_indices_.clear();
+  draw_arguments_version_++;
+}
+
+void AssetsManager::RebuildDrawArguments()
+{
+  FillDrawArguments();
+  RebuildModelBvh();
+  draw_arguments_layout_dirty_ = false;
+  draw_arguments_version_++;
+}
+
+void AssetsManager::FillDrawArguments()
+{
+  draw_arguments_.clear();
+  draw_arguments_.resize(models_.size());
+
+  int accumulated_diffuse_texture_index = 0;
+  for (size_t i = 0; i < models_.size(); ++i) {
+    const Mesh& mesh = meshes_[model_mesh_indices_[i]];
+    draw_arguments_[i].index_count = static_cast<UINT>(mesh.index_number);
+    draw_arguments_[i].index_start = mesh.index_start;
+    draw_arguments_[i].vertex_base = mesh.vertex_base;
+    draw_arguments_[i].mesh_index = model_mesh_indices_[i];
 
     if (models_[i]->GetTextureImageFileName() != "") {
-      draw_arguments[i].diffuse_texture_index = accumulated_diffuse_texture_index;
+      draw_arguments_[i].diffuse_texture_index = accumulated_diffuse_texture_index;
       accumulated_diffuse_texture_index++;  // Note: may be changed for extra textures, such as normal map
     }
 
-    draw_arguments[i].model_transform = models_[i]->GetModelTransform();
+    draw_arguments_[i].model_transform = models_[i]->GetModelTransform();
+    draw_arguments_[i].world_bounding_box = TransformBoundingBox(model_bounding_boxes_[i], draw_arguments_[i].model_transform);
+    draw_arguments_[i].dynamic = model_dynamic_flags_[i] != 0;
+  }
+}
+
+UINT AssetsManager::FindOrAddMesh(size_t model_index)
+{
+  const Asset::Model& model = *models_[model_index];
+  const MeshKey key(model.GetVertexData(), model.GetVertexNumber(), model.GetIndexData(), model.GetIndexNumber());
+  auto found = mesh_indices_.find(key);
+  if (found != mesh_indices_.end()) {
+    return found->second;
+  }
+
+  // New geometry goes after everything merged so far.
+  Mesh mesh;
+  mesh.model_index = model_index;
+  mesh.vertex_number = model.GetVertexNumber();
+  mesh.index_number = model.GetIndexNumber();
+  mesh.vertex_base = meshes_.empty() ? 0 : static_cast<UINT>(meshes_.back().vertex_base + meshes_.back().vertex_number);
+  mesh.index_start = meshes_.empty() ? 0 : static_cast<UINT>(meshes_.back().index_start + meshes_.back().index_number);
+  const UINT mesh_index = static_cast<UINT>(meshes_.size());
+  meshes_.push_back(mesh);
+  mesh_indices_.emplace(key, mesh_index);
+  return mesh_index;
+}
+
+void AssetsManager::RebuildMeshes()
+{
+  meshes_.clear();
+  mesh_indices_.clear();
+  model_mesh_indices_.clear();
+  for (size_t i = 0; i < models_.size(); ++i) {
+    model_mesh_indices_.push_back(FindOrAddMesh(i));
+  }
+}
+
+void AssetsManager::RebuildModelBvh()
+{
+  std::vector<Asset::Model::BoundingBox> world_bounding_boxes(draw_arguments_.size());
+  for (size_t i = 0; i < draw_arguments_.size(); ++i) {
+    world_bounding_boxes[i] = draw_arguments_[i].world_bounding_box;
+  }
+  model_bvh_.Build(world_bounding_boxes.data(), world_bounding_boxes.size());
+}
+
+void AssetsManager::RefitModelBvh()
+{
+  std::vector<Asset::Model::BoundingBox> moved_bounding_boxes;
+  moved_bounding_boxes.reserve(dirty_model_indices_.size());
+  for (size_t model_index : dirty_model_indices_) {
+    moved_bounding_boxes.push_back(draw_arguments_[model_index].world_bounding_box);
   }
+  model_bvh_.Refit(dirty_model_indices_.data(), moved_bounding_boxes.data(), dirty_model_indices_.size());
 }
 
 AssetsManager::AssetsManager()
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include <memory>
+#include <string>
 #include <algorithm>
+#include <tuple>
 
+#include "bounding_volume_hierarchy.h"
 #include "model.h"
 
 class AssetsManager {
@@ -13,28 +17,121 @@ class AssetsManager {
      UINT index_start = 0;
      UINT vertex_base = 0;
      int diffuse_texture_index = -1;
+     UINT mesh_index = 0;  // draws of the same mesh share index_start and vertex_base
      XMFLOAT4X4 model_transform;
+     Asset::Model::BoundingBox world_bounding_box;  // follows model_transform
+     bool dynamic = false;  // expected to move, see SetModelDynamic
    };
 
+  // Draws of one mesh, issued as a single DrawIndexedInstanced; instance i takes the transform of draw argument
+  // instance_objects[first_instance + i] from BuildInstanceBatches.
+  struct InstanceBatch {
+    UINT index_count;
+    UINT index_start;
+    UINT vertex_base;
+    int diffuse_texture_index;  // of every instance, unless textures were ignored
+    UINT first_instance;
+    UINT instance_number;
+  };  // struct InstanceBatch
+
+  struct InstancingBenchmarkReport {
+    size_t object_number;  // one draw each without instancing
+    size_t batch_number;  // draws with instancing, textures matched
+    size_t depth_batch_number;  // draws with instancing, textures ignored as in a depth pass
+    double microseconds;  // per BuildInstanceBatches of every object, textures matched
+  };  // struct InstancingBenchmarkReport
+
+  // Per frame, three GetModelDrawArguments, one for each pass that reads the table.
+  struct DrawArgumentsBenchmarkReport {
+    size_t model_number;
+    double rebuild_microseconds;  // rebuilding the table for each, as before the table was cached
+    double bvh_build_microseconds;  // one build of the BVH over the table, which the uncached path never did
+    double cached_microseconds;  // nothing moved
+    double patched_microseconds;  // 1% of the models moved
+  };  // struct DrawArgumentsBenchmarkReport
+
+  // Merging the geometry of every mesh into memory the size of the merged buffers, e.g. a mapped upload heap.
+  struct MergeBenchmarkReport {
+    size_t merged_size;  // in bytes, vertices and indices
+    double staged_milliseconds;  // GetMergedVerticesAndIndices, then a copy into the destination
+    double direct_milliseconds;  // CopyMergedVerticesAndIndices straight into the destination
+    size_t staged_peak_size;  // bytes held at once: the destination and the merged copies
+    size_t direct_peak_size;  // the destination only
+  };  // struct MergeBenchmarkReport
+
+  // Startup time to merged geometry in memory the size of the merged buffers.
+  struct MeshCacheBenchmarkReport {
+    double built_milliseconds;  // building the meshes in code, inserting them and merging
+    double cached_milliseconds;  // mapping a cache of the same meshes, inserting its draws and merging
+    size_t file_size;  // of the cache
+  };  // struct MeshCacheBenchmarkReport
+
+  // kInterleaved: one stream of Asset::Model::Vertex.
+  // kDeinterleaved: a position stream followed by a Asset::Model::VertexAttributes stream, so depth-only
+  // passes only fetch 12 bytes per vertex.
+  enum class VertexStreamLayout {
+    kInterleaved = 0,
+    kDeinterleaved = 1,
+  };
+
   static AssetsManager& GetSharedInstance();
 
+  // Groups objects (indices into draw_arguments, e.g. a visible list) into batches of one mesh and, if
+  // match_textures, one diffuse texture. instance_objects gets the objects batch after batch, each batch keeping
+  // the order they were given in.
+  static void BuildInstanceBatches(const std::vector<DrawArgument>& draw_arguments, const std::vector<UINT>& objects, bool match_textures,
+                                   std::vector<InstanceBatch>& batches, std::vector<UINT>& instance_objects);
+
+  // Batches object_number draws spread over mesh_number meshes and texture_number textures, iteration_number times.
+  static InstancingBenchmarkReport BenchmarkInstancing(size_t object_number, UINT mesh_number, UINT texture_number, UINT iteration_number);
+
+  // Fills a manager of its own with model_number cubes and times frame_number frames of draw table lookups.
+  static DrawArgumentsBenchmarkReport BenchmarkDrawArguments(size_t model_number, UINT frame_number);
+
+  // Fills a manager of its own with mesh_number meshes of vertex_number vertices each and times iteration_number
+  // merges of each kind.
+  static MergeBenchmarkReport BenchmarkMerge(size_t mesh_number, size_t vertex_number, UINT iteration_number);
+
+  // Builds mesh_number meshes of vertex_number vertices each in a manager of its own and cooks them into
+  // file_name, then times both ways to them from scratch. The file was just written, so it is likely still in
+  // the OS's file cache: the cached time leaves the disk out.
+  static MeshCacheBenchmarkReport BenchmarkMeshCache(size_t mesh_number, size_t vertex_number, const std::wstring& file_name);
+
   ~AssetsManager();
 
   AssetsManager(const AssetsManager&) = delete;
   AssetsManager& operator=(const AssetsManager&) = delete;
 
-  void InsertModel(std::unique_ptr<Asset::Model> model) {
+  // model_transform_matrix is stored as given, i.e. already transposed for the shaders.
+  void InsertModel(std::unique_ptr<Asset::Model> model, const XMMATRIX& model_transform_matrix) {
+    model->SetModelTransform(model_transform_matrix);
+    model_bounding_boxes_.push_back(model->ComputeBoundingBox());
     models_.emplace_back(std::move(model));
+    model_mesh_indices_.push_back(FindOrAddMesh(models_.size() - 1));
+    model_transform_dirty_flags_.push_back(0);
+    model_dynamic_flags_.push_back(0);
+    draw_arguments_layout_dirty_ = true;
   }
 
+  void RemoveModel(size_t model_index);
+
+  // Transforms of inserted models change through here only, so the cached draw arguments only patch the models
+  // that actually moved.
+  void SetModelTransform(size_t model_index, const XMMATRIX& model_transform_matrix);
+
+  // Marks a model as one that moves, e.g. so cached shadow maps keep it out of their static layer. Models are
+  // static when inserted.
+  void SetModelDynamic(size_t model_index, bool dynamic);
+
   size_t GetTotolModelNumber() const {
     return models_.size();
   }
 
+  // Geometry shared by several models (see Asset::Model::GetVertexData) is only counted once.
   size_t GetTotalModelVertexNumber() const {
     size_t total_vertex_number = 0;
-    std::for_each(models_.cbegin(), models_.cend(), [&total_vertex_number](const std::unique_ptr<Asset::Model>& model) {
-      total_vertex_number += model->GetVertexNumber();
+    std::for_each(meshes_.cbegin(), meshes_.cend(), [&total_vertex_number](const Mesh& mesh) {
+      total_vertex_number += mesh.vertex_number;
      });
 
     return total_vertex_number;
@@ -42,33 +139,54 @@ class AssetsManager {
 
   size_t GetTotalModelIndexNumber() const {
     size_t total_index_number = 0;
-    std::for_each(models_.cbegin(), models_.cend(), [&total_index_number](const std::unique_ptr<Asset::Model>& model) {
-      total_index_number += model->GetIndexNumber();
+    std::for_each(meshes_.cbegin(), meshes_.cend(), [&total_index_number](const Mesh& mesh) {
+      total_index_number += mesh.index_number;
       });
 
     return total_index_number;
   }
 
   size_t GetTotalModelVertexSize() const {
-    size_t total_vertex_size = 0;
-    std::for_each(models_.cbegin(), models_.cend(), [&total_vertex_size](const std::unique_ptr<Asset::Model>& model) {
-      total_vertex_size += model->GetVertexDataSize();
-      });
-
-    return total_vertex_size;
+    return GetTotalModelVertexNumber() * Asset::Model::GetVertexStride();
   }
 
   size_t GetTotalModelIndexSize() const {
-    size_t total_index_size = 0;
-    std::for_each(models_.cbegin(), models_.cend(), [&total_index_size](const std::unique_ptr<Asset::Model>& model) {
-      total_index_size += model->GetIndexDataSize();
-      });
+    return GetTotalModelIndexNumber() * sizeof(DWORD);
+  }
 
-    return total_index_size;
+  size_t GetMeshNumber() const {
+    return meshes_.size();
   }
 
   void GetMergedVerticesAndIndices(std::unique_ptr<Asset::Model::Vertex[]>& vertices_data, std::unique_ptr<DWORD[]>& indices_data);
 
+  // Merges every mesh in one pass straight into caller-owned memory (e.g. a mapped upload heap), sized
+  // for GetTotalModelVertexNumber() vertices and GetTotalModelIndexNumber() indices.
+  void CopyMergedVerticesAndIndices(Asset::Model::Vertex* vertices_destination, DWORD* indices_destination) const;
+
+  // De-interleaved version of CopyMergedVerticesAndIndices, vertex i of the merged buffer ends up in
+  // positions_destination[i] and attributes_destination[i].
+  void CopyMergedVertexStreamsAndIndices(XMFLOAT3* positions_destination, Asset::Model::VertexAttributes* attributes_destination, DWORD* indices_destination) const;
+
+  // Inserts every draw of the cache as an Asset::MeshCacheModel (after any models already inserted), whose geometry stays
+  // in the mapped file. Returns false (and inserts nothing) if the file is missing or not a valid cache.
+  bool LoadMeshCache(const std::wstring& file_name);
+
+  // Bakes the current models into a mesh cache that LoadMeshCache can read back.
+  bool CookMeshCache(const std::wstring& file_name) const;
+
+  // Matches "interleaved" and "deinterleaved" case-insensitively. Returns false, leaving vertex_stream_layout alone,
+  // for anything else.
+  static bool ParseVertexStreamLayout(const std::wstring& name, VertexStreamLayout& vertex_stream_layout);
+
+  void SetVertexStreamLayout(VertexStreamLayout vertex_stream_layout) {
+    vertex_stream_layout_ = vertex_stream_layout;
+  }
+
+  VertexStreamLayout GetVertexStreamLayout() const {
+    return vertex_stream_layout_;
+  }
+
   void GetModelTexturesFileNames(std::vector<std::string>& textures_file_names) const {
     textures_file_names.clear();
     std::for_each(models_.cbegin(), models_.cend(), [&textures_file_names](const std::unique_ptr<Asset::Model>& model) {
@@ -76,10 +194,60 @@ class AssetsManager {
     });
   }
 
-  void GetModelDrawArguments(std::vector<DrawArgument>& draw_arguments);
+  // Contiguous draw table, one entry per model in insertion order. It is rebuilt only after models are
+  // inserted or removed, and only the moved entries are patched after SetModelTransform, so calling this
+  // several times per frame is cheap. The reference stays valid until the next model change.
+  const std::vector<DrawArgument>& GetModelDrawArguments();
+
+  // Over the world_bounding_box of every draw argument, object i being draw argument i. Built with the table and
+  // refitted when models move.
+  const BoundingVolumeHierarchy& GetModelBvh() {
+    RefreshDrawArguments();
+    return model_bvh_;
+  }
+
+  // Bumped every time the table returned by GetModelDrawArguments changes.
+  UINT64 GetDrawArgumentsVersion() {
+    RefreshDrawArguments();
+    return draw_arguments_version_;
+  }
 
  private:
+  // Geometry of one or more models, stored once in the merged buffers.
+  struct Mesh {
+    size_t model_index;  // the first model using it
+    size_t vertex_number;
+    size_t index_number;
+    UINT vertex_base;
+    UINT index_start;
+  };  // struct Mesh
+
+  // Models share a mesh when they return the same vertex and index data.
+  using MeshKey = std::tuple<const Asset::Model::Vertex*, size_t, const DWORD*, size_t>;
+
   AssetsManager();
+
+  UINT FindOrAddMesh(size_t model_index);
+  void RebuildMeshes();
+  void RefreshDrawArguments();
+  void RebuildDrawArguments();
+  void FillDrawArguments();
+  void RebuildModelBvh();
+  void RefitModelBvh();
   
   std::vector<std::unique_ptr<Asset::Model>> models_;
+  std::vector<Asset::Model::BoundingBox> model_bounding_boxes_;  // per model, in model space, computed on insertion
+  std::vector<UINT> model_mesh_indices_;  // per model
+  std::vector<Mesh> meshes_;  // in merged buffer order
+  std::map<MeshKey, UINT> mesh_indices_;
+
+  std::vector<DrawArgument> draw_arguments_;
+  std::vector<uint8_t> model_transform_dirty_flags_;  // per model
+  std::vector<uint8_t> model_dynamic_flags_;  // per model
+  std::vector<size_t> dirty_model_indices_;
+  bool draw_arguments_layout_dirty_ = true;
+  UINT64 draw_arguments_version_ = 0;
+  BoundingVolumeHierarchy model_bvh_;
+
+  VertexStreamLayout vertex_stream_layout_ = VertexStreamLayout::kInterleaved;
 };
\ No newline at end of file
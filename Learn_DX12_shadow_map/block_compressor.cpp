@@ -0,0 +1,673 @@
+#include "block_compressor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace {
+
+constexpr int kBlockTexelNumber = 16;
+constexpr int kRefinementNumber = 2;
+
+// BC7 4 bit index interpolation weights, out of 64.
+const int kBc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Mean and principal axis of the texels, only over the channels set in channel_mask (1 or 0 per channel).
+void ComputePrincipalAxis(const XMVECTOR* texels, FXMVECTOR channel_mask, XMVECTOR& mean, XMVECTOR& axis)
+{
+  XMVECTOR sum = XMVectorZero();
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    sum = XMVectorAdd(sum, texels[i]);
+  }
+  mean = XMVectorMultiply(XMVectorScale(sum, 1.0f / kBlockTexelNumber), channel_mask);
+
+  float covariance[4][4] = {};
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    XMFLOAT4 d;
+    XMStoreFloat4(&d, XMVectorMultiply(XMVectorSubtract(texels[i], mean), channel_mask));
+    const float values[4] = { d.x, d.y, d.z, d.w };
+    for (int row = 0; row < 4; ++row) {
+      for (int column = row; column < 4; ++column) {
+        covariance[row][column] += values[row] * values[column];
+      }
+    }
+  }
+
+  // Power iteration, starting from the channel with the largest variance.
+  int start = 0;
+  for (int row = 1; row < 4; ++row) {
+    if (covariance[row][row] > covariance[start][start]) {
+      start = row;
+    }
+  }
+  float vector[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  vector[start] = 1.0f;
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    float next[4] = {};
+    for (int row = 0; row < 4; ++row) {
+      for (int column = 0; column < 4; ++column) {
+        next[row] += covariance[std::min(row, column)][std::max(row, column)] * vector[column];
+      }
+    }
+    const float largest = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::max(std::fabs(next[2]), std::fabs(next[3])));
+    if (largest < FLT_EPSILON) {
+      break;  // flat block, any axis will do
+    }
+    for (int row = 0; row < 4; ++row) {
+      vector[row] = next[row] / largest;
+    }
+  }
+  axis = XMVector4Normalize(XMVectorMultiply(XMVectorSet(vector[0], vector[1], vector[2], vector[3]), channel_mask));
+}
+
+// Extremes of the texels projected on the axis.
+void ComputeAxisEndpoints(const XMVECTOR* texels, FXMVECTOR mean, FXMVECTOR axis, XMVECTOR& endpoint0, XMVECTOR& endpoint1)
+{
+  float low = 0.0f;
+  float high = 0.0f;
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const float t = XMVectorGetX(XMVector4Dot(XMVectorSubtract(texels[i], mean), axis));
+    low = std::min(low, t);
+    high = std::max(high, t);
+  }
+  endpoint0 = XMVectorMultiplyAdd(axis, XMVectorReplicate(high), mean);
+  endpoint1 = XMVectorMultiplyAdd(axis, XMVectorReplicate(low), mean);
+}
+
+// Least squares endpoints for fixed interpolation weights: texel i ~ weights0[i] * e0 + (1 - weights0[i]) * e1.
+// False when every texel uses the same weight.
+bool SolveEndpoints(const XMVECTOR* texels, const float* weights0, XMVECTOR& endpoint0, XMVECTOR& endpoint1)
+{
+  float aa = 0.0f;
+  float bb = 0.0f;
+  float ab = 0.0f;
+  XMVECTOR ax = XMVectorZero();
+  XMVECTOR bx = XMVectorZero();
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const float a = weights0[i];
+    const float b = 1.0f - a;
+    aa += a * a;
+    bb += b * b;
+    ab += a * b;
+    ax = XMVectorMultiplyAdd(texels[i], XMVectorReplicate(a), ax);
+    bx = XMVectorMultiplyAdd(texels[i], XMVectorReplicate(b), bx);
+  }
+
+  const float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f) {
+    return false;
+  }
+  const float inverse = 1.0f / determinant;
+  endpoint0 = XMVectorScale(XMVectorSubtract(XMVectorScale(ax, bb), XMVectorScale(bx, ab)), inverse);
+  endpoint1 = XMVectorScale(XMVectorSubtract(XMVectorScale(bx, aa), XMVectorScale(ax, ab)), inverse);
+  return true;
+}
+
+float SquaredDistance(FXMVECTOR a, FXMVECTOR b)
+{
+  return XMVectorGetX(XMVector4LengthSq(XMVectorSubtract(a, b)));
+}
+
+uint16_t QuantizeTo565(FXMVECTOR color)
+{
+  XMFLOAT4 c;
+  XMStoreFloat4(&c, XMVectorClamp(color, XMVectorZero(), XMVectorReplicate(255.0f)));
+  const int r = static_cast<int>(c.x * (31.0f / 255.0f) + 0.5f);
+  const int g = static_cast<int>(c.y * (63.0f / 255.0f) + 0.5f);
+  const int b = static_cast<int>(c.z * (31.0f / 255.0f) + 0.5f);
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+XMVECTOR ExpandFrom565(uint16_t color)
+{
+  const int r = (color >> 11) & 31;
+  const int g = (color >> 5) & 63;
+  const int b = color & 31;
+  return XMVectorSet(static_cast<float>((r << 3) | (r >> 2)), static_cast<float>((g << 2) | (g >> 4)), static_cast<float>((b << 3) | (b >> 2)), 0.0f);
+}
+
+// Four color BC1 palette order: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1.
+const float kBc1Weights0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+float FitBc1Indices(const XMVECTOR* texels, uint16_t color0, uint16_t color1, uint8_t* indices)
+{
+  const XMVECTOR endpoint0 = ExpandFrom565(color0);
+  const XMVECTOR endpoint1 = ExpandFrom565(color1);
+  XMVECTOR palette[4];
+  for (int i = 0; i < 4; ++i) {
+    palette[i] = XMVectorLerp(endpoint1, endpoint0, kBc1Weights0[i]);
+  }
+
+  float error = 0.0f;
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const XMVECTOR texel = XMVectorSetW(texels[i], 0.0f);
+    float best = FLT_MAX;
+    for (int entry = 0; entry < 4; ++entry) {
+      const float distance = SquaredDistance(texel, palette[entry]);
+      if (distance < best) {
+        best = distance;
+        indices[i] = static_cast<uint8_t>(entry);
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+void EncodeBc1ColorBlock(const XMVECTOR* texels, uint8_t* block)
+{
+  const XMVECTOR rgb_mask = XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f);
+  XMVECTOR mean, axis, endpoint0, endpoint1;
+  ComputePrincipalAxis(texels, rgb_mask, mean, axis);
+  ComputeAxisEndpoints(texels, mean, axis, endpoint0, endpoint1);
+
+  uint16_t color0 = QuantizeTo565(endpoint0);
+  uint16_t color1 = QuantizeTo565(endpoint1);
+  uint8_t indices[kBlockTexelNumber];
+  float error = FitBc1Indices(texels, color0, color1, indices);
+
+  for (int refinement = 0; refinement < kRefinementNumber && error > 0.0f; ++refinement) {
+    float weights0[kBlockTexelNumber];
+    for (int i = 0; i < kBlockTexelNumber; ++i) {
+      weights0[i] = kBc1Weights0[indices[i]];
+    }
+    if (!SolveEndpoints(texels, weights0, endpoint0, endpoint1)) {
+      break;
+    }
+    const uint16_t refined_color0 = QuantizeTo565(endpoint0);
+    const uint16_t refined_color1 = QuantizeTo565(endpoint1);
+    uint8_t refined_indices[kBlockTexelNumber];
+    const float refined_error = FitBc1Indices(texels, refined_color0, refined_color1, refined_indices);
+    if (refined_error >= error) {
+      break;
+    }
+    color0 = refined_color0;
+    color1 = refined_color1;
+    error = refined_error;
+    std::memcpy(indices, refined_indices, sizeof(indices));
+  }
+
+  // color0 > color1 selects the four color mode; swapping the endpoints swaps indices 0/1 and 2/3.
+  if (color0 < color1) {
+    std::swap(color0, color1);
+    for (uint8_t& index : indices) {
+      index ^= 1;
+    }
+  } else if (color0 == color1) {
+    std::memset(indices, 0, sizeof(indices));
+  }
+
+  uint32_t packed_indices = 0;
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    packed_indices |= static_cast<uint32_t>(indices[i]) << (i * 2);
+  }
+  block[0] = static_cast<uint8_t>(color0);
+  block[1] = static_cast<uint8_t>(color0 >> 8);
+  block[2] = static_cast<uint8_t>(color1);
+  block[3] = static_cast<uint8_t>(color1 >> 8);
+  std::memcpy(block + 4, &packed_indices, sizeof(packed_indices));
+}
+
+// BC4 in the eight value mode: endpoints are the block's max and min.
+void EncodeBc4Block(const float* values, uint8_t* block)
+{
+  float low = 255.0f;
+  float high = 0.0f;
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    low = std::min(low, values[i]);
+    high = std::max(high, values[i]);
+  }
+  const int value0 = static_cast<int>(high + 0.5f);
+  const int value1 = static_cast<int>(low + 0.5f);
+  block[0] = static_cast<uint8_t>(value0);
+  block[1] = static_cast<uint8_t>(value1);
+
+  uint64_t packed_indices = 0;
+  if (value0 > value1) {
+    const float scale = 7.0f / (value0 - value1);
+    for (int i = 0; i < kBlockTexelNumber; ++i) {
+      // Level 0 is value1, level 7 is value0; indices 0 and 1 are the endpoints, 2..7 run from value0 down.
+      const int level = std::min(7, std::max(0, static_cast<int>((values[i] - value1) * scale + 0.5f)));
+      const int index = level == 7 ? 0 : (level == 0 ? 1 : 8 - level);
+      packed_indices |= static_cast<uint64_t>(index) << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; ++i) {
+    block[2 + i] = static_cast<uint8_t>(packed_indices >> (i * 8));
+  }
+}
+
+struct Bc7Mode6Endpoints {
+  int quantized[2][4];  // 7 bits per channel
+  int p_bits[2];
+};  // struct Bc7Mode6Endpoints
+
+XMVECTOR GetBc7Endpoint(const Bc7Mode6Endpoints& endpoints, int endpoint)
+{
+  const int* quantized = endpoints.quantized[endpoint];
+  const int p_bit = endpoints.p_bits[endpoint];
+  return XMVectorSet(static_cast<float>(quantized[0] << 1 | p_bit), static_cast<float>(quantized[1] << 1 | p_bit),
+                     static_cast<float>(quantized[2] << 1 | p_bit), static_cast<float>(quantized[3] << 1 | p_bit));
+}
+
+float FitBc7Indices(const XMVECTOR* texels, const Bc7Mode6Endpoints& endpoints, uint8_t* indices)
+{
+  XMFLOAT4 endpoint0, endpoint1;
+  XMStoreFloat4(&endpoint0, GetBc7Endpoint(endpoints, 0));
+  XMStoreFloat4(&endpoint1, GetBc7Endpoint(endpoints, 1));
+
+  // Interpolated exactly as the hardware does: (e0 * (64 - w) + e1 * w + 32) >> 6 per channel.
+  XMVECTOR palette[16];
+  for (int entry = 0; entry < 16; ++entry) {
+    const int w = kBc7Weights[entry];
+    auto interpolate = [w](float e0, float e1) {
+      return static_cast<float>((static_cast<int>(e0) * (64 - w) + static_cast<int>(e1) * w + 32) >> 6);
+    };
+    palette[entry] = XMVectorSet(interpolate(endpoint0.x, endpoint1.x), interpolate(endpoint0.y, endpoint1.y),
+                                 interpolate(endpoint0.z, endpoint1.z), interpolate(endpoint0.w, endpoint1.w));
+  }
+
+  // Project on the endpoint segment for a first guess, then settle between its neighbours.
+  const XMVECTOR start = XMLoadFloat4(&endpoint0);
+  const XMVECTOR direction = XMVectorSubtract(XMLoadFloat4(&endpoint1), start);
+  const float length_squared = XMVectorGetX(XMVector4LengthSq(direction));
+  const float projection_scale = length_squared > 0.0f ? 15.0f / length_squared : 0.0f;
+
+  float error = 0.0f;
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const float t = XMVectorGetX(XMVector4Dot(XMVectorSubtract(texels[i], start), direction)) * projection_scale;
+    const int guess = std::min(15, std::max(0, static_cast<int>(t + 0.5f)));
+    float best = FLT_MAX;
+    for (int entry = std::max(0, guess - 1); entry <= std::min(15, guess + 1); ++entry) {
+      const float distance = SquaredDistance(texels[i], palette[entry]);
+      if (distance < best) {
+        best = distance;
+        indices[i] = static_cast<uint8_t>(entry);
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+void QuantizeBc7Endpoint(FXMVECTOR endpoint, int p_bit, int* quantized)
+{
+  XMFLOAT4 e;
+  XMStoreFloat4(&e, endpoint);
+  const float values[4] = { e.x, e.y, e.z, e.w };
+  for (int channel = 0; channel < 4; ++channel) {
+    quantized[channel] = std::min(127, std::max(0, static_cast<int>((values[channel] - p_bit) * 0.5f + 0.5f)));
+  }
+}
+
+class BlockBitWriter {
+ public:
+  explicit BlockBitWriter(uint8_t* block) : block_(block) {
+    std::memset(block_, 0, 16);
+  }
+
+  void Write(uint32_t value, int bit_number) {
+    for (int i = 0; i < bit_number; ++i, ++position_) {
+      block_[position_ >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position_ & 7));
+    }
+  }
+
+ private:
+  uint8_t* block_;
+  int position_ = 0;
+};  // class BlockBitWriter
+
+void EncodeBc7Mode6Block(const XMVECTOR* texels, uint8_t* block)
+{
+  XMVECTOR mean, axis, endpoint0, endpoint1;
+  ComputePrincipalAxis(texels, XMVectorSplatOne(), mean, axis);
+  ComputeAxisEndpoints(texels, mean, axis, endpoint0, endpoint1);
+
+  Bc7Mode6Endpoints best_endpoints = {};
+  uint8_t best_indices[kBlockTexelNumber] = {};
+  float best_error = FLT_MAX;
+  for (int refinement = 0; refinement <= kRefinementNumber; ++refinement) {
+    // Every p-bit combination, the lowest bit of all channels of each endpoint.
+    for (int p_bits = 0; p_bits < 4; ++p_bits) {
+      Bc7Mode6Endpoints endpoints;
+      endpoints.p_bits[0] = p_bits & 1;
+      endpoints.p_bits[1] = p_bits >> 1;
+      QuantizeBc7Endpoint(endpoint0, endpoints.p_bits[0], endpoints.quantized[0]);
+      QuantizeBc7Endpoint(endpoint1, endpoints.p_bits[1], endpoints.quantized[1]);
+      uint8_t indices[kBlockTexelNumber];
+      const float error = FitBc7Indices(texels, endpoints, indices);
+      if (error < best_error) {
+        best_error = error;
+        best_endpoints = endpoints;
+        std::memcpy(best_indices, indices, sizeof(indices));
+      }
+    }
+
+    float weights0[kBlockTexelNumber];
+    for (int i = 0; i < kBlockTexelNumber; ++i) {
+      weights0[i] = 1.0f - kBc7Weights[best_indices[i]] / 64.0f;
+    }
+    if (best_error == 0.0f || !SolveEndpoints(texels, weights0, endpoint0, endpoint1)) {
+      break;
+    }
+  }
+
+  // The first index is stored without its top bit, so it must be below 8. The weights are symmetric, so
+  // swapping the endpoints mirrors the indices.
+  if (best_indices[0] >= 8) {
+    std::swap(best_endpoints.quantized[0], best_endpoints.quantized[1]);
+    std::swap(best_endpoints.p_bits[0], best_endpoints.p_bits[1]);
+    for (uint8_t& index : best_indices) {
+      index = static_cast<uint8_t>(15 - index);
+    }
+  }
+
+  BlockBitWriter writer(block);
+  writer.Write(1 << 6, 7);  // mode 6
+  for (int channel = 0; channel < 4; ++channel) {
+    writer.Write(best_endpoints.quantized[0][channel], 7);
+    writer.Write(best_endpoints.quantized[1][channel], 7);
+  }
+  writer.Write(best_endpoints.p_bits[0], 1);
+  writer.Write(best_endpoints.p_bits[1], 1);
+  writer.Write(best_indices[0], 3);
+  for (int i = 1; i < kBlockTexelNumber; ++i) {
+    writer.Write(best_indices[i], 4);
+  }
+}
+
+// Writes 16 RGBA8 texels. The color block of BC3 is always in the four color mode.
+void DecodeBc1ColorBlock(const uint8_t* block, bool four_color_only, uint8_t* texels)
+{
+  const uint16_t color0 = static_cast<uint16_t>(block[0] | block[1] << 8);
+  const uint16_t color1 = static_cast<uint16_t>(block[2] | block[3] << 8);
+  const XMVECTOR endpoint0 = ExpandFrom565(color0);
+  const XMVECTOR endpoint1 = ExpandFrom565(color1);
+  XMFLOAT4 palette[4];
+  XMStoreFloat4(&palette[0], XMVectorSetW(endpoint0, 255.0f));
+  XMStoreFloat4(&palette[1], XMVectorSetW(endpoint1, 255.0f));
+  if (four_color_only || color0 > color1) {
+    XMStoreFloat4(&palette[2], XMVectorSetW(XMVectorLerp(endpoint1, endpoint0, kBc1Weights0[2]), 255.0f));
+    XMStoreFloat4(&palette[3], XMVectorSetW(XMVectorLerp(endpoint1, endpoint0, kBc1Weights0[3]), 255.0f));
+  } else {
+    // Three colors and transparent black.
+    XMStoreFloat4(&palette[2], XMVectorSetW(XMVectorLerp(endpoint1, endpoint0, 0.5f), 255.0f));
+    palette[3] = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+
+  uint32_t packed_indices;
+  std::memcpy(&packed_indices, block + 4, sizeof(packed_indices));
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const XMFLOAT4& color = palette[(packed_indices >> (i * 2)) & 3];
+    uint8_t* texel = texels + i * 4;
+    texel[0] = static_cast<uint8_t>(color.x + 0.5f);
+    texel[1] = static_cast<uint8_t>(color.y + 0.5f);
+    texel[2] = static_cast<uint8_t>(color.z + 0.5f);
+    texel[3] = static_cast<uint8_t>(color.w + 0.5f);
+  }
+}
+
+// Writes one channel of 16 RGBA8 texels.
+void DecodeBc4Block(const uint8_t* block, uint8_t* channel)
+{
+  const int value0 = block[0];
+  const int value1 = block[1];
+  int values[8] = { value0, value1 };
+  if (value0 > value1) {
+    for (int i = 2; i < 8; ++i) {
+      values[i] = ((8 - i) * value0 + (i - 1) * value1 + 3) / 7;
+    }
+  } else {
+    for (int i = 2; i < 6; ++i) {
+      values[i] = ((6 - i) * value0 + (i - 1) * value1 + 2) / 5;
+    }
+    values[6] = 0;
+    values[7] = 255;
+  }
+
+  uint64_t packed_indices = 0;
+  for (int i = 0; i < 6; ++i) {
+    packed_indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+  }
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    channel[i * 4] = static_cast<uint8_t>(values[(packed_indices >> (i * 3)) & 7]);
+  }
+}
+
+class BlockBitReader {
+ public:
+  explicit BlockBitReader(const uint8_t* block) : block_(block) {}
+
+  uint32_t Read(int bit_number) {
+    uint32_t value = 0;
+    for (int i = 0; i < bit_number; ++i, ++position_) {
+      value |= static_cast<uint32_t>((block_[position_ >> 3] >> (position_ & 7)) & 1) << i;
+    }
+    return value;
+  }
+
+ private:
+  const uint8_t* block_;
+  int position_ = 0;
+};  // class BlockBitReader
+
+void DecodeBc7Block(const uint8_t* block, uint8_t* texels)
+{
+  BlockBitReader reader(block);
+  if (reader.Read(7) != 1 << 6) {
+    std::memset(texels, 0, kBlockTexelNumber * 4);
+    return;
+  }
+
+  Bc7Mode6Endpoints endpoints;
+  for (int channel = 0; channel < 4; ++channel) {
+    endpoints.quantized[0][channel] = static_cast<int>(reader.Read(7));
+    endpoints.quantized[1][channel] = static_cast<int>(reader.Read(7));
+  }
+  endpoints.p_bits[0] = static_cast<int>(reader.Read(1));
+  endpoints.p_bits[1] = static_cast<int>(reader.Read(1));
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const int w = kBc7Weights[reader.Read(i == 0 ? 3 : 4)];
+    for (int channel = 0; channel < 4; ++channel) {
+      const int e0 = endpoints.quantized[0][channel] << 1 | endpoints.p_bits[0];
+      const int e1 = endpoints.quantized[1][channel] << 1 | endpoints.p_bits[1];
+      texels[i * 4 + channel] = static_cast<uint8_t>((e0 * (64 - w) + e1 * w + 32) >> 6);
+    }
+  }
+}
+
+}  // namespace
+
+BlockCompressor::BenchmarkReport BlockCompressor::Benchmark(Format format, UINT size, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (size == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  // Gradients a few blocks wide with a little noise, closer to real textures than noise alone.
+  MipChainGenerator::Surface source;
+  source.width = size;
+  source.height = size;
+  source.row_pitch = size * 4;
+  std::vector<uint8_t> texels(static_cast<size_t>(source.row_pitch) * size);
+  source.data = texels.data();
+  uint32_t state = 0x9e3779b9u;
+  for (UINT y = 0; y < size; ++y) {
+    for (UINT x = 0; x < size; ++x) {
+      uint8_t* texel = &texels[static_cast<size_t>(y) * source.row_pitch + x * 4];
+      for (int channel = 0; channel < 4; ++channel) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        const float wave = std::sin(0.05f * (channel + 1) * x + 0.03f * (4 - channel) * y);
+        const float noise = static_cast<float>(state & 15) - 7.5f;
+        texel[channel] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, 127.5f + 110.0f * wave + noise)));
+      }
+    }
+  }
+
+  const UINT block_columns = (size + 3) / 4;
+  const UINT block_rows = (size + 3) / 4;
+  const UINT block_size = GetBlockSize(format);
+  const UINT destination_row_pitch = block_columns * block_size;
+  std::vector<uint8_t> blocks(static_cast<size_t>(destination_row_pitch) * block_rows);
+
+  auto megatexels_per_second = [&](ThreadPool* thread_pool) {
+    const auto start_time = std::chrono::steady_clock::now();
+    for (UINT i = 0; i < iteration_number; ++i) {
+      CompressImage(format, DXGI_FORMAT_R8G8B8A8_UNORM, source, blocks.data(), destination_row_pitch, thread_pool);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return seconds > 0.0 ? static_cast<double>(size) * size * iteration_number / seconds * 1e-6 : 0.0;
+  };
+  report.megatexels_per_second = megatexels_per_second(nullptr);
+  ThreadPool thread_pool;
+  report.thread_number = thread_pool.GetWorkerNumber() + 1;
+  report.parallel_megatexels_per_second = megatexels_per_second(&thread_pool);
+
+  const int channel_number = format == Format::kBC1 ? 3 : (format == Format::kBC5 ? 2 : 4);
+  double squared_error = 0.0;
+  uint8_t decoded[kBlockTexelNumber * 4];
+  for (UINT block_row = 0; block_row < block_rows; ++block_row) {
+    for (UINT block_column = 0; block_column < block_columns; ++block_column) {
+      DecompressBlock(format, &blocks[static_cast<size_t>(block_row) * destination_row_pitch + block_column * block_size], decoded);
+      for (UINT y = 0; y < 4 && block_row * 4 + y < size; ++y) {
+        for (UINT x = 0; x < 4 && block_column * 4 + x < size; ++x) {
+          const uint8_t* texel = &texels[static_cast<size_t>(block_row * 4 + y) * source.row_pitch + (block_column * 4 + x) * 4];
+          for (int channel = 0; channel < channel_number; ++channel) {
+            const double difference = static_cast<double>(decoded[(y * 4 + x) * 4 + channel]) - texel[channel];
+            squared_error += difference * difference;
+          }
+        }
+      }
+    }
+  }
+  const double mean_squared_error = squared_error / (static_cast<double>(size) * size * channel_number);
+  report.psnr = mean_squared_error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mean_squared_error) : 99.0;
+  return report;
+}
+
+DXGI_FORMAT BlockCompressor::GetDxgiFormat(Format format)
+{
+  switch (format) {
+    case Format::kBC1:
+      return DXGI_FORMAT_BC1_UNORM;
+    case Format::kBC3:
+      return DXGI_FORMAT_BC3_UNORM;
+    case Format::kBC5:
+      return DXGI_FORMAT_BC5_UNORM;
+    case Format::kBC7:
+      return DXGI_FORMAT_BC7_UNORM;
+  }
+  return DXGI_FORMAT_UNKNOWN;
+}
+
+UINT BlockCompressor::GetBlockSize(Format format)
+{
+  return format == Format::kBC1 ? 8 : 16;
+}
+
+bool BlockCompressor::IsSourceFormatSupported(DXGI_FORMAT source_format)
+{
+  return source_format == DXGI_FORMAT_R8G8B8A8_UNORM || source_format == DXGI_FORMAT_B8G8R8A8_UNORM || source_format == DXGI_FORMAT_B8G8R8X8_UNORM;
+}
+
+void BlockCompressor::CompressImage(Format format, DXGI_FORMAT source_format, const MipChainGenerator::Surface& source,
+                                    uint8_t* destination, UINT destination_row_pitch, ThreadPool* thread_pool)
+{
+  const bool bgr = source_format != DXGI_FORMAT_R8G8B8A8_UNORM;
+  const bool opaque = source_format == DXGI_FORMAT_B8G8R8X8_UNORM;
+  const UINT block_columns = (source.width + 3) / 4;
+  const UINT block_rows = (source.height + 3) / 4;
+  const UINT block_size = GetBlockSize(format);
+
+  auto compress_block_row = [&](size_t block_row, size_t) {
+    uint8_t texels[kBlockTexelNumber * 4];
+    for (UINT block_column = 0; block_column < block_columns; ++block_column) {
+      for (UINT y = 0; y < 4; ++y) {
+        const UINT source_y = std::min(static_cast<UINT>(block_row) * 4 + y, source.height - 1);
+        const uint8_t* source_row = source.data + static_cast<size_t>(source_y) * source.row_pitch;
+        for (UINT x = 0; x < 4; ++x) {
+          const UINT source_x = std::min(block_column * 4 + x, source.width - 1);
+          const uint8_t* texel = source_row + source_x * 4;
+          uint8_t* block_texel = texels + (y * 4 + x) * 4;
+          block_texel[0] = texel[bgr ? 2 : 0];
+          block_texel[1] = texel[1];
+          block_texel[2] = texel[bgr ? 0 : 2];
+          block_texel[3] = opaque ? 255 : texel[3];
+        }
+      }
+      CompressBlock(format, texels, destination + block_row * destination_row_pitch + block_column * block_size);
+    }
+  };
+
+  if (thread_pool != nullptr && block_rows > 1) {
+    thread_pool->ParallelFor(block_rows, compress_block_row);
+  } else {
+    for (size_t block_row = 0; block_row < block_rows; ++block_row) {
+      compress_block_row(block_row, 0);
+    }
+  }
+}
+
+void BlockCompressor::CompressBlock(Format format, const uint8_t* texels, uint8_t* block)
+{
+  XMVECTOR colors[kBlockTexelNumber];
+  float reds[kBlockTexelNumber];
+  float greens[kBlockTexelNumber];
+  float alphas[kBlockTexelNumber];
+  for (int i = 0; i < kBlockTexelNumber; ++i) {
+    const uint8_t* texel = texels + i * 4;
+    colors[i] = XMVectorSet(texel[0], texel[1], texel[2], texel[3]);
+    reds[i] = texel[0];
+    greens[i] = texel[1];
+    alphas[i] = texel[3];
+  }
+
+  switch (format) {
+    case Format::kBC1:
+      EncodeBc1ColorBlock(colors, block);
+      break;
+    case Format::kBC3:
+      EncodeBc4Block(alphas, block);
+      EncodeBc1ColorBlock(colors, block + 8);
+      break;
+    case Format::kBC5:
+      EncodeBc4Block(reds, block);
+      EncodeBc4Block(greens, block + 8);
+      break;
+    case Format::kBC7:
+      EncodeBc7Mode6Block(colors, block);
+      break;
+  }
+}
+
+void BlockCompressor::DecompressBlock(Format format, const uint8_t* block, uint8_t* texels)
+{
+  switch (format) {
+    case Format::kBC1:
+      DecodeBc1ColorBlock(block, false, texels);
+      break;
+    case Format::kBC3:
+      DecodeBc1ColorBlock(block + 8, true, texels);
+      DecodeBc4Block(block, texels + 3);
+      break;
+    case Format::kBC5:
+      for (int i = 0; i < kBlockTexelNumber; ++i) {
+        texels[i * 4 + 2] = 0;
+        texels[i * 4 + 3] = 255;
+      }
+      DecodeBc4Block(block, texels);
+      DecodeBc4Block(block + 8, texels + 1);
+      break;
+    case Format::kBC7:
+      DecodeBc7Block(block, texels);
+      break;
+  }
+}
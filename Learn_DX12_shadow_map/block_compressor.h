@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common_headers.h"
+#include "mip_chain_generator.h"
+
+class ThreadPool;
+
+// Encodes 8 bit RGBA images into BCn blocks, either offline or while textures load. Each 4x4 block is fit
+// with its principal axis (DirectXMath on float4 texels), then the endpoints are refined by least squares
+// against the chosen indices. Images are split into rows of blocks for ThreadPool::ParallelFor.
+//   BC1 - RGB, 4 bpp, alpha ignored.
+//   BC3 - BC1 color plus a BC4 alpha block, 8 bpp.
+//   BC5 - R and G as two BC4 blocks, 8 bpp, e.g. for normal maps.
+//   BC7 - RGBA in mode 6 (single subset, 7777.1 endpoints, 4 bit indices), 8 bpp.
+class BlockCompressor {
+ public:
+  enum class Format {
+    kBC1,
+    kBC3,
+    kBC5,
+    kBC7,
+  };  // enum class Format
+
+  struct BenchmarkReport {
+    double psnr;  // dB over the channels the format keeps
+    double megatexels_per_second;
+    size_t thread_number;  // of the parallel run, the calling thread included
+    double parallel_megatexels_per_second;
+  };  // struct BenchmarkReport
+
+  // Compresses a size x size image of soft gradients with some noise, on one thread and then on a pool with a
+  // worker per hardware thread, iteration_number times each, and measures the quality of the decoded blocks.
+  static BenchmarkReport Benchmark(Format format, UINT size, UINT iteration_number);
+
+  static DXGI_FORMAT GetDxgiFormat(Format format);
+
+  // Bytes per 4x4 block.
+  static UINT GetBlockSize(Format format);
+
+  // R8G8B8A8_UNORM, B8G8R8A8_UNORM and B8G8R8X8_UNORM.
+  static bool IsSourceFormatSupported(DXGI_FORMAT source_format);
+
+  // Compresses source into rows of blocks destination_row_pitch bytes apart. Partial blocks at the right and
+  // bottom edges (e.g. of small mip levels) repeat the last column and row. thread_pool may be null.
+  static void CompressImage(Format format, DXGI_FORMAT source_format, const MipChainGenerator::Surface& source,
+                            uint8_t* destination, UINT destination_row_pitch, ThreadPool* thread_pool);
+
+  // texels are 16 RGBA8 texels in row order.
+  static void CompressBlock(Format format, const uint8_t* texels, uint8_t* block);
+
+  // The reverse of CompressBlock, into 16 RGBA8 texels; BC1 and BC5 set the channels they don't store to 255
+  // and 0. Of BC7, only mode 6 blocks are decoded, other modes come out as zeros.
+  static void DecompressBlock(Format format, const uint8_t* block, uint8_t* texels);
+};  // class BlockCompressor
@@ -0,0 +1,688 @@
+#include "bounding_volume_hierarchy.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <random>
+
+#include "cube_shadow_map.h"
+
+constexpr UINT BoundingVolumeHierarchy::kBinNumber;
+constexpr UINT BoundingVolumeHierarchy::kMaxLeafObjectNumber;
+constexpr UINT BoundingVolumeHierarchy::kMaxFrustumNumber;
+
+namespace {
+
+using BoundingBox = BoundingVolumeHierarchy::BoundingBox;
+
+// Smaller builds stay on the calling thread.
+constexpr size_t kParallelMinObjectNumber = 8192;
+// The top of the tree is split until there are this many subtrees per thread, or they get this small.
+constexpr size_t kSubtreesPerThread = 4;
+constexpr UINT kSubtreeMinObjectNumber = 1024;
+
+BoundingBox EmptyBox()
+{
+  return { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+}
+
+void Grow(BoundingBox& box, const BoundingBox& other)
+{
+  box.min = XMFLOAT3(std::min(box.min.x, other.min.x), std::min(box.min.y, other.min.y), std::min(box.min.z, other.min.z));
+  box.max = XMFLOAT3(std::max(box.max.x, other.max.x), std::max(box.max.y, other.max.y), std::max(box.max.z, other.max.z));
+}
+
+void Grow(BoundingBox& box, const XMFLOAT3& point)
+{
+  Grow(box, BoundingBox{ point, point });
+}
+
+bool IsSameBox(const BoundingBox& a, const BoundingBox& b)
+{
+  return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z && a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+float ComputeSurfaceArea(const BoundingBox& box)
+{
+  if (box.min.x > box.max.x) {
+    return 0.0f;
+  }
+  const float x = box.max.x - box.min.x;
+  const float y = box.max.y - box.min.y;
+  const float z = box.max.z - box.min.z;
+  return 2.0f * (x * y + y * z + z * x);
+}
+
+float GetComponent(const XMFLOAT3& v, int axis)
+{
+  return (&v.x)[axis];
+}
+
+enum class Overlap {
+  kOutside,
+  kIntersecting,
+  kInside,
+};
+
+// With the same distances as FrustumCuller::IsVisible: the box is inside when its nearest corner to each plane
+// is in front of it.
+Overlap ClassifyBox(const FrustumCuller::Frustum& frustum, const BoundingBox& box)
+{
+  const float center_x = 0.5f * (box.min.x + box.max.x);
+  const float center_y = 0.5f * (box.min.y + box.max.y);
+  const float center_z = 0.5f * (box.min.z + box.max.z);
+  const float extent_x = 0.5f * (box.max.x - box.min.x);
+  const float extent_y = 0.5f * (box.max.y - box.min.y);
+  const float extent_z = 0.5f * (box.max.z - box.min.z);
+  Overlap overlap = Overlap::kInside;
+  for (UINT i = 0; i < frustum.plane_number; ++i) {
+    const XMFLOAT4& plane = frustum.planes[i];
+    float center_distance = center_x * plane.x + plane.w;
+    center_distance = center_y * plane.y + center_distance;
+    center_distance = center_z * plane.z + center_distance;
+    const float reach = extent_x * std::fabs(plane.x) + extent_y * std::fabs(plane.y) + extent_z * std::fabs(plane.z);
+    float distance = extent_x * std::fabs(plane.x) + center_distance;
+    distance = extent_y * std::fabs(plane.y) + distance;
+    distance = extent_z * std::fabs(plane.z) + distance;
+    if (distance < 0.0f) {
+      return Overlap::kOutside;
+    }
+    if (center_distance - reach < 0.0f) {
+      overlap = Overlap::kIntersecting;
+    }
+  }
+  return overlap;
+}
+
+// Distance along the ray to where it enters the box, clamped to 0 from inside, or FLT_MAX if it misses.
+float IntersectRay(const BoundingBox& box, const XMFLOAT3& origin, const XMFLOAT3& inverse_direction)
+{
+  float enter = 0.0f;
+  float exit = FLT_MAX;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float o = GetComponent(origin, axis);
+    const float inverse_d = GetComponent(inverse_direction, axis);
+    float t0 = (GetComponent(box.min, axis) - o) * inverse_d;
+    float t1 = (GetComponent(box.max, axis) - o) * inverse_d;
+    if (t0 > t1) {
+      std::swap(t0, t1);
+    }
+    // Written so a NaN (a ray starting on a parallel slab's plane) leaves the bounds alone.
+    enter = t0 > enter ? t0 : enter;
+    exit = t1 < exit ? t1 : exit;
+  }
+  return enter <= exit ? enter : FLT_MAX;
+}
+
+float ComputeSquaredDistance(const BoundingBox& box, const XMFLOAT3& point)
+{
+  float squared_distance = 0.0f;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float p = GetComponent(point, axis);
+    const float d = std::max(std::max(GetComponent(box.min, axis) - p, p - GetComponent(box.max, axis)), 0.0f);
+    squared_distance += d * d;
+  }
+  return squared_distance;
+}
+
+double ElapsedMilliseconds(std::chrono::steady_clock::time_point start_time)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+}  // namespace
+
+BoundingVolumeHierarchy::BenchmarkReport BoundingVolumeHierarchy::Benchmark(size_t object_number, UINT query_number)
+{
+  BenchmarkReport report{};
+  if (object_number == 0 || query_number == 0) {
+    return report;
+  }
+
+  // The same city block, camera and light as FrustumCuller::Benchmark, and a point light in the middle.
+  std::mt19937 random_engine(static_cast<unsigned int>(object_number));
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> size(0.5f, 4.0f);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::vector<BoundingBox> object_bounds(object_number);
+  for (BoundingBox& bounding_box : object_bounds) {
+    bounding_box.min = XMFLOAT3(position(random_engine), 0.5f * position(random_engine), position(random_engine));
+    bounding_box.max = XMFLOAT3(bounding_box.min.x + size(random_engine), bounding_box.min.y + size(random_engine), bounding_box.min.z + size(random_engine));
+  }
+
+  BoundingVolumeHierarchy bvh;
+  auto start_time = std::chrono::steady_clock::now();
+  bvh.Build(object_bounds.data(), object_number);
+  report.build_milliseconds = ElapsedMilliseconds(start_time);
+  report.thread_number = bvh.thread_pool_ ? bvh.thread_pool_->GetWorkerNumber() + 1 : 1;
+  report.sah_cost = bvh.GetSahCost();
+  report.depth = bvh.GetDepth();
+
+  std::vector<size_t> moved_object_indices;
+  std::vector<BoundingBox> moved_object_bounds;
+  for (size_t i = 0; i < object_number; i += 100) {
+    const XMFLOAT3 offset(2.0f * unit(random_engine), 2.0f * unit(random_engine), 2.0f * unit(random_engine));
+    BoundingBox& bounding_box = object_bounds[i];
+    bounding_box.min = XMFLOAT3(bounding_box.min.x + offset.x, bounding_box.min.y + offset.y, bounding_box.min.z + offset.z);
+    bounding_box.max = XMFLOAT3(bounding_box.max.x + offset.x, bounding_box.max.y + offset.y, bounding_box.max.z + offset.z);
+    moved_object_indices.push_back(i);
+    moved_object_bounds.push_back(bounding_box);
+  }
+  start_time = std::chrono::steady_clock::now();
+  bvh.Refit(moved_object_indices.data(), moved_object_bounds.data(), moved_object_indices.size());
+  report.refit_milliseconds = ElapsedMilliseconds(start_time);
+
+  const XMMATRIX camera_view = XMMatrixLookAtLH(XMVectorSet(0.0f, 10.0f, -200.0f, 1.0f), XMVectorSet(50.0f, 0.0f, 100.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  const XMMATRIX camera_proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 400.0f);
+  const XMMATRIX light_view = XMMatrixLookAtLH(XMVectorSet(0.0f, 300.0f, 0.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+  const XMMATRIX light_proj = XMMatrixOrthographicLH(500.0f, 500.0f, 1.0f, 600.0f);
+  const FrustumCuller::Frustum frustums[] = {
+    FrustumCuller::ComputeFrustum(XMMatrixMultiply(camera_view, camera_proj), true),
+    FrustumCuller::ComputeFrustum(XMMatrixMultiply(light_view, light_proj), false),
+  };
+  constexpr UINT frustum_number = sizeof(frustums) / sizeof(frustums[0]);
+
+  std::vector<UINT> visible_lists[CubeShadowMap::kFaceNumber];
+  start_time = std::chrono::steady_clock::now();
+  for (UINT query = 0; query < query_number; ++query) {
+    bvh.QueryFrustums(frustums, frustum_number, visible_lists);
+  }
+  report.frustum_query_microseconds = 1000.0 * ElapsedMilliseconds(start_time) / query_number;
+
+  FrustumCuller culler;
+  culler.SetBounds(object_bounds.data(), object_number);
+  std::vector<UINT> brute_force_visible_lists[frustum_number];
+  start_time = std::chrono::steady_clock::now();
+  for (UINT query = 0; query < query_number; ++query) {
+    culler.Cull(frustums, frustum_number, brute_force_visible_lists);
+  }
+  report.brute_force_frustum_microseconds = 1000.0 * ElapsedMilliseconds(start_time) / query_number;
+  for (UINT f = 0; f < frustum_number; ++f) {
+    std::vector<UINT> differences;
+    std::set_symmetric_difference(visible_lists[f].begin(), visible_lists[f].end(),
+      brute_force_visible_lists[f].begin(), brute_force_visible_lists[f].end(), std::back_inserter(differences));
+    report.mismatch_number += differences.size();
+  }
+  report.visible_fraction = static_cast<double>(visible_lists[0].size()) / object_number;
+
+  const XMVECTOR point_light_position = XMVectorSet(0.0f, 20.0f, 0.0f, 1.0f);
+  const XMMATRIX face_proj = CubeShadowMap::ComputeFaceProj(0.1f, 100.0f);
+  FrustumCuller::Frustum face_frustums[CubeShadowMap::kFaceNumber];
+  for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+    face_frustums[face] = FrustumCuller::ComputeFrustum(XMMatrixMultiply(CubeShadowMap::ComputeFaceView(point_light_position, face), face_proj), false);
+  }
+  start_time = std::chrono::steady_clock::now();
+  for (UINT query = 0; query < query_number; ++query) {
+    bvh.QueryFrustums(face_frustums, CubeShadowMap::kFaceNumber, visible_lists);
+  }
+  report.cube_query_microseconds = 1000.0 * ElapsedMilliseconds(start_time) / query_number;
+
+  std::vector<XMFLOAT3> points(query_number);
+  std::vector<XMFLOAT3> directions(query_number);
+  for (UINT query = 0; query < query_number; ++query) {
+    points[query] = XMFLOAT3(position(random_engine), 0.5f * position(random_engine), position(random_engine));
+    XMStoreFloat3(&directions[query], XMVector3Normalize(XMVectorSet(unit(random_engine), unit(random_engine), unit(random_engine), 0.0f)));
+  }
+  RayHit ray_hit;
+  start_time = std::chrono::steady_clock::now();
+  for (UINT query = 0; query < query_number; ++query) {
+    bvh.Raycast(XMLoadFloat3(&points[query]), XMLoadFloat3(&directions[query]), 1000.0f, ray_hit);
+  }
+  report.ray_query_microseconds = 1000.0 * ElapsedMilliseconds(start_time) / query_number;
+
+  NearestHit nearest_hit;
+  start_time = std::chrono::steady_clock::now();
+  for (UINT query = 0; query < query_number; ++query) {
+    bvh.FindNearest(XMLoadFloat3(&points[query]), FLT_MAX, nearest_hit);
+  }
+  report.nearest_query_microseconds = 1000.0 * ElapsedMilliseconds(start_time) / query_number;
+  return report;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(size_t worker_number) : worker_number_(worker_number)
+{
+}
+
+void BoundingVolumeHierarchy::Build(const BoundingBox* object_bounds, size_t object_number)
+{
+  object_bounds_.assign(object_bounds, object_bounds + object_number);
+  object_centers_.resize(object_number);
+  for (size_t i = 0; i < object_number; ++i) {
+    XMStoreFloat3(&object_centers_[i], XMVectorScale(XMVectorAdd(XMLoadFloat3(&object_bounds[i].min), XMLoadFloat3(&object_bounds[i].max)), 0.5f));
+  }
+  object_indices_.resize(object_number);
+  std::iota(object_indices_.begin(), object_indices_.end(), 0u);
+  nodes_.clear();
+  if (object_number == 0) {
+    UpdateObjectLeaves();
+    return;
+  }
+
+  nodes_.resize(1);
+  if (object_number < kParallelMinObjectNumber) {
+    BuildSubtree(nodes_, 0, 0, static_cast<UINT>(object_number));
+    UpdateObjectLeaves();
+    return;
+  }
+
+  if (!thread_pool_) {
+    thread_pool_ = std::make_unique<ThreadPool>(worker_number_);
+  }
+  // Split the largest pending subtree until every thread has a few to pick from.
+  const size_t subtree_number = kSubtreesPerThread * (thread_pool_->GetWorkerNumber() + 1);
+  std::vector<BuildTask> tasks = { { 0, 0, static_cast<UINT>(object_number) } };
+  while (tasks.size() < subtree_number) {
+    const auto largest = std::max_element(tasks.begin(), tasks.end(), [](const BuildTask& a, const BuildTask& b) {
+      return a.object_end - a.object_begin < b.object_end - b.object_begin;
+    });
+    if (largest->object_end - largest->object_begin < kSubtreeMinObjectNumber) {
+      break;
+    }
+    const BuildTask task = *largest;
+    tasks.erase(largest);
+    UINT middle = 0;
+    if (SplitNode(nodes_, task.node_index, task.object_begin, task.object_end, middle)) {
+      const UINT first_child = nodes_[task.node_index].first_child;
+      tasks.push_back({ first_child, task.object_begin, middle });
+      tasks.push_back({ first_child + 1, middle, task.object_end });
+    }
+  }
+
+  // Each subtree only reorders its own range of object_indices_, into nodes of its own.
+  std::vector<std::vector<Node>> subtree_nodes(tasks.size());
+  thread_pool_->ParallelFor(tasks.size(), [this, &tasks, &subtree_nodes](size_t task_index, size_t) {
+    const BuildTask& task = tasks[task_index];
+    subtree_nodes[task_index].resize(1);
+    BuildSubtree(subtree_nodes[task_index], 0, task.object_begin, task.object_end);
+  });
+
+  // Subtree roots replace their placeholders, the other nodes go after the top of the tree.
+  for (size_t task_index = 0; task_index < tasks.size(); ++task_index) {
+    const std::vector<Node>& nodes = subtree_nodes[task_index];
+    const UINT base = static_cast<UINT>(nodes_.size()) - 1;  // where nodes[1] lands, minus 1
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      Node node = nodes[i];
+      node.first_child = node.first_child == 0 ? 0 : node.first_child + base;
+      if (i == 0) {
+        nodes_[tasks[task_index].node_index] = node;
+      }
+      else {
+        nodes_.push_back(node);
+      }
+    }
+  }
+  UpdateObjectLeaves();
+}
+
+void BoundingVolumeHierarchy::Refit(const size_t* changed_object_indices, const BoundingBox* changed_object_bounds, size_t changed_object_number)
+{
+  for (size_t i = 0; i < changed_object_number; ++i) {
+    const size_t object_index = changed_object_indices[i];
+    if (object_index < object_bounds_.size()) {
+      object_bounds_[object_index] = changed_object_bounds[i];
+    }
+  }
+
+  const auto compute_node_bounds = [this](const Node& node) {
+    BoundingBox bounds = EmptyBox();
+    if (node.first_child != 0) {
+      bounds = nodes_[node.first_child].bounds;
+      Grow(bounds, nodes_[node.first_child + 1].bounds);
+    }
+    else {
+      for (UINT i = node.object_begin; i < node.object_begin + node.object_number; ++i) {
+        Grow(bounds, object_bounds_[object_indices_[i]]);
+      }
+    }
+    return bounds;
+  };
+
+  // Past a point, one sweep from the leaves up beats walking up from every moved object.
+  if (changed_object_number * 8 > object_bounds_.size()) {
+    for (size_t i = nodes_.size(); i-- > 0;) {
+      nodes_[i].bounds = compute_node_bounds(nodes_[i]);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < changed_object_number; ++i) {
+    if (changed_object_indices[i] >= object_bounds_.size()) {
+      continue;
+    }
+    // Up from the object's leaf, until a node's box stays the same.
+    UINT node_index = object_leaves_[changed_object_indices[i]];
+    while (true) {
+      const BoundingBox bounds = compute_node_bounds(nodes_[node_index]);
+      if (IsSameBox(bounds, nodes_[node_index].bounds)) {
+        break;
+      }
+      nodes_[node_index].bounds = bounds;
+      if (node_index == 0) {
+        break;
+      }
+      node_index = parents_[node_index];
+    }
+  }
+}
+
+double BoundingVolumeHierarchy::GetSahCost() const
+{
+  if (nodes_.empty()) {
+    return 0.0;
+  }
+  const double root_area = ComputeSurfaceArea(nodes_[0].bounds);
+  if (root_area <= 0.0) {
+    return static_cast<double>(object_bounds_.size());
+  }
+  double cost = 0.0;
+  for (const Node& node : nodes_) {
+    cost += ComputeSurfaceArea(node.bounds) / root_area * (node.first_child != 0 ? 1.0 : node.object_number);
+  }
+  return cost;
+}
+
+UINT BoundingVolumeHierarchy::GetDepth() const
+{
+  std::vector<UINT> depths(nodes_.size(), 1);
+  UINT max_depth = nodes_.empty() ? 0 : 1;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    max_depth = std::max(max_depth, depths[i]);
+    if (nodes_[i].first_child != 0) {
+      depths[nodes_[i].first_child] = depths[nodes_[i].first_child + 1] = depths[i] + 1;
+    }
+  }
+  return max_depth;
+}
+
+void BoundingVolumeHierarchy::QueryFrustums(const FrustumCuller::Frustum* frustums, UINT frustum_number, std::vector<UINT>* visible_lists) const
+{
+  for (UINT f = 0; f < frustum_number; ++f) {
+    visible_lists[f].clear();
+  }
+  frustum_number = std::min(frustum_number, kMaxFrustumNumber);
+  if (nodes_.empty() || frustum_number == 0) {
+    return;
+  }
+
+  // Each pending node carries the frustums it may straddle; the others have already taken or dropped it.
+  struct Entry {
+    UINT node_index;
+    uint32_t frustum_mask;
+  };  // struct Entry
+  std::vector<Entry> stack = { { 0, frustum_number == 32 ? ~0u : (1u << frustum_number) - 1 } };
+  while (!stack.empty()) {
+    const Entry entry = stack.back();
+    stack.pop_back();
+    const Node& node = nodes_[entry.node_index];
+    uint32_t straddled_mask = 0;
+    for (UINT f = 0; f < frustum_number; ++f) {
+      if ((entry.frustum_mask & (1u << f)) == 0) {
+        continue;
+      }
+      const Overlap overlap = ClassifyBox(frustums[f], node.bounds);
+      if (overlap == Overlap::kInside) {
+        visible_lists[f].insert(visible_lists[f].end(), object_indices_.begin() + node.object_begin, object_indices_.begin() + node.object_begin + node.object_number);
+      }
+      else if (overlap == Overlap::kIntersecting) {
+        straddled_mask |= 1u << f;
+      }
+    }
+    if (straddled_mask == 0) {
+      continue;
+    }
+
+    if (node.first_child != 0) {
+      stack.push_back({ node.first_child, straddled_mask });
+      stack.push_back({ node.first_child + 1, straddled_mask });
+      continue;
+    }
+    for (UINT i = node.object_begin; i < node.object_begin + node.object_number; ++i) {
+      const UINT object_index = object_indices_[i];
+      for (UINT f = 0; f < frustum_number; ++f) {
+        if ((straddled_mask & (1u << f)) != 0 && FrustumCuller::IsVisible(frustums[f], object_bounds_[object_index])) {
+          visible_lists[f].push_back(object_index);
+        }
+      }
+    }
+  }
+
+  for (UINT f = 0; f < frustum_number; ++f) {
+    std::sort(visible_lists[f].begin(), visible_lists[f].end());
+  }
+}
+
+bool BoundingVolumeHierarchy::Raycast(FXMVECTOR origin, FXMVECTOR direction, float max_distance, RayHit& hit) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  XMFLOAT3 ray_origin;
+  XMFLOAT3 inverse_direction;
+  XMStoreFloat3(&ray_origin, origin);
+  XMStoreFloat3(&inverse_direction, XMVectorReciprocal(direction));
+
+  // Nearer child first, and nodes the ray enters past the closest hit so far are skipped.
+  struct Entry {
+    UINT node_index;
+    float distance;
+  };  // struct Entry
+  float closest_distance = max_distance;
+  bool found = false;
+  std::vector<Entry> stack;
+  const float root_distance = IntersectRay(nodes_[0].bounds, ray_origin, inverse_direction);
+  if (root_distance <= closest_distance) {
+    stack.push_back({ 0, root_distance });
+  }
+  while (!stack.empty()) {
+    const Entry entry = stack.back();
+    stack.pop_back();
+    if (entry.distance > closest_distance) {
+      continue;
+    }
+
+    const Node& node = nodes_[entry.node_index];
+    if (node.first_child != 0) {
+      Entry children[2] = {
+        { node.first_child, IntersectRay(nodes_[node.first_child].bounds, ray_origin, inverse_direction) },
+        { node.first_child + 1, IntersectRay(nodes_[node.first_child + 1].bounds, ray_origin, inverse_direction) },
+      };
+      if (children[0].distance < children[1].distance) {
+        std::swap(children[0], children[1]);
+      }
+      for (const Entry& child : children) {
+        if (child.distance <= closest_distance) {
+          stack.push_back(child);
+        }
+      }
+      continue;
+    }
+    for (UINT i = node.object_begin; i < node.object_begin + node.object_number; ++i) {
+      const float distance = IntersectRay(object_bounds_[object_indices_[i]], ray_origin, inverse_direction);
+      if (distance <= closest_distance && (!found || distance < hit.distance)) {
+        hit = { object_indices_[i], distance };
+        closest_distance = distance;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+bool BoundingVolumeHierarchy::FindNearest(FXMVECTOR point, float max_distance, NearestHit& hit) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  XMFLOAT3 query_point;
+  XMStoreFloat3(&query_point, point);
+
+  // Same walk as Raycast, with squared distances to the boxes.
+  struct Entry {
+    UINT node_index;
+    float squared_distance;
+  };  // struct Entry
+  float closest_squared_distance = max_distance < FLT_MAX ? max_distance * max_distance : FLT_MAX;
+  bool found = false;
+  std::vector<Entry> stack = { { 0, ComputeSquaredDistance(nodes_[0].bounds, query_point) } };
+  while (!stack.empty()) {
+    const Entry entry = stack.back();
+    stack.pop_back();
+    if (entry.squared_distance > closest_squared_distance) {
+      continue;
+    }
+
+    const Node& node = nodes_[entry.node_index];
+    if (node.first_child != 0) {
+      Entry children[2] = {
+        { node.first_child, ComputeSquaredDistance(nodes_[node.first_child].bounds, query_point) },
+        { node.first_child + 1, ComputeSquaredDistance(nodes_[node.first_child + 1].bounds, query_point) },
+      };
+      if (children[0].squared_distance < children[1].squared_distance) {
+        std::swap(children[0], children[1]);
+      }
+      for (const Entry& child : children) {
+        if (child.squared_distance <= closest_squared_distance) {
+          stack.push_back(child);
+        }
+      }
+      continue;
+    }
+    for (UINT i = node.object_begin; i < node.object_begin + node.object_number; ++i) {
+      const float squared_distance = ComputeSquaredDistance(object_bounds_[object_indices_[i]], query_point);
+      if (squared_distance <= closest_squared_distance && (!found || squared_distance < hit.distance)) {
+        hit = { object_indices_[i], squared_distance };
+        closest_squared_distance = squared_distance;
+        found = true;
+      }
+    }
+  }
+  if (found) {
+    hit.distance = std::sqrt(hit.distance);
+  }
+  return found;
+}
+
+bool BoundingVolumeHierarchy::SplitNode(std::vector<Node>& nodes, UINT node_index, UINT object_begin, UINT object_end, UINT& middle)
+{
+  BoundingBox bounds = EmptyBox();
+  BoundingBox center_bounds = EmptyBox();
+  for (UINT i = object_begin; i < object_end; ++i) {
+    Grow(bounds, object_bounds_[object_indices_[i]]);
+    Grow(center_bounds, object_centers_[object_indices_[i]]);
+  }
+  const UINT object_number = object_end - object_begin;
+  nodes[node_index] = { bounds, 0, object_begin, object_number };
+  if (object_number <= kMaxLeafObjectNumber) {
+    return false;
+  }
+
+  // Objects are binned by center along each axis; the cheapest boundary between two bins wins, where a side
+  // costs its box's area times its object number.
+  struct Bin {
+    BoundingBox bounds;
+    UINT object_number;
+  };  // struct Bin
+  float best_cost = FLT_MAX;
+  int best_axis = -1;
+  UINT best_bin = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float axis_min = GetComponent(center_bounds.min, axis);
+    const float axis_extent = GetComponent(center_bounds.max, axis) - axis_min;
+    if (axis_extent <= 0.0f) {
+      continue;
+    }
+    const float bin_scale = kBinNumber / axis_extent;
+    Bin bins[kBinNumber];
+    for (Bin& bin : bins) {
+      bin = { EmptyBox(), 0 };
+    }
+    for (UINT i = object_begin; i < object_end; ++i) {
+      const UINT object_index = object_indices_[i];
+      const UINT bin = std::min(static_cast<UINT>((GetComponent(object_centers_[object_index], axis) - axis_min) * bin_scale), kBinNumber - 1);
+      Grow(bins[bin].bounds, object_bounds_[object_index]);
+      bins[bin].object_number++;
+    }
+
+    // Bins [b, kBinNumber) on the right of boundary b.
+    float right_areas[kBinNumber];
+    UINT right_object_numbers[kBinNumber];
+    BoundingBox side_bounds = EmptyBox();
+    UINT side_object_number = 0;
+    for (UINT b = kBinNumber - 1; b > 0; --b) {
+      Grow(side_bounds, bins[b].bounds);
+      side_object_number += bins[b].object_number;
+      right_areas[b] = ComputeSurfaceArea(side_bounds);
+      right_object_numbers[b] = side_object_number;
+    }
+    side_bounds = EmptyBox();
+    side_object_number = 0;
+    for (UINT b = 1; b < kBinNumber; ++b) {
+      Grow(side_bounds, bins[b - 1].bounds);
+      side_object_number += bins[b - 1].object_number;
+      if (side_object_number == 0 || right_object_numbers[b] == 0) {
+        continue;
+      }
+      const float cost = ComputeSurfaceArea(side_bounds) * side_object_number + right_areas[b] * right_object_numbers[b];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+
+  if (best_axis < 0) {
+    // All the centers fall into one bin on every axis; halve the range so leaves stay small.
+    middle = object_begin + object_number / 2;
+  }
+  else {
+    const float axis_min = GetComponent(center_bounds.min, best_axis);
+    const float bin_scale = kBinNumber / (GetComponent(center_bounds.max, best_axis) - axis_min);
+    const auto first_right = std::partition(object_indices_.begin() + object_begin, object_indices_.begin() + object_end,
+      [this, best_axis, best_bin, axis_min, bin_scale](UINT object_index) {
+        return std::min(static_cast<UINT>((GetComponent(object_centers_[object_index], best_axis) - axis_min) * bin_scale), kBinNumber - 1) < best_bin;
+      });
+    middle = static_cast<UINT>(first_right - object_indices_.begin());
+  }
+
+  nodes[node_index].first_child = static_cast<UINT>(nodes.size());
+  nodes.resize(nodes.size() + 2);
+  return true;
+}
+
+void BoundingVolumeHierarchy::BuildSubtree(std::vector<Node>& nodes, UINT node_index, UINT object_begin, UINT object_end)
+{
+  // A stack rather than recursion: badly spread objects can make the tree deep.
+  std::vector<BuildTask> tasks = { { node_index, object_begin, object_end } };
+  while (!tasks.empty()) {
+    const BuildTask task = tasks.back();
+    tasks.pop_back();
+    UINT middle = 0;
+    if (SplitNode(nodes, task.node_index, task.object_begin, task.object_end, middle)) {
+      const UINT first_child = nodes[task.node_index].first_child;
+      tasks.push_back({ first_child + 1, middle, task.object_end });
+      tasks.push_back({ first_child, task.object_begin, middle });
+    }
+  }
+}
+
+void BoundingVolumeHierarchy::UpdateObjectLeaves()
+{
+  parents_.assign(nodes_.size(), 0);
+  object_leaves_.assign(object_bounds_.size(), 0);
+  for (UINT i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    if (node.first_child != 0) {
+      parents_[node.first_child] = parents_[node.first_child + 1] = i;
+      continue;
+    }
+    for (UINT j = node.object_begin; j < node.object_begin + node.object_number; ++j) {
+      object_leaves_[object_indices_[j]] = i;
+    }
+  }
+}
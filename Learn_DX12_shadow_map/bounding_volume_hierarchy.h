@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "frustum_culler.h"
+#include "model.h"
+#include "thread_pool.h"
+
+using namespace DirectX;
+
+// Bounding box tree over objects' world boxes, e.g. AssetsManager's models, so frustum, ray and nearest object
+// queries only visit the branches that can answer them instead of every object.
+//
+// Build splits nodes with the surface area heuristic, choosing among kBinNumber bins of object centers per
+// axis, until kMaxLeafObjectNumber objects or fewer are left. The top of the tree is split on the calling
+// thread until there are enough subtrees to keep a thread pool busy, then the subtrees are built in parallel.
+// Each node covers a contiguous range of GetObjectIndices(), so a node found entirely inside a frustum hands
+// its range over without testing the objects. Refit follows moved objects by growing and shrinking the boxes
+// of their ancestors, which is much cheaper than a build but lets the tree's quality drift as objects travel;
+// call Build again when the objects change a lot. Only DirectXMath is used, so it runs without a device.
+class BoundingVolumeHierarchy {
+ public:
+  using BoundingBox = Asset::Model::BoundingBox;
+
+  struct Node {
+    BoundingBox bounds;
+    UINT first_child;  // children at first_child and first_child + 1, 0 for a leaf (the root is nobody's child)
+    UINT object_begin;  // into GetObjectIndices()
+    UINT object_number;
+  };  // struct Node
+
+  struct RayHit {
+    UINT object_index;
+    float distance;  // along the direction, in its units
+  };  // struct RayHit
+
+  struct NearestHit {
+    UINT object_index;
+    float distance;  // 0 if the point is inside the object's box
+  };  // struct NearestHit
+
+  struct BenchmarkReport {
+    double build_milliseconds;
+    size_t thread_number;  // of the build, the calling thread included
+    double refit_milliseconds;  // after moving 1% of the objects
+    double sah_cost;  // of the built tree, see GetSahCost
+    UINT depth;
+    // Per query.
+    double frustum_query_microseconds;  // a camera and a light
+    double brute_force_frustum_microseconds;  // the same frustums through FrustumCuller
+    double cube_query_microseconds;  // the six faces of a point light
+    double ray_query_microseconds;
+    double nearest_query_microseconds;
+    double visible_fraction;  // of the camera
+    size_t mismatch_number;  // objects the tree and FrustumCuller::IsVisible disagree on, 0 unless something is wrong
+  };  // struct BenchmarkReport
+
+  static constexpr UINT kBinNumber = 16;
+  static constexpr UINT kMaxLeafObjectNumber = 4;
+  static constexpr UINT kMaxFrustumNumber = 32;  // per QueryFrustums
+
+  // Builds a tree over object_number random boxes, then times a refit and query_number queries of each kind.
+  static BenchmarkReport Benchmark(size_t object_number, UINT query_number);
+
+  // worker_number == 0 means one worker per hardware thread. The pool is only started by the first build
+  // large enough to use it.
+  explicit BoundingVolumeHierarchy(size_t worker_number = 0);
+
+  BoundingVolumeHierarchy(const BoundingVolumeHierarchy&) = delete;
+  BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&) = delete;
+
+  // Copies the boxes and builds the tree from scratch.
+  void Build(const BoundingBox* object_bounds, size_t object_number);
+
+  // changed_object_bounds[i] is the new box of object changed_object_indices[i].
+  void Refit(const size_t* changed_object_indices, const BoundingBox* changed_object_bounds, size_t changed_object_number);
+
+  size_t GetObjectNumber() const {
+    return object_bounds_.size();
+  }
+
+  const std::vector<Node>& GetNodes() const {
+    return nodes_;
+  }
+
+  const std::vector<UINT>& GetObjectIndices() const {
+    return object_indices_;
+  }
+
+  // Expected cost of a ray through the tree: the surface area weighted number of node visits plus object tests,
+  // relative to the root's area. Lower is better.
+  double GetSahCost() const;
+
+  UINT GetDepth() const;
+
+  // visible_lists[i] gets the objects that may intersect frustums[i], in object order, with the same test as
+  // FrustumCuller::IsVisible. All the frustums are answered in one walk of the tree.
+  void QueryFrustums(const FrustumCuller::Frustum* frustums, UINT frustum_number, std::vector<UINT>* visible_lists) const;
+
+  // The object whose box the ray enters first, within max_distance. Returns false if it misses them all.
+  bool Raycast(FXMVECTOR origin, FXMVECTOR direction, float max_distance, RayHit& hit) const;
+
+  // The object whose box is closest to point, within max_distance. Returns false if none is.
+  bool FindNearest(FXMVECTOR point, float max_distance, NearestHit& hit) const;
+
+ private:
+  struct BuildTask {
+    UINT node_index;
+    UINT object_begin;
+    UINT object_end;
+  };  // struct BuildTask
+
+  // Sets nodes[node_index] over [object_begin, object_end); unless it is a leaf, appends its two children and
+  // returns true with the end of the first one's range in middle.
+  bool SplitNode(std::vector<Node>& nodes, UINT node_index, UINT object_begin, UINT object_end, UINT& middle);
+  void BuildSubtree(std::vector<Node>& nodes, UINT node_index, UINT object_begin, UINT object_end);
+  void UpdateObjectLeaves();
+
+  size_t worker_number_ = 0;
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::vector<BoundingBox> object_bounds_;
+  std::vector<XMFLOAT3> object_centers_;
+  std::vector<UINT> object_indices_;  // grouped by leaf
+  std::vector<Node> nodes_;  // the root first, parents before their children
+  std::vector<UINT> parents_;  // per node
+  std::vector<UINT> object_leaves_;  // per object
+};  // class BoundingVolumeHierarchy
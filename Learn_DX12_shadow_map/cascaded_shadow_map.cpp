@@ -0,0 +1,149 @@
+#include "cascaded_shadow_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+constexpr UINT CascadedShadowMap::kMaxCascadeNumber;
+
+CascadedShadowMap::CascadedShadowMap(const Options& options) : options_(options)
+{
+  options_.cascade_number = std::min(std::max(options_.cascade_number, 1u), kMaxCascadeNumber);
+}
+
+CascadedShadowMap::BenchmarkReport CascadedShadowMap::Benchmark(UINT object_number, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (iteration_number == 0) {
+    return report;
+  }
+
+  // Unit boxes on a square grid 4 units apart, centered on the origin.
+  std::vector<LightFrustumFitter::BoundingBox> object_bounds(object_number);
+  const UINT grid_size = static_cast<UINT>(std::ceil(std::sqrt(static_cast<float>(object_number))));
+  for (UINT i = 0; i < object_number; ++i) {
+    const float x = 4.0f * (i % grid_size) - 2.0f * grid_size;
+    const float z = 4.0f * (i / grid_size) - 2.0f * grid_size;
+    object_bounds[i] = { XMFLOAT3(x, 0.0f, z), XMFLOAT3(x + 1.0f, 1.0f, z + 1.0f) };
+  }
+
+  const float near_plane = 0.1f;
+  const float far_plane = 200.0f;
+  const XMMATRIX camera_proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, near_plane, far_plane);
+  const XMVECTOR light_direction = XMVectorSet(-1.0f, -2.0f, 1.0f, 0.0f);
+  CascadedShadowMap cascaded_shadow_map;
+  float split_sum = 0.0f;  // keeps the splits from being optimized out
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    float split_distances[kMaxCascadeNumber];
+    ComputeSplitDistances(near_plane, far_plane + i * 1e-3f, kMaxCascadeNumber, 0.5f, split_distances);
+    split_sum += split_distances[0];
+  }
+  report.split_microseconds = split_sum > 0.0f ? std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count() / iteration_number : 0.0;
+
+  auto time_fits = [&](const LightFrustumFitter::BoundingBox* bounds, size_t bound_number) {
+    const auto fit_start_time = std::chrono::steady_clock::now();
+    for (UINT i = 0; i < iteration_number; ++i) {
+      const float yaw = XM_2PI * i / iteration_number;
+      const XMMATRIX camera_view = XMMatrixLookToLH(XMVectorSet(0.0f, 5.0f, 0.0f, 1.0f), XMVectorSet(std::sin(yaw), -0.3f, std::cos(yaw), 0.0f),
+                                                    XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+      cascaded_shadow_map.Fit(camera_view, camera_proj, near_plane, far_plane, light_direction, bounds, bound_number);
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - fit_start_time).count() / iteration_number;
+  };
+  report.fit_microseconds = time_fits(nullptr, 0);
+  report.bounded_fit_microseconds = time_fits(object_bounds.data(), object_bounds.size());
+  return report;
+}
+
+void CascadedShadowMap::Fit(FXMMATRIX camera_view, CXMMATRIX camera_proj, float near_plane, float far_plane, FXMVECTOR light_direction,
+                            const LightFrustumFitter::BoundingBox* object_bounds, size_t object_number)
+{
+  float split_distances[kMaxCascadeNumber]{};
+  ComputeSplitDistances(near_plane, far_plane, options_.cascade_number, options_.split_lambda, split_distances);
+
+  XMVECTOR frustum_corners[8];
+  ComputeFrustumCorners(XMMatrixInverse(nullptr, XMMatrixMultiply(camera_view, camera_proj)), frustum_corners);
+
+  // Depth is linear along each edge from a near corner to its far corner.
+  float slice_near = near_plane;
+  for (UINT i = 0; i < options_.cascade_number; ++i) {
+    XMVECTOR slice_corners[8];
+    for (int corner = 0; corner < 4; ++corner) {
+      const XMVECTOR edge_near = frustum_corners[corner];
+      const XMVECTOR edge_far = frustum_corners[corner + 4];
+      slice_corners[corner] = XMVectorLerp(edge_near, edge_far, (slice_near - near_plane) / (far_plane - near_plane));
+      slice_corners[corner + 4] = XMVectorLerp(edge_near, edge_far, (split_distances[i] - near_plane) / (far_plane - near_plane));
+    }
+
+    cascades_[i] = FitCascade(slice_corners, light_direction, options_.resolution, options_.caster_distance, object_bounds, object_number);
+    cascades_[i].split_distance = split_distances[i];
+    slice_near = split_distances[i];
+  }
+}
+
+void CascadedShadowMap::ComputeSplitDistances(float near_plane, float far_plane, UINT cascade_number, float split_lambda, float* split_distances)
+{
+  for (UINT i = 1; i < cascade_number; ++i) {
+    const float fraction = static_cast<float>(i) / cascade_number;
+    const float log_split = near_plane * std::pow(far_plane / near_plane, fraction);
+    const float uniform_split = near_plane + (far_plane - near_plane) * fraction;
+    split_distances[i - 1] = split_lambda * log_split + (1.0f - split_lambda) * uniform_split;
+  }
+  // Exactly the far plane, not what pow rounds to.
+  split_distances[cascade_number - 1] = far_plane;
+}
+
+void CascadedShadowMap::ComputeFrustumCorners(FXMMATRIX inverse_view_proj, XMVECTOR* corners)
+{
+  static const XMFLOAT3 kNdcCorners[8] = {
+    {-1.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}, {1.0f, -1.0f, 0.0f}, {-1.0f, -1.0f, 0.0f},
+    {-1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {1.0f, -1.0f, 1.0f}, {-1.0f, -1.0f, 1.0f},
+  };
+  for (int i = 0; i < 8; ++i) {
+    corners[i] = XMVector3TransformCoord(XMLoadFloat3(&kNdcCorners[i]), inverse_view_proj);
+  }
+}
+
+CascadedShadowMap::Cascade CascadedShadowMap::FitCascade(const XMVECTOR* slice_corners, FXMVECTOR light_direction, UINT resolution, float caster_distance,
+                                                         const LightFrustumFitter::BoundingBox* object_bounds, size_t object_number)
+{
+  XMVECTOR center = XMVectorZero();
+  for (int i = 0; i < 8; ++i) {
+    center = XMVectorAdd(center, slice_corners[i]);
+  }
+  center = XMVectorScale(center, 1.0f / 8.0f);
+
+  float radius = 0.0f;
+  for (int i = 0; i < 8; ++i) {
+    radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(slice_corners[i], center))));
+  }
+  // Rounded up, so float noise in the corners can't change the texel size from frame to frame.
+  radius = std::ceil(radius * 16.0f) / 16.0f;
+
+  // The light's rotation only: its translation would move the texel grid along with the camera.
+  const XMVECTOR direction = XMVector3Normalize(light_direction);
+  const XMVECTOR up = std::fabs(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+  const XMMATRIX light_view = XMMatrixLookToLH(XMVectorZero(), direction, up);
+
+  Cascade cascade{};
+  cascade.texel_size = 2.0f * radius / resolution;
+  const XMVECTOR light_space_center = XMVector3TransformCoord(center, light_view);
+  const float center_x = std::floor(XMVectorGetX(light_space_center) / cascade.texel_size) * cascade.texel_size;
+  const float center_y = std::floor(XMVectorGetY(light_space_center) / cascade.texel_size) * cascade.texel_size;
+  float near_z = XMVectorGetZ(light_space_center) - radius - caster_distance;
+  float far_z = XMVectorGetZ(light_space_center) + radius;
+  LightFrustumFitter::BoundingBox fitted_bounds;
+  if (object_number > 0 && LightFrustumFitter::FitOrthographic(light_view, slice_corners, object_bounds, object_number, fitted_bounds)) {
+    // The casters' own near side, however far it is, replaces caster_distance.
+    near_z = fitted_bounds.min.z;
+    far_z = std::max(std::min(far_z, fitted_bounds.max.z), near_z + 1.0f / 16.0f);
+  }
+  cascade.depth_range = far_z - near_z;
+
+  const XMMATRIX light_proj = XMMatrixOrthographicOffCenterLH(center_x - radius, center_x + radius, center_y - radius, center_y + radius, near_z, far_z);
+  XMStoreFloat4x4(&cascade.view_proj, XMMatrixMultiply(light_view, light_proj));
+  return cascade;
+}
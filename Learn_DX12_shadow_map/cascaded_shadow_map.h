@@ -0,0 +1,75 @@
+#pragma once
+
+#include "common_headers.h"
+#include "light_frustum_fitter.h"
+
+using namespace DirectX;
+
+// Splits the view frustum of the main camera along its depth and fits an orthographic light matrix to each
+// slice, for the directional light. Only DirectXMath is used, so it runs without a device.
+//
+// Splits blend the logarithmic and the uniform scheme ("practical" splits). Each slice is bounded by a
+// sphere, so the projection keeps its size while the camera turns, and the sphere's center is snapped to
+// whole shadow map texels in light space, so the shadow edges don't crawl while the camera moves. Given the
+// scene's bounds, the depth range shrinks to the receivers in the slice and their casters.
+class CascadedShadowMap {
+ public:
+  static constexpr UINT kMaxCascadeNumber = 4;
+
+  struct Options {
+    UINT cascade_number = kMaxCascadeNumber;
+    UINT resolution = 2048;  // of each cascade, square
+    float split_lambda = 0.5f;  // 0: uniform splits, 1: logarithmic splits
+    float caster_distance = 10.0f;  // how far towards the light casters outside a slice are still caught
+  };  // struct Options
+
+  struct Cascade {
+    XMFLOAT4X4 view_proj;  // world to light clip space, not transposed
+    float split_distance;  // view space depth where the cascade ends
+    float texel_size;  // in world units
+    float depth_range;  // of the orthographic projection, in world units
+  };  // struct Cascade
+
+  struct BenchmarkReport {
+    double split_microseconds;  // ComputeSplitDistances alone
+    double fit_microseconds;  // a whole Fit, without scene bounds
+    double bounded_fit_microseconds;  // a whole Fit, with the depth ranges fitted to the scene's objects
+  };  // struct BenchmarkReport
+
+  // Fits kMaxCascadeNumber cascades to a camera turning over a grid of object_number boxes, iteration_number
+  // times each way, and returns the average cost of a frame.
+  static BenchmarkReport Benchmark(UINT object_number, UINT iteration_number);
+
+  CascadedShadowMap() = default;
+  explicit CascadedShadowMap(const Options& options);
+
+  const Options& GetOptions() const {
+    return options_;
+  }
+
+  const Cascade& GetCascade(UINT cascade_index) const {
+    return cascades_[cascade_index];
+  }
+
+  // camera_view and camera_proj are the main camera's (LH, not transposed); near_plane and far_plane are the
+  // ones camera_proj was built with. light_direction points from the light to the scene. object_bounds are
+  // the world space boxes of the scene's objects, if known.
+  void Fit(FXMMATRIX camera_view, CXMMATRIX camera_proj, float near_plane, float far_plane, FXMVECTOR light_direction,
+           const LightFrustumFitter::BoundingBox* object_bounds = nullptr, size_t object_number = 0);
+
+  // Writes the far distance of each of cascade_number slices of [near_plane, far_plane].
+  static void ComputeSplitDistances(float near_plane, float far_plane, UINT cascade_number, float split_lambda, float* split_distances);
+
+  // The 8 world space corners of the frustum whose inverse view projection is given: the near plane's 4, then
+  // the far plane's 4 in the same order.
+  static void ComputeFrustumCorners(FXMMATRIX inverse_view_proj, XMVECTOR* corners);
+
+  // Fits an orthographic projection along light_direction around the 8 corners of a frustum slice. Only the
+  // depth range is fitted to object_bounds: x and y stay on the snapped sphere, which keeps the texels stable.
+  static Cascade FitCascade(const XMVECTOR* slice_corners, FXMVECTOR light_direction, UINT resolution, float caster_distance,
+                            const LightFrustumFitter::BoundingBox* object_bounds = nullptr, size_t object_number = 0);
+
+ private:
+  Options options_;
+  Cascade cascades_[kMaxCascadeNumber]{};
+};  // class CascadedShadowMap
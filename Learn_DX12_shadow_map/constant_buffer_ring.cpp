@@ -0,0 +1,57 @@
+#include "constant_buffer_ring.h"
+
+#include <algorithm>
+
+#include "d3dx12.h"
+#include "dx_sample_helper.h"
+
+void ConstantBufferRing::Initialize(ID3D12Device* device, UINT64 capacity)
+{
+  device_ = device;
+  retired_buffers_.clear();
+  growth_number_ = 0;
+  CreateAndMapBuffer(capacity);
+}
+
+void ConstantBufferRing::BeginFrame(UINT64 fence_value, UINT64 completed_fence_value)
+{
+  ring_.BeginFrame(fence_value, completed_fence_value);
+  retired_buffers_.erase(std::remove_if(retired_buffers_.begin(), retired_buffers_.end(), [completed_fence_value](const RetiredBuffer& retired_buffer) {
+    return retired_buffer.fence_value <= completed_fence_value;
+    }), retired_buffers_.end());
+}
+
+ConstantBufferRing::Allocation ConstantBufferRing::Allocate(UINT64 size)
+{
+  UINT64 offset = ring_.Allocate(size);
+  if (offset == RingAllocator::kInvalidOffset) {
+    // The frames in flight keep reading the old buffer, up to and including this one.
+    const UINT64 fence_value = ring_.GetFrameFenceValue();
+    retired_buffers_.push_back({ buffer_, fence_value });
+    CreateAndMapBuffer(std::max(2 * ring_.GetCapacity(), size));
+    ring_.BeginFrame(fence_value, 0);
+    growth_number_++;
+    offset = ring_.Allocate(size);
+  }
+  return { cpu_address_ + offset, gpu_address_ + offset };
+}
+
+void ConstantBufferRing::CreateAndMapBuffer(UINT64 capacity)
+{
+  ring_.Reset(std::max<UINT64>(capacity, RingAllocator::kAlignment));
+  auto upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  auto buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(ring_.GetCapacity());
+  ThrowIfFailed(device_->CreateCommittedResource(
+    &upload_heap_properties,
+    D3D12_HEAP_FLAG_NONE,
+    &buffer_desc,
+    D3D12_RESOURCE_STATE_GENERIC_READ,
+    nullptr,
+    IID_PPV_ARGS(&buffer_)));
+  NAME_D3D12_OBJECT(buffer_);
+
+  // Left mapped for its whole life; the CPU never reads it.
+  const CD3DX12_RANGE read_range(0, 0);
+  ThrowIfFailed(buffer_->Map(0, &read_range, reinterpret_cast<void**>(&cpu_address_)));
+  gpu_address_ = buffer_->GetGPUVirtualAddress();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "common_headers.h"
+#include "ring_allocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Constants of every pass, view and object, written into one persistently mapped upload buffer shared by the
+// frames in flight, in place of a buffer per frame with a slot per object. RingAllocator hands out the pieces
+// and reclaims a frame's once the fence MyEngine signals after it has passed. When a frame asks for more than
+// is free, a buffer twice as large (or as large as needed) takes over, and the old one is released once the
+// frames still reading it are done.
+class ConstantBufferRing {
+ public:
+  struct Allocation {
+    void* cpu_address;
+    D3D12_GPU_VIRTUAL_ADDRESS gpu_address;
+  };  // struct Allocation
+
+  // Keeps the device, to grow.
+  void Initialize(ID3D12Device* device, UINT64 capacity);
+
+  // See RingAllocator::BeginFrame. Call before the frame's first Allocate.
+  void BeginFrame(UINT64 fence_value, UINT64 completed_fence_value);
+
+  // Valid until the GPU is done with the current frame.
+  Allocation Allocate(UINT64 size);
+
+  // Copies constants into a new allocation and returns its address, e.g. for SetGraphicsRootConstantBufferView.
+  template <typename T>
+  D3D12_GPU_VIRTUAL_ADDRESS Commit(const T& constants) {
+    const Allocation allocation = Allocate(sizeof(T));
+    memcpy(allocation.cpu_address, &constants, sizeof(T));
+    return allocation.gpu_address;
+  }
+
+  UINT64 GetCapacity() const {
+    return ring_.GetCapacity();
+  }
+
+  UINT GetGrowthNumber() const {
+    return growth_number_;
+  }
+
+ private:
+  void CreateAndMapBuffer(UINT64 capacity);
+
+  struct RetiredBuffer {
+    ComPtr<ID3D12Resource> buffer;
+    UINT64 fence_value;  // of the last frame that allocated from it
+  };  // struct RetiredBuffer
+
+  ComPtr<ID3D12Device> device_;
+  RingAllocator ring_;
+  ComPtr<ID3D12Resource> buffer_;
+  UINT8* cpu_address_ = nullptr;
+  D3D12_GPU_VIRTUAL_ADDRESS gpu_address_ = 0;
+  std::vector<RetiredBuffer> retired_buffers_;
+  UINT growth_number_ = 0;
+};  // class ConstantBufferRing
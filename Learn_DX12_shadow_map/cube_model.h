@@ -6,58 +6,10 @@ namespace Asset {
 
 class CubeModel : public Model {
  public:
-   std::unique_ptr<Vertex[]> GetVertexData() const override {
-     std::unique_ptr<Vertex[]> vertices_data = std::make_unique<Vertex[]>(8);
-
-     vertices_data[0].position = XMFLOAT3(-0.5f, -0.5f, -0.5f);
-     XMVECTOR temp_vector = XMLoadFloat3(&(vertices_data[0].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[0].normal), temp_vector);
-     vertices_data[0].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[1].position = XMFLOAT3(-0.5f, 0.5f, -0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[1].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[1].normal), temp_vector);
-     vertices_data[1].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[2].position = XMFLOAT3(0.5f, -0.5f, -0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[2].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[2].normal), temp_vector);
-     vertices_data[2].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[3].position = XMFLOAT3(0.5f, 0.5f, -0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[3].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[3].normal), temp_vector);
-     vertices_data[3].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[4].position = XMFLOAT3(-0.5f, -0.5f, 0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[4].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[4].normal), temp_vector);
-     vertices_data[4].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[5].position = XMFLOAT3(-0.5f, 0.5f, 0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[5].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[5].normal), temp_vector);
-     vertices_data[5].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[6].position = XMFLOAT3(0.5f, -0.5f, 0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[6].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[6].normal), temp_vector);
-     vertices_data[6].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     vertices_data[7].position = XMFLOAT3(0.5f, 0.5f, 0.5f);
-     temp_vector = XMLoadFloat3(&(vertices_data[7].position));
-     temp_vector = XMVector3Normalize(temp_vector);
-     XMStoreFloat3(&(vertices_data[7].normal), temp_vector);
-     vertices_data[7].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
-
-     return vertices_data;
+   const Vertex* GetVertexData() const override {
+     // Built (and normals normalized) once, shared by every cube.
+     static const std::vector<Vertex> vertices_data = BuildVertexData();
+     return vertices_data.data();
    }
 
    size_t GetVertexDataSize() const override {
@@ -68,57 +20,32 @@ class CubeModel : public Model {
      return 8;
    }
 
-   std::unique_ptr<DWORD[]> GetIndexData() const override {
-     std::unique_ptr<DWORD[]> indices_data = std::make_unique<DWORD[]>(36);
-
-     // front
-     indices_data[0] = 0;
-     indices_data[1] = 1;
-     indices_data[2] = 2;
-     indices_data[3] = 2;
-     indices_data[4] = 1;
-     indices_data[5] = 3;
-
-     // back
-     indices_data[6] = 6;
-     indices_data[7] = 7;
-     indices_data[8] = 4;
-     indices_data[9] = 4;
-     indices_data[10] = 7;
-     indices_data[11] = 5;
-
-     // left
-     indices_data[12] = 4;
-     indices_data[13] = 5;
-     indices_data[14] = 0;
-     indices_data[15] = 0;
-     indices_data[16] = 5;
-     indices_data[17] = 1;
-
-     // right
-     indices_data[18] = 2;
-     indices_data[19] = 3;
-     indices_data[20] = 6;
-     indices_data[21] = 6;
-     indices_data[22] = 3;
-     indices_data[23] = 7;
-
-     // top
-     indices_data[24] = 1;
-     indices_data[25] = 5;
-     indices_data[26] = 3;
-     indices_data[27] = 3;
-     indices_data[28] = 5;
-     indices_data[29] = 7;
-
-     // bottom
-     indices_data[30] = 4;
-     indices_data[31] = 0;
-     indices_data[32] = 6;
-     indices_data[33] = 6;
-     indices_data[34] = 0;
-     indices_data[35] = 2;
+   const DWORD* GetIndexData() const override {
+     static const DWORD indices_data[36] = {
+       // front
+       0, 1, 2,
+       2, 1, 3,
+
+       // back
+       6, 7, 4,
+       4, 7, 5,
+
+       // left
+       4, 5, 0,
+       0, 5, 1,
 
+       // right
+       2, 3, 6,
+       6, 3, 7,
+
+       // top
+       1, 5, 3,
+       3, 5, 7,
+
+       // bottom
+       4, 0, 6,
+       6, 0, 2,
+     };
      return indices_data;
    }
 
@@ -135,7 +62,29 @@ class CubeModel : public Model {
    }
 
  private:
+   static std::vector<Vertex> BuildVertexData() {
+     const XMFLOAT3 positions[8] = {
+       XMFLOAT3(-0.5f, -0.5f, -0.5f),
+       XMFLOAT3(-0.5f, 0.5f, -0.5f),
+       XMFLOAT3(0.5f, -0.5f, -0.5f),
+       XMFLOAT3(0.5f, 0.5f, -0.5f),
+       XMFLOAT3(-0.5f, -0.5f, 0.5f),
+       XMFLOAT3(-0.5f, 0.5f, 0.5f),
+       XMFLOAT3(0.5f, -0.5f, 0.5f),
+       XMFLOAT3(0.5f, 0.5f, 0.5f),
+     };
+
+     std::vector<Vertex> vertices_data(8);
+     for (size_t i = 0; i < vertices_data.size(); ++i) {
+       vertices_data[i].position = positions[i];
+       XMVECTOR temp_vector = XMLoadFloat3(&(vertices_data[i].position));
+       temp_vector = XMVector3Normalize(temp_vector);
+       XMStoreFloat3(&(vertices_data[i].normal), temp_vector);
+       vertices_data[i].color = XMFLOAT3(0.74118f, 0.49020f, 0.45490f);
+     }
 
+     return vertices_data;
+   }
 };
 
-}  // namespace Asset
\ No newline at end of file
+}  // namespace Asset
@@ -0,0 +1,53 @@
+cbuffer CubeShadowFaceMask : register(b1)
+{
+  uint face_mask;  // bit i: the object may overlap cube face i, see CubeShadowMap::ComputeFaceMask
+};
+
+cbuffer CubeShadowConstantBuffer : register(b2)
+{
+  float4x4 face_view_projs[6];  // +x, -x, +y, -y, +z, -z
+};
+
+struct GSInput
+{
+  float4 world_pos : POSITION;
+};
+
+struct GSOutput
+{
+  float4 pos : SV_POSITION;
+  uint face : SV_RenderTargetArrayIndex;
+};
+
+[maxvertexcount(18)]
+void main(
+  triangle GSInput input[3],
+  inout TriangleStream< GSOutput > output_stream
+)
+{
+  for (uint face = 0; face < 6; ++face) {
+    if ((face_mask & (1u << face)) == 0) {
+      continue;
+    }
+
+    GSOutput gs_output[3];
+    for (uint i = 0; i < 3; ++i) {
+      gs_output[i].pos = mul(input[i].world_pos, face_view_projs[face]);
+      gs_output[i].face = face;
+    }
+
+    // Skip the face if all three vertices are outside the same side of its frustum.
+    float4 p0 = gs_output[0].pos;
+    float4 p1 = gs_output[1].pos;
+    float4 p2 = gs_output[2].pos;
+    if ((p0.x > p0.w && p1.x > p1.w && p2.x > p2.w) || (p0.x < -p0.w && p1.x < -p1.w && p2.x < -p2.w) ||
+        (p0.y > p0.w && p1.y > p1.w && p2.y > p2.w) || (p0.y < -p0.w && p1.y < -p1.w && p2.y < -p2.w)) {
+      continue;
+    }
+
+    output_stream.Append(gs_output[0]);
+    output_stream.Append(gs_output[1]);
+    output_stream.Append(gs_output[2]);
+    output_stream.RestartStrip();
+  }
+}
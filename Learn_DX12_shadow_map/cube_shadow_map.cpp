@@ -0,0 +1,97 @@
+#include "cube_shadow_map.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr UINT CubeShadowMap::kFaceNumber;
+constexpr UINT CubeShadowMap::kAllFacesMask;
+
+namespace {
+
+// Axis (0: x, 1: y, 2: z) and sign each face looks along, and its up.
+struct Face {
+  int axis;
+  float sign;
+  XMFLOAT3 up;
+};  // struct Face
+
+const Face kFaces[CubeShadowMap::kFaceNumber] = {
+  {0, 1.0f, XMFLOAT3(0.0f, 1.0f, 0.0f)},
+  {0, -1.0f, XMFLOAT3(0.0f, 1.0f, 0.0f)},
+  {1, 1.0f, XMFLOAT3(0.0f, 0.0f, -1.0f)},
+  {1, -1.0f, XMFLOAT3(0.0f, 0.0f, 1.0f)},
+  {2, 1.0f, XMFLOAT3(0.0f, 1.0f, 0.0f)},
+  {2, -1.0f, XMFLOAT3(0.0f, 1.0f, 0.0f)},
+};
+
+}  // namespace
+
+XMMATRIX CubeShadowMap::ComputeFaceView(FXMVECTOR light_position, UINT face)
+{
+  float direction[3] = { 0.0f, 0.0f, 0.0f };
+  direction[kFaces[face].axis] = kFaces[face].sign;
+  return XMMatrixLookToLH(light_position, XMVectorSet(direction[0], direction[1], direction[2], 0.0f), XMLoadFloat3(&kFaces[face].up));
+}
+
+XMMATRIX CubeShadowMap::ComputeFaceProj(float near_plane, float far_plane)
+{
+  return XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, near_plane, far_plane);
+}
+
+XMFLOAT2 CubeShadowMap::ComputeDepthParams(float near_plane, float far_plane)
+{
+  const float scale = far_plane / (far_plane - near_plane);
+  return XMFLOAT2(scale, -near_plane * scale);
+}
+
+UINT CubeShadowMap::ComputeFaceMask(FXMVECTOR light_position, const BoundingBox& bounding_box, float near_plane, float far_plane)
+{
+  XMFLOAT3 light;
+  XMStoreFloat3(&light, light_position);
+  const float box_min[3] = { bounding_box.min.x - light.x, bounding_box.min.y - light.y, bounding_box.min.z - light.z };
+  const float box_max[3] = { bounding_box.max.x - light.x, bounding_box.max.y - light.y, bounding_box.max.z - light.z };
+  if (box_min[0] > box_max[0] || box_min[1] > box_max[1] || box_min[2] > box_max[2]) {
+    return 0;
+  }
+
+  UINT face_mask = 0;
+  for (UINT face = 0; face < kFaceNumber; ++face) {
+    const int axis = kFaces[face].axis;
+    // Depth along the face's axis, over the box.
+    const float depth_min = kFaces[face].sign > 0.0f ? box_min[axis] : -box_max[axis];
+    const float depth_max = kFaces[face].sign > 0.0f ? box_max[axis] : -box_min[axis];
+    if (depth_max < near_plane || depth_min > far_plane) {
+      continue;
+    }
+
+    // The frustum's side planes go through the light: depth >= |p| on both other axes. The box is outside
+    // one of them if even its deepest point is nearer than its closest extent on that axis.
+    bool outside = false;
+    for (int other = 0; other < 3 && !outside; ++other) {
+      if (other != axis) {
+        outside = depth_max < box_min[other] || depth_max < -box_max[other];
+      }
+    }
+    if (!outside) {
+      face_mask |= 1u << face;
+    }
+  }
+  return face_mask;
+}
+
+CubeShadowMap::DrawStats CubeShadowMap::ComputeFaceMasks(FXMVECTOR light_position, const BoundingBox* object_bounds, size_t object_number, float near_plane,
+                                                         float far_plane, UINT* face_masks)
+{
+  DrawStats stats{};
+  for (size_t i = 0; i < object_number; ++i) {
+    face_masks[i] = ComputeFaceMask(light_position, object_bounds[i], near_plane, far_plane);
+    for (UINT face_mask = face_masks[i]; face_mask != 0; face_mask &= face_mask - 1) {
+      stats.face_draw_number++;
+    }
+    if (face_masks[i] != 0) {
+      stats.draw_number++;
+    }
+  }
+  stats.naive_draw_number = static_cast<UINT>(object_number * kFaceNumber);
+  return stats;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common_headers.h"
+#include "model.h"
+
+using namespace DirectX;
+
+// Omnidirectional shadows for the point light: the six 90 degree faces of a depth cube map, all rendered in
+// one pass. The geometry shader sends each triangle to the faces (SV_RenderTargetArrayIndex) whose bit is
+// set in its object's face mask, and the masks come from culling the objects' world boxes against each
+// face's frustum here on the CPU. Only DirectXMath is used, so it runs without a device.
+class CubeShadowMap {
+ public:
+  using BoundingBox = Asset::Model::BoundingBox;
+
+  // Faces are in TextureCube order: +x, -x, +y, -y, +z, -z.
+  static constexpr UINT kFaceNumber = 6;
+  static constexpr UINT kAllFacesMask = (1u << kFaceNumber) - 1;
+
+  struct DrawStats {
+    UINT draw_number;  // one per object reaching at least one face
+    UINT face_draw_number;  // object and face pairs, i.e. what six separate passes would have drawn after culling
+    UINT naive_draw_number;  // six passes drawing every object
+  };  // struct DrawStats
+
+  // World to face view space (LH, not transposed), with the ups TextureCube sampling expects.
+  static XMMATRIX ComputeFaceView(FXMVECTOR light_position, UINT face);
+
+  // The square 90 degree projection shared by all faces.
+  static XMMATRIX ComputeFaceProj(float near_plane, float far_plane);
+
+  // x and y such that the depth stored for a point at view_depth along its face's axis is x + y / view_depth.
+  static XMFLOAT2 ComputeDepthParams(float near_plane, float far_plane);
+
+  // Bit i is set if the box may overlap the frustum of face i. Conservative: a box near a frustum's corner can
+  // get a bit it doesn't need, never lose one it does.
+  static UINT ComputeFaceMask(FXMVECTOR light_position, const BoundingBox& bounding_box, float near_plane, float far_plane);
+
+  // Writes a face mask per object and returns what the single pass draws, against six naive passes.
+  static DrawStats ComputeFaceMasks(FXMVECTOR light_position, const BoundingBox* object_bounds, size_t object_number, float near_plane, float far_plane,
+                                    UINT* face_masks);
+};  // class CubeShadowMap
@@ -0,0 +1,10 @@
+cbuffer SceneConstantBuffer : register(b0)
+{
+  float4x4 model;
+};
+
+// World space; the geometry shader projects it once per cube face.
+float4 main(float3 pos : POSITION) : POSITION
+{
+  return mul(float4(pos, 1.0f), model);
+}
@@ -0,0 +1,609 @@
+#include "dds_texture.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "portable_image_decoder.h"
+
+namespace {
+
+const uint32_t kDdsMagic = 0x20534444;  // "DDS "
+
+// DDS_PIXELFORMAT::flags
+const uint32_t kDdpfAlphaPixels = 0x1;
+const uint32_t kDdpfAlpha = 0x2;
+const uint32_t kDdpfFourCC = 0x4;
+const uint32_t kDdpfRgb = 0x40;
+const uint32_t kDdpfLuminance = 0x20000;
+
+// DDS_HEADER::flags and caps2
+const uint32_t kDdsdDepth = 0x800000;
+const uint32_t kDdsCaps2CubeMap = 0x200;
+const uint32_t kDdsCaps2CubeMapAllFaces = 0xFC00;
+const uint32_t kDdsCaps2Volume = 0x200000;
+
+// DDS_HEADER_DXT10::misc_flag
+const uint32_t kDdsResourceMiscTextureCube = 0x4;
+
+struct DdsPixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t rgb_bit_count;
+  uint32_t r_bit_mask;
+  uint32_t g_bit_mask;
+  uint32_t b_bit_mask;
+  uint32_t a_bit_mask;
+};  // struct DdsPixelFormat
+
+struct DdsHeader {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitch_or_linear_size;
+  uint32_t depth;
+  uint32_t mip_map_count;
+  uint32_t reserved1[11];
+  DdsPixelFormat pixel_format;
+  uint32_t caps;
+  uint32_t caps2;
+  uint32_t caps3;
+  uint32_t caps4;
+  uint32_t reserved2;
+};  // struct DdsHeader
+
+struct DdsHeaderDxt10 {
+  uint32_t dxgi_format;
+  uint32_t resource_dimension;  // same values as D3D12_RESOURCE_DIMENSION
+  uint32_t misc_flag;
+  uint32_t array_size;
+  uint32_t misc_flags2;
+};  // struct DdsHeaderDxt10
+
+constexpr uint32_t MakeFourCC(char c0, char c1, char c2, char c3)
+{
+  return static_cast<uint32_t>(static_cast<uint8_t>(c0)) | (static_cast<uint32_t>(static_cast<uint8_t>(c1)) << 8) |
+    (static_cast<uint32_t>(static_cast<uint8_t>(c2)) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(c3)) << 24);
+}
+
+bool HasBitMasks(const DdsPixelFormat& pixel_format, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+  return pixel_format.r_bit_mask == r && pixel_format.g_bit_mask == g && pixel_format.b_bit_mask == b && pixel_format.a_bit_mask == a;
+}
+
+// Maps a header without the DX10 extension to its DXGI format, the way D3DX and texconv write them.
+DXGI_FORMAT GetLegacyFormat(const DdsPixelFormat& pixel_format)
+{
+  if (pixel_format.flags & kDdpfFourCC) {
+    switch (pixel_format.four_cc) {
+    case MakeFourCC('D', 'X', 'T', '1'):
+      return DXGI_FORMAT_BC1_UNORM;
+    case MakeFourCC('D', 'X', 'T', '2'):
+    case MakeFourCC('D', 'X', 'T', '3'):
+      return DXGI_FORMAT_BC2_UNORM;
+    case MakeFourCC('D', 'X', 'T', '4'):
+    case MakeFourCC('D', 'X', 'T', '5'):
+      return DXGI_FORMAT_BC3_UNORM;
+    case MakeFourCC('A', 'T', 'I', '1'):
+    case MakeFourCC('B', 'C', '4', 'U'):
+      return DXGI_FORMAT_BC4_UNORM;
+    case MakeFourCC('B', 'C', '4', 'S'):
+      return DXGI_FORMAT_BC4_SNORM;
+    case MakeFourCC('A', 'T', 'I', '2'):
+    case MakeFourCC('B', 'C', '5', 'U'):
+      return DXGI_FORMAT_BC5_UNORM;
+    case MakeFourCC('B', 'C', '5', 'S'):
+      return DXGI_FORMAT_BC5_SNORM;
+    // D3DFORMAT values stored as FourCC.
+    case 36:
+      return DXGI_FORMAT_R16G16B16A16_UNORM;
+    case 110:
+      return DXGI_FORMAT_R16G16B16A16_SNORM;
+    case 111:
+      return DXGI_FORMAT_R16_FLOAT;
+    case 112:
+      return DXGI_FORMAT_R16G16_FLOAT;
+    case 113:
+      return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    case 114:
+      return DXGI_FORMAT_R32_FLOAT;
+    case 115:
+      return DXGI_FORMAT_R32G32_FLOAT;
+    case 116:
+      return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    default:
+      return DXGI_FORMAT_UNKNOWN;
+    }
+  }
+
+  if (pixel_format.flags & kDdpfRgb) {
+    switch (pixel_format.rgb_bit_count) {
+    case 32:
+      if (HasBitMasks(pixel_format, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000)) {
+        return DXGI_FORMAT_R8G8B8A8_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000)) {
+        return DXGI_FORMAT_B8G8R8A8_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0x00FF0000, 0x0000FF00, 0x000000FF, 0)) {
+        return DXGI_FORMAT_B8G8R8X8_UNORM;
+      }
+      // D3DX writes R10G10B10A2 with the red and blue masks swapped.
+      if (HasBitMasks(pixel_format, 0x3FF00000, 0x000FFC00, 0x000003FF, 0xC0000000)) {
+        return DXGI_FORMAT_R10G10B10A2_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0x0000FFFF, 0xFFFF0000, 0, 0)) {
+        return DXGI_FORMAT_R16G16_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0xFFFFFFFF, 0, 0, 0)) {
+        return DXGI_FORMAT_R32_FLOAT;
+      }
+      return DXGI_FORMAT_UNKNOWN;
+    case 16:
+      if (HasBitMasks(pixel_format, 0xF800, 0x07E0, 0x001F, 0)) {
+        return DXGI_FORMAT_B5G6R5_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0x7C00, 0x03E0, 0x001F, 0x8000)) {
+        return DXGI_FORMAT_B5G5R5A1_UNORM;
+      }
+      if (HasBitMasks(pixel_format, 0x0F00, 0x00F0, 0x000F, 0xF000)) {
+        return DXGI_FORMAT_B4G4R4A4_UNORM;
+      }
+      return DXGI_FORMAT_UNKNOWN;
+    default:
+      return DXGI_FORMAT_UNKNOWN;
+    }
+  }
+
+  if (pixel_format.flags & kDdpfLuminance) {
+    if (pixel_format.rgb_bit_count == 8 && pixel_format.r_bit_mask == 0xFF) {
+      return DXGI_FORMAT_R8_UNORM;
+    }
+    if (pixel_format.rgb_bit_count == 16 && HasBitMasks(pixel_format, 0xFFFF, 0, 0, 0)) {
+      return DXGI_FORMAT_R16_UNORM;
+    }
+    if (pixel_format.rgb_bit_count == 16 && (pixel_format.flags & kDdpfAlphaPixels) && HasBitMasks(pixel_format, 0x00FF, 0, 0, 0xFF00)) {
+      return DXGI_FORMAT_R8G8_UNORM;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+  }
+
+  if ((pixel_format.flags & kDdpfAlpha) && pixel_format.rgb_bit_count == 8) {
+    return DXGI_FORMAT_A8_UNORM;
+  }
+
+  return DXGI_FORMAT_UNKNOWN;
+}
+
+// Bytes per 4x4 block for BC formats, 0 for everything else.
+UINT GetBlockSize(DXGI_FORMAT format)
+{
+  switch (format) {
+  case DXGI_FORMAT_BC1_TYPELESS:
+  case DXGI_FORMAT_BC1_UNORM:
+  case DXGI_FORMAT_BC1_UNORM_SRGB:
+  case DXGI_FORMAT_BC4_TYPELESS:
+  case DXGI_FORMAT_BC4_UNORM:
+  case DXGI_FORMAT_BC4_SNORM:
+    return 8;
+  case DXGI_FORMAT_BC2_TYPELESS:
+  case DXGI_FORMAT_BC2_UNORM:
+  case DXGI_FORMAT_BC2_UNORM_SRGB:
+  case DXGI_FORMAT_BC3_TYPELESS:
+  case DXGI_FORMAT_BC3_UNORM:
+  case DXGI_FORMAT_BC3_UNORM_SRGB:
+  case DXGI_FORMAT_BC5_TYPELESS:
+  case DXGI_FORMAT_BC5_UNORM:
+  case DXGI_FORMAT_BC5_SNORM:
+  case DXGI_FORMAT_BC6H_TYPELESS:
+  case DXGI_FORMAT_BC6H_UF16:
+  case DXGI_FORMAT_BC6H_SF16:
+  case DXGI_FORMAT_BC7_TYPELESS:
+  case DXGI_FORMAT_BC7_UNORM:
+  case DXGI_FORMAT_BC7_UNORM_SRGB:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+// Bytes per texel, 0 for BC formats and for the packed, planar and video formats we don't load.
+UINT GetTexelSize(DXGI_FORMAT format)
+{
+  switch (format) {
+  case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+  case DXGI_FORMAT_R32G32B32A32_FLOAT:
+  case DXGI_FORMAT_R32G32B32A32_UINT:
+  case DXGI_FORMAT_R32G32B32A32_SINT:
+    return 16;
+  case DXGI_FORMAT_R32G32B32_TYPELESS:
+  case DXGI_FORMAT_R32G32B32_FLOAT:
+  case DXGI_FORMAT_R32G32B32_UINT:
+  case DXGI_FORMAT_R32G32B32_SINT:
+    return 12;
+  case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+  case DXGI_FORMAT_R16G16B16A16_FLOAT:
+  case DXGI_FORMAT_R16G16B16A16_UNORM:
+  case DXGI_FORMAT_R16G16B16A16_UINT:
+  case DXGI_FORMAT_R16G16B16A16_SNORM:
+  case DXGI_FORMAT_R16G16B16A16_SINT:
+  case DXGI_FORMAT_R32G32_TYPELESS:
+  case DXGI_FORMAT_R32G32_FLOAT:
+  case DXGI_FORMAT_R32G32_UINT:
+  case DXGI_FORMAT_R32G32_SINT:
+    return 8;
+  case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+  case DXGI_FORMAT_R10G10B10A2_UNORM:
+  case DXGI_FORMAT_R10G10B10A2_UINT:
+  case DXGI_FORMAT_R11G11B10_FLOAT:
+  case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+  case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+  case DXGI_FORMAT_R8G8B8A8_UINT:
+  case DXGI_FORMAT_R8G8B8A8_SNORM:
+  case DXGI_FORMAT_R8G8B8A8_SINT:
+  case DXGI_FORMAT_R16G16_TYPELESS:
+  case DXGI_FORMAT_R16G16_FLOAT:
+  case DXGI_FORMAT_R16G16_UNORM:
+  case DXGI_FORMAT_R16G16_UINT:
+  case DXGI_FORMAT_R16G16_SNORM:
+  case DXGI_FORMAT_R16G16_SINT:
+  case DXGI_FORMAT_R32_TYPELESS:
+  case DXGI_FORMAT_D32_FLOAT:
+  case DXGI_FORMAT_R32_FLOAT:
+  case DXGI_FORMAT_R32_UINT:
+  case DXGI_FORMAT_R32_SINT:
+  case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+  case DXGI_FORMAT_B8G8R8X8_UNORM:
+  case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+  case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+  case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+  case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+  case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+    return 4;
+  case DXGI_FORMAT_R8G8_TYPELESS:
+  case DXGI_FORMAT_R8G8_UNORM:
+  case DXGI_FORMAT_R8G8_UINT:
+  case DXGI_FORMAT_R8G8_SNORM:
+  case DXGI_FORMAT_R8G8_SINT:
+  case DXGI_FORMAT_R16_TYPELESS:
+  case DXGI_FORMAT_R16_FLOAT:
+  case DXGI_FORMAT_D16_UNORM:
+  case DXGI_FORMAT_R16_UNORM:
+  case DXGI_FORMAT_R16_UINT:
+  case DXGI_FORMAT_R16_SNORM:
+  case DXGI_FORMAT_R16_SINT:
+  case DXGI_FORMAT_B5G6R5_UNORM:
+  case DXGI_FORMAT_B5G5R5A1_UNORM:
+  case DXGI_FORMAT_B4G4R4A4_UNORM:
+    return 2;
+  case DXGI_FORMAT_R8_TYPELESS:
+  case DXGI_FORMAT_R8_UNORM:
+  case DXGI_FORMAT_R8_UINT:
+  case DXGI_FORMAT_R8_SNORM:
+  case DXGI_FORMAT_R8_SINT:
+  case DXGI_FORMAT_A8_UNORM:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+UINT64 AlignUp(UINT64 size, UINT64 alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+DdsTexture::BenchmarkReport DdsTexture::BenchmarkIngestion(const std::vector<std::wstring>& dds_file_names, const std::vector<std::wstring>& image_file_names,
+                                                           UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (iteration_number == 0) {
+    return report;
+  }
+
+  // Checked once, so a texture either file of which can't be read is left out of both sides.
+  std::vector<size_t> texture_indices;
+  std::vector<uint8_t> upload_heap;
+  for (size_t i = 0; i < std::min(dds_file_names.size(), image_file_names.size()); ++i) {
+    DdsTexture texture;
+    MappedFile image_file;
+    if (!texture.Load(dds_file_names[i]) || !image_file.Open(image_file_names[i])) {
+      continue;
+    }
+    D3D12_RESOURCE_DESC texture_desc{};
+    int bytes_per_row = 0;
+    if (PortableImageDecoder::DecodeMemory(image_file.GetData(), image_file.GetSize(), texture_desc, bytes_per_row,
+      [&upload_heap](const D3D12_RESOURCE_DESC& decoded_desc, UINT& row_pitch) -> uint8_t* {
+        upload_heap.resize(static_cast<size_t>(row_pitch) * decoded_desc.Height);
+        return upload_heap.data();
+      }) != 0) {
+      texture_indices.push_back(i);
+    }
+  }
+  report.texture_number = texture_indices.size();
+  if (texture_indices.empty()) {
+    return report;
+  }
+
+  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT iteration = 0; iteration < iteration_number; ++iteration) {
+    report.dds_file_size = 0;
+    report.dds_upload_size = 0;
+    for (size_t i : texture_indices) {
+      DdsTexture texture;
+      if (!texture.Load(dds_file_names[i])) {
+        continue;
+      }
+      footprints.resize(texture.GetSubresourceNumber());
+      UINT64 upload_heap_size = 0;
+      for (UINT j = 0; j < texture.GetSubresourceNumber(); ++j) {
+        const Subresource& subresource = texture.GetSubresource(j);
+        footprints[j].Offset = AlignUp(upload_heap_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+        footprints[j].Footprint.RowPitch = static_cast<UINT>(AlignUp(subresource.row_pitch, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+        upload_heap_size = footprints[j].Offset + static_cast<UINT64>(footprints[j].Footprint.RowPitch) * subresource.row_number * subresource.depth;
+      }
+      if (upload_heap.size() < upload_heap_size) {
+        upload_heap.resize(static_cast<size_t>(upload_heap_size));
+      }
+      texture.CopySubresources(footprints.data(), upload_heap.data());
+      report.dds_file_size += texture.file_.GetSize();
+      report.dds_upload_size += upload_heap_size;
+    }
+  }
+  report.dds_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT iteration = 0; iteration < iteration_number; ++iteration) {
+    report.image_file_size = 0;
+    report.image_upload_size = 0;
+    for (size_t i : texture_indices) {
+      MappedFile image_file;
+      if (!image_file.Open(image_file_names[i])) {
+        continue;
+      }
+      D3D12_RESOURCE_DESC texture_desc{};
+      int bytes_per_row = 0;
+      PortableImageDecoder::DecodeMemory(image_file.GetData(), image_file.GetSize(), texture_desc, bytes_per_row,
+        [&upload_heap, &report](const D3D12_RESOURCE_DESC& decoded_desc, UINT& row_pitch) -> uint8_t* {
+          // row_pitch comes in as the decoded row size.
+          row_pitch = static_cast<UINT>(AlignUp(row_pitch, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT));
+          const UINT64 upload_heap_size = static_cast<UINT64>(row_pitch) * decoded_desc.Height;
+          if (upload_heap.size() < upload_heap_size) {
+            upload_heap.resize(static_cast<size_t>(upload_heap_size));
+          }
+          report.image_upload_size += upload_heap_size;
+          return upload_heap.data();
+        });
+      report.image_file_size += image_file.GetSize();
+    }
+  }
+  report.image_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+  return report;
+}
+
+bool DdsTexture::Load(const std::wstring& file_name)
+{
+  texel_data_ = nullptr;
+  texture_desc_ = {};
+  cube_map_ = false;
+  subresources_.clear();
+
+  if (!file_.Open(file_name)) {
+    return false;
+  }
+  if (!ReadHeader() || !LayOutSubresources()) {
+    file_.Close();
+    return false;
+  }
+  return true;
+}
+
+void DdsTexture::CopySubresources(const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, uint8_t* destination) const
+{
+  for (size_t i = 0; i < subresources_.size(); ++i) {
+    const Subresource& subresource = subresources_[i];
+    const UINT destination_row_pitch = footprints[i].Footprint.RowPitch;
+    uint8_t* destination_subresource = destination + footprints[i].Offset;
+    if (destination_row_pitch == subresource.row_pitch) {
+      std::memcpy(destination_subresource, subresource.data, static_cast<size_t>(subresource.slice_pitch) * subresource.depth);
+      continue;
+    }
+
+    const size_t destination_slice_pitch = static_cast<size_t>(destination_row_pitch) * subresource.row_number;
+    for (UINT z = 0; z < subresource.depth; ++z) {
+      const uint8_t* source_row = subresource.data + static_cast<size_t>(subresource.slice_pitch) * z;
+      uint8_t* destination_row = destination_subresource + destination_slice_pitch * z;
+      for (UINT row = 0; row < subresource.row_number; ++row) {
+        std::memcpy(destination_row, source_row, subresource.row_pitch);
+        source_row += subresource.row_pitch;
+        destination_row += destination_row_pitch;
+      }
+    }
+  }
+}
+
+bool DdsTexture::IsDdsFileName(const std::string& file_name)
+{
+  const char extension[] = ".dds";
+  const size_t extension_length = sizeof(extension) - 1;
+  if (file_name.size() < extension_length) {
+    return false;
+  }
+  return std::equal(extension, extension + extension_length, file_name.end() - extension_length,
+    [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+bool DdsTexture::ReadHeader()
+{
+  const uint8_t* data = file_.GetData();
+  const size_t size = file_.GetSize();
+  if (size < sizeof(uint32_t) + sizeof(DdsHeader)) {
+    return false;
+  }
+
+  uint32_t magic = 0;
+  std::memcpy(&magic, data, sizeof(magic));
+  DdsHeader header;
+  std::memcpy(&header, data + sizeof(magic), sizeof(header));
+  if (magic != kDdsMagic || header.size != sizeof(DdsHeader) || header.pixel_format.size != sizeof(DdsPixelFormat)) {
+    return false;
+  }
+  size_t header_size = sizeof(magic) + sizeof(header);
+
+  texture_desc_.Width = header.width;
+  texture_desc_.Height = header.height;
+  texture_desc_.MipLevels = static_cast<UINT16>(std::min<uint32_t>(std::max<uint32_t>(header.mip_map_count, 1), UINT16_MAX));
+  texture_desc_.SampleDesc.Count = 1;
+  texture_desc_.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+  texture_desc_.Flags = D3D12_RESOURCE_FLAG_NONE;
+  UINT depth = 1;
+  UINT array_size = 1;
+
+  if ((header.pixel_format.flags & kDdpfFourCC) && header.pixel_format.four_cc == MakeFourCC('D', 'X', '1', '0')) {
+    if (size < header_size + sizeof(DdsHeaderDxt10)) {
+      return false;
+    }
+    DdsHeaderDxt10 header_dxt10;
+    std::memcpy(&header_dxt10, data + header_size, sizeof(header_dxt10));
+    header_size += sizeof(header_dxt10);
+
+    texture_desc_.Format = static_cast<DXGI_FORMAT>(header_dxt10.dxgi_format);
+    array_size = header_dxt10.array_size;
+    switch (header_dxt10.resource_dimension) {
+    case D3D12_RESOURCE_DIMENSION_TEXTURE1D:
+      texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE1D;
+      texture_desc_.Height = 1;
+      break;
+    case D3D12_RESOURCE_DIMENSION_TEXTURE2D:
+      texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+      if (header_dxt10.misc_flag & kDdsResourceMiscTextureCube) {
+        // array_size counts cubes; six times a huge count would wrap around to a small one.
+        if (array_size > UINT32_MAX / 6) {
+          return false;
+        }
+        cube_map_ = true;
+        array_size *= 6;
+      }
+      break;
+    case D3D12_RESOURCE_DIMENSION_TEXTURE3D:
+      if (array_size != 1 || !(header.flags & kDdsdDepth)) {
+        return false;
+      }
+      texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+      depth = header.depth;
+      break;
+    default:
+      return false;
+    }
+  } else {
+    texture_desc_.Format = GetLegacyFormat(header.pixel_format);
+    if ((header.flags & kDdsdDepth) && (header.caps2 & kDdsCaps2Volume)) {
+      texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+      depth = header.depth;
+    } else {
+      texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+      if (header.caps2 & kDdsCaps2CubeMap) {
+        // D3D10 and later have no partial cube maps.
+        if ((header.caps2 & kDdsCaps2CubeMapAllFaces) != kDdsCaps2CubeMapAllFaces) {
+          return false;
+        }
+        cube_map_ = true;
+        array_size = 6;
+      }
+    }
+  }
+
+  if (GetBlockSize(texture_desc_.Format) == 0 && GetTexelSize(texture_desc_.Format) == 0) {
+    return false;
+  }
+
+  // The same limits CreateCommittedResource enforces, checked here so a bad file can't send us past the end.
+  switch (texture_desc_.Dimension) {
+  case D3D12_RESOURCE_DIMENSION_TEXTURE1D:
+    if (texture_desc_.Width > D3D12_REQ_TEXTURE1D_U_DIMENSION || array_size > D3D12_REQ_TEXTURE1D_ARRAY_AXIS_DIMENSION) {
+      return false;
+    }
+    break;
+  case D3D12_RESOURCE_DIMENSION_TEXTURE2D:
+    if (texture_desc_.Width > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION || texture_desc_.Height > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+        array_size > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION || (cube_map_ && texture_desc_.Width != texture_desc_.Height)) {
+      return false;
+    }
+    break;
+  default:
+    if (texture_desc_.Width > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION || texture_desc_.Height > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION ||
+        depth > D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION) {
+      return false;
+    }
+    break;
+  }
+  if (texture_desc_.Width == 0 || texture_desc_.Height == 0 || depth == 0 || array_size == 0) {
+    return false;
+  }
+
+  // A full chain ends at 1x1x1; anything longer is a broken file.
+  const UINT largest_dimension = std::max(std::max(static_cast<UINT>(texture_desc_.Width), texture_desc_.Height), depth);
+  UINT full_mip_level_number = 1;
+  while ((largest_dimension >> full_mip_level_number) != 0) {
+    ++full_mip_level_number;
+  }
+  if (texture_desc_.MipLevels > full_mip_level_number) {
+    return false;
+  }
+
+  texture_desc_.DepthOrArraySize = static_cast<UINT16>(texture_desc_.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? depth : array_size);
+  texel_data_ = data + header_size;
+  return true;
+}
+
+bool DdsTexture::LayOutSubresources()
+{
+  const UINT block_size = GetBlockSize(texture_desc_.Format);
+  const UINT texel_size = GetTexelSize(texture_desc_.Format);
+  const bool volume = texture_desc_.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+  const UINT array_size = volume ? 1 : texture_desc_.DepthOrArraySize;
+  const UINT top_depth = volume ? texture_desc_.DepthOrArraySize : 1;
+
+  const uint8_t* file_end = file_.GetData() + file_.GetSize();
+  const uint8_t* data = texel_data_;
+  subresources_.reserve(static_cast<size_t>(array_size) * texture_desc_.MipLevels);
+  for (UINT item = 0; item < array_size; ++item) {
+    UINT width = static_cast<UINT>(texture_desc_.Width);
+    UINT height = texture_desc_.Height;
+    UINT depth = top_depth;
+    for (UINT level = 0; level < texture_desc_.MipLevels; ++level) {
+      Subresource subresource;
+      subresource.data = data;
+      if (block_size != 0) {
+        subresource.row_pitch = std::max(1u, (width + 3) / 4) * block_size;
+        subresource.row_number = std::max(1u, (height + 3) / 4);
+      } else {
+        subresource.row_pitch = width * texel_size;
+        subresource.row_number = height;
+      }
+      subresource.slice_pitch = static_cast<UINT64>(subresource.row_pitch) * subresource.row_number;
+      subresource.depth = depth;
+
+      const UINT64 subresource_size = subresource.slice_pitch * depth;
+      if (subresource_size > static_cast<UINT64>(file_end - data)) {
+        return false;
+      }
+      data += subresource_size;
+      subresources_.push_back(subresource);
+
+      width = std::max(1u, width / 2);
+      height = std::max(1u, height / 2);
+      depth = std::max(1u, depth / 2);
+    }
+  }
+  return true;
+}
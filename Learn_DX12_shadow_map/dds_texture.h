@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common_headers.h"
+#include "mapped_file.h"
+
+// A DDS file mapped into memory, ready to be uploaded without decoding. Reads the legacy header and the
+// DX10 extension: 1D, 2D and 3D textures, arrays, cube maps, mip chains and any format with a fixed
+// size per texel or per 4x4 block (BC1-BC7 included). Subresources are kept in the file's order, which is
+// D3D12's subresource order (array slice major, mip level minor), so index i matches footprint i from
+// GetCopyableFootprints.
+class DdsTexture {
+ public:
+  // Where one subresource's texels live in the mapped file. Rows are rows of blocks for BC formats.
+  struct Subresource {
+    const uint8_t* data = nullptr;
+    UINT row_pitch = 0;
+    UINT row_number = 0;
+    UINT64 slice_pitch = 0;
+    UINT depth = 0;
+  };  // struct Subresource
+
+  struct BenchmarkReport {
+    size_t texture_number;  // pairs where both files could be read, the others are left out
+    double dds_milliseconds;  // per pass over the texture set
+    double image_milliseconds;
+    UINT64 dds_file_size;
+    UINT64 image_file_size;
+    UINT64 dds_upload_size;  // every subresource, laid out as GetCopyableFootprints would
+    UINT64 image_upload_size;  // the decoded top level only, see below
+  };  // struct BenchmarkReport
+
+  // Ingests each texture of a set iteration_number times from dds_file_names and from image_file_names (the
+  // same textures in any format PortableImageDecoder reads, e.g. JPEG): mapping the file, then copying
+  // (DDS) or decoding (image) it into a buffer standing in for the upload heap. The images get no mip chain
+  // or block compression, which the DDS files usually already have, so their times are a lower bound.
+  static BenchmarkReport BenchmarkIngestion(const std::vector<std::wstring>& dds_file_names, const std::vector<std::wstring>& image_file_names,
+                                            UINT iteration_number);
+
+  // Returns false if the file can't be mapped or isn't a DDS texture D3D12 can create.
+  bool Load(const std::wstring& file_name);
+
+  bool IsCubeMap() const {
+    return cube_map_;
+  }
+
+  const D3D12_RESOURCE_DESC& GetTextureDesc() const {
+    return texture_desc_;
+  }
+
+  UINT GetSubresourceNumber() const {
+    return static_cast<UINT>(subresources_.size());
+  }
+
+  const Subresource& GetSubresource(UINT subresource_index) const {
+    return subresources_[subresource_index];
+  }
+
+  // Copies every subresource into destination, laid out by footprints (one per subresource, e.g. from
+  // GetCopyableFootprints on GetTextureDesc()). Rows are copied in one go when the pitches already match.
+  void CopySubresources(const D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints, uint8_t* destination) const;
+
+  // True for names ending in ".dds", in any case.
+  static bool IsDdsFileName(const std::string& file_name);
+
+ private:
+  bool ReadHeader();
+  bool LayOutSubresources();
+
+  MappedFile file_;
+  const uint8_t* texel_data_ = nullptr;  // just past the headers
+  D3D12_RESOURCE_DESC texture_desc_{};
+  bool cube_map_ = false;
+  std::vector<Subresource> subresources_;
+};  // class DdsTexture
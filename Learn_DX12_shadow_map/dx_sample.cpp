@@ -24,7 +24,27 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
   m_title(name),
   m_aspectRatio(0.0f),
   m_useWarpDevice(false),
-  m_enableUI(true)
+  m_enableUI(true),
+  m_shadowAtlasBenchmarkLightNumber(0),
+  m_cullBenchmarkObjectNumber(0),
+  m_bvhBenchmarkObjectNumber(0),
+  m_occlusionBenchmarkObjectNumber(0),
+  m_instancingBenchmarkObjectNumber(0),
+  m_indirectBenchmarkRecordNumber(0),
+  m_recordingThreadNumber(0),
+  m_recordingBenchmarkDrawNumber(0),
+  m_constantRingBenchmarkAllocationNumber(0),
+  m_drawTableBenchmarkModelNumber(0),
+  m_mergeBenchmarkMeshNumber(0),
+  m_vertexStreamBenchmarkVertexNumber(0),
+  m_meshCacheBenchmarkMeshNumber(0),
+  m_mipBenchmarkSize(0),
+  m_bcBenchmarkSize(0),
+  m_csmBenchmarkObjectNumber(0),
+  m_softwareRasterizerFrameNumber(0),
+  m_shadowQualityReport(false),
+  m_selfTest(false),
+  m_frameStats(false)
 {
   WCHAR assetsPath[512];
   GetAssetsPath(assetsPath, _countof(assetsPath));
@@ -141,6 +161,156 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
     {
       m_enableUI = false;
     }
+    else if (_wcsnicmp(argv[i], L"-selfTest", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/selfTest", wcslen(argv[i])) == 0)
+    {
+      m_selfTest = true;
+    }
+    else if (_wcsnicmp(argv[i], L"-frameStats", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/frameStats", wcslen(argv[i])) == 0)
+    {
+      m_frameStats = true;
+    }
+    else if ((_wcsnicmp(argv[i], L"-meshCache", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/meshCache", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_meshCacheFileName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-cookMeshCache", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/cookMeshCache", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_cookMeshCacheFileName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-shadowQuality", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowQuality", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_shadowQualityName = argv[++i];
+    }
+    else if (_wcsnicmp(argv[i], L"-shadowQualityReport", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowQualityReport", wcslen(argv[i])) == 0)
+    {
+      m_shadowQualityReport = true;
+    }
+    else if ((_wcsnicmp(argv[i], L"-shadowFilter", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowFilter", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_shadowFilterName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-shadowFilterReport", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowFilterReport", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_shadowFilterReportFileName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-vertexStreams", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/vertexStreams", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_vertexStreamLayoutName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-shadowCache", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowCache", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_shadowCacheModeName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-shadowAtlasBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/shadowAtlasBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_shadowAtlasBenchmarkLightNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-cullBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/cullBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_cullBenchmarkObjectNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-bvhBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/bvhBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_bvhBenchmarkObjectNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-occlusionBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/occlusionBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_occlusionBenchmarkObjectNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-instancingBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/instancingBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_instancingBenchmarkObjectNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-indirectDraws", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/indirectDraws", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_indirectDrawModeName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-indirectBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/indirectBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_indirectBenchmarkRecordNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-recordingThreads", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/recordingThreads", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_recordingThreadNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-recordingBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/recordingBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_recordingBenchmarkDrawNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-constantRingBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/constantRingBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_constantRingBenchmarkAllocationNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-drawTableBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/drawTableBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_drawTableBenchmarkModelNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-mergeBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/mergeBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_mergeBenchmarkMeshNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-vertexStreamBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/vertexStreamBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_vertexStreamBenchmarkVertexNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-meshCacheBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/meshCacheBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_meshCacheBenchmarkMeshNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-imageDecodeBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/imageDecodeBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_imageDecodeBenchmarkFileName = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-mipBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/mipBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_mipBenchmarkSize = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-bcBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/bcBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_bcBenchmarkSize = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-ingestionBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/ingestionBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_ingestionBenchmarkNames = argv[++i];
+    }
+    else if ((_wcsnicmp(argv[i], L"-csmBenchmark", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/csmBenchmark", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_csmBenchmarkObjectNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
+    else if ((_wcsnicmp(argv[i], L"-softwareRasterizer", wcslen(argv[i])) == 0 ||
+      _wcsnicmp(argv[i], L"/softwareRasterizer", wcslen(argv[i])) == 0) && i + 1 < argc)
+    {
+      m_softwareRasterizerFrameNumber = static_cast<UINT>(_wtoi(argv[++i]));
+    }
   }
 }
 
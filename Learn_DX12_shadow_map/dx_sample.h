@@ -34,6 +34,10 @@ public:
   virtual void OnLeftButtonUp(UINT /*x*/, UINT /*y*/) {}
   virtual void OnDisplayChanged() {}
 
+  // Called before the window and the device are created, for work that needs neither. Returning true
+  // exits with exitCode without ever opening the window.
+  virtual bool OnHeadlessRun(int& /*exitCode*/) { return false; }
+
   // Accessors.
   UINT GetWidth() const { return m_width; }
   UINT GetHeight() const { return m_height; }
@@ -73,6 +77,68 @@ protected:
   // Override to be able to start without Dx11on12 UI for PIX. PIX doesn't support 11 on 12. 
   bool m_enableUI;
 
+  // The report and benchmark flags run before the window and the device are created; the sample exits after them.
+  // -selfTest: run the known-answer checks of the CPU modules; the sample exits with a failure code if any fails.
+  // -meshCache <file>: load geometry from a baked mesh cache instead of building it in code.
+  // -cookMeshCache <file>: write the loaded geometry out as a mesh cache.
+  // -shadowQuality <low|medium|high|ultra>: shadow map resolution, cascades and depth format.
+  // -shadowQualityReport: log what each shadow quality tier costs per frame.
+  // -shadowFilter <point|pcf|poisson|pcss|vsm|evsm>: shadow filtering permutation of the scene pixel shader.
+  // -shadowFilterReport <file.dds>: compare the filters' CPU references on a saved depth map.
+  // -vertexStreams <interleaved|deinterleaved>: vertex buffer layout; deinterleaved keeps positions in a stream of their own for the depth passes.
+  // -shadowCache <off|on|split>: redraw shadow maps only when the light or the casters changed.
+  // -shadowAtlasBenchmark <light number>: time the shadow atlas packer with that many lights.
+  // -cullBenchmark <object number>: time frustum culling of that many objects, e.g. 100000.
+  // -bvhBenchmark <object number>: time the bounding volume hierarchy with 10k objects, then 10 times more up to that many.
+  // -occlusionBenchmark <object number>: time occlusion culling of that many objects along a street, e.g. 100000.
+  // -instancingBenchmark <object number>: time instance batching of that many objects over 256 meshes, e.g. 50000.
+  // -indirectDraws <off|on|counted>: draw the instance batches through ExecuteIndirect, optionally with a count buffer.
+  // -indirectBenchmark <record number>: time writing that many ExecuteIndirect records, e.g. 10000.
+  // -recordingThreads <thread number>: record the shadow and scene passes' draws on that many threads.
+  // -recordingBenchmark <draw number>: time recording that many synthetic draws on 1 thread, then 2, up to one per hardware thread.
+  // -constantRingBenchmark <allocation number>: time that many scene constant allocations per frame from the constant buffer ring, e.g. 10000.
+  // -drawTableBenchmark <model number>: time the draw table lookups of a frame with 10k models, then 10 times more up to that many, e.g. 100000.
+  // -mergeBenchmark <mesh number>: time merging that many meshes of 1000 vertices into the vertex and index buffers, e.g. 1000.
+  // -vertexStreamBenchmark <vertex number>: time transforming that many positions from each vertex stream layout, e.g. 1000000.
+  // -meshCacheBenchmark <mesh number>: time startup from that many meshes built in code against a mesh cache of them, e.g. 1000.
+  // -imageDecodeBenchmark <file>: time decoding an image file with the portable decoder, e.g. a PNG or a JPEG.
+  // -mipBenchmark <size>: time generating the mip chain of a 4096x4096 texture, then twice as large up to size, e.g. 8192.
+  // -bcBenchmark <size>: compress a size x size image to BC1/3/5/7 and log the PSNR and Mtexels/s of each, e.g. 2048.
+  // -ingestionBenchmark <names>: time loading textures from .dds files against decoding the same ones from .jpg files, e.g. textures\brick;textures\wood.
+  // -csmBenchmark <object number>: time splitting the view frustum into cascades and fitting them, with and without that many scene objects, e.g. 1000.
+  // -softwareRasterizer <frame number>: render the scene with each light that many times on the CPU, log the pixels/s and triangles/s and write the last frames as software_*.tga and .pfm images, e.g. 10.
+  // -frameStats: log what the culling, batching, shadow caching and recording did, whenever it changes from one frame to the next.
+  std::wstring m_meshCacheFileName;
+  std::wstring m_cookMeshCacheFileName;
+  std::wstring m_shadowQualityName;
+  std::wstring m_shadowFilterName;
+  std::wstring m_shadowFilterReportFileName;
+  std::wstring m_vertexStreamLayoutName;
+  std::wstring m_shadowCacheModeName;
+  std::wstring m_indirectDrawModeName;
+  std::wstring m_imageDecodeBenchmarkFileName;
+  std::wstring m_ingestionBenchmarkNames;
+  UINT m_shadowAtlasBenchmarkLightNumber;
+  UINT m_cullBenchmarkObjectNumber;
+  UINT m_bvhBenchmarkObjectNumber;
+  UINT m_occlusionBenchmarkObjectNumber;
+  UINT m_instancingBenchmarkObjectNumber;
+  UINT m_indirectBenchmarkRecordNumber;
+  UINT m_recordingThreadNumber;
+  UINT m_recordingBenchmarkDrawNumber;
+  UINT m_constantRingBenchmarkAllocationNumber;
+  UINT m_drawTableBenchmarkModelNumber;
+  UINT m_mergeBenchmarkMeshNumber;
+  UINT m_vertexStreamBenchmarkVertexNumber;
+  UINT m_meshCacheBenchmarkMeshNumber;
+  UINT m_mipBenchmarkSize;
+  UINT m_bcBenchmarkSize;
+  UINT m_csmBenchmarkObjectNumber;
+  UINT m_softwareRasterizerFrameNumber;
+  bool m_shadowQualityReport;
+  bool m_selfTest;
+  bool m_frameStats;
+
 private:
   // Root assets path.
   std::wstring m_assetsPath;
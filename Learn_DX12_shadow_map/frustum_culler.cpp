@@ -0,0 +1,267 @@
+#include "frustum_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <random>
+
+constexpr size_t FrustumCuller::kChunkSize;
+
+namespace {
+
+static_assert(FrustumCuller::kChunkSize % 4 == 0, "chunks are culled four boxes at a time");
+
+// A frustum's planes with every component splatted into its own register, and the absolute values of the
+// normals, which turn half extents into the box's reach along the normal.
+struct SplattedFrustum {
+  XMVECTOR normal_xs[6];
+  XMVECTOR normal_ys[6];
+  XMVECTOR normal_zs[6];
+  XMVECTOR distances[6];
+  XMVECTOR abs_normal_xs[6];
+  XMVECTOR abs_normal_ys[6];
+  XMVECTOR abs_normal_zs[6];
+  UINT plane_number;
+
+  explicit SplattedFrustum(const FrustumCuller::Frustum& frustum) : plane_number(frustum.plane_number) {
+    for (UINT i = 0; i < plane_number; ++i) {
+      const XMVECTOR plane = XMLoadFloat4(&frustum.planes[i]);
+      const XMVECTOR abs_plane = XMVectorAbs(plane);
+      normal_xs[i] = XMVectorSplatX(plane);
+      normal_ys[i] = XMVectorSplatY(plane);
+      normal_zs[i] = XMVectorSplatZ(plane);
+      distances[i] = XMVectorSplatW(plane);
+      abs_normal_xs[i] = XMVectorSplatX(abs_plane);
+      abs_normal_ys[i] = XMVectorSplatY(abs_plane);
+      abs_normal_zs[i] = XMVectorSplatZ(abs_plane);
+    }
+  }
+};  // struct SplattedFrustum
+
+// All ones in the lanes of the four boxes lying entirely behind one of the planes.
+inline XMVECTOR ComputeOutsideMask(const SplattedFrustum& frustum, FXMVECTOR center_xs, FXMVECTOR center_ys, FXMVECTOR center_zs,
+  GXMVECTOR extent_xs, HXMVECTOR extent_ys, HXMVECTOR extent_zs)
+{
+  // The signed distance of the box corner furthest along each plane's normal; the box is out when it is negative.
+  XMVECTOR min_distances = XMVectorSplatInfinity();
+  for (UINT i = 0; i < frustum.plane_number; ++i) {
+    XMVECTOR distances = XMVectorMultiplyAdd(center_xs, frustum.normal_xs[i], frustum.distances[i]);
+    distances = XMVectorMultiplyAdd(center_ys, frustum.normal_ys[i], distances);
+    distances = XMVectorMultiplyAdd(center_zs, frustum.normal_zs[i], distances);
+    distances = XMVectorMultiplyAdd(extent_xs, frustum.abs_normal_xs[i], distances);
+    distances = XMVectorMultiplyAdd(extent_ys, frustum.abs_normal_ys[i], distances);
+    distances = XMVectorMultiplyAdd(extent_zs, frustum.abs_normal_zs[i], distances);
+    min_distances = XMVectorMin(min_distances, distances);
+  }
+  return XMVectorLess(min_distances, XMVectorZero());
+}
+
+double ElapsedMilliseconds(std::chrono::steady_clock::time_point start_time)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+}  // namespace
+
+FrustumCuller::Frustum FrustumCuller::ComputeFrustum(FXMMATRIX view_proj, bool include_near_plane)
+{
+  // Gribb and Hartmann: with clip = p * view_proj, each clip coordinate is p dotted with a column of view_proj,
+  // i.e. a row of its transpose, and -w <= x <= w, -w <= y <= w, 0 <= z <= w are planes in p.
+  const XMMATRIX columns = XMMatrixTranspose(view_proj);
+  Frustum frustum{};
+  XMStoreFloat4(&frustum.planes[frustum.plane_number++], XMVectorAdd(columns.r[3], columns.r[0]));  // left
+  XMStoreFloat4(&frustum.planes[frustum.plane_number++], XMVectorSubtract(columns.r[3], columns.r[0]));  // right
+  XMStoreFloat4(&frustum.planes[frustum.plane_number++], XMVectorAdd(columns.r[3], columns.r[1]));  // bottom
+  XMStoreFloat4(&frustum.planes[frustum.plane_number++], XMVectorSubtract(columns.r[3], columns.r[1]));  // top
+  XMStoreFloat4(&frustum.planes[frustum.plane_number++], XMVectorSubtract(columns.r[3], columns.r[2]));  // far
+  if (include_near_plane) {
+    XMStoreFloat4(&frustum.planes[frustum.plane_number++], columns.r[2]);
+  }
+  return frustum;
+}
+
+bool FrustumCuller::IsVisible(const Frustum& frustum, const BoundingBox& bounding_box)
+{
+  const float center_x = 0.5f * (bounding_box.min.x + bounding_box.max.x);
+  const float center_y = 0.5f * (bounding_box.min.y + bounding_box.max.y);
+  const float center_z = 0.5f * (bounding_box.min.z + bounding_box.max.z);
+  const float extent_x = 0.5f * (bounding_box.max.x - bounding_box.min.x);
+  const float extent_y = 0.5f * (bounding_box.max.y - bounding_box.min.y);
+  const float extent_z = 0.5f * (bounding_box.max.z - bounding_box.min.z);
+  for (UINT i = 0; i < frustum.plane_number; ++i) {
+    const XMFLOAT4& plane = frustum.planes[i];
+    float distance = center_x * plane.x + plane.w;
+    distance = center_y * plane.y + distance;
+    distance = center_z * plane.z + distance;
+    distance = extent_x * std::fabs(plane.x) + distance;
+    distance = extent_y * std::fabs(plane.y) + distance;
+    distance = extent_z * std::fabs(plane.z) + distance;
+    if (distance < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FrustumCuller::BenchmarkReport FrustumCuller::Benchmark(size_t object_number, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (object_number == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  // Boxes of 0.5 to 4 units scattered over a 1000 unit wide city block, seen by a camera standing in it and by a
+  // directional light's orthographic frustum covering a quarter of it.
+  std::mt19937 random_engine(static_cast<unsigned int>(object_number));
+  std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+  std::uniform_real_distribution<float> size(0.5f, 4.0f);
+  std::vector<BoundingBox> object_bounds(object_number);
+  for (BoundingBox& bounding_box : object_bounds) {
+    bounding_box.min = XMFLOAT3(position(random_engine), 0.5f * position(random_engine), position(random_engine));
+    bounding_box.max = XMFLOAT3(bounding_box.min.x + size(random_engine), bounding_box.min.y + size(random_engine), bounding_box.min.z + size(random_engine));
+  }
+
+  const XMMATRIX camera_view = XMMatrixLookAtLH(XMVectorSet(0.0f, 10.0f, -200.0f, 1.0f), XMVectorSet(50.0f, 0.0f, 100.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  const XMMATRIX camera_proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 400.0f);
+  const XMMATRIX light_view = XMMatrixLookAtLH(XMVectorSet(0.0f, 300.0f, 0.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+  const XMMATRIX light_proj = XMMatrixOrthographicLH(500.0f, 500.0f, 1.0f, 600.0f);
+  const Frustum frustums[] = {
+    ComputeFrustum(XMMatrixMultiply(camera_view, camera_proj), true),
+    ComputeFrustum(XMMatrixMultiply(light_view, light_proj), false),
+  };
+  constexpr size_t frustum_number = sizeof(frustums) / sizeof(frustums[0]);
+  const double tested_number = static_cast<double>(object_number) * iteration_number;
+
+  std::vector<UINT> scalar_visible_lists[frustum_number];
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT iteration = 0; iteration < iteration_number; ++iteration) {
+    for (size_t f = 0; f < frustum_number; ++f) {
+      scalar_visible_lists[f].clear();
+      for (size_t i = 0; i < object_number; ++i) {
+        if (IsVisible(frustums[f], object_bounds[i])) {
+          scalar_visible_lists[f].push_back(static_cast<UINT>(i));
+        }
+      }
+    }
+  }
+  report.scalar_objects_per_millisecond = tested_number / ElapsedMilliseconds(start_time);
+
+  FrustumCuller culler;
+  culler.SetBounds(object_bounds.data(), object_number);
+  std::vector<UINT> visible_lists[frustum_number];
+  start_time = std::chrono::steady_clock::now();
+  for (UINT iteration = 0; iteration < iteration_number; ++iteration) {
+    culler.CullAll(frustums, frustum_number, visible_lists, false);
+  }
+  report.objects_per_millisecond = tested_number / ElapsedMilliseconds(start_time);
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT iteration = 0; iteration < iteration_number; ++iteration) {
+    culler.Cull(frustums, frustum_number, visible_lists);
+  }
+  report.parallel_objects_per_millisecond = tested_number / ElapsedMilliseconds(start_time);
+  report.thread_number = culler.thread_pool_ ? culler.thread_pool_->GetWorkerNumber() + 1 : 1;
+
+  for (size_t f = 0; f < frustum_number; ++f) {
+    std::vector<UINT> differences;
+    std::set_symmetric_difference(scalar_visible_lists[f].begin(), scalar_visible_lists[f].end(),
+      visible_lists[f].begin(), visible_lists[f].end(), std::back_inserter(differences));
+    report.mismatch_number += differences.size();
+  }
+  report.visible_fraction = static_cast<double>(visible_lists[0].size()) / object_number;
+  report.light_visible_fraction = static_cast<double>(visible_lists[1].size()) / object_number;
+  return report;
+}
+
+FrustumCuller::FrustumCuller(size_t worker_number) : worker_number_(worker_number)
+{
+}
+
+void FrustumCuller::SetBounds(const BoundingBox* object_bounds, size_t object_number)
+{
+  object_number_ = object_number;
+  // Zero sized boxes at the origin fill the last group of four; CullChunk drops them.
+  const size_t padded_number = (object_number + 3) & ~static_cast<size_t>(3);
+  for (std::vector<float>* values : { &center_xs_, &center_ys_, &center_zs_, &extent_xs_, &extent_ys_, &extent_zs_ }) {
+    values->assign(padded_number, 0.0f);
+  }
+  for (size_t i = 0; i < object_number; ++i) {
+    const BoundingBox& bounding_box = object_bounds[i];
+    center_xs_[i] = 0.5f * (bounding_box.min.x + bounding_box.max.x);
+    center_ys_[i] = 0.5f * (bounding_box.min.y + bounding_box.max.y);
+    center_zs_[i] = 0.5f * (bounding_box.min.z + bounding_box.max.z);
+    extent_xs_[i] = 0.5f * (bounding_box.max.x - bounding_box.min.x);
+    extent_ys_[i] = 0.5f * (bounding_box.max.y - bounding_box.min.y);
+    extent_zs_[i] = 0.5f * (bounding_box.max.z - bounding_box.min.z);
+  }
+}
+
+void FrustumCuller::Cull(const Frustum* frustums, size_t frustum_number, std::vector<UINT>* visible_lists)
+{
+  CullAll(frustums, frustum_number, visible_lists, true);
+}
+
+void FrustumCuller::CullAll(const Frustum* frustums, size_t frustum_number, std::vector<UINT>* visible_lists, bool parallel)
+{
+  const size_t chunk_number = (object_number_ + kChunkSize - 1) / kChunkSize;
+  chunk_visible_lists_.resize(chunk_number);
+  for (auto& chunk_visible_lists : chunk_visible_lists_) {
+    chunk_visible_lists.resize(frustum_number);
+  }
+
+  // Scenes fitting in one chunk never start the pool.
+  if (parallel && chunk_number > 1) {
+    if (!thread_pool_) {
+      thread_pool_ = std::make_unique<ThreadPool>(worker_number_);
+    }
+    thread_pool_->ParallelFor(chunk_number, [this, frustums, frustum_number](size_t chunk_index, size_t) {
+      CullChunk(chunk_index, frustums, frustum_number);
+    });
+  }
+  else {
+    for (size_t chunk_index = 0; chunk_index < chunk_number; ++chunk_index) {
+      CullChunk(chunk_index, frustums, frustum_number);
+    }
+  }
+
+  for (size_t f = 0; f < frustum_number; ++f) {
+    visible_lists[f].clear();
+    for (const auto& chunk_visible_lists : chunk_visible_lists_) {
+      visible_lists[f].insert(visible_lists[f].end(), chunk_visible_lists[f].begin(), chunk_visible_lists[f].end());
+    }
+  }
+}
+
+void FrustumCuller::CullChunk(size_t chunk_index, const Frustum* frustums, size_t frustum_number)
+{
+  std::vector<SplattedFrustum> splatted_frustums;
+  splatted_frustums.reserve(frustum_number);
+  for (size_t f = 0; f < frustum_number; ++f) {
+    splatted_frustums.emplace_back(frustums[f]);
+    chunk_visible_lists_[chunk_index][f].clear();
+  }
+
+  const size_t begin = chunk_index * kChunkSize;
+  const size_t end = std::min(begin + kChunkSize, object_number_);
+  for (size_t i = begin; i < end; i += 4) {
+    // Each group of boxes is loaded once for all the frustums.
+    const XMVECTOR center_xs = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&center_xs_[i]));
+    const XMVECTOR center_ys = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&center_ys_[i]));
+    const XMVECTOR center_zs = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&center_zs_[i]));
+    const XMVECTOR extent_xs = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&extent_xs_[i]));
+    const XMVECTOR extent_ys = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&extent_ys_[i]));
+    const XMVECTOR extent_zs = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&extent_zs_[i]));
+    const size_t group_size = std::min<size_t>(end - i, 4);
+    for (size_t f = 0; f < frustum_number; ++f) {
+      uint32_t outside[4];
+      XMStoreInt4(outside, ComputeOutsideMask(splatted_frustums[f], center_xs, center_ys, center_zs, extent_xs, extent_ys, extent_zs));
+      std::vector<UINT>& visible_list = chunk_visible_lists_[chunk_index][f];
+      for (size_t lane = 0; lane < group_size; ++lane) {
+        if (outside[lane] == 0) {
+          visible_list.push_back(static_cast<UINT>(i + lane));
+        }
+      }
+    }
+  }
+}
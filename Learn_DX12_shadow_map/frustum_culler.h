@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "model.h"
+#include "thread_pool.h"
+
+using namespace DirectX;
+
+// Culls world space boxes (AssetsManager::DrawArgument::world_bounding_box) against view frustums, so the scene
+// and shadow passes only issue draws for objects that can reach their target. The boxes are kept as a structure
+// of arrays, centers and half extents one component per array, so a plane is tested against four boxes with a
+// few multiply-adds. Every frustum is tested in the same sweep over the boxes, whose chunks are spread over a
+// thread pool, and each gets its own list of visible objects, in object order. Only DirectXMath is used, so it
+// runs without a device.
+class FrustumCuller {
+ public:
+  using BoundingBox = Asset::Model::BoundingBox;
+
+  // Planes as (normal, distance), normals pointing inwards and not normalized.
+  struct Frustum {
+    XMFLOAT4 planes[6];
+    UINT plane_number;
+  };  // struct Frustum
+
+  struct BenchmarkReport {
+    // Objects tested against both frustums per millisecond.
+    double scalar_objects_per_millisecond;  // IsVisible, one box at a time
+    double objects_per_millisecond;  // four boxes at a time, one thread
+    double parallel_objects_per_millisecond;  // four boxes at a time, over the pool
+    size_t thread_number;  // of the parallel run, the calling thread included
+    double visible_fraction;  // of the camera
+    double light_visible_fraction;
+    size_t mismatch_number;  // objects the scalar and the SIMD tests disagree on, 0 unless something is wrong
+  };  // struct BenchmarkReport
+
+  static constexpr size_t kChunkSize = 4096;  // objects per job
+
+  // From a view projection in DirectXMath's row-vector convention (not the transposed copy of the constant
+  // buffers), with clip space depth in [0, w]. Casters in front of a light's near plane still throw shadows
+  // into its frustum, so shadow passes leave that plane out.
+  static Frustum ComputeFrustum(FXMMATRIX view_proj, bool include_near_plane);
+
+  // The same test as Cull for one box: outside if it lies entirely behind one of the planes. Conservative,
+  // a box near a frustum's edge can pass without intersecting it.
+  static bool IsVisible(const Frustum& frustum, const BoundingBox& bounding_box);
+
+  // Culls object_number random boxes against a camera and a light frustum, iteration_number times each way.
+  static BenchmarkReport Benchmark(size_t object_number, UINT iteration_number);
+
+  // worker_number == 0 means one worker per hardware thread. The pool is only started once there is more than
+  // one chunk of objects to cull.
+  explicit FrustumCuller(size_t worker_number = 0);
+
+  FrustumCuller(const FrustumCuller&) = delete;
+  FrustumCuller& operator=(const FrustumCuller&) = delete;
+
+  // Copies the boxes; call again whenever they change.
+  void SetBounds(const BoundingBox* object_bounds, size_t object_number);
+
+  size_t GetObjectNumber() const {
+    return object_number_;
+  }
+
+  // visible_lists[i] gets the indices of the objects that may intersect frustums[i].
+  void Cull(const Frustum* frustums, size_t frustum_number, std::vector<UINT>* visible_lists);
+
+ private:
+  // Cull, on the calling thread alone unless parallel.
+  void CullAll(const Frustum* frustums, size_t frustum_number, std::vector<UINT>* visible_lists, bool parallel);
+  // Into chunk_visible_lists_[chunk_index], a list per frustum.
+  void CullChunk(size_t chunk_index, const Frustum* frustums, size_t frustum_number);
+
+  size_t worker_number_ = 0;
+  std::unique_ptr<ThreadPool> thread_pool_;
+  size_t object_number_ = 0;
+  // Padded to a multiple of four.
+  std::vector<float> center_xs_;
+  std::vector<float> center_ys_;
+  std::vector<float> center_zs_;
+  std::vector<float> extent_xs_;
+  std::vector<float> extent_ys_;
+  std::vector<float> extent_zs_;
+  std::vector<std::vector<std::vector<UINT>>> chunk_visible_lists_;
+};  // class FrustumCuller
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "common_headers.h"
+
+// Decoding backend behind ImageLoader.
+class ImageDecoder {
+ public:
+  // Called once the image size is known: returns where the first decoded row goes and may raise row_pitch
+  // (initially the packed row size) to match the destination. Returning nullptr cancels the load.
+  using RowsDestinationAllocator = std::function<uint8_t*(const D3D12_RESOURCE_DESC& texture_desc, UINT& row_pitch)>;
+
+  virtual ~ImageDecoder() {
+
+  }
+
+  // Decodes filename into the memory given by allocate_rows, fills texture_desc for a single mip 2D texture
+  // and bytesPerRow with the packed row size. Returns the packed image size in bytes, 0 on failure.
+  // Implementations must be safe to call from several threads at once.
+  virtual int Decode(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows) = 0;
+};  // class ImageDecoder
@@ -1,226 +1,92 @@
 #include "image_loader.h"
 
-#include <wincodec.h>
+#include <algorithm>
+#include <mutex>
 
-namespace {
-// get the dxgi format equivilent of a wic format
-DXGI_FORMAT GetDXGIFormatFromWICFormat(WICPixelFormatGUID& wicFormatGUID)
-{
-	if (wicFormatGUID == GUID_WICPixelFormat128bppRGBAFloat) return DXGI_FORMAT_R32G32B32A32_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBAHalf) return DXGI_FORMAT_R16G16B16A16_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBA) return DXGI_FORMAT_R16G16B16A16_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA) return DXGI_FORMAT_R8G8B8A8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGRA) return DXGI_FORMAT_B8G8R8A8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGR) return DXGI_FORMAT_B8G8R8X8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA1010102XR) return DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM;
+#include "portable_image_decoder.h"
+#ifdef _WIN32
+#include "wic_image_decoder.h"
+#endif
 
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBA1010102) return DXGI_FORMAT_R10G10B10A2_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGRA5551) return DXGI_FORMAT_B5G5R5A1_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGR565) return DXGI_FORMAT_B5G6R5_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppGrayFloat) return DXGI_FORMAT_R32_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGrayHalf) return DXGI_FORMAT_R16_FLOAT;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGray) return DXGI_FORMAT_R16_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppGray) return DXGI_FORMAT_R8_UNORM;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppAlpha) return DXGI_FORMAT_A8_UNORM;
+namespace {
 
-	else return DXGI_FORMAT_UNKNOWN;
-}
+std::mutex decoder_mutex;
 
-// get a dxgi compatible wic format from another wic format
-WICPixelFormatGUID GetConvertToWICFormat(WICPixelFormatGUID& wicFormatGUID)
+std::shared_ptr<ImageDecoder>& GetDecoderInstance()
 {
-	if (wicFormatGUID == GUID_WICPixelFormatBlackWhite) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat1bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat2bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat4bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat8bppIndexed) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat2bppGray) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat4bppGray) return GUID_WICPixelFormat8bppGray;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppGrayFixedPoint) return GUID_WICPixelFormat16bppGrayHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppGrayFixedPoint) return GUID_WICPixelFormat32bppGrayFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat16bppBGR555) return GUID_WICPixelFormat16bppBGRA5551;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppBGR101010) return GUID_WICPixelFormat32bppRGBA1010102;
-	else if (wicFormatGUID == GUID_WICPixelFormat24bppBGR) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat24bppRGB) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppPBGRA) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppPRGBA) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGB) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppBGR) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppBGRA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPRGBA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPBGRA) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGBFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppBGRFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBAFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppBGRAFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBFixedPoint) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGBHalf) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat48bppRGBHalf) return GUID_WICPixelFormat64bppRGBAHalf;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppPRGBAFloat) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBFloat) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBAFixedPoint) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat128bppRGBFixedPoint) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGBE) return GUID_WICPixelFormat128bppRGBAFloat;
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppCMYK) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppCMYK) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat40bppCMYKAlpha) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat80bppCMYKAlpha) return GUID_WICPixelFormat64bppRGBA;
-
-#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8) || defined(_WIN7_PLATFORM_UPDATE)
-	else if (wicFormatGUID == GUID_WICPixelFormat32bppRGB) return GUID_WICPixelFormat32bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppRGB) return GUID_WICPixelFormat64bppRGBA;
-	else if (wicFormatGUID == GUID_WICPixelFormat64bppPRGBAHalf) return GUID_WICPixelFormat64bppRGBAHalf;
+#ifdef _WIN32
+  static std::shared_ptr<ImageDecoder> decoder = std::make_shared<WicImageDecoder>();
+#else
+  static std::shared_ptr<ImageDecoder> decoder = std::make_shared<PortableImageDecoder>();
 #endif
-
-	else return GUID_WICPixelFormatDontCare;
-}
-
-// get the number of bits per pixel for a dxgi format
-int GetDXGIFormatBitsPerPixel(DXGI_FORMAT& dxgiFormat)
-{
-	if (dxgiFormat == DXGI_FORMAT_R32G32B32A32_FLOAT) return 128;
-	else if (dxgiFormat == DXGI_FORMAT_R16G16B16A16_FLOAT) return 64;
-	else if (dxgiFormat == DXGI_FORMAT_R16G16B16A16_UNORM) return 64;
-	else if (dxgiFormat == DXGI_FORMAT_R8G8B8A8_UNORM) return 32;
-	else if (dxgiFormat == DXGI_FORMAT_B8G8R8A8_UNORM) return 32;
-	else if (dxgiFormat == DXGI_FORMAT_B8G8R8X8_UNORM) return 32;
-	else if (dxgiFormat == DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM) return 32;
-
-	else if (dxgiFormat == DXGI_FORMAT_R10G10B10A2_UNORM) return 32;
-	else if (dxgiFormat == DXGI_FORMAT_B5G5R5A1_UNORM) return 16;
-	else if (dxgiFormat == DXGI_FORMAT_B5G6R5_UNORM) return 16;
-	else if (dxgiFormat == DXGI_FORMAT_R32_FLOAT) return 32;
-	else if (dxgiFormat == DXGI_FORMAT_R16_FLOAT) return 16;
-	else if (dxgiFormat == DXGI_FORMAT_R16_UNORM) return 16;
-	else if (dxgiFormat == DXGI_FORMAT_R8_UNORM) return 8;
-	else if (dxgiFormat == DXGI_FORMAT_A8_UNORM) return 8;
-
-	return 0;
+  return decoder;
 }
 
 }  // namespace
 
 int ImageLoader::LoadImageDataFromFile(std::vector<uint8_t>& imageData, D3D12_RESOURCE_DESC& texture_desc, const std::string& filename, int& bytesPerRow)
 {
-  HRESULT hr;
-
-  // we only need one instance of the imaging factory to create decoders and frames
-  static IWICImagingFactory* wicFactory;
-
-  // reset decoder, frame, and converter, since these will be different for each image we load
-  IWICBitmapDecoder* wicDecoder = NULL;
-  IWICBitmapFrameDecode* wicFrame = NULL;
-  IWICFormatConverter* wicConverter = NULL;
-
-  bool imageConverted = false;
-	if (wicFactory == NULL)
-	{
-		// Initialize the COM library
-		CoInitialize(NULL);
-
-		// create the WIC factory
-		hr = CoCreateInstance(
-			CLSID_WICImagingFactory,
-			NULL,
-			CLSCTX_INPROC_SERVER,
-			IID_PPV_ARGS(&wicFactory)
-		);
-		if (FAILED(hr)) return 0;
-	}
-
-	if (wicConverter == nullptr) {
-		hr = wicFactory->CreateFormatConverter(&wicConverter);
-		if (FAILED(hr)) return 0;
-	}
-
-	// load a decoder for the image
-	std::wstring file_name_wstring = std::wstring(filename.begin(), filename.end());
-	hr = wicFactory->CreateDecoderFromFilename(
-		file_name_wstring.c_str(),                        // Image we want to load in
-		NULL,                            // This is a vendor ID, we do not prefer a specific one so set to null
-		GENERIC_READ,                    // We want to read from this file
-		WICDecodeMetadataCacheOnLoad,    // We will cache the metadata right away, rather than when needed, which might be unknown
-		&wicDecoder                      // the wic decoder to be created
-	);
-	if (FAILED(hr)) return 0;
-
-	// get image from decoder (this will decode the "frame")
-	hr = wicDecoder->GetFrame(0, &wicFrame);
-	if (FAILED(hr)) return 0;
-
-	// get wic pixel format of image
-	WICPixelFormatGUID pixelFormat;
-	hr = wicFrame->GetPixelFormat(&pixelFormat);
-	if (FAILED(hr)) return 0;
-
-	// get size of image
-	UINT textureWidth, textureHeight;
-	hr = wicFrame->GetSize(&textureWidth, &textureHeight);
-	if (FAILED(hr)) return 0;
-
-	// we are not handling sRGB types in this tutorial, so if you need that support, you'll have to figure
-	// out how to implement the support yourself
-
-	// convert wic pixel format to dxgi pixel format
-	DXGI_FORMAT dxgiFormat = GetDXGIFormatFromWICFormat(pixelFormat);
-
-	// if the format of the image is not a supported dxgi format, try to convert it
-	if (dxgiFormat == DXGI_FORMAT_UNKNOWN)
-	{
-		// get a dxgi compatible wic format from the current image format
-		WICPixelFormatGUID convertToPixelFormat = GetConvertToWICFormat(pixelFormat);
-
-		// return if no dxgi compatible format was found
-		if (convertToPixelFormat == GUID_WICPixelFormatDontCare) return 0;
-
-		// set the dxgi format
-		dxgiFormat = GetDXGIFormatFromWICFormat(convertToPixelFormat);
-
-		// make sure we can convert to the dxgi compatible format
-		BOOL canConvert = FALSE;
-		hr = wicConverter->CanConvert(pixelFormat, convertToPixelFormat, &canConvert);
-		if (FAILED(hr) || !canConvert) return 0;
-
-		// do the conversion (wicConverter will contain the converted image)
-		hr = wicConverter->Initialize(wicFrame, convertToPixelFormat, WICBitmapDitherTypeErrorDiffusion, 0, 0, WICBitmapPaletteTypeCustom);
-		if (FAILED(hr)) return 0;
-
-		// this is so we know to get the image data from the wicConverter (otherwise we will get from wicFrame)
-		imageConverted = true;
-	}
-
-	int bitsPerPixel = GetDXGIFormatBitsPerPixel(dxgiFormat); // number of bits per pixel
-	bytesPerRow = (textureWidth * bitsPerPixel) / 8; // number of bytes in each row of the image data
-	int imageSize = bytesPerRow * textureHeight; // total image size in bytes
+  return LoadImageDataFromFile(filename, texture_desc, bytesPerRow, [&imageData](const D3D12_RESOURCE_DESC& desc, UINT& row_pitch) {
+    imageData.resize(static_cast<size_t>(row_pitch) * desc.Height);
+    return imageData.data();
+  });
+}
 
-	// allocate enough memory for the raw image data, and set imageData to point to that memory
-	imageData.resize(imageSize);
-	// *imageData = (BYTE*)malloc(imageSize);
+int ImageLoader::LoadImageDataFromFile(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows)
+{
+  return GetDecoder()->Decode(filename, texture_desc, bytesPerRow, allocate_rows);
+}
 
-	// copy (decoded) raw image data into the newly allocated memory (imageData)
-	if (imageConverted)
-	{
-		// if image format needed to be converted, the wic converter will contain the converted image
-		hr = wicConverter->CopyPixels(0, bytesPerRow, imageSize, imageData.data());
-		if (FAILED(hr)) return 0;
-	}
-	else
-	{
-		// no need to convert, just copy data from the wic frame
-		hr = wicFrame->CopyPixels(0, bytesPerRow, imageSize, imageData.data());
-		if (FAILED(hr)) return 0;
-	}
+int ImageLoader::LoadImageDataFromFile(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const SubresourcesDestinationAllocator& allocate_subresources, const MipChainGenerator::Options& mip_options)
+{
+  std::vector<SubresourceDestination> destinations;
+  UINT16 mip_level_number = 1;
+  const int image_size = LoadImageDataFromFile(filename, texture_desc, bytesPerRow,
+    [&allocate_subresources, &destinations, &mip_level_number](const D3D12_RESOURCE_DESC& desc, UINT& row_pitch) -> uint8_t* {
+      D3D12_RESOURCE_DESC chain_desc = desc;
+      if (MipChainGenerator::IsFormatSupported(desc.Format)) {
+        chain_desc.MipLevels = static_cast<UINT16>(MipChainGenerator::GetMipLevelNumber(desc.Width, desc.Height));
+      }
+      destinations.assign(chain_desc.MipLevels, SubresourceDestination());
+      if (!allocate_subresources(chain_desc, destinations)) {
+        return nullptr;
+      }
+      // row_pitch is still the packed size of level 0. Every supported format has whole bytes per texel.
+      const UINT texel_size = static_cast<UINT>(row_pitch / desc.Width);
+      for (UINT16 level = 0; level < chain_desc.MipLevels; ++level) {
+        const UINT level_width = std::max(1u, static_cast<UINT>(desc.Width >> level));
+        if (destinations[level].data == nullptr || destinations[level].row_pitch < level_width * texel_size) {
+          return nullptr;
+        }
+      }
+
+      mip_level_number = chain_desc.MipLevels;
+      row_pitch = destinations[0].row_pitch;
+      return destinations[0].data;
+    });
+  if (image_size == 0) {
+    return 0;
+  }
+
+  MipChainGenerator::Surface source = { destinations[0].data, destinations[0].row_pitch, static_cast<UINT>(texture_desc.Width), texture_desc.Height };
+  for (UINT16 level = 1; level < mip_level_number; ++level) {
+    const MipChainGenerator::Surface destination = { destinations[level].data, destinations[level].row_pitch, std::max(1u, source.width >> 1), std::max(1u, source.height >> 1) };
+    MipChainGenerator::GenerateMip(texture_desc.Format, source, destination, mip_options);
+    source = destination;
+  }
+
+  texture_desc.MipLevels = mip_level_number;
+  return image_size;
+}
 
-	texture_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	texture_desc.Alignment = 0;  // may be 0, 4KB, 64KB, or 4MB. 0 will let runtime decide between 64KB and 4MB (4MB for multi-sampled textures)
-	texture_desc.Width = textureWidth;
-	texture_desc.Height = textureHeight;
-	texture_desc.DepthOrArraySize = 1;  // if 3d image, depth of 3d image. Otherwise an array of 1D or 2D textures (we only have one image, so we set 1)
-	texture_desc.MipLevels = 1;  // Number of mipmaps. We are not generating mipmaps for this texture, so we have only one level
-	texture_desc.Format = dxgiFormat;  // This is the dxgi format of the image (format of the pixels)
-	texture_desc.SampleDesc = { 1, 0 };  // no msaa
-	texture_desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;   // The arrangement of the pixels. Setting to unknown lets the driver choose the most efficient one
-	texture_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+void ImageLoader::SetDecoder(std::shared_ptr<ImageDecoder> decoder)
+{
+  std::lock_guard<std::mutex> lock(decoder_mutex);
+  GetDecoderInstance() = std::move(decoder);
+}
 
-  return imageSize;
+std::shared_ptr<ImageDecoder> ImageLoader::GetDecoder()
+{
+  std::lock_guard<std::mutex> lock(decoder_mutex);
+  return GetDecoderInstance();
 }
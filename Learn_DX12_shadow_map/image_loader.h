@@ -1,11 +1,38 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <string>
 
 #include "common_headers.h"
+#include "image_decoder.h"
+#include "mip_chain_generator.h"
 
 class ImageLoader {
 public:
+  using RowsDestinationAllocator = ImageDecoder::RowsDestinationAllocator;
+
   static int LoadImageDataFromFile(std::vector<uint8_t>& imageData, D3D12_RESOURCE_DESC& texture_desc, const std::string& filename, int& bytesPerRow);
-};  // class ImageLoader
\ No newline at end of file
+
+  // Decodes straight into caller-provided memory, e.g. a mapped upload heap laid out by GetCopyableFootprints.
+  // Safe to call from several threads at once. Returns the packed image size in bytes, 0 on failure.
+  static int LoadImageDataFromFile(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows);
+
+  struct SubresourceDestination {
+    uint8_t* data = nullptr;
+    UINT row_pitch = 0;  // at least the level's packed row size
+  };  // struct SubresourceDestination
+
+  // Called once the image size is known, with texture_desc.MipLevels set to the chain length: fills one
+  // destination per level, e.g. from GetCopyableFootprints. Returning false cancels the load.
+  using SubresourcesDestinationAllocator = std::function<bool(const D3D12_RESOURCE_DESC& texture_desc, std::vector<SubresourceDestination>& destinations)>;
+
+  // Decodes level 0 like above, then fills the levels below it with MipChainGenerator. Formats it doesn't
+  // support get a single level; texture_desc.MipLevels says how many were written.
+  static int LoadImageDataFromFile(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const SubresourcesDestinationAllocator& allocate_subresources, const MipChainGenerator::Options& mip_options);
+
+  // Backend used by the loads above: WicImageDecoder on Windows, PortableImageDecoder elsewhere. Loads
+  // already running keep the backend they started with.
+  static void SetDecoder(std::shared_ptr<ImageDecoder> decoder);
+  static std::shared_ptr<ImageDecoder> GetDecoder();
+};  // class ImageLoader
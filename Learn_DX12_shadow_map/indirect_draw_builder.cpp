@@ -0,0 +1,95 @@
+#include "indirect_draw_builder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cwctype>
+#include <vector>
+
+constexpr UINT IndirectDrawBuilder::kRecordStride;
+
+namespace {
+
+static_assert(sizeof(IndirectDrawBuilder::DrawRecord) == 32, "the command signature's byte stride");
+static_assert(offsetof(IndirectDrawBuilder::DrawRecord, index_count_per_instance) == sizeof(UINT64),
+  "the draw arguments follow the root SRV's address");
+
+const wchar_t* const kModeNames[] = {
+  L"off",
+  L"on",
+  L"counted",
+};
+
+}  // namespace
+
+const wchar_t* IndirectDrawBuilder::GetModeName(Mode mode)
+{
+  return kModeNames[static_cast<int>(mode)];
+}
+
+bool IndirectDrawBuilder::ParseMode(const std::wstring& name, Mode& mode)
+{
+  for (int i = 0; i < static_cast<int>(Mode::kModeNumber); ++i) {
+    const std::wstring mode_name = kModeNames[i];
+    if (name.size() == mode_name.size() && std::equal(name.begin(), name.end(), mode_name.begin(),
+        [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; })) {
+      mode = static_cast<Mode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+UINT IndirectDrawBuilder::WriteRecords(const AssetsManager::InstanceBatch* batches, UINT batch_number, UINT64 transforms_address, UINT transform_stride,
+                                       DrawRecord* records, UINT max_record_number)
+{
+  // Built in a local and stored whole, so a write-combined destination only sees full, sequential writes.
+  const UINT record_number = std::min(batch_number, max_record_number);
+  for (UINT i = 0; i < record_number; ++i) {
+    const AssetsManager::InstanceBatch& batch = batches[i];
+    DrawRecord record;
+    record.transforms_address = transforms_address + static_cast<UINT64>(transform_stride) * batch.first_instance;
+    record.index_count_per_instance = batch.index_count;
+    record.instance_count = batch.instance_number;
+    record.start_index_location = batch.index_start;
+    record.base_vertex_location = static_cast<INT>(batch.vertex_base);
+    record.start_instance_location = 0;  // SV_InstanceID counts from 0 anyway; the root SRV picks the transforms
+    record.padding = 0;
+    records[i] = record;
+  }
+  return record_number;
+}
+
+IndirectDrawBuilder::BenchmarkReport IndirectDrawBuilder::Benchmark(UINT record_number, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  report.record_number = record_number;
+  if (record_number == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  std::vector<AssetsManager::InstanceBatch> batches(record_number);
+  UINT first_instance = 0;
+  for (UINT i = 0; i < record_number; ++i) {
+    AssetsManager::InstanceBatch& batch = batches[i];
+    batch.index_count = 36 + 6 * (i % 7);
+    batch.index_start = 96 * i;
+    batch.vertex_base = 24 * i;
+    batch.diffuse_texture_index = -1;
+    batch.first_instance = first_instance;
+    batch.instance_number = 1 + i % 4;
+    first_instance += batch.instance_number;
+  }
+
+  std::vector<DrawRecord> records(record_number);
+  const UINT64 transforms_address = 0x10000;
+  UINT written_number = 0;
+  const auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    written_number += WriteRecords(batches.data(), record_number, transforms_address, sizeof(XMFLOAT4X4), records.data(), record_number);
+  }
+  const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+  report.microseconds = microseconds / iteration_number;
+  report.records_per_microsecond = microseconds > 0.0 ? written_number / microseconds : 0.0;
+  return report;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+#include "assets_manager.h"
+
+// Writes the argument buffers ExecuteIndirect reads in place of a loop of SetGraphicsRootShaderResourceView and
+// DrawIndexedInstanced calls: one DrawRecord per instance batch, in a single pass over the batches, straight into
+// caller-owned memory such as a mapped upload buffer. The scene owns the command signatures and the buffers;
+// nothing here needs a device.
+class IndirectDrawBuilder {
+ public:
+  enum class Mode {
+    kOff,  // a draw call per batch, the original behavior
+    kOn,  // an ExecuteIndirect per pass (per texture in the scene pass), the count given on the CPU
+    kCounted,  // as kOn, with the count read from a count buffer, as a GPU culling pass would write it
+    kModeNumber,
+  };  // enum class Mode
+
+  // Laid out as the command signature's arguments: the root SRV of the batch's instance transforms, then
+  // D3D12_DRAW_INDEXED_ARGUMENTS.
+  struct DrawRecord {
+    UINT64 transforms_address;
+    UINT index_count_per_instance;
+    UINT instance_count;
+    UINT start_index_location;
+    INT base_vertex_location;
+    UINT start_instance_location;
+    UINT padding;  // keeps every record's address 8-byte aligned
+  };  // struct DrawRecord
+
+  struct BenchmarkReport {
+    UINT record_number;  // per WriteRecords
+    double microseconds;  // per WriteRecords
+    double records_per_microsecond;
+  };  // struct BenchmarkReport
+
+  static constexpr UINT kRecordStride = sizeof(DrawRecord);
+
+  static const wchar_t* GetModeName(Mode mode);
+
+  // Matches the mode names case-insensitively. Returns false, leaving mode alone, for anything else.
+  static bool ParseMode(const std::wstring& name, Mode& mode);
+
+  // Fills records[i] from batches[i], whose transforms start transform_stride * first_instance bytes past
+  // transforms_address. Writes at most max_record_number records and returns how many.
+  static UINT WriteRecords(const AssetsManager::InstanceBatch* batches, UINT batch_number, UINT64 transforms_address, UINT transform_stride,
+                           DrawRecord* records, UINT max_record_number);
+
+  // Times WriteRecords of record_number batches into a buffer, iteration_number times.
+  static BenchmarkReport Benchmark(UINT record_number, UINT iteration_number);
+};  // class IndirectDrawBuilder
@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "portable_image_formats.h"
+
+namespace PortableImage {
+
+namespace {
+
+// Position of the k-th coefficient of the zigzag order in the natural 8x8 layout.
+const uint8_t kZigzag[64] = {
+  0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// MSB-first reader over entropy coded data. Stuffed 0xFF00 bytes are unstuffed; at any other marker it
+// stops and feeds zeros, leaving the position on the marker.
+class JpegBitReader {
+ public:
+  JpegBitReader(const uint8_t* data, size_t size, size_t position) : data_(data), size_(size), position_(position) {
+
+  }
+
+  void Refill() {
+    while (bit_count_ <= 56) {
+      uint64_t byte = 0;
+      if (!marker_reached_ && position_ < size_) {
+        byte = data_[position_];
+        if (byte == 0xFF) {
+          const uint8_t next = position_ + 1 < size_ ? data_[position_ + 1] : 0xD9;
+          if (next == 0x00) {
+            position_ += 2;
+          } else {
+            marker_reached_ = true;
+            byte = 0;
+          }
+        } else {
+          position_++;
+        }
+      }
+      bits_ |= byte << (56 - bit_count_);
+      bit_count_ += 8;
+    }
+  }
+
+  uint32_t Peek(int bit_number) const {
+    return static_cast<uint32_t>(bits_ >> (64 - bit_number));
+  }
+
+  void Consume(int bit_number) {
+    bits_ <<= bit_number;
+    bit_count_ -= bit_number;
+  }
+
+  // Reads a bit_number bit magnitude category value and sign extends it (F.2.2.1 EXTEND).
+  int ReceiveExtend(int bit_number) {
+    if (bit_number == 0) {
+      return 0;
+    }
+    Refill();
+    int value = static_cast<int>(Peek(bit_number));
+    Consume(bit_number);
+    if (value < (1 << (bit_number - 1))) {
+      value -= (1 << bit_number) - 1;
+    }
+    return value;
+  }
+
+  // Drops buffered bits and skips the RSTn marker that must follow. False if it isn't there.
+  bool Restart() {
+    bits_ = 0;
+    bit_count_ = 0;
+    marker_reached_ = false;
+    if (position_ + 1 < size_ && data_[position_] == 0xFF && data_[position_ + 1] >= 0xD0 && data_[position_ + 1] <= 0xD7) {
+      position_ += 2;
+      return true;
+    }
+    return false;
+  }
+
+  size_t GetPosition() const {
+    return position_;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_;
+  uint64_t bits_ = 0;
+  int bit_count_ = 0;
+  bool marker_reached_ = false;
+};  // class JpegBitReader
+
+class JpegHuffmanTable {
+ public:
+  static constexpr int kFastBits = 9;
+
+  bool Build(const uint8_t* counts, const uint8_t* values, int value_number) {
+    std::memset(fast_, 0, sizeof(fast_));
+    std::memcpy(values_, values, value_number);
+
+    int code = 0;
+    int value_index = 0;
+    for (int length = 1; length <= 16; ++length) {
+      // Over-subscribed: more codes of this length than are left, which would index past fast_.
+      if (code + counts[length - 1] > (1 << length)) {
+        return false;
+      }
+      value_offsets_[length] = value_index - code;
+      for (int i = 0; i < counts[length - 1]; ++i, ++code, ++value_index) {
+        if (length <= kFastBits) {
+          const int first = code << (kFastBits - length);
+          for (int index = first; index < first + (1 << (kFastBits - length)); ++index) {
+            fast_[index] = static_cast<uint16_t>((values[value_index] << 8) | length);
+          }
+        }
+      }
+      max_codes_[length] = code - 1;  // -1 (or below the first code) when there are none of this length
+      code <<= 1;
+    }
+    return value_index == value_number;
+  }
+
+  // -1 for a code that isn't in the table.
+  int Decode(JpegBitReader& reader) const {
+    reader.Refill();
+    const uint16_t entry = fast_[reader.Peek(kFastBits)];
+    if (entry != 0) {
+      reader.Consume(entry & 0xFF);
+      return entry >> 8;
+    }
+
+    const uint32_t bits = reader.Peek(16);
+    for (int length = kFastBits + 1; length <= 16; ++length) {
+      const int code = static_cast<int>(bits >> (16 - length));
+      if (code <= max_codes_[length]) {
+        reader.Consume(length);
+        return values_[value_offsets_[length] + code];
+      }
+    }
+    return -1;
+  }
+
+ private:
+  uint16_t fast_[1 << kFastBits];  // value << 8 | length, 0 for longer codes
+  int max_codes_[17];
+  int value_offsets_[17];  // value index = offset + code
+  uint8_t values_[256];
+};  // class JpegHuffmanTable
+
+struct JpegComponent {
+  int id = 0;
+  int h = 1;
+  int v = 1;
+  int quantization_table = 0;
+  int dc_table = 0;
+  int ac_table = 0;
+  int dc_prediction = 0;
+  int plane_width = 0;  // covers whole MCUs
+  int plane_height = 0;
+  std::vector<uint8_t> plane;
+};  // struct JpegComponent
+
+// Float AAN inverse DCT (as in the IJG jidctflt.c). coefficients are dequantized and pre-scaled by the AAN
+// factors, natural order; writes an 8x8 block of samples.
+void InverseDct(const float* coefficients, uint8_t* output, int output_stride)
+{
+  float workspace[64];
+  for (int column = 0; column < 8; ++column) {
+    const float* in = coefficients + column;
+    float* out = workspace + column;
+
+    // Even part.
+    float tmp0 = in[0];
+    float tmp1 = in[16];
+    float tmp2 = in[32];
+    float tmp3 = in[48];
+    float tmp10 = tmp0 + tmp2;
+    float tmp11 = tmp0 - tmp2;
+    float tmp13 = tmp1 + tmp3;
+    float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+    tmp0 = tmp10 + tmp13;
+    tmp3 = tmp10 - tmp13;
+    tmp1 = tmp11 + tmp12;
+    tmp2 = tmp11 - tmp12;
+
+    // Odd part.
+    float tmp4 = in[8];
+    float tmp5 = in[24];
+    float tmp6 = in[40];
+    float tmp7 = in[56];
+    const float z13 = tmp6 + tmp5;
+    const float z10 = tmp6 - tmp5;
+    const float z11 = tmp4 + tmp7;
+    const float z12 = tmp4 - tmp7;
+    tmp7 = z11 + z13;
+    tmp11 = (z11 - z13) * 1.414213562f;
+    const float z5 = (z10 + z12) * 1.847759065f;
+    tmp10 = 1.082392200f * z12 - z5;
+    tmp12 = -2.613125930f * z10 + z5;
+    tmp6 = tmp12 - tmp7;
+    tmp5 = tmp11 - tmp6;
+    tmp4 = tmp10 + tmp5;
+
+    out[0] = tmp0 + tmp7;
+    out[56] = tmp0 - tmp7;
+    out[8] = tmp1 + tmp6;
+    out[48] = tmp1 - tmp6;
+    out[16] = tmp2 + tmp5;
+    out[40] = tmp2 - tmp5;
+    out[32] = tmp3 + tmp4;
+    out[24] = tmp3 - tmp4;
+  }
+
+  for (int row = 0; row < 8; ++row) {
+    const float* in = workspace + row * 8;
+    uint8_t* out = output + row * output_stride;
+
+    float tmp10 = in[0] + in[4];
+    float tmp11 = in[0] - in[4];
+    float tmp13 = in[2] + in[6];
+    float tmp12 = (in[2] - in[6]) * 1.414213562f - tmp13;
+    float tmp0 = tmp10 + tmp13;
+    float tmp3 = tmp10 - tmp13;
+    float tmp1 = tmp11 + tmp12;
+    float tmp2 = tmp11 - tmp12;
+
+    const float z13 = in[5] + in[3];
+    const float z10 = in[5] - in[3];
+    const float z11 = in[1] + in[7];
+    const float z12 = in[1] - in[7];
+    float tmp7 = z11 + z13;
+    tmp11 = (z11 - z13) * 1.414213562f;
+    const float z5 = (z10 + z12) * 1.847759065f;
+    tmp10 = 1.082392200f * z12 - z5;
+    tmp12 = -2.613125930f * z10 + z5;
+    float tmp6 = tmp12 - tmp7;
+    float tmp5 = tmp11 - tmp6;
+    float tmp4 = tmp10 + tmp5;
+
+    // Undo the 8x scale of the AAN factors and level shift back to unsigned samples.
+    const float values[8] = { tmp0 + tmp7, tmp1 + tmp6, tmp2 + tmp5, tmp3 - tmp4, tmp3 + tmp4, tmp2 - tmp5, tmp1 - tmp6, tmp0 - tmp7 };
+    for (int i = 0; i < 8; ++i) {
+      const int sample = static_cast<int>(values[i] * 0.125f + 128.5f);
+      out[i] = static_cast<uint8_t>(std::min(255, std::max(0, sample)));
+    }
+  }
+}
+
+uint16_t ReadBigEndian16(const uint8_t* data)
+{
+  return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+class JpegDecoder {
+ public:
+  JpegDecoder(const uint8_t* data, size_t size) : data_(data), size_(size) {
+
+  }
+
+  bool Decode(DecodedImageWriter& writer);
+
+ private:
+  bool ReadQuantizationTables(const uint8_t* segment, size_t segment_size);
+  bool ReadHuffmanTables(const uint8_t* segment, size_t segment_size);
+  bool ReadFrameHeader(const uint8_t* segment, size_t segment_size);
+  bool DecodeScan(const uint8_t* segment, size_t segment_size, size_t& position);
+  bool DecodeBlock(JpegBitReader& reader, JpegComponent& component, int block_x, int block_y);
+  bool WriteImage(DecodedImageWriter& writer) const;
+
+  const uint8_t* data_;
+  size_t size_;
+
+  float quantization_tables_[4][64];  // zigzag order, scaled by the AAN factors
+  bool quantization_table_defined_[4] = {};
+  JpegHuffmanTable huffman_tables_[2][4];  // [0]: DC, [1]: AC
+  bool huffman_table_defined_[2][4] = {};
+
+  int width_ = 0;
+  int height_ = 0;
+  int max_h_ = 1;
+  int max_v_ = 1;
+  int mcu_columns_ = 0;
+  int mcu_rows_ = 0;
+  std::vector<JpegComponent> components_;
+  int restart_interval_ = 0;
+  bool frame_read_ = false;
+  bool scan_decoded_ = false;
+  bool rgb_components_ = false;  // Adobe transform 0: stored as RGB, not YCbCr
+};  // class JpegDecoder
+
+bool JpegDecoder::Decode(DecodedImageWriter& writer)
+{
+  size_t position = 2;
+  for (;;) {
+    // Markers may be preceded by any number of 0xFF fill bytes.
+    if (position >= size_ || data_[position] != 0xFF) {
+      break;  // missing EOI, keep what was decoded
+    }
+    while (position < size_ && data_[position] == 0xFF) {
+      position++;
+    }
+    if (position >= size_) {
+      break;
+    }
+    const uint8_t marker = data_[position++];
+
+    if (marker == 0xD9) {  // EOI
+      break;
+    }
+    if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+      continue;  // no payload
+    }
+
+    if (position + 2 > size_) {
+      return false;
+    }
+    const size_t segment_size = ReadBigEndian16(data_ + position);
+    if (segment_size < 2 || position + segment_size > size_) {
+      return false;
+    }
+    const uint8_t* segment = data_ + position + 2;
+    const size_t payload_size = segment_size - 2;
+    position += segment_size;
+
+    switch (marker) {
+      case 0xDB:
+        if (!ReadQuantizationTables(segment, payload_size)) return false;
+        break;
+      case 0xC4:
+        if (!ReadHuffmanTables(segment, payload_size)) return false;
+        break;
+      case 0xC0:  // baseline
+      case 0xC1:  // extended sequential, Huffman
+        if (frame_read_ || !ReadFrameHeader(segment, payload_size)) return false;
+        break;
+      case 0xDD:
+        if (payload_size < 2) return false;
+        restart_interval_ = ReadBigEndian16(segment);
+        break;
+      case 0xDA:
+        if (!frame_read_ || !DecodeScan(segment, payload_size, position)) return false;
+        scan_decoded_ = true;
+        break;
+      case 0xEE:  // APP14, Adobe color transform
+        if (payload_size >= 12 && std::memcmp(segment, "Adobe", 5) == 0) {
+          rgb_components_ = segment[11] == 0;
+        }
+        break;
+      default:
+        // Progressive, lossless, hierarchical and arithmetic coded frames are not supported.
+        if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+          return false;
+        }
+        break;  // APPn, COM and the rest are skipped
+    }
+  }
+
+  return scan_decoded_ && WriteImage(writer);
+}
+
+bool JpegDecoder::ReadQuantizationTables(const uint8_t* segment, size_t segment_size)
+{
+  // AAN scale factors: cos(k * pi / 16) * sqrt(2) for k > 0, 1 for k = 0.
+  static const float kAanScales[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+  size_t offset = 0;
+  while (offset < segment_size) {
+    const int precision = segment[offset] >> 4;
+    const int table_id = segment[offset] & 0x0F;
+    offset++;
+    const size_t value_size = precision == 0 ? 1 : 2;
+    if (precision > 1 || table_id > 3 || offset + 64 * value_size > segment_size) {
+      return false;
+    }
+
+    for (int k = 0; k < 64; ++k) {
+      const int value = precision == 0 ? segment[offset + k] : ReadBigEndian16(segment + offset + k * 2);
+      const int natural = kZigzag[k];
+      quantization_tables_[table_id][k] = value * kAanScales[natural / 8] * kAanScales[natural % 8];
+    }
+    quantization_table_defined_[table_id] = true;
+    offset += 64 * value_size;
+  }
+  return true;
+}
+
+bool JpegDecoder::ReadHuffmanTables(const uint8_t* segment, size_t segment_size)
+{
+  size_t offset = 0;
+  while (offset < segment_size) {
+    if (offset + 17 > segment_size) {
+      return false;
+    }
+    const int table_class = segment[offset] >> 4;
+    const int table_id = segment[offset] & 0x0F;
+    const uint8_t* counts = segment + offset + 1;
+    int value_number = 0;
+    for (int i = 0; i < 16; ++i) {
+      value_number += counts[i];
+    }
+    offset += 17;
+    if (table_class > 1 || table_id > 3 || value_number > 256 || offset + value_number > segment_size) {
+      return false;
+    }
+
+    if (!huffman_tables_[table_class][table_id].Build(counts, segment + offset, value_number)) {
+      return false;
+    }
+    huffman_table_defined_[table_class][table_id] = true;
+    offset += value_number;
+  }
+  return true;
+}
+
+bool JpegDecoder::ReadFrameHeader(const uint8_t* segment, size_t segment_size)
+{
+  if (segment_size < 6) {
+    return false;
+  }
+
+  const int precision = segment[0];
+  height_ = ReadBigEndian16(segment + 1);
+  width_ = ReadBigEndian16(segment + 3);
+  const int component_number = segment[5];
+  // Height 0 (defined later by DNL), 12 bit samples and CMYK are not supported.
+  if (precision != 8 || height_ == 0 || width_ == 0 || height_ > static_cast<int>(kMaxDimension) || width_ > static_cast<int>(kMaxDimension) ||
+      (component_number != 1 && component_number != 3) || segment_size < 6 + static_cast<size_t>(component_number) * 3) {
+    return false;
+  }
+
+  components_.resize(component_number);
+  for (int i = 0; i < component_number; ++i) {
+    JpegComponent& component = components_[i];
+    component.id = segment[6 + i * 3];
+    component.h = segment[7 + i * 3] >> 4;
+    component.v = segment[7 + i * 3] & 0x0F;
+    component.quantization_table = segment[8 + i * 3];
+    if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantization_table > 3) {
+      return false;
+    }
+    max_h_ = std::max(max_h_, component.h);
+    max_v_ = std::max(max_v_, component.v);
+  }
+
+  mcu_columns_ = (width_ + 8 * max_h_ - 1) / (8 * max_h_);
+  mcu_rows_ = (height_ + 8 * max_v_ - 1) / (8 * max_v_);
+  for (JpegComponent& component : components_) {
+    component.plane_width = mcu_columns_ * component.h * 8;
+    component.plane_height = mcu_rows_ * component.v * 8;
+    component.plane.assign(static_cast<size_t>(component.plane_width) * component.plane_height, 0);
+  }
+
+  // JFIF files without an Adobe marker may still label their components R, G, B.
+  rgb_components_ = rgb_components_ || (component_number == 3 && components_[0].id == 'R' && components_[1].id == 'G' && components_[2].id == 'B');
+  frame_read_ = true;
+  return true;
+}
+
+bool JpegDecoder::DecodeBlock(JpegBitReader& reader, JpegComponent& component, int block_x, int block_y)
+{
+  float coefficients[64] = {};
+  const float* quantization_table = quantization_tables_[component.quantization_table];
+
+  const int dc_category = huffman_tables_[0][component.dc_table].Decode(reader);
+  if (dc_category < 0 || dc_category > 11) {
+    return false;
+  }
+  component.dc_prediction += reader.ReceiveExtend(dc_category);
+  coefficients[0] = component.dc_prediction * quantization_table[0];
+
+  const JpegHuffmanTable& ac_table = huffman_tables_[1][component.ac_table];
+  for (int k = 1; k < 64;) {
+    const int run_size = ac_table.Decode(reader);
+    if (run_size < 0) {
+      return false;
+    }
+    const int run = run_size >> 4;
+    const int category = run_size & 0x0F;
+    if (category == 0) {
+      if (run != 15) {
+        break;  // end of block
+      }
+      k += 16;
+      continue;
+    }
+
+    k += run;
+    if (k > 63) {
+      return false;
+    }
+    coefficients[kZigzag[k]] = reader.ReceiveExtend(category) * quantization_table[k];
+    k++;
+  }
+
+  InverseDct(coefficients, &component.plane[static_cast<size_t>(block_y) * 8 * component.plane_width + block_x * 8], component.plane_width);
+  return true;
+}
+
+bool JpegDecoder::DecodeScan(const uint8_t* segment, size_t segment_size, size_t& position)
+{
+  if (segment_size < 1) {
+    return false;
+  }
+  const int scan_component_number = segment[0];
+  if (scan_component_number < 1 || scan_component_number > static_cast<int>(components_.size()) || segment_size < 4 + static_cast<size_t>(scan_component_number) * 2) {
+    return false;
+  }
+
+  std::vector<JpegComponent*> scan_components;
+  for (int i = 0; i < scan_component_number; ++i) {
+    const int id = segment[1 + i * 2];
+    auto found = std::find_if(components_.begin(), components_.end(), [id](const JpegComponent& component) {
+      return component.id == id;
+    });
+    if (found == components_.end()) {
+      return false;
+    }
+    found->dc_table = segment[2 + i * 2] >> 4;
+    found->ac_table = segment[2 + i * 2] & 0x0F;
+    if (found->dc_table > 3 || found->ac_table > 3 ||
+        !huffman_table_defined_[0][found->dc_table] || !huffman_table_defined_[1][found->ac_table] ||
+        !quantization_table_defined_[found->quantization_table]) {
+      return false;
+    }
+    found->dc_prediction = 0;
+    scan_components.push_back(&*found);
+  }
+
+  // A single component scan covers just that component's blocks, in raster order; otherwise whole MCUs.
+  int mcu_columns = mcu_columns_;
+  int mcu_rows = mcu_rows_;
+  if (scan_component_number == 1) {
+    const JpegComponent& component = *scan_components[0];
+    mcu_columns = ((width_ * component.h + max_h_ - 1) / max_h_ + 7) / 8;
+    mcu_rows = ((height_ * component.v + max_v_ - 1) / max_v_ + 7) / 8;
+  }
+
+  JpegBitReader reader(data_, size_, position);
+  int restarts_left = restart_interval_;
+  for (int mcu_y = 0; mcu_y < mcu_rows; ++mcu_y) {
+    for (int mcu_x = 0; mcu_x < mcu_columns; ++mcu_x) {
+      if (restart_interval_ != 0) {
+        if (restarts_left == 0) {
+          if (!reader.Restart()) {
+            return false;
+          }
+          for (JpegComponent* component : scan_components) {
+            component->dc_prediction = 0;
+          }
+          restarts_left = restart_interval_;
+        }
+        restarts_left--;
+      }
+
+      if (scan_component_number == 1) {
+        if (!DecodeBlock(reader, *scan_components[0], mcu_x, mcu_y)) {
+          return false;
+        }
+        continue;
+      }
+      for (JpegComponent* component : scan_components) {
+        for (int v = 0; v < component->v; ++v) {
+          for (int h = 0; h < component->h; ++h) {
+            if (!DecodeBlock(reader, *component, mcu_x * component->h + h, mcu_y * component->v + v)) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  position = reader.GetPosition();
+  return true;
+}
+
+bool JpegDecoder::WriteImage(DecodedImageWriter& writer) const
+{
+  if (!writer.Begin(static_cast<UINT>(width_), static_cast<UINT>(height_), DXGI_FORMAT_R8G8B8A8_UNORM)) {
+    return false;
+  }
+
+  // Subsampled components are upsampled by replication.
+  std::vector<int> source_columns[3];
+  for (size_t i = 0; i < components_.size(); ++i) {
+    source_columns[i].resize(width_);
+    for (int x = 0; x < width_; ++x) {
+      source_columns[i][x] = x * components_[i].h / max_h_;
+    }
+  }
+
+  for (int y = 0; y < height_; ++y) {
+    uint8_t* row = writer.GetRow(static_cast<UINT>(y));
+    const uint8_t* source_rows[3] = {};
+    for (size_t i = 0; i < components_.size(); ++i) {
+      source_rows[i] = &components_[i].plane[static_cast<size_t>(y * components_[i].v / max_v_) * components_[i].plane_width];
+    }
+
+    if (components_.size() == 1) {
+      for (int x = 0; x < width_; ++x) {
+        const uint8_t gray = source_rows[0][source_columns[0][x]];
+        row[x * 4 + 0] = gray;
+        row[x * 4 + 1] = gray;
+        row[x * 4 + 2] = gray;
+        row[x * 4 + 3] = 255;
+      }
+      continue;
+    }
+
+    for (int x = 0; x < width_; ++x) {
+      const int c0 = source_rows[0][source_columns[0][x]];
+      const int c1 = source_rows[1][source_columns[1][x]];
+      const int c2 = source_rows[2][source_columns[2][x]];
+      if (rgb_components_) {
+        row[x * 4 + 0] = static_cast<uint8_t>(c0);
+        row[x * 4 + 1] = static_cast<uint8_t>(c1);
+        row[x * 4 + 2] = static_cast<uint8_t>(c2);
+      } else {
+        // JFIF YCbCr to RGB, 16 bit fixed point.
+        const int cb = c1 - 128;
+        const int cr = c2 - 128;
+        const int y_scaled = (c0 << 16) + (1 << 15);
+        const int r = (y_scaled + 91881 * cr) >> 16;
+        const int g = (y_scaled - 22554 * cb - 46802 * cr) >> 16;
+        const int b = (y_scaled + 116130 * cb) >> 16;
+        row[x * 4 + 0] = static_cast<uint8_t>(std::min(255, std::max(0, r)));
+        row[x * 4 + 1] = static_cast<uint8_t>(std::min(255, std::max(0, g)));
+        row[x * 4 + 2] = static_cast<uint8_t>(std::min(255, std::max(0, b)));
+      }
+      row[x * 4 + 3] = 255;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool DecodeJpeg(const uint8_t* data, size_t size, DecodedImageWriter& writer)
+{
+  // The decoder holds the component planes and tables, too big for the stack.
+  std::unique_ptr<JpegDecoder> decoder = std::make_unique<JpegDecoder>(data, size);
+  return decoder->Decode(writer);
+}
+
+}  // namespace PortableImage
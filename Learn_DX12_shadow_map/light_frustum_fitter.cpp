@@ -0,0 +1,196 @@
+#include "light_frustum_fitter.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+
+using BoundingBox = LightFrustumFitter::BoundingBox;
+
+const BoundingBox kEmptyBox = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+
+bool IsEmpty(const BoundingBox& bounding_box)
+{
+  return bounding_box.min.x > bounding_box.max.x || bounding_box.min.y > bounding_box.max.y || bounding_box.min.z > bounding_box.max.z;
+}
+
+void Expand(BoundingBox& bounding_box, FXMVECTOR point)
+{
+  XMFLOAT3 p;
+  XMStoreFloat3(&p, point);
+  bounding_box.min = XMFLOAT3(std::min(bounding_box.min.x, p.x), std::min(bounding_box.min.y, p.y), std::min(bounding_box.min.z, p.z));
+  bounding_box.max = XMFLOAT3(std::max(bounding_box.max.x, p.x), std::max(bounding_box.max.y, p.y), std::max(bounding_box.max.z, p.z));
+}
+
+BoundingBox Intersect(const BoundingBox& a, const BoundingBox& b)
+{
+  BoundingBox intersection;
+  intersection.min = XMFLOAT3(std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y), std::max(a.min.z, b.min.z));
+  intersection.max = XMFLOAT3(std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y), std::min(a.max.z, b.max.z));
+  return intersection;
+}
+
+void GetCorners(const BoundingBox& bounding_box, XMVECTOR* corners)
+{
+  for (int i = 0; i < 8; ++i) {
+    corners[i] = XMVectorSet((i & 1) ? bounding_box.max.x : bounding_box.min.x, (i & 2) ? bounding_box.max.y : bounding_box.min.y,
+      (i & 4) ? bounding_box.max.z : bounding_box.min.z, 1.0f);
+  }
+}
+
+// Bounds of the box's corners after transform.
+BoundingBox TransformBox(const BoundingBox& bounding_box, FXMMATRIX transform)
+{
+  XMVECTOR corners[8];
+  GetCorners(bounding_box, corners);
+  BoundingBox transformed_box = kEmptyBox;
+  for (int i = 0; i < 8; ++i) {
+    Expand(transformed_box, XMVector3TransformCoord(corners[i], transform));
+  }
+  return transformed_box;
+}
+
+// Tangents x / z and y / z of the box's corners, in light view space, left, right, bottom, top. The part of
+// the box in front of min_z is all the light can see.
+void GetTangentRect(const BoundingBox& light_space_box, float min_z, float max_tan, float* rect)
+{
+  rect[0] = rect[2] = FLT_MAX;
+  rect[1] = rect[3] = -FLT_MAX;
+  const float zs[2] = { std::max(light_space_box.min.z, min_z), light_space_box.max.z };
+  for (float z : zs) {
+    rect[0] = std::min(rect[0], std::min(light_space_box.min.x / z, light_space_box.max.x / z));
+    rect[1] = std::max(rect[1], std::max(light_space_box.min.x / z, light_space_box.max.x / z));
+    rect[2] = std::min(rect[2], std::min(light_space_box.min.y / z, light_space_box.max.y / z));
+    rect[3] = std::max(rect[3], std::max(light_space_box.min.y / z, light_space_box.max.y / z));
+  }
+  for (int i = 0; i < 4; ++i) {
+    rect[i] = std::min(std::max(rect[i], -max_tan), max_tan);
+  }
+}
+
+// Receivers are the objects inside the frustum, clipped to the frustum's own bounds, in light view space.
+BoundingBox GetReceiverBounds(FXMMATRIX light_view, const XMVECTOR* frustum_corners, const BoundingBox* object_bounds, size_t object_number)
+{
+  BoundingBox frustum_box = kEmptyBox;
+  for (int i = 0; i < 8; ++i) {
+    Expand(frustum_box, frustum_corners[i]);
+  }
+
+  BoundingBox receivers = kEmptyBox;
+  for (size_t i = 0; i < object_number; ++i) {
+    if (IsEmpty(object_bounds[i]) || !LightFrustumFitter::IntersectsFrustum(frustum_corners, object_bounds[i])) {
+      continue;
+    }
+    const BoundingBox light_space_box = TransformBox(Intersect(object_bounds[i], frustum_box), light_view);
+    Expand(receivers, XMLoadFloat3(&light_space_box.min));
+    Expand(receivers, XMLoadFloat3(&light_space_box.max));
+  }
+  return receivers;
+}
+
+}  // namespace
+
+bool LightFrustumFitter::FitOrthographic(FXMMATRIX light_view, const XMVECTOR* frustum_corners, const BoundingBox* object_bounds, size_t object_number,
+                                         BoundingBox& light_space_bounds)
+{
+  BoundingBox receivers = GetReceiverBounds(light_view, frustum_corners, object_bounds, object_number);
+  if (IsEmpty(receivers)) {
+    return false;
+  }
+
+  BoundingBox light_space_frustum = kEmptyBox;
+  for (int i = 0; i < 8; ++i) {
+    Expand(light_space_frustum, XMVector3TransformCoord(frustum_corners[i], light_view));
+  }
+  receivers = Intersect(receivers, light_space_frustum);
+  if (IsEmpty(receivers)) {
+    return false;
+  }
+
+  // Casters only matter over the receivers' footprint and in front of their far side.
+  float near_z = receivers.min.z;
+  for (size_t i = 0; i < object_number; ++i) {
+    if (IsEmpty(object_bounds[i])) {
+      continue;
+    }
+    const BoundingBox caster = TransformBox(object_bounds[i], light_view);
+    if (caster.max.x < receivers.min.x || caster.min.x > receivers.max.x || caster.max.y < receivers.min.y || caster.min.y > receivers.max.y ||
+        caster.min.z > receivers.max.z) {
+      continue;
+    }
+    near_z = std::min(near_z, caster.min.z);
+  }
+
+  light_space_bounds = receivers;
+  light_space_bounds.min.z = near_z;
+  return true;
+}
+
+bool LightFrustumFitter::FitPerspective(FXMMATRIX light_view, const XMVECTOR* frustum_corners, const BoundingBox* object_bounds, size_t object_number,
+                                        float max_tan_half_angle, float min_near_plane, PerspectiveBounds& bounds)
+{
+  const BoundingBox receivers = GetReceiverBounds(light_view, frustum_corners, object_bounds, object_number);
+  if (IsEmpty(receivers) || receivers.max.z <= min_near_plane) {
+    return false;
+  }
+
+  float receiver_rect[4];
+  GetTangentRect(receivers, min_near_plane, max_tan_half_angle, receiver_rect);
+
+  float near_plane = std::max(receivers.min.z, min_near_plane);
+  for (size_t i = 0; i < object_number; ++i) {
+    if (IsEmpty(object_bounds[i])) {
+      continue;
+    }
+    const BoundingBox caster = TransformBox(object_bounds[i], light_view);
+    if (caster.max.z <= min_near_plane || caster.min.z > receivers.max.z) {
+      continue;
+    }
+    float caster_rect[4];
+    GetTangentRect(caster, min_near_plane, max_tan_half_angle, caster_rect);
+    if (caster_rect[1] < receiver_rect[0] || caster_rect[0] > receiver_rect[1] || caster_rect[3] < receiver_rect[2] || caster_rect[2] > receiver_rect[3]) {
+      continue;
+    }
+    near_plane = std::min(near_plane, std::max(caster.min.z, min_near_plane));
+  }
+
+  bounds.left = receiver_rect[0];
+  bounds.right = receiver_rect[1];
+  bounds.bottom = receiver_rect[2];
+  bounds.top = receiver_rect[3];
+  bounds.near_plane = near_plane;
+  // A receiver facing the light square on has no depth of its own.
+  bounds.far_plane = std::max(receivers.max.z, near_plane + 1.0f / 16.0f);
+  return true;
+}
+
+bool LightFrustumFitter::IntersectsFrustum(const XMVECTOR* frustum_corners, const BoundingBox& bounding_box)
+{
+  // near, far, left, right, top, bottom; corners are ordered top left, top right, bottom right, bottom left.
+  static const int kFaces[6][3] = { {0, 1, 2}, {4, 5, 6}, {0, 3, 7}, {1, 2, 6}, {0, 1, 5}, {3, 2, 6} };
+
+  XMVECTOR center = XMVectorZero();
+  for (int i = 0; i < 8; ++i) {
+    center = XMVectorAdd(center, frustum_corners[i]);
+  }
+  center = XMVectorScale(center, 1.0f / 8.0f);
+
+  for (const auto& face : kFaces) {
+    const XMVECTOR p = frustum_corners[face[0]];
+    XMVECTOR normal = XMVector3Cross(XMVectorSubtract(frustum_corners[face[1]], p), XMVectorSubtract(frustum_corners[face[2]], p));
+    // Pointing inwards whatever the winding.
+    if (XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(center, p))) < 0.0f) {
+      normal = XMVectorNegate(normal);
+    }
+
+    // The box corner furthest along the normal.
+    XMFLOAT3 n;
+    XMStoreFloat3(&n, normal);
+    const XMVECTOR farthest = XMVectorSet(n.x >= 0.0f ? bounding_box.max.x : bounding_box.min.x, n.y >= 0.0f ? bounding_box.max.y : bounding_box.min.y,
+      n.z >= 0.0f ? bounding_box.max.z : bounding_box.min.z, 1.0f);
+    if (XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(farthest, p))) < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "model.h"
+
+using namespace DirectX;
+
+// Fits a light's projection to what it actually has to shade: the receivers, i.e. objects inside a view
+// frustum (clipped to it), and the casters that can throw a shadow onto them. Bounds are world space
+// boxes, e.g. AssetsManager::DrawArgument::world_bounding_box. Only DirectXMath is used, so it runs
+// without a device.
+class LightFrustumFitter {
+ public:
+  using BoundingBox = Asset::Model::BoundingBox;
+
+  // Tangents of the frustum sides as seen from the light, and its depth range.
+  struct PerspectiveBounds {
+    float left;
+    float right;
+    float bottom;
+    float top;
+    float near_plane;
+    float far_plane;
+  };  // struct PerspectiveBounds
+
+  // light_view maps world space to the light's view space, looking down +z. frustum_corners are the 8 world
+  // space corners of the view frustum, near plane first (see CascadedShadowMap::ComputeFrustumCorners).
+  // Writes the light view space box holding the receivers and, in front of them, their casters. Returns false
+  // if no receiver is inside the frustum.
+  static bool FitOrthographic(FXMMATRIX light_view, const XMVECTOR* frustum_corners, const BoundingBox* object_bounds, size_t object_number,
+                              BoundingBox& light_space_bounds);
+
+  // The same for a light at light_view's origin. The sides never open wider than max_tan_half_angle (the
+  // light's cone) and near_plane never comes closer than min_near_plane.
+  static bool FitPerspective(FXMMATRIX light_view, const XMVECTOR* frustum_corners, const BoundingBox* object_bounds, size_t object_number,
+                             float max_tan_half_angle, float min_near_plane, PerspectiveBounds& bounds);
+
+  // False when the box is entirely outside one of the frustum's planes.
+  static bool IntersectsFrustum(const XMVECTOR* frustum_corners, const BoundingBox& bounding_box);
+};  // class LightFrustumFitter
@@ -0,0 +1,56 @@
+#include "mapped_file.h"
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+bool MappedFile::Open(const std::wstring& file_name)
+{
+  Close();
+
+  file_ = CreateFileW(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart <= 0) {
+    Close();
+    return false;
+  }
+
+  file_mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (file_mapping_ == nullptr) {
+    Close();
+    return false;
+  }
+
+  data_ = static_cast<const uint8_t*>(MapViewOfFile(file_mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    Close();
+    return false;
+  }
+
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+
+  if (file_mapping_ != nullptr) {
+    CloseHandle(file_mapping_);
+    file_mapping_ = nullptr;
+  }
+
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+}
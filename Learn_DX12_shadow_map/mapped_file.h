@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "common_headers.h"
+
+// Read-only view of a whole file, mapped into memory. Nothing is read until the pages are touched.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file can't be opened or mapped (an empty file can't be mapped either).
+  bool Open(const std::wstring& file_name);
+  void Close();
+
+  bool IsOpen() const {
+    return data_ != nullptr;
+  }
+
+  const uint8_t* GetData() const {
+    return data_;
+  }
+
+  size_t GetSize() const {
+    return size_;
+  }
+
+ private:
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE file_mapping_ = nullptr;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};  // class MappedFile
@@ -0,0 +1,125 @@
+#include "mesh_cache.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kBlockAlignment = 16;
+
+uint64_t AlignBlockOffset(uint64_t offset)
+{
+  return (offset + kBlockAlignment - 1) & ~(kBlockAlignment - 1);
+}
+
+// Whether [offset, offset + element_number * element_size) lies inside a file of file_size bytes.
+bool IsBlockInFile(uint64_t offset, uint64_t element_number, uint64_t element_size, uint64_t file_size)
+{
+  if (offset % kBlockAlignment != 0 || offset > file_size) {
+    return false;
+  }
+
+  return element_number <= (file_size - offset) / element_size;
+}
+
+}  // namespace
+
+bool MeshCache::Write(const std::wstring& file_name,
+  const Asset::Model::Vertex* vertices, size_t vertex_number,
+  const DWORD* indices, size_t index_number,
+  const std::vector<Draw>& draws,
+  const std::vector<std::string>& texture_file_names)
+{
+  Header header{};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.vertex_stride = static_cast<uint32_t>(sizeof(Asset::Model::Vertex));
+  header.vertex_number = static_cast<uint32_t>(vertex_number);
+  header.index_number = static_cast<uint32_t>(index_number);
+  header.draw_number = static_cast<uint32_t>(draws.size());
+  header.texture_number = static_cast<uint32_t>(texture_file_names.size());
+  header.vertex_layout = VertexLayout::kInterleaved;
+  header.vertex_offset = AlignBlockOffset(sizeof(Header));
+  header.index_offset = AlignBlockOffset(header.vertex_offset + vertex_number * sizeof(Asset::Model::Vertex));
+  header.draw_offset = AlignBlockOffset(header.index_offset + index_number * sizeof(DWORD));
+  header.texture_offset = AlignBlockOffset(header.draw_offset + draws.size() * sizeof(Draw));
+  header.file_size = header.texture_offset + texture_file_names.size() * sizeof(TextureReference);
+
+  // Zero filled, so padding and unused name bytes are deterministic.
+  std::vector<uint8_t> file_data(static_cast<size_t>(header.file_size), 0);
+  std::memcpy(file_data.data(), &header, sizeof(Header));
+  if (vertex_number > 0) {
+    std::memcpy(file_data.data() + header.vertex_offset, vertices, vertex_number * sizeof(Asset::Model::Vertex));
+  }
+  if (index_number > 0) {
+    std::memcpy(file_data.data() + header.index_offset, indices, index_number * sizeof(DWORD));
+  }
+  if (!draws.empty()) {
+    std::memcpy(file_data.data() + header.draw_offset, draws.data(), draws.size() * sizeof(Draw));
+  }
+
+  TextureReference* texture_references = reinterpret_cast<TextureReference*>(file_data.data() + header.texture_offset);
+  for (size_t i = 0; i < texture_file_names.size(); ++i) {
+    if (texture_file_names[i].size() >= kMaxTextureFileNameLength) {
+      return false;
+    }
+    std::memcpy(texture_references[i].file_name, texture_file_names[i].c_str(), texture_file_names[i].size());
+  }
+
+  HANDLE file = CreateFileW(file_name.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  DWORD written_size = 0;
+  const BOOL written = WriteFile(file, file_data.data(), static_cast<DWORD>(file_data.size()), &written_size, nullptr);
+  CloseHandle(file);
+
+  return written && written_size == file_data.size();
+}
+
+bool MeshCache::Load(const std::wstring& file_name)
+{
+  header_ = nullptr;
+  if (!file_.Open(file_name)) {
+    return false;
+  }
+
+  const uint64_t file_size = file_.GetSize();
+  const Header* header = reinterpret_cast<const Header*>(file_.GetData());
+  if (file_size < sizeof(Header) ||
+      header->magic != kMagic ||
+      header->version != kVersion ||
+      header->vertex_layout != VertexLayout::kInterleaved ||
+      header->vertex_stride != sizeof(Asset::Model::Vertex) ||
+      header->file_size != file_size ||
+      !IsBlockInFile(header->vertex_offset, header->vertex_number, sizeof(Asset::Model::Vertex), file_size) ||
+      !IsBlockInFile(header->index_offset, header->index_number, sizeof(DWORD), file_size) ||
+      !IsBlockInFile(header->draw_offset, header->draw_number, sizeof(Draw), file_size) ||
+      !IsBlockInFile(header->texture_offset, header->texture_number, sizeof(TextureReference), file_size)) {
+    file_.Close();
+    return false;
+  }
+
+  // Draw ranges and texture references are trusted by everything downstream, so check them once here.
+  const Draw* draws = reinterpret_cast<const Draw*>(file_.GetData() + header->draw_offset);
+  for (uint32_t i = 0; i < header->draw_number; ++i) {
+    const Draw& draw = draws[i];
+    if (static_cast<uint64_t>(draw.vertex_base) + draw.vertex_number > header->vertex_number ||
+        static_cast<uint64_t>(draw.index_start) + draw.index_number > header->index_number ||
+        draw.texture_index >= static_cast<int32_t>(header->texture_number)) {
+      file_.Close();
+      return false;
+    }
+  }
+
+  const TextureReference* texture_references = reinterpret_cast<const TextureReference*>(file_.GetData() + header->texture_offset);
+  for (uint32_t i = 0; i < header->texture_number; ++i) {
+    if (std::memchr(texture_references[i].file_name, 0, kMaxTextureFileNameLength) == nullptr) {
+      file_.Close();
+      return false;
+    }
+  }
+
+  header_ = header;
+  return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "model.h"
+
+// Baked geometry container, laid out so a mapped file can be used in place:
+//
+//   Header | vertex block (Asset::Model::Vertex) | index block (DWORD) | draw table (Draw) | texture table (TextureReference)
+//
+// Every block starts on a 16 byte boundary at the offset recorded in the header. Indices are relative to
+// their draw's vertex_base, the same as the merged buffers AssetsManager builds.
+//
+// The vertex block is always interleaved, as Asset::Model hands out whole vertices: with the de-interleaved
+// vertex streams, AssetsManager::CopyMergedVertexStreamsAndIndices splits it while it copies into the upload
+// heap, the one pass over the vertices a load makes anyway. The header records the layout, so a cache of
+// another one is rejected rather than misread.
+class MeshCache {
+ public:
+  static constexpr uint32_t kMagic = 0x4348534D;  // "MSHC"
+  static constexpr uint32_t kVersion = 2;  // 2: vertex_layout
+  static constexpr size_t kMaxTextureFileNameLength = 256;  // including the terminating zero
+
+  enum class VertexLayout : uint32_t {
+    kInterleaved = 0,  // Asset::Model::Vertex
+  };  // enum class VertexLayout
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_stride;  // sizeof(Asset::Model::Vertex) when cooked, checked on load
+    uint32_t vertex_number;
+    uint32_t index_number;
+    uint32_t draw_number;
+    uint32_t texture_number;
+    VertexLayout vertex_layout;  // of the vertex block, checked on load
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t draw_offset;
+    uint64_t texture_offset;
+    uint64_t file_size;
+  };  // struct Header
+
+  struct Draw {
+    uint32_t vertex_base;
+    uint32_t vertex_number;
+    uint32_t index_start;
+    uint32_t index_number;
+    int32_t texture_index;  // into the texture table, -1 for none
+    uint32_t reserved[3];
+    XMFLOAT4X4 model_transform;  // as returned by Asset::Model::GetModelTransform
+  };  // struct Draw
+
+  struct TextureReference {
+    char file_name[kMaxTextureFileNameLength];
+  };  // struct TextureReference
+
+  // Serializes merged geometry into file_name. Returns false if a texture name is too long or the file
+  // can't be written.
+  static bool Write(const std::wstring& file_name,
+    const Asset::Model::Vertex* vertices, size_t vertex_number,
+    const DWORD* indices, size_t index_number,
+    const std::vector<Draw>& draws,
+    const std::vector<std::string>& texture_file_names);
+
+  // Maps file_name and checks the header and every range in it. Nothing is copied; the accessors below
+  // point into the mapping and stay valid as long as this object lives.
+  bool Load(const std::wstring& file_name);
+
+  const Header& GetHeader() const {
+    return *header_;
+  }
+
+  const Asset::Model::Vertex* GetVertexData() const {
+    return reinterpret_cast<const Asset::Model::Vertex*>(file_.GetData() + header_->vertex_offset);
+  }
+
+  const DWORD* GetIndexData() const {
+    return reinterpret_cast<const DWORD*>(file_.GetData() + header_->index_offset);
+  }
+
+  const Draw* GetDraws() const {
+    return reinterpret_cast<const Draw*>(file_.GetData() + header_->draw_offset);
+  }
+
+  // Empty for texture_index < 0.
+  std::string GetTextureFileName(int32_t texture_index) const {
+    if (texture_index < 0) {
+      return "";
+    }
+
+    const TextureReference* texture_references = reinterpret_cast<const TextureReference*>(file_.GetData() + header_->texture_offset);
+    return texture_references[texture_index].file_name;
+  }
+
+ private:
+  MappedFile file_;
+  const Header* header_ = nullptr;
+};  // class MeshCache
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+
+#include "mesh_cache.h"
+#include "model.h"
+
+namespace Asset {
+
+// One draw of a loaded MeshCache. The geometry stays in the mapped file, shared by every model made from it.
+class MeshCacheModel : public Model {
+ public:
+  MeshCacheModel(std::shared_ptr<const MeshCache> mesh_cache, uint32_t draw_index)
+    : mesh_cache_(std::move(mesh_cache)), draw_(mesh_cache_->GetDraws()[draw_index]) {
+
+  }
+
+  const Vertex* GetVertexData() const override {
+    return mesh_cache_->GetVertexData() + draw_.vertex_base;
+  }
+
+  size_t GetVertexDataSize() const override {
+    return GetVertexNumber() * sizeof(Vertex);
+  }
+
+  size_t GetVertexNumber() const override {
+    return draw_.vertex_number;
+  }
+
+  const DWORD* GetIndexData() const override {
+    return mesh_cache_->GetIndexData() + draw_.index_start;
+  }
+
+  size_t GetIndexDataSize() const override {
+    return GetIndexNumber() * sizeof(DWORD);
+  }
+
+  size_t GetIndexNumber() const override {
+    return draw_.index_number;
+  }
+
+  const std::string GetTextureImageFileName() const override {
+    return mesh_cache_->GetTextureFileName(draw_.texture_index);
+  }
+
+ private:
+  std::shared_ptr<const MeshCache> mesh_cache_;
+  const MeshCache::Draw& draw_;
+};  // class MeshCacheModel
+
+}  // namespace Asset
@@ -0,0 +1,352 @@
+#include "mip_chain_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace {
+
+constexpr float kKaiserWidth = 3.0f;  // in destination texels
+constexpr float kKaiserAlpha = 4.0f;
+constexpr UINT kBandRowNumber = 8;  // destination rows per ParallelFor job
+constexpr int kSrgbEncodeTableSize = 1 << 14;
+
+struct PixelLayout {
+  UINT channel_number = 0;
+  UINT channel_size = 0;  // 1 and 2 bytes are UNORM, 4 bytes are float
+  UINT color_channel_number = 0;  // leading channels that may be sRGB encoded
+};  // struct PixelLayout
+
+bool GetPixelLayout(DXGI_FORMAT format, PixelLayout& layout)
+{
+  switch (format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+      layout = { 4, 1, 3 };
+      return true;
+    case DXGI_FORMAT_R8_UNORM:
+      layout = { 1, 1, 1 };
+      return true;
+    case DXGI_FORMAT_A8_UNORM:
+      layout = { 1, 1, 0 };
+      return true;
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+      layout = { 4, 2, 3 };
+      return true;
+    case DXGI_FORMAT_R16_UNORM:
+      layout = { 1, 2, 1 };
+      return true;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+      layout = { 4, 4, 0 };
+      return true;
+    case DXGI_FORMAT_R32_FLOAT:
+      layout = { 1, 4, 0 };
+      return true;
+    default:
+      return false;
+  }
+}
+
+float SrgbToLinear(float value)
+{
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float value)
+{
+  return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Decoding is exact. 8 bit encoding looks linear values up at 1/16384 steps, which is within 0.1 of a
+// step of the exact result even near black where the curve is steepest.
+class SrgbTables {
+ public:
+  static const SrgbTables& Get() {
+    static const SrgbTables tables;
+    return tables;
+  }
+
+  float decode_8bit[256];
+  std::vector<float> decode_16bit;
+  uint8_t encode_8bit[kSrgbEncodeTableSize];
+
+ private:
+  SrgbTables() : decode_16bit(65536) {
+    for (int i = 0; i < 256; ++i) {
+      decode_8bit[i] = SrgbToLinear(i / 255.0f);
+    }
+    for (int i = 0; i < 65536; ++i) {
+      decode_16bit[i] = SrgbToLinear(i / 65535.0f);
+    }
+    for (int i = 0; i < kSrgbEncodeTableSize; ++i) {
+      encode_8bit[i] = static_cast<uint8_t>(LinearToSrgb(i / static_cast<float>(kSrgbEncodeTableSize - 1)) * 255.0f + 0.5f);
+    }
+  }
+};  // class SrgbTables
+
+// Source rows are unpacked to float4 (missing channels 0, alpha 1), color in linear space when sRGB.
+void DecodeRow(const uint8_t* row, UINT width, const PixelLayout& layout, bool srgb, XMFLOAT4* output)
+{
+  const SrgbTables& tables = SrgbTables::Get();
+  const UINT srgb_channel_number = srgb ? layout.color_channel_number : 0;
+  for (UINT x = 0; x < width; ++x) {
+    float values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const uint8_t* pixel = row + static_cast<size_t>(x) * layout.channel_number * layout.channel_size;
+    for (UINT channel = 0; channel < layout.channel_number; ++channel) {
+      if (layout.channel_size == 1) {
+        const uint8_t value = pixel[channel];
+        values[channel] = channel < srgb_channel_number ? tables.decode_8bit[value] : value * (1.0f / 255.0f);
+      } else if (layout.channel_size == 2) {
+        uint16_t value;
+        std::memcpy(&value, pixel + channel * 2, sizeof(value));
+        values[channel] = channel < srgb_channel_number ? tables.decode_16bit[value] : value * (1.0f / 65535.0f);
+      } else {
+        std::memcpy(&values[channel], pixel + channel * 4, sizeof(float));
+      }
+    }
+    output[x] = XMFLOAT4(values[0], values[1], values[2], values[3]);
+  }
+}
+
+void EncodeRow(const XMFLOAT4* input, UINT width, const PixelLayout& layout, bool srgb, uint8_t* row)
+{
+  const SrgbTables& tables = SrgbTables::Get();
+  const UINT srgb_channel_number = srgb ? layout.color_channel_number : 0;
+  for (UINT x = 0; x < width; ++x) {
+    XMFLOAT4 pixel_values;
+    XMStoreFloat4(&pixel_values, layout.channel_size == 4 ? XMLoadFloat4(&input[x]) : XMVectorSaturate(XMLoadFloat4(&input[x])));
+    const float values[4] = { pixel_values.x, pixel_values.y, pixel_values.z, pixel_values.w };
+
+    uint8_t* pixel = row + static_cast<size_t>(x) * layout.channel_number * layout.channel_size;
+    for (UINT channel = 0; channel < layout.channel_number; ++channel) {
+      const float value = values[channel];
+      if (layout.channel_size == 1) {
+        pixel[channel] = channel < srgb_channel_number ? tables.encode_8bit[static_cast<int>(value * (kSrgbEncodeTableSize - 1) + 0.5f)]
+                                                       : static_cast<uint8_t>(value * 255.0f + 0.5f);
+      } else if (layout.channel_size == 2) {
+        const uint16_t encoded = static_cast<uint16_t>((channel < srgb_channel_number ? LinearToSrgb(value) : value) * 65535.0f + 0.5f);
+        std::memcpy(pixel + channel * 2, &encoded, sizeof(encoded));
+      } else {
+        std::memcpy(pixel + channel * 4, &value, sizeof(float));
+      }
+    }
+  }
+}
+
+float BesselI0(float x)
+{
+  float sum = 1.0f;
+  float term = 1.0f;
+  for (int k = 1; k < 32 && term > sum * 1e-8f; ++k) {
+    const float half_x_over_k = x / (2.0f * k);
+    term *= half_x_over_k * half_x_over_k;
+    sum += term;
+  }
+  return sum;
+}
+
+// t in destination texels from the destination texel center.
+float KaiserSinc(float t)
+{
+  if (std::fabs(t) >= kKaiserWidth) {
+    return 0.0f;
+  }
+  const float sinc = t == 0.0f ? 1.0f : std::sin(XM_PI * t) / (XM_PI * t);
+  const float window_position = t / kKaiserWidth;
+  return sinc * BesselI0(kKaiserAlpha * std::sqrt(1.0f - window_position * window_position)) / BesselI0(kKaiserAlpha);
+}
+
+// A fixed number of taps per destination texel along one axis, source indices already clamped to the
+// edge, so the inner loops have no branches.
+struct AxisTaps {
+  UINT tap_number = 0;
+  std::vector<UINT> indices;
+  std::vector<float> weights;
+};  // struct AxisTaps
+
+AxisTaps BuildAxisTaps(UINT source_size, UINT destination_size, MipChainGenerator::Filter filter)
+{
+  const float scale = static_cast<float>(source_size) / destination_size;
+  const float radius = filter == MipChainGenerator::Filter::kBox ? scale * 0.5f : kKaiserWidth * scale;
+
+  // Enough taps for the widest footprint, e.g. 2 for an even box, 3 for an odd one.
+  AxisTaps taps;
+  std::vector<int> firsts(destination_size);
+  for (UINT d = 0; d < destination_size; ++d) {
+    const float center = (d + 0.5f) * scale;
+    firsts[d] = static_cast<int>(std::floor(center - radius));
+    const int end = static_cast<int>(std::ceil(center + radius));
+    taps.tap_number = std::max(taps.tap_number, static_cast<UINT>(end - firsts[d]));
+  }
+  taps.indices.resize(static_cast<size_t>(destination_size) * taps.tap_number);
+  taps.weights.resize(taps.indices.size());
+
+  for (UINT d = 0; d < destination_size; ++d) {
+    const float center = (d + 0.5f) * scale;
+    const int first = firsts[d];
+    UINT* indices = &taps.indices[static_cast<size_t>(d) * taps.tap_number];
+    float* weights = &taps.weights[static_cast<size_t>(d) * taps.tap_number];
+
+    float weight_sum = 0.0f;
+    for (UINT k = 0; k < taps.tap_number; ++k) {
+      const int source = first + static_cast<int>(k);
+      float weight = 0.0f;
+      if (filter == MipChainGenerator::Filter::kBox) {
+        // Overlap of the source texel with the destination texel's footprint.
+        weight = std::max(0.0f, std::min(source + 1.0f, center + radius) - std::max(static_cast<float>(source), center - radius));
+      } else {
+        weight = KaiserSinc((source + 0.5f - center) / scale);
+      }
+      indices[k] = static_cast<UINT>(std::min(std::max(source, 0), static_cast<int>(source_size) - 1));
+      weights[k] = weight;
+      weight_sum += weight;
+    }
+    for (UINT k = 0; k < taps.tap_number; ++k) {
+      weights[k] /= weight_sum;
+    }
+  }
+
+  return taps;
+}
+
+}  // namespace
+
+MipChainGenerator::BenchmarkReport MipChainGenerator::Benchmark(UINT size, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (size == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  const UINT level_number = GetMipLevelNumber(size, size);
+  std::vector<Surface> levels(level_number);
+  std::vector<size_t> level_offsets(level_number);
+  size_t total_size = 0;
+  for (UINT level = 0; level < level_number; ++level) {
+    Surface& surface = levels[level];
+    surface.width = std::max(1u, size >> level);
+    surface.height = surface.width;
+    surface.row_pitch = surface.width * 4;
+    level_offsets[level] = total_size;
+    total_size += static_cast<size_t>(surface.row_pitch) * surface.height;
+  }
+  std::vector<uint8_t> texels(total_size);
+  for (UINT level = 0; level < level_number; ++level) {
+    levels[level].data = texels.data() + level_offsets[level];
+  }
+  const size_t top_size = static_cast<size_t>(levels[0].row_pitch) * levels[0].height;
+  report.chain_size = total_size - top_size;
+
+  uint32_t state = 0x9e3779b9u;
+  for (size_t i = 0; i < top_size; ++i) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    texels[i] = static_cast<uint8_t>(state);
+  }
+
+  auto time_chain = [&](Filter filter, ThreadPool* thread_pool) {
+    Options options;
+    options.filter = filter;
+    options.thread_pool = thread_pool;
+    const auto start_time = std::chrono::steady_clock::now();
+    for (UINT i = 0; i < iteration_number; ++i) {
+      for (UINT level = 1; level < level_number; ++level) {
+        GenerateMip(DXGI_FORMAT_R8G8B8A8_UNORM, levels[level - 1], levels[level], options);
+      }
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+  };
+
+  report.box_milliseconds = time_chain(Filter::kBox, nullptr);
+  report.kaiser_milliseconds = time_chain(Filter::kKaiser, nullptr);
+  ThreadPool thread_pool;
+  report.thread_number = thread_pool.GetWorkerNumber() + 1;
+  report.parallel_box_milliseconds = time_chain(Filter::kBox, &thread_pool);
+  report.parallel_kaiser_milliseconds = time_chain(Filter::kKaiser, &thread_pool);
+  return report;
+}
+
+UINT MipChainGenerator::GetMipLevelNumber(UINT64 width, UINT height)
+{
+  UINT level_number = 1;
+  while (width > 1 || height > 1) {
+    width >>= 1;
+    height >>= 1;
+    level_number++;
+  }
+  return level_number;
+}
+
+bool MipChainGenerator::IsFormatSupported(DXGI_FORMAT format)
+{
+  PixelLayout layout;
+  return GetPixelLayout(format, layout);
+}
+
+void MipChainGenerator::GenerateMip(DXGI_FORMAT format, const Surface& source, const Surface& destination, const Options& options)
+{
+  PixelLayout layout;
+  if (!GetPixelLayout(format, layout)) {
+    return;
+  }
+  const bool srgb = options.srgb && layout.channel_size < 4;
+
+  const AxisTaps horizontal_taps = BuildAxisTaps(source.width, destination.width, options.filter);
+  const AxisTaps vertical_taps = BuildAxisTaps(source.height, destination.height, options.filter);
+
+  // Each band of destination rows filters the source rows it needs horizontally, then vertically. Bands
+  // share no output, neighbours only redo a few horizontal rows at their edges.
+  auto filter_band = [&](size_t band_index, size_t) {
+    const UINT first_row = static_cast<UINT>(band_index) * kBandRowNumber;
+    const UINT end_row = std::min(first_row + kBandRowNumber, destination.height);
+    const UINT first_source_row = vertical_taps.indices[static_cast<size_t>(first_row) * vertical_taps.tap_number];
+    const UINT last_source_row = vertical_taps.indices[static_cast<size_t>(end_row) * vertical_taps.tap_number - 1];
+
+    std::vector<XMFLOAT4> source_line(source.width);
+    std::vector<XMFLOAT4> filtered_rows(static_cast<size_t>(last_source_row - first_source_row + 1) * destination.width);
+    for (UINT source_row = first_source_row; source_row <= last_source_row; ++source_row) {
+      DecodeRow(source.data + static_cast<size_t>(source_row) * source.row_pitch, source.width, layout, srgb, source_line.data());
+
+      XMFLOAT4* filtered_row = &filtered_rows[static_cast<size_t>(source_row - first_source_row) * destination.width];
+      for (UINT x = 0; x < destination.width; ++x) {
+        const UINT* indices = &horizontal_taps.indices[static_cast<size_t>(x) * horizontal_taps.tap_number];
+        const float* weights = &horizontal_taps.weights[static_cast<size_t>(x) * horizontal_taps.tap_number];
+        XMVECTOR sum = XMVectorZero();
+        for (UINT k = 0; k < horizontal_taps.tap_number; ++k) {
+          sum = XMVectorMultiplyAdd(XMLoadFloat4(&source_line[indices[k]]), XMVectorReplicate(weights[k]), sum);
+        }
+        XMStoreFloat4(&filtered_row[x], sum);
+      }
+    }
+
+    std::vector<XMFLOAT4> destination_line(destination.width);
+    for (UINT y = first_row; y < end_row; ++y) {
+      const UINT* indices = &vertical_taps.indices[static_cast<size_t>(y) * vertical_taps.tap_number];
+      const float* weights = &vertical_taps.weights[static_cast<size_t>(y) * vertical_taps.tap_number];
+      for (UINT x = 0; x < destination.width; ++x) {
+        XMVECTOR sum = XMVectorZero();
+        for (UINT k = 0; k < vertical_taps.tap_number; ++k) {
+          const XMFLOAT4& texel = filtered_rows[static_cast<size_t>(indices[k] - first_source_row) * destination.width + x];
+          sum = XMVectorMultiplyAdd(XMLoadFloat4(&texel), XMVectorReplicate(weights[k]), sum);
+        }
+        XMStoreFloat4(&destination_line[x], sum);
+      }
+      EncodeRow(destination_line.data(), destination.width, layout, srgb, destination.data + static_cast<size_t>(y) * destination.row_pitch);
+    }
+  };
+
+  const size_t band_number = (destination.height + kBandRowNumber - 1) / kBandRowNumber;
+  if (options.thread_pool != nullptr && band_number > 1) {
+    options.thread_pool->ParallelFor(band_number, filter_band);
+  } else {
+    for (size_t band_index = 0; band_index < band_number; ++band_index) {
+      filter_band(band_index, 0);
+    }
+  }
+}
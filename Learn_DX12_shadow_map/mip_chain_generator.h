@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common_headers.h"
+
+using namespace DirectX;
+
+class ThreadPool;
+
+// Builds mip levels on the CPU, each from the level above it. Filtering is separable and done on float4
+// pixels with DirectXMath; 8 and 16 bit UNORM color can be treated as sRGB encoded, so it is averaged in
+// linear space and the smaller levels don't get darker.
+class MipChainGenerator {
+ public:
+  enum class Filter {
+    kBox,  // average of the covered texels, cheap
+    kKaiser,  // Kaiser windowed sinc (width 3, alpha 4), sharper minification
+  };  // enum class Filter
+
+  struct Options {
+    Filter filter = Filter::kBox;
+    bool srgb = true;  // UNORM color channels (not alpha) are sRGB encoded
+    ThreadPool* thread_pool = nullptr;  // spreads each level's rows over the pool, may be null
+  };  // struct Options
+
+  struct Surface {
+    uint8_t* data = nullptr;
+    UINT row_pitch = 0;
+    UINT width = 0;
+    UINT height = 0;
+  };  // struct Surface
+
+  struct BenchmarkReport {
+    UINT64 chain_size;  // bytes of the levels below the top one
+    double box_milliseconds;
+    double kaiser_milliseconds;
+    size_t thread_number;  // of the parallel runs, the calling thread included
+    double parallel_box_milliseconds;
+    double parallel_kaiser_milliseconds;
+  };  // struct BenchmarkReport
+
+  // Builds the full chain of a size x size R8G8B8A8 sRGB image of noise with each filter, on one thread and
+  // then on a pool with a worker per hardware thread, and returns the time of each, averaged over
+  // iteration_number runs.
+  static BenchmarkReport Benchmark(UINT size, UINT iteration_number);
+
+  // Levels of the full chain down to 1x1.
+  static UINT GetMipLevelNumber(UINT64 width, UINT height);
+
+  // R8G8B8A8/B8G8R8A8/B8G8R8X8/R8/A8/R16G16B16A16/R16 UNORM and R32G32B32A32/R32 FLOAT.
+  static bool IsFormatSupported(DXGI_FORMAT format);
+
+  // Writes destination, which must be max(1, source size >> 1), from source. Both are in format.
+  static void GenerateMip(DXGI_FORMAT format, const Surface& source, const Surface& destination, const Options& options);
+};  // class MipChainGenerator
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cfloat>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common_headers.h"
 
 using namespace DirectX;
 
+class AssetsManager;
+
 namespace Asset {
 
 class Model {
@@ -18,21 +23,44 @@ class Model {
     XMFLOAT3 color;
   };  // struct Vertex
 
+  // Everything in Vertex but the position, for the second stream of the de-interleaved layout.
+  struct VertexAttributes {
+    XMFLOAT3 normal;
+    XMFLOAT2 uv;
+    XMFLOAT3 color;
+  };  // struct VertexAttributes
+
+  // Axis aligned. min > max on some axis means empty.
+  struct BoundingBox {
+    XMFLOAT3 min;
+    XMFLOAT3 max;
+  };  // struct BoundingBox
+
   static size_t GetVertexStride() {
     return sizeof(Vertex);
   }
 
+  static size_t GetPositionStride() {
+    return sizeof(XMFLOAT3);
+  }
+
+  static size_t GetVertexAttributesStride() {
+    return sizeof(VertexAttributes);
+  }
+
   virtual ~Model() {
 
   }
 
-  virtual std::unique_ptr<Vertex[]> GetVertexData() const = 0;
+  // Geometry is built once and owned by the model (or shared by every instance of a model type), so the
+  // returned pointers stay valid for the model's lifetime and can be read without copying.
+  virtual const Vertex* GetVertexData() const = 0;
 
   virtual size_t GetVertexDataSize() const = 0;
 
   virtual size_t GetVertexNumber() const = 0;
 
-  virtual std::unique_ptr<DWORD[]> GetIndexData() const = 0;
+  virtual const DWORD* GetIndexData() const = 0;
 
   virtual size_t GetIndexDataSize() const = 0;
 
@@ -40,8 +68,16 @@ class Model {
 
   virtual const std::string GetTextureImageFileName() const = 0;
 
-  void SetModelTransform(const XMMATRIX& model_transform_matrix) {
-    XMStoreFloat4x4(&model_transform_, model_transform_matrix);
+  // Model space bounds of every vertex. Walks the whole vertex data, so compute it once.
+  BoundingBox ComputeBoundingBox() const {
+    BoundingBox bounding_box = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    const Vertex* vertices = GetVertexData();
+    for (size_t i = 0; i < GetVertexNumber(); ++i) {
+      const XMFLOAT3& position = vertices[i].position;
+      bounding_box.min = XMFLOAT3(std::min(bounding_box.min.x, position.x), std::min(bounding_box.min.y, position.y), std::min(bounding_box.min.z, position.z));
+      bounding_box.max = XMFLOAT3(std::max(bounding_box.max.x, position.x), std::max(bounding_box.max.y, position.y), std::max(bounding_box.max.z, position.z));
+    }
+    return bounding_box;
   }
 
   XMFLOAT4X4 GetModelTransform() const {
@@ -49,7 +85,15 @@ class Model {
   }
 
  private:
-   XMFLOAT4X4 model_transform_;
+  // Only AssetsManager moves models (AssetsManager::InsertModel and AssetsManager::SetModelTransform), so its
+  // cached draw arguments and their version always follow the transforms.
+  friend class ::AssetsManager;
+
+  void SetModelTransform(const XMMATRIX& model_transform_matrix) {
+    XMStoreFloat4x4(&model_transform_, model_transform_matrix);
+  }
+
+  XMFLOAT4X4 model_transform_;
 };  // class Model
 
 }  // namespace Asset
\ No newline at end of file
@@ -1,8 +1,548 @@
 #include "my_engine.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+
+#include "block_compressor.h"
+#include "cube_model.h"
 #include "d3dx12.h"
+#include "dds_texture.h"
+#include "image_loader.h"
+#include "mapped_file.h"
+#include "mip_chain_generator.h"
+#include "portable_image_decoder.h"
+#include "quad_model.h"
+#include "self_test.h"
+#include "software_rasterizer.h"
+#include "thread_pool.h"
+#include "vertex_stream_transform.h"
 #include "win32_application.h"
 
+namespace {
+
+// -shadowQuality, high when not given or unknown.
+ShadowQuality::Tier ParseShadowQuality(const std::wstring& name)
+{
+  ShadowQuality::Tier shadow_quality = ShadowQuality::Tier::kHigh;
+  if (!name.empty() && !ShadowQuality::ParseTier(name, shadow_quality)) {
+    OutputDebugStringW((L"Unknown shadow quality " + name + L", using high.\n").c_str());
+  }
+  return shadow_quality;
+}
+
+// -shadowFilter, point when not given or unknown.
+ShadowFilter::Mode ParseShadowFilter(const std::wstring& name)
+{
+  ShadowFilter::Mode shadow_filter = ShadowFilter::Mode::kPoint;
+  if (!name.empty() && !ShadowFilter::ParseMode(name, shadow_filter)) {
+    OutputDebugStringW((L"Unknown shadow filter " + name + L", using point.\n").c_str());
+  }
+  return shadow_filter;
+}
+
+// Logs every check's outcome. Returns false if any failed.
+bool ReportSelfTests()
+{
+  UINT failed_number = 0;
+  const std::vector<SelfTest::Result> results = SelfTest::Run();
+  for (const SelfTest::Result& result : results) {
+    const std::wstring line = std::wstring(L"Self test ") + result.name + (result.failure.empty() ? L": passed\n" : L": FAILED, " + result.failure + L"\n");
+    OutputDebugStringW(line.c_str());
+    if (!result.failure.empty()) {
+      failed_number++;
+    }
+  }
+  OutputDebugStringW((std::to_wstring(results.size() - failed_number) + L" of " + std::to_wstring(results.size()) + L" self tests passed\n").c_str());
+  return failed_number == 0;
+}
+
+// What each tier would cost with the directional light, for comparing them.
+void ReportShadowQuality()
+{
+  for (int i = 0; i < static_cast<int>(ShadowQuality::Tier::kTierNumber); ++i) {
+    const ShadowQuality::Tier tier = static_cast<ShadowQuality::Tier>(i);
+    const ShadowQuality::Settings& settings = ShadowQuality::GetSettings(tier);
+    const ShadowQuality::Cost cost = ShadowQuality::EstimateCost(settings, settings.cascade_number);
+    const std::wstring line = std::wstring(L"Shadow quality ") + ShadowQuality::GetTierName(tier) + L": " +
+      std::to_wstring(settings.resolution) + L"^2 x " + std::to_wstring(settings.cascade_number) + L" cascades, " +
+      std::to_wstring(cost.texels_rasterized) + L" texels and " + std::to_wstring(cost.bytes_written >> 20) + L" MB written per frame, " +
+      std::to_wstring(cost.memory_bytes >> 20) + L" MB\n";
+    OutputDebugStringW(line.c_str());
+  }
+}
+
+// Runs every filter's CPU reference on a saved depth map and logs how they compare.
+void ReportShadowFilters(const std::wstring& depth_map_file_name)
+{
+  ShadowFilter::DepthMap depth_map;
+  if (!ShadowFilter::LoadDepthMap(depth_map_file_name, depth_map)) {
+    OutputDebugStringW((L"Can't read a depth map from " + depth_map_file_name + L".\n").c_str());
+    return;
+  }
+
+  const float bias = 0.001f;
+  for (int i = 0; i < static_cast<int>(ShadowFilter::Mode::kModeNumber); ++i) {
+    const ShadowFilter::Mode mode = static_cast<ShadowFilter::Mode>(i);
+    const ShadowFilter::Report report = ShadowFilter::Evaluate(mode, depth_map, bias);
+    const std::wstring line = std::wstring(L"Shadow filter ") + ShadowFilter::GetModeName(mode) + L": " +
+      std::to_wstring(report.average_lit) + L" lit on average, " + std::to_wstring(report.penumbra_fraction * 100.0) + L"% penumbra, " +
+      std::to_wstring(report.fetches_per_pixel) + L" fetches and " + std::to_wstring(report.nanoseconds_per_pixel) + L" ns per pixel" +
+      (ShadowFilter::IsMomentMode(mode) ? L", after " + std::to_wstring(report.prefilter_nanoseconds_per_texel) + L" ns per texel building the moments\n" : L"\n");
+    OutputDebugStringW(line.c_str());
+  }
+}
+
+// Packs light_number lights over many frames of lights coming, going and changing size, and logs the cost.
+void ReportShadowAtlas(UINT light_number)
+{
+  const UINT atlas_size = 8192;
+  const UINT frame_number = 1000;
+  const ShadowAtlas::BenchmarkReport report = ShadowAtlas::Benchmark(atlas_size, light_number, frame_number);
+  const std::wstring line = L"Shadow atlas with " + std::to_wstring(light_number) + L" lights on " + std::to_wstring(atlas_size) + L"^2: " +
+    std::to_wstring(report.microseconds_per_update) + L" us per update (" + std::to_wstring(report.max_microseconds_per_update) + L" at most), " +
+    std::to_wstring(report.placed_per_update) + L" tiles placed per update, " + std::to_wstring(report.repack_fraction * 100.0) + L"% repacks, " +
+    std::to_wstring(report.occupancy * 100.0) + L"% occupied, " + std::to_wstring(report.shrunk_number) + L" tiles shrunk and " +
+    std::to_wstring(report.unplaced_number) + L" left out over " + std::to_wstring(frame_number) + L" updates\n";
+  OutputDebugStringW(line.c_str());
+}
+
+void ReportFrustumCulling(UINT object_number)
+{
+  const UINT iteration_number = 100;
+  const FrustumCuller::BenchmarkReport report = FrustumCuller::Benchmark(object_number, iteration_number);
+  const std::wstring line = L"Frustum culling of " + std::to_wstring(object_number) + L" objects against a camera and a light: " +
+    std::to_wstring(report.scalar_objects_per_millisecond) + L" objects per ms one at a time, " + std::to_wstring(report.objects_per_millisecond) +
+    L" four at a time, " + std::to_wstring(report.parallel_objects_per_millisecond) + L" on " + std::to_wstring(report.thread_number) + L" threads; " +
+    std::to_wstring(report.visible_fraction * 100.0) + L"% in view, " + std::to_wstring(report.light_visible_fraction * 100.0) + L"% casting, " +
+    std::to_wstring(report.mismatch_number) + L" mismatches\n";
+  OutputDebugStringW(line.c_str());
+}
+
+void ReportBoundingVolumeHierarchy(UINT max_object_number)
+{
+  const UINT query_number = 1000;
+  for (UINT object_number = 10000; object_number <= max_object_number; object_number *= 10) {
+    const BoundingVolumeHierarchy::BenchmarkReport report = BoundingVolumeHierarchy::Benchmark(object_number, query_number);
+    const std::wstring line = L"BVH over " + std::to_wstring(object_number) + L" objects: built in " + std::to_wstring(report.build_milliseconds) + L" ms on " +
+      std::to_wstring(report.thread_number) + L" threads (SAH cost " + std::to_wstring(report.sah_cost) + L", depth " + std::to_wstring(report.depth) +
+      L"), refitted in " + std::to_wstring(report.refit_milliseconds) + L" ms; per query " + std::to_wstring(report.frustum_query_microseconds) +
+      L" us for a camera and a light against " + std::to_wstring(report.brute_force_frustum_microseconds) + L" us testing every box, " +
+      std::to_wstring(report.cube_query_microseconds) + L" us for a cube, " + std::to_wstring(report.ray_query_microseconds) + L" us for a ray, " +
+      std::to_wstring(report.nearest_query_microseconds) + L" us for the nearest object; " + std::to_wstring(report.visible_fraction * 100.0) +
+      L"% in view, " + std::to_wstring(report.mismatch_number) + L" mismatches\n";
+    OutputDebugStringW(line.c_str());
+    if (object_number > max_object_number / 10) {
+      break;
+    }
+  }
+}
+
+void ReportOcclusionCulling(UINT object_number)
+{
+  const UINT frame_number = 100;
+  const OcclusionCuller::BenchmarkReport report = OcclusionCuller::Benchmark(object_number, frame_number);
+  const std::wstring line = L"Occlusion culling of " + std::to_wstring(object_number) + L" objects: " + std::to_wstring(report.stats.occluder_number) +
+    L" occluders (" + std::to_wstring(report.stats.occluder_triangle_number) + L" triangles) rasterized in " + std::to_wstring(report.raster_milliseconds) +
+    L" ms, " + std::to_wstring(report.stats.tested_number) + L" objects in view tested in " + std::to_wstring(report.test_milliseconds) + L" ms (" +
+    std::to_wstring(report.tested_objects_per_millisecond) + L" objects/ms), " + std::to_wstring(report.occluded_fraction * 100.0) + L"% occluded\n";
+  OutputDebugStringW(line.c_str());
+}
+
+void ReportInstancing(UINT object_number)
+{
+  const UINT mesh_number = 256;
+  const UINT texture_number = 32;
+  const UINT iteration_number = 100;
+  const AssetsManager::InstancingBenchmarkReport report = AssetsManager::BenchmarkInstancing(object_number, mesh_number, texture_number, iteration_number);
+  const std::wstring line = L"Instancing of " + std::to_wstring(report.object_number) + L" objects over " + std::to_wstring(mesh_number) + L" meshes: " +
+    std::to_wstring(report.batch_number) + L" draws in the scene pass and " + std::to_wstring(report.depth_batch_number) + L" in a depth pass instead of " +
+    std::to_wstring(report.object_number) + L", batched in " + std::to_wstring(report.microseconds) + L" us\n";
+  OutputDebugStringW(line.c_str());
+}
+
+void ReportIndirectDraws(UINT record_number)
+{
+  const UINT iteration_number = 100;
+  const IndirectDrawBuilder::BenchmarkReport report = IndirectDrawBuilder::Benchmark(record_number, iteration_number);
+  const std::wstring line = L"Indirect draws: " + std::to_wstring(report.record_number) + L" records written in " + std::to_wstring(report.microseconds) +
+    L" us, " + std::to_wstring(report.records_per_microsecond) + L" records/us\n";
+  OutputDebugStringW(line.c_str());
+}
+
+void ReportParallelRecording(UINT draw_number)
+{
+  const UINT hardware_thread_number = std::thread::hardware_concurrency();
+  const UINT iteration_number = 20;
+  const std::vector<ParallelRecorder::BenchmarkReport> reports = ParallelRecorder::Benchmark(draw_number, hardware_thread_number > 0 ? hardware_thread_number : 1, iteration_number);
+  for (const ParallelRecorder::BenchmarkReport& report : reports) {
+    const std::wstring line = L"Recording " + std::to_wstring(draw_number) + L" synthetic draws (no device) on " + std::to_wstring(report.thread_number) + L" threads, " +
+      std::to_wstring(report.part_number) + L" lists: " + std::to_wstring(report.microseconds) + L" us, " + std::to_wstring(report.items_per_microsecond) +
+      L" draws/us, " + std::to_wstring(report.speedup) + L"x\n";
+    OutputDebugStringW(line.c_str());
+  }
+}
+
+void ReportConstantBufferRing(UINT allocation_number, UINT frames_in_flight)
+{
+  const UINT frame_number = 1000;
+  const RingAllocator::BenchmarkReport report = RingAllocator::Benchmark(sizeof(SceneConstantBuffer), allocation_number, frame_number, frames_in_flight);
+  const std::wstring line = L"Constant buffer ring: " + std::to_wstring(report.allocation_number) + L" allocations of " +
+    std::to_wstring(sizeof(SceneConstantBuffer)) + L" bytes over " + std::to_wstring(frame_number) + L" frames, " +
+    std::to_wstring(report.allocations_per_second) + L" allocations/s, " + std::to_wstring(report.failed_allocation_number) + L" failed\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Times the draw table lookups of a frame with 10k models, then 10 times more up to max_model_number.
+void ReportDrawArguments(UINT max_model_number)
+{
+  const UINT frame_number = 20;
+  for (UINT model_number = 10000; model_number <= max_model_number; model_number *= 10) {
+    const AssetsManager::DrawArgumentsBenchmarkReport report = AssetsManager::BenchmarkDrawArguments(model_number, frame_number);
+    const std::wstring line = L"Draw table of " + std::to_wstring(report.model_number) + L" models, per frame of 3 passes: " +
+      std::to_wstring(report.rebuild_microseconds) + L" us rebuilt for each pass, " + std::to_wstring(report.cached_microseconds) + L" us cached, " +
+      std::to_wstring(report.patched_microseconds) + L" us with 1% of the models moved, " +
+      std::to_wstring(report.bvh_build_microseconds) + L" us to build the BVH once\n";
+    OutputDebugStringW(line.c_str());
+    if (model_number > max_model_number / 10) {
+      break;
+    }
+  }
+}
+
+// Merges mesh_number meshes of 1000 vertices each, both ways, and logs the time and memory of each.
+void ReportMerge(UINT mesh_number)
+{
+  const size_t vertex_number = 1000;
+  const UINT iteration_number = 10;
+  const AssetsManager::MergeBenchmarkReport report = AssetsManager::BenchmarkMerge(mesh_number, vertex_number, iteration_number);
+  const std::wstring line = L"Merging " + std::to_wstring(mesh_number) + L" meshes of " + std::to_wstring(vertex_number) + L" vertices (" +
+    std::to_wstring(report.merged_size >> 20) + L" MB): " + std::to_wstring(report.staged_milliseconds) + L" ms and " +
+    std::to_wstring(report.staged_peak_size >> 20) + L" MB at peak through merged copies, " + std::to_wstring(report.direct_milliseconds) + L" ms and " +
+    std::to_wstring(report.direct_peak_size >> 20) + L" MB straight into the destination\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Transforms vertex_number positions from each vertex stream layout and logs the bandwidth of each.
+void ReportVertexStreams(UINT vertex_number)
+{
+  const UINT iteration_number = 20;
+  const VertexStreamTransform::BenchmarkReport report = VertexStreamTransform::Benchmark(vertex_number, iteration_number);
+  const std::wstring line = L"Transforming " + std::to_wstring(vertex_number) + L" positions: " + std::to_wstring(report.interleaved_milliseconds) +
+    L" ms interleaved (" + std::to_wstring(report.interleaved_gigabytes_per_second) + L" GB/s of vertices), " +
+    std::to_wstring(report.deinterleaved_milliseconds) + L" ms from the position stream (" + std::to_wstring(report.deinterleaved_gigabytes_per_second) + L" GB/s)\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Times startup from meshes built in code against a mesh cache of the same meshes, written to the temp directory.
+void ReportMeshCache(UINT mesh_number)
+{
+  const size_t vertex_number = 1000;
+  WCHAR temp_path[MAX_PATH];
+  if (GetTempPathW(MAX_PATH, temp_path) == 0) {
+    OutputDebugStringW(L"Can't find the temp directory for the mesh cache benchmark.\n");
+    return;
+  }
+  const std::wstring file_name = std::wstring(temp_path) + L"mesh_cache_benchmark.bin";
+  const AssetsManager::MeshCacheBenchmarkReport report = AssetsManager::BenchmarkMeshCache(mesh_number, vertex_number, file_name);
+  DeleteFileW(file_name.c_str());
+  const std::wstring line = L"Startup with " + std::to_wstring(mesh_number) + L" meshes of " + std::to_wstring(vertex_number) + L" vertices: " +
+    std::to_wstring(report.built_milliseconds) + L" ms built in code, " + std::to_wstring(report.cached_milliseconds) + L" ms from a " +
+    std::to_wstring(report.file_size >> 20) + L" MB mesh cache (warm file cache)\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Decodes an image file with the portable decoder on one thread, then on all of them, and logs the throughput.
+void ReportImageDecoding(const std::wstring& file_name)
+{
+  MappedFile file;
+  if (!file.Open(file_name)) {
+    OutputDebugStringW((L"Can't read " + file_name + L".\n").c_str());
+    return;
+  }
+
+  const UINT iteration_number = 10;
+  const PortableImageDecoder::BenchmarkReport report = PortableImageDecoder::Benchmark(file.GetData(), file.GetSize(), iteration_number);
+  if (report.decoded_size == 0) {
+    OutputDebugStringW((L"Can't decode " + file_name + L".\n").c_str());
+    return;
+  }
+  const std::wstring line = L"Decoding " + file_name + L" (" + std::to_wstring(report.decoded_size >> 10) + L" KB decoded): " +
+    std::to_wstring(report.encoded_megabytes_per_second) + L" MB/s in, " + std::to_wstring(report.decoded_megabytes_per_second) + L" MB/s out on 1 thread, " +
+    std::to_wstring(report.decoded_megabytes_per_second_per_thread) + L" MB/s out per thread on " + std::to_wstring(report.thread_number) + L" threads\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Times the mip chain of a 4096x4096 texture, then twice as large up to max_size, with each filter.
+void ReportMipChains(UINT max_size)
+{
+  const UINT iteration_number = 3;
+  for (UINT size = std::min(4096u, max_size); size <= max_size; size *= 2) {
+    const MipChainGenerator::BenchmarkReport report = MipChainGenerator::Benchmark(size, iteration_number);
+    const std::wstring line = L"Mip chain of " + std::to_wstring(size) + L"x" + std::to_wstring(size) + L" RGBA8 (" +
+      std::to_wstring(report.chain_size >> 20) + L" MB below the top): " + std::to_wstring(report.box_milliseconds) + L" ms box, " +
+      std::to_wstring(report.kaiser_milliseconds) + L" ms Kaiser on 1 thread, " + std::to_wstring(report.parallel_box_milliseconds) + L" ms box, " +
+      std::to_wstring(report.parallel_kaiser_milliseconds) + L" ms Kaiser on " + std::to_wstring(report.thread_number) + L" threads\n";
+    OutputDebugStringW(line.c_str());
+    if (size > max_size / 2) {
+      break;
+    }
+  }
+}
+
+// Compresses a size x size image to each format and logs the quality and throughput.
+void ReportBlockCompression(UINT size)
+{
+  const UINT iteration_number = 3;
+  const std::pair<BlockCompressor::Format, const wchar_t*> formats[] = {
+    { BlockCompressor::Format::kBC1, L"BC1" },
+    { BlockCompressor::Format::kBC3, L"BC3" },
+    { BlockCompressor::Format::kBC5, L"BC5" },
+    { BlockCompressor::Format::kBC7, L"BC7" },
+  };
+  for (const auto& format : formats) {
+    const BlockCompressor::BenchmarkReport report = BlockCompressor::Benchmark(format.first, size, iteration_number);
+    const std::wstring line = std::wstring(format.second) + L" of " + std::to_wstring(size) + L"x" + std::to_wstring(size) + L": " +
+      std::to_wstring(report.psnr) + L" dB PSNR, " + std::to_wstring(report.megatexels_per_second) + L" Mtexels/s on 1 thread, " +
+      std::to_wstring(report.parallel_megatexels_per_second) + L" Mtexels/s on " + std::to_wstring(report.thread_number) + L" threads\n";
+    OutputDebugStringW(line.c_str());
+  }
+}
+
+// Loads each texture of a ';' separated list from its .dds file and from its .jpg file and logs the time of each.
+void ReportTextureIngestion(const std::wstring& names)
+{
+  std::vector<std::wstring> dds_file_names;
+  std::vector<std::wstring> image_file_names;
+  size_t begin = 0;
+  while (begin <= names.size()) {
+    const size_t end = std::min(names.find(L';', begin), names.size());
+    if (end > begin) {
+      dds_file_names.push_back(names.substr(begin, end - begin) + L".dds");
+      image_file_names.push_back(names.substr(begin, end - begin) + L".jpg");
+    }
+    begin = end + 1;
+  }
+
+  const UINT iteration_number = 5;
+  const DdsTexture::BenchmarkReport report = DdsTexture::BenchmarkIngestion(dds_file_names, image_file_names, iteration_number);
+  if (report.texture_number == 0) {
+    OutputDebugStringW((L"None of " + names + L" can be read both as .dds and as .jpg.\n").c_str());
+    return;
+  }
+  const std::wstring line = L"Ingesting " + std::to_wstring(report.texture_number) + L" of " + std::to_wstring(dds_file_names.size()) + L" textures: " +
+    std::to_wstring(report.dds_milliseconds) + L" ms from DDS (" + std::to_wstring(report.dds_file_size >> 10) + L" KB read, " +
+    std::to_wstring(report.dds_upload_size >> 10) + L" KB uploaded), " + std::to_wstring(report.image_milliseconds) + L" ms from JPEG (" +
+    std::to_wstring(report.image_file_size >> 10) + L" KB read, " + std::to_wstring(report.image_upload_size >> 10) + L" KB uploaded, no mips)\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Times the cascade splits and fits of a frame, with the depth ranges fitted to object_number objects or not.
+void ReportCascadeFitting(UINT object_number)
+{
+  const UINT iteration_number = 100;
+  const CascadedShadowMap::BenchmarkReport report = CascadedShadowMap::Benchmark(object_number, iteration_number);
+  const std::wstring line = L"Fitting " + std::to_wstring(CascadedShadowMap::kMaxCascadeNumber) + L" cascades: " +
+    std::to_wstring(report.split_microseconds) + L" us to split, " + std::to_wstring(report.fit_microseconds) + L" us to split and fit, " +
+    std::to_wstring(report.bounded_fit_microseconds) + L" us fitted to " + std::to_wstring(object_number) + L" objects\n";
+  OutputDebugStringW(line.c_str());
+}
+
+// Light setup of Scene::UpdateConstantBuffers for the software rasterizer, with the scene's camera and light
+// planes. The spot light gets the whole first slice rather than an atlas tile sized by its screen coverage.
+SoftwareRasterizer::FrameConstants ComputeSoftwareFrameConstants(int light_type, UINT width, UINT height, const ShadowQuality::Settings& shadow_settings,
+                                                                 const std::vector<AssetsManager::DrawArgument>& draw_arguments)
+{
+  const float camera_fov_degrees = 90.0f;
+  const float camera_near_plane = 0.01f;
+  const float camera_far_plane = 10.0f;
+  const float point_light_near_plane = 0.01f;
+  const float point_light_far_plane = 10.0f;
+  const float spot_light_max_tan_half_angle = 1.7320508f;  // tan(60 degrees), the outer cone in the pixel shader
+
+  SoftwareRasterizer::FrameConstants frame_constants;
+  Camera camera;
+  camera.Get3DViewProjMatricesLH(&frame_constants.view, &frame_constants.proj, camera_fov_degrees, static_cast<float>(width), static_cast<float>(height),
+    camera_near_plane, camera_far_plane);
+  XMStoreFloat4(&frame_constants.camera_world_pos, camera.mEye);
+  frame_constants.light_type = light_type;
+  std::vector<Asset::Model::BoundingBox> object_bounds;
+  for (const auto& draw_argument : draw_arguments) {
+    object_bounds.push_back(draw_argument.world_bounding_box);
+  }
+  const float depth_quantization = ShadowQuality::GetDepthQuantization(shadow_settings.depth_format);
+
+  if (light_type == 0) {
+    const DirectionalLight directional_light;
+    frame_constants.light_world_direction_or_position = directional_light.world_direction();
+    frame_constants.light_color = directional_light.light_color();
+
+    CascadedShadowMap::Options options;
+    options.cascade_number = shadow_settings.cascade_number;
+    options.resolution = shadow_settings.resolution;
+    CascadedShadowMap cascaded_shadow_map(options);
+    cascaded_shadow_map.Fit(XMMatrixTranspose(XMLoadFloat4x4(&frame_constants.view)), XMMatrixTranspose(XMLoadFloat4x4(&frame_constants.proj)),
+      camera_near_plane, camera_far_plane, XMLoadFloat4(&frame_constants.light_world_direction_or_position), object_bounds.data(), object_bounds.size());
+
+    float split_distances[CascadedShadowMap::kMaxCascadeNumber]{};
+    float depth_biases[CascadedShadowMap::kMaxCascadeNumber]{};
+    for (UINT i = 0; i < options.cascade_number; ++i) {
+      const CascadedShadowMap::Cascade& cascade = cascaded_shadow_map.GetCascade(i);
+      XMStoreFloat4x4(&frame_constants.light_view_proj_transforms[i], XMMatrixTranspose(XMLoadFloat4x4(&cascade.view_proj)));
+      split_distances[i] = cascade.split_distance;
+      depth_biases[i] = 2.0f * cascade.texel_size / cascade.depth_range + depth_quantization;
+      frame_constants.shadow_depth_params[i] = ShadowFilter::ComputeOrthographicDepthParams(cascade.depth_range, cascade.texel_size);
+    }
+    frame_constants.cascade_split_distances = XMFLOAT4(split_distances[0], split_distances[1], split_distances[2], split_distances[3]);
+    frame_constants.cascade_depth_biases = XMFLOAT4(depth_biases[0], depth_biases[1], depth_biases[2], depth_biases[3]);
+    frame_constants.cascade_number = static_cast<int>(options.cascade_number);
+    return frame_constants;
+  }
+
+  if (light_type == 1) {
+    const PointLight point_light;
+    frame_constants.light_world_direction_or_position = point_light.world_pos();
+    frame_constants.light_color = point_light.light_color();
+
+    const XMVECTOR light_position = XMLoadFloat4(&frame_constants.light_world_direction_or_position);
+    const XMMATRIX face_proj = CubeShadowMap::ComputeFaceProj(point_light_near_plane, point_light_far_plane);
+    for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+      XMStoreFloat4x4(&frame_constants.cube_face_view_projs[face], XMMatrixTranspose(XMMatrixMultiply(CubeShadowMap::ComputeFaceView(light_position, face), face_proj)));
+    }
+    const XMFLOAT2 depth_params = CubeShadowMap::ComputeDepthParams(point_light_near_plane, point_light_far_plane);
+    frame_constants.cube_shadow_depth_params = XMFLOAT4(depth_params.x, depth_params.y, 0.00004f + depth_quantization, 0.0f);
+    return frame_constants;
+  }
+
+  const SpotLight spot_light;
+  frame_constants.light_world_direction_or_position = spot_light.world_pos();
+  frame_constants.light_color = spot_light.light_color();
+
+  Camera light_camera;
+  light_camera.Set(XMLoadFloat4(&frame_constants.light_world_direction_or_position), XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+  XMFLOAT4X4 light_camera_view;
+  XMFLOAT4X4 light_camera_proj;
+  float light_near_plane = 0.01f;
+  float light_far_plane = 10.0f;
+  light_camera.Get3DViewProjMatricesLH(&light_camera_view, &light_camera_proj, 90.0f, static_cast<float>(shadow_settings.resolution),
+    static_cast<float>(shadow_settings.resolution), light_near_plane, light_far_plane);
+  XMMATRIX light_camera_proj_matrix = XMLoadFloat4x4(&light_camera_proj);
+  // Narrowed down to what the camera sees and what shadows it.
+  XMVECTOR frustum_corners[8];
+  CascadedShadowMap::ComputeFrustumCorners(XMMatrixInverse(nullptr, XMMatrixMultiply(XMMatrixTranspose(XMLoadFloat4x4(&frame_constants.view)),
+    XMMatrixTranspose(XMLoadFloat4x4(&frame_constants.proj)))), frustum_corners);
+  LightFrustumFitter::PerspectiveBounds bounds;
+  if (LightFrustumFitter::FitPerspective(XMMatrixTranspose(XMLoadFloat4x4(&light_camera_view)), frustum_corners, object_bounds.data(), object_bounds.size(),
+      spot_light_max_tan_half_angle, 0.01f, bounds)) {
+    light_camera_proj_matrix = XMMatrixTranspose(XMMatrixPerspectiveOffCenterLH(bounds.left * bounds.near_plane, bounds.right * bounds.near_plane,
+      bounds.bottom * bounds.near_plane, bounds.top * bounds.near_plane, bounds.near_plane, bounds.far_plane));
+    light_near_plane = bounds.near_plane;
+    light_far_plane = bounds.far_plane;
+  }
+  XMStoreFloat4x4(&frame_constants.light_view_proj_transforms[0], XMMatrixMultiply(light_camera_proj_matrix, XMLoadFloat4x4(&light_camera_view)));
+  frame_constants.shadow_depth_params[0] = ShadowFilter::ComputePerspectiveDepthParams(light_near_plane, light_far_plane);
+  frame_constants.cascade_split_distances = XMFLOAT4(camera_far_plane, camera_far_plane, camera_far_plane, camera_far_plane);
+  const float depth_bias = 0.00004f + depth_quantization;
+  frame_constants.cascade_depth_biases = XMFLOAT4(depth_bias, depth_bias, depth_bias, depth_bias);
+  frame_constants.cascade_number = 1;
+  return frame_constants;
+}
+
+// Renders the startup scene with each light frame_number times on the CPU, on 1 thread then on every hardware
+// thread, and logs the throughput. The last frame of each light is written next to the executable's working
+// directory: software_<light>.tga, software_<light>_depth.pfm and software_<light>_shadow.pfm (the first slice
+// or cube face).
+void ReportSoftwareRasterizer(UINT frame_number, UINT width, UINT height, const std::wstring& mesh_cache_file_name,
+                              ShadowQuality::Tier shadow_quality, ShadowFilter::Mode shadow_filter)
+{
+  // The models Scene::LoadModelVerticesAndIndices loads.
+  AssetsManager& assets_manager = AssetsManager::GetSharedInstance();
+  if (mesh_cache_file_name.empty() || !assets_manager.LoadMeshCache(mesh_cache_file_name)) {
+    assets_manager.InsertModel(std::make_unique<Asset::QuadModel>(Asset::QuadModel()), XMMatrixIdentity());
+    assets_manager.InsertModel(std::make_unique<Asset::CubeModel>(Asset::CubeModel()), XMMatrixTranspose(XMMatrixTranslation(0.0f, 1.0f, 0.0f)));
+  }
+  std::unique_ptr<Asset::Model::Vertex[]> vertices;
+  std::unique_ptr<DWORD[]> indices;
+  assets_manager.GetMergedVerticesAndIndices(vertices, indices);
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = assets_manager.GetModelDrawArguments();
+
+  // Top mips only; textures that don't decode to RGBA8 are left black, like missing ones.
+  std::vector<std::string> texture_file_names;
+  assets_manager.GetModelTexturesFileNames(texture_file_names);
+  std::vector<SoftwareRasterizer::Texture> textures(texture_file_names.size());
+  for (size_t i = 0; i < texture_file_names.size(); ++i) {
+    std::vector<uint8_t> image_data;
+    D3D12_RESOURCE_DESC texture_desc = {};
+    int bytes_per_row = 0;
+    if (texture_file_names[i].empty() || ImageLoader::LoadImageDataFromFile(image_data, texture_desc, texture_file_names[i], bytes_per_row) <= 0 ||
+        (texture_desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM && texture_desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)) {
+      continue;
+    }
+    SoftwareRasterizer::Texture& texture = textures[i];
+    texture.width = static_cast<UINT>(texture_desc.Width);
+    texture.height = texture_desc.Height;
+    texture.texels.resize(static_cast<size_t>(texture.width) * texture.height * 4);
+    for (UINT row = 0; row < texture.height; ++row) {
+      std::copy_n(image_data.data() + static_cast<size_t>(row) * bytes_per_row, static_cast<size_t>(texture.width) * 4,
+        texture.texels.data() + static_cast<size_t>(row) * texture.width * 4);
+    }
+  }
+
+  const ShadowQuality::Settings& shadow_settings = ShadowQuality::GetSettings(shadow_quality);
+  ThreadPool thread_pool;
+  SoftwareRasterizer serial_rasterizer;
+  SoftwareRasterizer parallel_rasterizer(&thread_pool);
+  for (SoftwareRasterizer* rasterizer : { &serial_rasterizer, &parallel_rasterizer }) {
+    rasterizer->Resize(width, height, shadow_settings.resolution, shadow_settings.cube_resolution);
+    rasterizer->SetGeometry(vertices.get(), assets_manager.GetTotalModelVertexNumber(), indices.get(), assets_manager.GetTotalModelIndexNumber());
+    rasterizer->SetDiffuseTextures(textures);
+    rasterizer->SetShadowFilter(shadow_filter);
+  }
+
+  const char* light_names[] = { "directional", "point", "spot" };
+  for (int light_type = 0; light_type < 3; ++light_type) {
+    const SoftwareRasterizer::FrameConstants frame_constants = ComputeSoftwareFrameConstants(light_type, width, height, shadow_settings, draw_arguments);
+    std::wstring line = std::wstring(light_type == 0 ? L"Directional" : light_type == 1 ? L"Point" : L"Spot") + L" light, " +
+      std::to_wstring(width) + L"x" + std::to_wstring(height) + L" on the CPU with " + ShadowFilter::GetModeName(shadow_filter) + L" shadows:";
+    for (SoftwareRasterizer* rasterizer : { &serial_rasterizer, &parallel_rasterizer }) {
+      SoftwareRasterizer::RenderStats shadow_stats;
+      SoftwareRasterizer::RenderStats scene_stats;
+      for (UINT frame = 0; frame < frame_number; ++frame) {
+        const SoftwareRasterizer::RenderStats frame_shadow_stats = rasterizer->ShadowPass(draw_arguments, frame_constants);
+        const SoftwareRasterizer::RenderStats frame_scene_stats = rasterizer->ScenePass(draw_arguments, frame_constants);
+        shadow_stats.triangles_submitted += frame_shadow_stats.triangles_submitted;
+        shadow_stats.pixels_written += frame_shadow_stats.pixels_written;
+        shadow_stats.seconds += frame_shadow_stats.seconds;
+        scene_stats.triangles_submitted += frame_scene_stats.triangles_submitted;
+        scene_stats.pixels_written += frame_scene_stats.pixels_written;
+        scene_stats.seconds += frame_scene_stats.seconds;
+      }
+      const size_t thread_number = rasterizer == &serial_rasterizer ? 1 : thread_pool.GetWorkerNumber() + 1;
+      const auto per_second = [](size_t count, double seconds) {
+        return seconds > 0.0 ? static_cast<double>(count) / seconds / 1e6 : 0.0;
+      };
+      line += L" " + std::to_wstring(thread_number) + (thread_number == 1 ? L" thread: " : L" threads: ") +
+        std::to_wstring(per_second(shadow_stats.pixels_written, shadow_stats.seconds)) + L" Mpixels/s and " +
+        std::to_wstring(per_second(shadow_stats.triangles_submitted, shadow_stats.seconds)) + L" Mtriangles/s in the shadow pass, " +
+        std::to_wstring(per_second(scene_stats.pixels_written, scene_stats.seconds)) + L" Mpixels/s and " +
+        std::to_wstring(per_second(scene_stats.triangles_submitted, scene_stats.seconds)) + L" Mtriangles/s in the scene pass" +
+        (rasterizer == &serial_rasterizer ? L";" : L"");
+    }
+    OutputDebugStringW((line + L"\n").c_str());
+
+    const std::string base_name = std::string("software_") + light_names[light_type];
+    const ShadowFilter::DepthMap& shadow_map = light_type == 1 ? parallel_rasterizer.GetCubeFace(0) : parallel_rasterizer.GetShadowSlice(0);
+    if (!parallel_rasterizer.WriteColorImage(base_name + ".tga") ||
+        !SoftwareRasterizer::WriteDepthImage(base_name + "_depth.pfm", parallel_rasterizer.GetSceneDepthTarget(), width, height) ||
+        !SoftwareRasterizer::WriteDepthImage(base_name + "_shadow.pfm", shadow_map.depths, shadow_map.width, shadow_map.height)) {
+      OutputDebugStringA(("Failed to write the " + base_name + " images.\n").c_str());
+    }
+  }
+}
+
+}  // namespace
+
 MyEngine::MyEngine(UINT width, UINT height, std::wstring name) : DXSample(width, height, name),
   fence_values_{},
   width_(width), height_(height)
@@ -13,6 +553,99 @@ MyEngine::~MyEngine()
 {
 }
 
+bool MyEngine::OnHeadlessRun(int& exit_code)
+{
+  exit_code = EXIT_SUCCESS;
+  bool ran = false;
+  if (m_selfTest) {
+    if (!ReportSelfTests()) {
+      exit_code = EXIT_FAILURE;
+    }
+    ran = true;
+  }
+  if (m_shadowQualityReport) {
+    ReportShadowQuality();
+    ran = true;
+  }
+  if (!m_shadowFilterReportFileName.empty()) {
+    ReportShadowFilters(m_shadowFilterReportFileName);
+    ran = true;
+  }
+  if (m_shadowAtlasBenchmarkLightNumber > 0) {
+    ReportShadowAtlas(m_shadowAtlasBenchmarkLightNumber);
+    ran = true;
+  }
+  if (m_cullBenchmarkObjectNumber > 0) {
+    ReportFrustumCulling(m_cullBenchmarkObjectNumber);
+    ran = true;
+  }
+  if (m_bvhBenchmarkObjectNumber > 0) {
+    ReportBoundingVolumeHierarchy(m_bvhBenchmarkObjectNumber);
+    ran = true;
+  }
+  if (m_occlusionBenchmarkObjectNumber > 0) {
+    ReportOcclusionCulling(m_occlusionBenchmarkObjectNumber);
+    ran = true;
+  }
+  if (m_instancingBenchmarkObjectNumber > 0) {
+    ReportInstancing(m_instancingBenchmarkObjectNumber);
+    ran = true;
+  }
+  if (m_indirectBenchmarkRecordNumber > 0) {
+    ReportIndirectDraws(m_indirectBenchmarkRecordNumber);
+    ran = true;
+  }
+  if (m_recordingBenchmarkDrawNumber > 0) {
+    ReportParallelRecording(m_recordingBenchmarkDrawNumber);
+    ran = true;
+  }
+  if (m_constantRingBenchmarkAllocationNumber > 0) {
+    ReportConstantBufferRing(m_constantRingBenchmarkAllocationNumber, kFrameCount);
+    ran = true;
+  }
+  if (m_drawTableBenchmarkModelNumber > 0) {
+    ReportDrawArguments(m_drawTableBenchmarkModelNumber);
+    ran = true;
+  }
+  if (m_mergeBenchmarkMeshNumber > 0) {
+    ReportMerge(m_mergeBenchmarkMeshNumber);
+    ran = true;
+  }
+  if (m_vertexStreamBenchmarkVertexNumber > 0) {
+    ReportVertexStreams(m_vertexStreamBenchmarkVertexNumber);
+    ran = true;
+  }
+  if (m_meshCacheBenchmarkMeshNumber > 0) {
+    ReportMeshCache(m_meshCacheBenchmarkMeshNumber);
+    ran = true;
+  }
+  if (!m_imageDecodeBenchmarkFileName.empty()) {
+    ReportImageDecoding(m_imageDecodeBenchmarkFileName);
+    ran = true;
+  }
+  if (m_mipBenchmarkSize > 0) {
+    ReportMipChains(m_mipBenchmarkSize);
+    ran = true;
+  }
+  if (m_bcBenchmarkSize > 0) {
+    ReportBlockCompression(m_bcBenchmarkSize);
+    ran = true;
+  }
+  if (!m_ingestionBenchmarkNames.empty()) {
+    ReportTextureIngestion(m_ingestionBenchmarkNames);
+    ran = true;
+  }
+  if (m_csmBenchmarkObjectNumber > 0) {
+    ReportCascadeFitting(m_csmBenchmarkObjectNumber);
+    ran = true;
+  }
+  if (m_softwareRasterizerFrameNumber > 0) {
+    ReportSoftwareRasterizer(m_softwareRasterizerFrameNumber, m_width, m_height, m_meshCacheFileName, ParseShadowQuality(m_shadowQualityName), ParseShadowFilter(m_shadowFilterName));
+    ran = true;
+  }
+  return ran;
+}
+
 void MyEngine::OnInit()
 {
   LoadPipeline();
@@ -29,6 +662,16 @@ void MyEngine::OnRender()
 {
   scene_->Render(command_queue_.Get());
 
+  // The title is only touched when what it shows changed.
+  const ShadowCache::FrameStats& shadow_cache_stats = scene_->GetShadowCacheFrameStats();
+  if (shadow_cache_stats.action != shown_shadow_cache_stats_.action || shadow_cache_stats.draw_number != shown_shadow_cache_stats_.draw_number ||
+      shadow_cache_stats.saved_draw_number != shown_shadow_cache_stats_.saved_draw_number) {
+    const std::wstring text = std::wstring(L"shadow map ") + ShadowCache::GetActionName(shadow_cache_stats.action) + L", " +
+      std::to_wstring(shadow_cache_stats.draw_number) + L" draws, " + std::to_wstring(shadow_cache_stats.saved_draw_number) + L" saved";
+    SetCustomWindowText(text.c_str());
+    shown_shadow_cache_stats_ = shadow_cache_stats;
+  }
+
   ThrowIfFailed(swap_chain_->Present(0, DXGI_PRESENT_ALLOW_TEARING));
 
   MoveToNextFrame();
@@ -127,8 +770,32 @@ void MyEngine::LoadAssets()
     scene_ = std::make_unique<Scene>(kFrameCount, width_, height_);
   }
 
+  scene_->SetMeshCacheFileNames(m_meshCacheFileName, m_cookMeshCacheFileName);
+  scene_->SetShadowQuality(ParseShadowQuality(m_shadowQualityName));
+  scene_->SetShadowFilter(ParseShadowFilter(m_shadowFilterName));
+  AssetsManager::VertexStreamLayout vertex_stream_layout = AssetsManager::VertexStreamLayout::kDeinterleaved;
+  if (!m_vertexStreamLayoutName.empty() && !AssetsManager::ParseVertexStreamLayout(m_vertexStreamLayoutName, vertex_stream_layout)) {
+    OutputDebugStringW((L"Unknown vertex stream layout " + m_vertexStreamLayoutName + L", using deinterleaved.
+").c_str());
+  }
+  scene_->SetVertexStreamLayout(vertex_stream_layout);
+  ShadowCache::Mode shadow_cache_mode = ShadowCache::Mode::kOn;
+  if (!m_shadowCacheModeName.empty() && !ShadowCache::ParseMode(m_shadowCacheModeName, shadow_cache_mode)) {
+    OutputDebugStringW((L"Unknown shadow cache mode " + m_shadowCacheModeName + L", using on.\n").c_str());
+  }
+  scene_->SetShadowCacheMode(shadow_cache_mode);
+  IndirectDrawBuilder::Mode indirect_draw_mode = IndirectDrawBuilder::Mode::kOff;
+  if (!m_indirectDrawModeName.empty() && !IndirectDrawBuilder::ParseMode(m_indirectDrawModeName, indirect_draw_mode)) {
+    OutputDebugStringW((L"Unknown indirect draw mode " + m_indirectDrawModeName + L", using off.\n").c_str());
+  }
+  scene_->SetIndirectDrawMode(indirect_draw_mode);
+  if (m_recordingThreadNumber > 0) {
+    scene_->SetRecordingThreadNumber(m_recordingThreadNumber);
+  }
+  scene_->SetFrameStatsLogging(m_frameStats);
   scene_->Initialize(device_.Get(), command_queue_.Get(), current_frame_index_);
   WaitForGPU();
+  scene_->SetFrameFence(fence_values_[current_frame_index_], fence_->GetCompletedValue());
 }
 
 void MyEngine::LoadSizeDependentResources()
@@ -165,4 +832,6 @@ void MyEngine::MoveToNextFrame()
   scene_->SetFrameIndex(current_frame_index_);
 
   fence_values_[current_frame_index_] = current_fence_value + 1;
+  // Signaled at the end of the next MoveToNextFrame.
+  scene_->SetFrameFence(fence_values_[current_frame_index_], fence_->GetCompletedValue());
 }
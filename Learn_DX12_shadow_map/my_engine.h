@@ -14,6 +14,7 @@ public:
   static constexpr UINT kFrameCount = 3;
 
 protected:
+  bool OnHeadlessRun(int& exit_code) override;
   void OnInit() override;
   void OnUpdate() override;
   void OnRender() override;
@@ -46,4 +47,6 @@ private:
 
   UINT width_ = 0;
   UINT height_ = 0;
+
+  ShadowCache::FrameStats shown_shadow_cache_stats_{};  // in the window title
 };
\ No newline at end of file
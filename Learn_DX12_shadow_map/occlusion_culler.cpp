@@ -0,0 +1,411 @@
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+#include "frustum_culler.h"
+#include "vertex_stream_transform.h"
+
+constexpr UINT OcclusionCuller::kTileSize;
+constexpr UINT OcclusionCuller::kMaxOccluderNumber;
+constexpr UINT OcclusionCuller::kMaxOccluderTriangleNumber;
+constexpr float OcclusionCuller::kMinOccluderAngularSize;
+
+namespace {
+
+static_assert(OcclusionCuller::kTileSize % 4 == 0, "rows are rasterized four pixels at a time");
+
+// Clip space w below which a vertex counts as on or behind the eye.
+constexpr float kMinClipW = 1e-5f;
+
+const XMVECTORF32 kLaneOffsets = { { { 0.0f, 1.0f, 2.0f, 3.0f } } };
+
+struct ScreenVertex {
+  float x;  // pixels from the top left
+  float y;
+  float z;  // post-projection depth
+};  // struct ScreenVertex
+
+ScreenVertex ToScreen(const XMFLOAT4& clip_position, UINT width, UINT height)
+{
+  const float inv_w = 1.0f / clip_position.w;
+  return { (clip_position.x * inv_w * 0.5f + 0.5f) * width, (0.5f - clip_position.y * inv_w * 0.5f) * height, clip_position.z * inv_w };
+}
+
+// Edge a to b as a * x + b * y + c, positive on the inside of a counterclockwise (in pixels) triangle.
+struct Edge {
+  float a;
+  float b;
+  float c;
+
+  Edge(const ScreenVertex& from, const ScreenVertex& to) : a(from.y - to.y), b(to.x - from.x), c(from.x * to.y - from.y * to.x) {
+  }
+};  // struct Edge
+
+// A cube of side 1 around the origin, for the benchmark's walls and objects.
+const XMFLOAT3 kCubePositions[] = {
+  XMFLOAT3(-0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, 0.5f, -0.5f), XMFLOAT3(-0.5f, 0.5f, -0.5f),
+  XMFLOAT3(-0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f), XMFLOAT3(-0.5f, 0.5f, 0.5f),
+};
+const DWORD kCubeIndices[] = {
+  0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,  3, 7, 6, 3, 6, 2,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5,
+};
+
+AssetsManager::DrawArgument MakeCubeDrawArgument(const XMFLOAT3& center, const XMFLOAT3& size)
+{
+  AssetsManager::DrawArgument draw_argument;
+  draw_argument.index_count = static_cast<UINT>(sizeof(kCubeIndices) / sizeof(kCubeIndices[0]));
+  // Stored transposed, like every model transform.
+  XMStoreFloat4x4(&draw_argument.model_transform, XMMatrixTranspose(XMMatrixMultiply(XMMatrixScaling(size.x, size.y, size.z),
+    XMMatrixTranslation(center.x, center.y, center.z))));
+  draw_argument.world_bounding_box.min = XMFLOAT3(center.x - 0.5f * size.x, center.y - 0.5f * size.y, center.z - 0.5f * size.z);
+  draw_argument.world_bounding_box.max = XMFLOAT3(center.x + 0.5f * size.x, center.y + 0.5f * size.y, center.z + 0.5f * size.z);
+  return draw_argument;
+}
+
+double ElapsedMilliseconds(std::chrono::steady_clock::time_point start_time)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+}  // namespace
+
+OcclusionCuller::BenchmarkReport OcclusionCuller::Benchmark(size_t object_number, UINT frame_number)
+{
+  BenchmarkReport report{};
+  if (object_number == 0 || frame_number == 0) {
+    return report;
+  }
+
+  // A street along +z lined with buildings, a wall across it further down, and props scattered everywhere.
+  std::vector<AssetsManager::DrawArgument> draw_arguments;
+  for (UINT i = 0; i + 1 < kMaxOccluderNumber; ++i) {
+    const float side = (i & 1) ? 1.0f : -1.0f;
+    draw_arguments.push_back(MakeCubeDrawArgument(XMFLOAT3(side * 17.0f, 10.0f, 8.0f + 12.0f * (i / 2)), XMFLOAT3(10.0f, 20.0f, 11.0f)));
+  }
+  draw_arguments.push_back(MakeCubeDrawArgument(XMFLOAT3(0.0f, 10.0f, 100.0f), XMFLOAT3(24.0f, 20.0f, 1.0f)));
+  std::mt19937 random_engine(static_cast<unsigned int>(object_number));
+  std::uniform_real_distribution<float> x(-200.0f, 200.0f);
+  std::uniform_real_distribution<float> z(-10.0f, 400.0f);
+  std::uniform_real_distribution<float> size(0.5f, 2.0f);
+  for (size_t i = 0; i < object_number; ++i) {
+    const XMFLOAT3 object_size(size(random_engine), size(random_engine), size(random_engine));
+    draw_arguments.push_back(MakeCubeDrawArgument(XMFLOAT3(x(random_engine), 0.5f * object_size.y, z(random_engine)), object_size));
+  }
+
+  const XMVECTOR camera_position = XMVectorSet(0.0f, 1.7f, -20.0f, 1.0f);
+  const XMMATRIX view = XMMatrixLookAtLH(camera_position, XMVectorSet(0.0f, 1.7f, 100.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  const XMMATRIX view_proj = XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(XM_PI / 3.0f, 16.0f / 9.0f, 0.1f, 1000.0f));
+  const FrustumCuller::Frustum frustum = FrustumCuller::ComputeFrustum(view_proj, true);
+  std::vector<UINT> candidates;
+  for (UINT i = 0; i < draw_arguments.size(); ++i) {
+    if (FrustumCuller::IsVisible(frustum, draw_arguments[i].world_bounding_box)) {
+      candidates.push_back(i);
+    }
+  }
+
+  OcclusionCuller culler;
+  culler.SetGeometry(std::vector<XMFLOAT3>(std::begin(kCubePositions), std::end(kCubePositions)),
+    std::vector<DWORD>(std::begin(kCubeIndices), std::end(kCubeIndices)));
+  std::vector<UINT> occluded_objects;
+  UINT64 tested_number = 0;
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    culler.BeginCull(view_proj, camera_position, draw_arguments, candidates);
+    culler.EndCull(occluded_objects, report.stats);
+    report.raster_milliseconds += report.stats.raster_milliseconds;
+    report.test_milliseconds += report.stats.test_milliseconds;
+    tested_number += report.stats.tested_number;
+  }
+  report.tested_objects_per_millisecond = report.test_milliseconds > 0.0 ? tested_number / report.test_milliseconds : 0.0;
+  report.raster_milliseconds /= frame_number;
+  report.test_milliseconds /= frame_number;
+  report.occluded_fraction = candidates.empty() ? 0.0 : static_cast<double>(report.stats.occluded_number) / candidates.size();
+  return report;
+}
+
+OcclusionCuller::OcclusionCuller(UINT width, UINT height)
+{
+  width_ = (std::max(width, 1u) + kTileSize - 1) / kTileSize * kTileSize;
+  height_ = (std::max(height, 1u) + kTileSize - 1) / kTileSize * kTileSize;
+  tile_columns_ = width_ / kTileSize;
+  depth_.resize(static_cast<size_t>(width_) * height_);
+  tile_max_depths_.resize(static_cast<size_t>(tile_columns_) * (height_ / kTileSize));
+  ClearDepth();
+  UpdateTiles();
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+  if (job_.valid()) {
+    job_.wait();
+  }
+}
+
+void OcclusionCuller::SetGeometry(std::vector<XMFLOAT3> positions, std::vector<DWORD> indices)
+{
+  if (job_.valid()) {
+    job_.wait();
+  }
+  positions_ = std::move(positions);
+  indices_ = std::move(indices);
+}
+
+void OcclusionCuller::BeginCull(FXMMATRIX view_proj, FXMVECTOR camera_position, const std::vector<AssetsManager::DrawArgument>& draw_arguments,
+                                const std::vector<UINT>& candidates)
+{
+  if (job_.valid()) {
+    job_.wait();
+  }
+
+  // The occluders hiding the most: the largest boxes for their distance, among the meshes cheap to rasterize.
+  std::vector<std::pair<float, UINT>> occluder_sizes;
+  job_candidates_.clear();
+  job_candidate_bounds_.clear();
+  for (UINT object_index : candidates) {
+    if (object_index >= draw_arguments.size()) {
+      continue;
+    }
+    const AssetsManager::DrawArgument& draw_argument = draw_arguments[object_index];
+    job_candidates_.push_back(object_index);
+    job_candidate_bounds_.push_back(draw_argument.world_bounding_box);
+    if (draw_argument.index_count / 3 > kMaxOccluderTriangleNumber) {
+      continue;
+    }
+    const XMVECTOR box_min = XMLoadFloat3(&draw_argument.world_bounding_box.min);
+    const XMVECTOR box_max = XMLoadFloat3(&draw_argument.world_bounding_box.max);
+    const XMVECTOR center = XMVectorScale(XMVectorAdd(box_min, box_max), 0.5f);
+    const XMVECTOR extents = XMVectorScale(XMVectorSubtract(box_max, box_min), 0.5f);
+    const XMVECTOR to_center = XMVectorSubtract(center, camera_position);
+    const float radius = XMVectorGetX(XMVector3Length(extents));
+    const float distance = XMVectorGetX(XMVector3Length(to_center));
+    // From inside its box, an object's triangles mostly cross the near plane and would be dropped anyway.
+    const bool contains_camera = XMVector3InBounds(to_center, extents);
+    if (!contains_camera && radius >= kMinOccluderAngularSize * distance) {
+      occluder_sizes.emplace_back(radius / distance, object_index);
+    }
+  }
+  const size_t occluder_number = std::min<size_t>(occluder_sizes.size(), kMaxOccluderNumber);
+  std::partial_sort(occluder_sizes.begin(), occluder_sizes.begin() + occluder_number, occluder_sizes.end(),
+    [](const std::pair<float, UINT>& a, const std::pair<float, UINT>& b) { return a.first > b.first; });
+  job_occluders_.clear();
+  for (size_t i = 0; i < occluder_number; ++i) {
+    job_occluders_.push_back(draw_arguments[occluder_sizes[i].second]);
+  }
+
+  XMStoreFloat4x4(&job_view_proj_, view_proj);
+  if (!worker_) {
+    worker_ = std::make_unique<ThreadPool>(1);
+  }
+  job_ = worker_->Submit([this]() { RunJob(); });
+}
+
+bool OcclusionCuller::EndCull(std::vector<UINT>& occluded_objects, Stats& stats)
+{
+  if (!job_.valid()) {
+    return false;
+  }
+  job_.get();
+  occluded_objects.swap(job_occluded_objects_);
+  stats = job_stats_;
+  return true;
+}
+
+void OcclusionCuller::RunJob()
+{
+  const XMMATRIX view_proj = XMLoadFloat4x4(&job_view_proj_);
+  job_stats_ = Stats{};
+
+  auto start_time = std::chrono::steady_clock::now();
+  ClearDepth();
+  for (const AssetsManager::DrawArgument& occluder : job_occluders_) {
+    const XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&occluder.model_transform));
+    job_stats_.occluder_triangle_number += RasterizeOccluder(XMMatrixMultiply(world, view_proj), occluder);
+  }
+  UpdateTiles();
+  job_stats_.occluder_number = static_cast<UINT>(job_occluders_.size());
+  job_stats_.raster_milliseconds = ElapsedMilliseconds(start_time);
+
+  start_time = std::chrono::steady_clock::now();
+  job_occluded_objects_.clear();
+  for (size_t i = 0; i < job_candidates_.size(); ++i) {
+    if (IsOccluded(job_candidate_bounds_[i], view_proj)) {
+      job_occluded_objects_.push_back(job_candidates_[i]);
+    }
+  }
+  job_stats_.tested_number = static_cast<UINT>(job_candidates_.size());
+  job_stats_.occluded_number = static_cast<UINT>(job_occluded_objects_.size());
+  job_stats_.test_milliseconds = ElapsedMilliseconds(start_time);
+}
+
+void OcclusionCuller::ClearDepth()
+{
+  std::fill(depth_.begin(), depth_.end(), 1.0f);
+}
+
+UINT OcclusionCuller::RasterizeOccluder(FXMMATRIX world_view_proj, const AssetsManager::DrawArgument& draw_argument)
+{
+  const size_t index_end = static_cast<size_t>(draw_argument.index_start) + draw_argument.index_count;
+  if (draw_argument.index_count < 3 || index_end > indices_.size()) {
+    return 0;
+  }
+
+  // Only the vertices the draw uses are transformed, with the same kernel as the CPU vertex transforms.
+  const auto index_range = std::minmax_element(indices_.begin() + draw_argument.index_start, indices_.begin() + index_end);
+  const size_t first_vertex = static_cast<size_t>(draw_argument.vertex_base) + *index_range.first;
+  const size_t vertex_number = static_cast<size_t>(*index_range.second) - *index_range.first + 1;
+  if (first_vertex + vertex_number > positions_.size()) {
+    return 0;
+  }
+  clip_positions_.resize(vertex_number);
+  VertexStreamTransform::TransformPositions(&positions_[first_vertex], vertex_number, world_view_proj, clip_positions_.data());
+
+  UINT rasterized_number = 0;
+  for (size_t i = draw_argument.index_start; i + 3 <= index_end; i += 3) {
+    const XMFLOAT4* clip[3];
+    bool in_front = true;
+    for (int k = 0; k < 3; ++k) {
+      clip[k] = &clip_positions_[indices_[i + k] - *index_range.first];
+      in_front = in_front && clip[k]->w > kMinClipW && clip[k]->z >= 0.0f;
+    }
+    if (!in_front) {
+      continue;
+    }
+
+    ScreenVertex v[3] = { ToScreen(*clip[0], width_, height_), ToScreen(*clip[1], width_, height_), ToScreen(*clip[2], width_, height_) };
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+    if (area < 0.0f) {
+      std::swap(v[1], v[2]);
+      area = -area;
+    }
+    if (!(area > 1e-8f)) {
+      continue;
+    }
+
+    // Pixels whose centers fall within the triangle's bounds.
+    const int min_x = std::max(static_cast<int>(std::ceil(std::min({ v[0].x, v[1].x, v[2].x }) - 0.5f)), 0);
+    const int max_x = std::min(static_cast<int>(std::floor(std::max({ v[0].x, v[1].x, v[2].x }) - 0.5f)), static_cast<int>(width_) - 1);
+    const int min_y = std::max(static_cast<int>(std::ceil(std::min({ v[0].y, v[1].y, v[2].y }) - 0.5f)), 0);
+    const int max_y = std::min(static_cast<int>(std::floor(std::max({ v[0].y, v[1].y, v[2].y }) - 0.5f)), static_cast<int>(height_) - 1);
+    if (min_x > max_x || min_y > max_y) {
+      continue;
+    }
+
+    const Edge edges[3] = { Edge(v[0], v[1]), Edge(v[1], v[2]), Edge(v[2], v[0]) };
+    // Depth is linear in screen space; pushing it back by half its slope along each axis gives the farthest
+    // point of the triangle's plane within each pixel.
+    const float dz_dx = ((v[1].z - v[0].z) * (v[2].y - v[0].y) - (v[2].z - v[0].z) * (v[1].y - v[0].y)) / area;
+    const float dz_dy = ((v[2].z - v[0].z) * (v[1].x - v[0].x) - (v[1].z - v[0].z) * (v[2].x - v[0].x)) / area;
+    const float z_offset = v[0].z - dz_dx * v[0].x - dz_dy * v[0].y + 0.5f * (std::fabs(dz_dx) + std::fabs(dz_dy));
+    const XMVECTOR max_z = XMVectorReplicate(std::max({ v[0].z, v[1].z, v[2].z }));
+    const XMVECTOR edge_as[3] = { XMVectorReplicate(edges[0].a), XMVectorReplicate(edges[1].a), XMVectorReplicate(edges[2].a) };
+    const XMVECTOR dz_dxs = XMVectorReplicate(dz_dx);
+
+    for (int y = min_y; y <= max_y; ++y) {
+      const float center_y = y + 0.5f;
+      const XMVECTOR edge_rows[3] = {
+        XMVectorReplicate(edges[0].b * center_y + edges[0].c),
+        XMVectorReplicate(edges[1].b * center_y + edges[1].c),
+        XMVectorReplicate(edges[2].b * center_y + edges[2].c),
+      };
+      const XMVECTOR z_row = XMVectorReplicate(dz_dy * center_y + z_offset);
+      float* depth_row = &depth_[static_cast<size_t>(y) * width_];
+      // Four pixels at a time from a multiple of four; lanes outside the triangle fail an edge test anyway.
+      for (int x = min_x & ~3; x <= max_x; x += 4) {
+        const XMVECTOR center_xs = XMVectorAdd(XMVectorReplicate(x + 0.5f), kLaneOffsets);
+        XMVECTOR inside = XMVectorGreater(XMVectorMultiplyAdd(center_xs, edge_as[0], edge_rows[0]), XMVectorZero());
+        inside = XMVectorAndInt(inside, XMVectorGreater(XMVectorMultiplyAdd(center_xs, edge_as[1], edge_rows[1]), XMVectorZero()));
+        inside = XMVectorAndInt(inside, XMVectorGreater(XMVectorMultiplyAdd(center_xs, edge_as[2], edge_rows[2]), XMVectorZero()));
+        const XMVECTOR z = XMVectorMin(XMVectorMultiplyAdd(center_xs, dz_dxs, z_row), max_z);
+        XMFLOAT4* depth = reinterpret_cast<XMFLOAT4*>(depth_row + x);
+        const XMVECTOR stored_z = XMLoadFloat4(depth);
+        XMStoreFloat4(depth, XMVectorSelect(stored_z, XMVectorMin(stored_z, z), inside));
+      }
+    }
+    rasterized_number++;
+  }
+  return rasterized_number;
+}
+
+void OcclusionCuller::UpdateTiles()
+{
+  const UINT tile_rows = height_ / kTileSize;
+  for (UINT tile_y = 0; tile_y < tile_rows; ++tile_y) {
+    for (UINT tile_x = 0; tile_x < tile_columns_; ++tile_x) {
+      XMVECTOR max_z = XMVectorZero();
+      for (UINT y = tile_y * kTileSize; y < (tile_y + 1) * kTileSize; ++y) {
+        const float* depth_row = &depth_[static_cast<size_t>(y) * width_ + tile_x * kTileSize];
+        for (UINT x = 0; x < kTileSize; x += 4) {
+          max_z = XMVectorMax(max_z, XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(depth_row + x)));
+        }
+      }
+      max_z = XMVectorMax(max_z, XMVectorSwizzle<2, 3, 0, 1>(max_z));
+      max_z = XMVectorMax(max_z, XMVectorSwizzle<1, 0, 3, 2>(max_z));
+      tile_max_depths_[tile_y * tile_columns_ + tile_x] = XMVectorGetX(max_z);
+    }
+  }
+}
+
+bool OcclusionCuller::IsOccluded(const BoundingBox& world_box, FXMMATRIX view_proj) const
+{
+  // The box's screen rectangle and nearest depth, from its eight corners.
+  float min_x = FLT_MAX;
+  float min_y = FLT_MAX;
+  float max_x = -FLT_MAX;
+  float max_y = -FLT_MAX;
+  float min_z = FLT_MAX;
+  for (int corner = 0; corner < 8; ++corner) {
+    const XMVECTOR position = XMVectorSet((corner & 1) ? world_box.max.x : world_box.min.x, (corner & 2) ? world_box.max.y : world_box.min.y,
+      (corner & 4) ? world_box.max.z : world_box.min.z, 1.0f);
+    XMFLOAT4 clip_position;
+    XMStoreFloat4(&clip_position, XMVector4Transform(position, view_proj));
+    if (clip_position.w <= kMinClipW || clip_position.z < 0.0f) {
+      return false;
+    }
+    const ScreenVertex v = ToScreen(clip_position, width_, height_);
+    min_x = std::min(min_x, v.x);
+    max_x = std::max(max_x, v.x);
+    min_y = std::min(min_y, v.y);
+    max_y = std::max(max_y, v.y);
+    min_z = std::min(min_z, v.z);
+  }
+
+  // Every pixel the rectangle touches; off screen the frustum culler has the final say.
+  const int first_x = std::max(static_cast<int>(std::floor(min_x)), 0);
+  const int last_x = std::min(static_cast<int>(std::floor(max_x)), static_cast<int>(width_) - 1);
+  const int first_y = std::max(static_cast<int>(std::floor(min_y)), 0);
+  const int last_y = std::min(static_cast<int>(std::floor(max_y)), static_cast<int>(height_) - 1);
+  if (first_x > last_x || first_y > last_y) {
+    return false;
+  }
+
+  const XMVECTOR min_zs = XMVectorReplicate(min_z);
+  const XMVECTOR first_xs = XMVectorReplicate(static_cast<float>(first_x));
+  const XMVECTOR last_xs = XMVectorReplicate(static_cast<float>(last_x));
+  for (int tile_y = first_y / static_cast<int>(kTileSize); tile_y <= last_y / static_cast<int>(kTileSize); ++tile_y) {
+    for (int tile_x = first_x / static_cast<int>(kTileSize); tile_x <= last_x / static_cast<int>(kTileSize); ++tile_x) {
+      // A tile whose farthest pixel is in front of the box hides its part of it.
+      if (tile_max_depths_[tile_y * tile_columns_ + tile_x] < min_z) {
+        continue;
+      }
+      const int x_begin = std::max(tile_x * static_cast<int>(kTileSize), first_x & ~3);
+      const int x_end = std::min((tile_x + 1) * static_cast<int>(kTileSize) - 1, last_x);
+      const int y_begin = std::max(tile_y * static_cast<int>(kTileSize), first_y);
+      const int y_end = std::min((tile_y + 1) * static_cast<int>(kTileSize) - 1, last_y);
+      for (int y = y_begin; y <= y_end; ++y) {
+        const float* depth_row = &depth_[static_cast<size_t>(y) * width_];
+        for (int x = x_begin; x <= x_end; x += 4) {
+          const XMVECTOR xs = XMVectorAdd(XMVectorReplicate(static_cast<float>(x)), kLaneOffsets);
+          const XMVECTOR in_rectangle = XMVectorAndInt(XMVectorGreaterOrEqual(xs, first_xs), XMVectorLessOrEqual(xs, last_xs));
+          const XMVECTOR visible = XMVectorGreaterOrEqual(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(depth_row + x)), min_zs);
+          if (XMVector4NotEqualInt(XMVectorAndInt(visible, in_rectangle), XMVectorZero())) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
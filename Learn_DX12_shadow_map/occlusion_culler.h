@@ -0,0 +1,115 @@
+#pragma once
+
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "assets_manager.h"
+#include "thread_pool.h"
+
+using namespace DirectX;
+
+// Skips objects hidden behind others. A few large, nearby objects are picked as occluders and their triangles
+// are rasterized into a small CPU depth buffer, four pixels at a time; the buffer is then summarized as the
+// farthest depth of each kTileSize square. An object is occluded when the nearest depth of its projected box is
+// behind every pixel the box covers, which the tiles settle without reading the pixels most of the time.
+//
+// Everything errs towards drawing: occluder triangles crossing the near plane are dropped, pixels on an edge are
+// left uncovered, and the depth written is the farthest the triangle gets within each pixel. An object whose box
+// crosses the near plane is never occluded.
+//
+// BeginCull hands a frame to a worker thread, and EndCull collects it during the next one, so the raster stays off
+// the frame's critical path. The price is a frame of latency: an object coming out from behind an occluder can
+// show up a frame late while the camera moves.
+class OcclusionCuller {
+ public:
+  using BoundingBox = Asset::Model::BoundingBox;
+
+  struct Stats {
+    UINT occluder_number;
+    UINT occluder_triangle_number;  // rasterized
+    UINT tested_number;
+    UINT occluded_number;
+    double raster_milliseconds;  // occluders and tiles
+    double test_milliseconds;
+  };  // struct Stats
+
+  struct BenchmarkReport {
+    Stats stats;  // of the last frame
+    double raster_milliseconds;  // per frame
+    double test_milliseconds;
+    double tested_objects_per_millisecond;
+    double occluded_fraction;  // of the objects in view
+  };  // struct BenchmarkReport
+
+  static constexpr UINT kTileSize = 8;
+  static constexpr UINT kMaxOccluderNumber = 16;
+  static constexpr UINT kMaxOccluderTriangleNumber = 2048;  // larger meshes are not worth rasterizing
+  // Boxes smaller than this (half diagonal over distance) rarely hide much.
+  static constexpr float kMinOccluderAngularSize = 0.05f;
+
+  // Walls and objects of a city street, object_number of them behind kMaxOccluderNumber walls.
+  static BenchmarkReport Benchmark(size_t object_number, UINT frame_number);
+
+  // width and height are rounded up to a multiple of kTileSize.
+  OcclusionCuller(UINT width = 256, UINT height = 144);
+  ~OcclusionCuller();
+
+  OcclusionCuller(const OcclusionCuller&) = delete;
+  OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+  // Merged positions and indices as in AssetsManager::CopyMergedVertexStreamsAndIndices, which DrawArguments
+  // index into.
+  void SetGeometry(std::vector<XMFLOAT3> positions, std::vector<DWORD> indices);
+
+  // Waits for the previous job, then starts culling candidates (object indices, e.g. those in the camera's
+  // frustum) on the worker. view_proj is DirectXMath's row-vector convention, not the constant buffers' copy.
+  void BeginCull(FXMMATRIX view_proj, FXMVECTOR camera_position, const std::vector<AssetsManager::DrawArgument>& draw_arguments,
+                 const std::vector<UINT>& candidates);
+
+  // Waits for the job BeginCull started and hands over the candidates it found occluded, in object order.
+  // Returns false if no job was started.
+  bool EndCull(std::vector<UINT>& occluded_objects, Stats& stats);
+
+  // The steps of a job, also usable directly on the calling thread.
+  void ClearDepth();
+  // Returns the triangles rasterized. world_view_proj in DirectXMath's row-vector convention.
+  UINT RasterizeOccluder(FXMMATRIX world_view_proj, const AssetsManager::DrawArgument& draw_argument);
+  void UpdateTiles();
+  bool IsOccluded(const BoundingBox& world_box, FXMMATRIX view_proj) const;
+
+  UINT GetWidth() const {
+    return width_;
+  }
+
+  UINT GetHeight() const {
+    return height_;
+  }
+
+  // Post-projection depth per pixel, 1 where no occluder was drawn.
+  const std::vector<float>& GetDepth() const {
+    return depth_;
+  }
+
+ private:
+  void RunJob();
+
+  UINT width_ = 0;
+  UINT height_ = 0;
+  UINT tile_columns_ = 0;
+  std::vector<float> depth_;
+  std::vector<float> tile_max_depths_;
+  std::vector<XMFLOAT3> positions_;
+  std::vector<DWORD> indices_;
+  std::vector<XMFLOAT4> clip_positions_;  // scratch, per occluder
+
+  // Inputs and outputs of the job in flight, only touched by the main thread while there is none.
+  XMFLOAT4X4 job_view_proj_;
+  std::vector<AssetsManager::DrawArgument> job_occluders_;
+  std::vector<UINT> job_candidates_;
+  std::vector<BoundingBox> job_candidate_bounds_;
+  std::vector<UINT> job_occluded_objects_;
+  Stats job_stats_{};
+  std::future<void> job_;
+  std::unique_ptr<ThreadPool> worker_;
+};  // class OcclusionCuller
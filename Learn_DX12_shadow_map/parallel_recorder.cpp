@@ -0,0 +1,129 @@
+#include "parallel_recorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+constexpr size_t ParallelRecorder::kMinPartItemNumber;
+
+namespace {
+
+// Synthetic stand-in for command lists: each part encodes a root SRV and an indexed draw per item into its own
+// memory, running them through a few rounds of xorshift mixing for a fixed amount of CPU work per draw. No device
+// is involved, so its timings say nothing about a real driver's recording cost.
+class EncodingTarget : public ParallelRecorder::Target {
+ public:
+  void BeginParts(UINT part_number) override {
+    if (part_commands_.size() < part_number) {
+      part_commands_.resize(part_number);
+    }
+  }
+
+  void RecordPart(UINT part_index, UINT /*worker_index*/, size_t item_begin, size_t item_end) override {
+    std::vector<uint8_t>& commands = part_commands_[part_index];
+    commands.clear();
+    for (size_t item = item_begin; item < item_end; ++item) {
+      uint64_t words[5] = { 0x10000 + 64 * item, 36 + item % 7 * 6, 1 + item % 4, 96 * item, 24 * item };
+      for (int round = 0; round < 16; ++round) {
+        for (uint64_t& word : words) {
+          word ^= word << 13;
+          word ^= word >> 7;
+          word ^= word << 17;
+        }
+      }
+      const size_t offset = commands.size();
+      commands.resize(offset + sizeof(words));
+      std::memcpy(commands.data() + offset, words, sizeof(words));
+    }
+  }
+
+  void EndParts(UINT part_number) override {
+    for (UINT i = 0; i < part_number; ++i) {
+      submitted_size_ += part_commands_[i].size();
+    }
+  }
+
+  size_t GetSubmittedSize() const {
+    return submitted_size_;
+  }
+
+ private:
+  std::vector<std::vector<uint8_t>> part_commands_;
+  size_t submitted_size_ = 0;
+};  // class EncodingTarget
+
+}  // namespace
+
+void ParallelRecorder::Partition(size_t item_number, UINT max_part_number, size_t min_part_item_number, std::vector<Range>& ranges)
+{
+  ranges.clear();
+  if (item_number == 0) {
+    return;
+  }
+
+  const size_t part_number = std::max<size_t>(1, std::min<size_t>(std::max<UINT>(max_part_number, 1), item_number / std::max<size_t>(min_part_item_number, 1)));
+  const size_t base_size = item_number / part_number;
+  const size_t larger_part_number = item_number % part_number;  // the first parts take one more item
+  size_t begin = 0;
+  for (size_t i = 0; i < part_number; ++i) {
+    const size_t end = begin + base_size + (i < larger_part_number ? 1 : 0);
+    ranges.push_back({ begin, end });
+    begin = end;
+  }
+}
+
+std::vector<ParallelRecorder::BenchmarkReport> ParallelRecorder::Benchmark(size_t item_number, UINT max_thread_number, UINT iteration_number)
+{
+  std::vector<BenchmarkReport> reports;
+  if (item_number == 0 || iteration_number == 0) {
+    return reports;
+  }
+
+  for (UINT thread_number = 1; thread_number <= std::max<UINT>(max_thread_number, 1); ++thread_number) {
+    ParallelRecorder recorder(thread_number);
+    EncodingTarget target;
+    BenchmarkReport report{};
+    report.thread_number = thread_number;
+    report.part_number = recorder.Record(item_number, target);  // warms the pool and the part memory up
+    const auto start_time = std::chrono::steady_clock::now();
+    for (UINT i = 0; i < iteration_number; ++i) {
+      recorder.Record(item_number, target);
+    }
+    const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+    report.microseconds = microseconds / iteration_number;
+    report.items_per_microsecond = microseconds > 0.0 && target.GetSubmittedSize() > 0 ? item_number * iteration_number / microseconds : 0.0;
+    report.speedup = reports.empty() || report.microseconds <= 0.0 ? 1.0 : reports.front().microseconds / report.microseconds;
+    reports.push_back(report);
+  }
+  return reports;
+}
+
+ParallelRecorder::ParallelRecorder(UINT thread_number) : thread_number_(std::max<UINT>(thread_number, 1))
+{
+  if (thread_number_ > 1) {
+    thread_pool_ = std::make_unique<ThreadPool>(thread_number_ - 1);
+  }
+}
+
+UINT ParallelRecorder::Record(size_t item_number, Target& target)
+{
+  Partition(item_number, thread_number_, kMinPartItemNumber, ranges_);
+  const UINT part_number = static_cast<UINT>(ranges_.size());
+  if (part_number == 0) {
+    return 0;
+  }
+
+  target.BeginParts(part_number);
+  if (part_number == 1) {
+    // The calling thread is the pool's last worker, see ThreadPool::ParallelFor.
+    target.RecordPart(0, thread_number_ - 1, ranges_[0].begin, ranges_[0].end);
+  }
+  else {
+    thread_pool_->ParallelFor(part_number, [this, &target](size_t part_index, size_t worker_index) {
+      target.RecordPart(static_cast<UINT>(part_index), static_cast<UINT>(worker_index), ranges_[part_index].begin, ranges_[part_index].end);
+      });
+  }
+  target.EndParts(part_number);
+  return part_number;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common_headers.h"
+#include "thread_pool.h"
+
+// Splits the draws of a pass into contiguous parts that are recorded at the same time, one command list per part.
+// Submitting the lists in part order then draws in the order a single list would have. What a part records into
+// sits behind Target: the scene's wraps command lists, the benchmark's only encodes fake commands into memory, so
+// the scheduling can be measured without a device.
+class ParallelRecorder {
+ public:
+  // Called by Record: BeginParts and EndParts on the calling thread, RecordPart on any thread, each part once.
+  class Target {
+   public:
+    virtual ~Target() = default;
+
+    // Before any part is recorded, e.g. to hand out command lists.
+    virtual void BeginParts(UINT part_number) = 0;
+    // Records items [item_begin, item_end). worker_index is in [0, GetThreadNumber()) and no two parts recorded
+    // at the same time share one, so it can pick a command allocator.
+    virtual void RecordPart(UINT part_index, UINT worker_index, size_t item_begin, size_t item_end) = 0;
+    // After every part is recorded, e.g. to queue the lists for submission in part order.
+    virtual void EndParts(UINT part_number) = 0;
+  };  // class Target
+
+  struct Range {
+    size_t begin;
+    size_t end;
+  };  // struct Range
+
+  struct BenchmarkReport {
+    UINT thread_number;
+    UINT part_number;  // per pass
+    double microseconds;  // per pass
+    double items_per_microsecond;
+    double speedup;  // over one thread
+  };  // struct BenchmarkReport
+
+  // Fewer draws and a list's own state setup costs more than recording them on another thread saves.
+  static constexpr size_t kMinPartItemNumber = 64;
+
+  // Splits item_number items into at most max_part_number contiguous ranges of at least min_part_item_number
+  // items (unless there are fewer items than that altogether), their sizes differing by one at most.
+  static void Partition(size_t item_number, UINT max_part_number, size_t min_part_item_number, std::vector<Range>& ranges);
+
+  // Records passes of item_number draws with 1 to max_thread_number threads, iteration_number times each. The
+  // draws go to a synthetic target, not to command lists: it measures the partitioning and the scheduling,
+  // with a fixed amount of CPU work per draw standing in for the driver's. The speedup is only an upper bound
+  // of what real command lists get.
+  static std::vector<BenchmarkReport> Benchmark(size_t item_number, UINT max_thread_number, UINT iteration_number);
+
+  // The calling thread records too, so 1 (or 0) records everything on it and starts no pool.
+  explicit ParallelRecorder(UINT thread_number = 1);
+
+  ParallelRecorder(const ParallelRecorder&) = delete;
+  ParallelRecorder& operator=(const ParallelRecorder&) = delete;
+
+  UINT GetThreadNumber() const {
+    return thread_number_;
+  }
+
+  // Partitions item_number items over the threads and has target record the parts, blocking until they all are.
+  // Returns the number of parts, 0 for no items.
+  UINT Record(size_t item_number, Target& target);
+
+ private:
+  UINT thread_number_ = 1;
+  std::unique_ptr<ThreadPool> thread_pool_;  // thread_number_ - 1 workers
+  std::vector<Range> ranges_;
+};  // class ParallelRecorder
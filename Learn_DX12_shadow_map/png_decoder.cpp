@@ -0,0 +1,615 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "portable_image_formats.h"
+
+namespace PortableImage {
+
+namespace {
+
+// LSB-first bit reader over a deflate stream. Reading past the end yields zeros; Overrun() tells whether
+// any of those were actually consumed.
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {
+
+  }
+
+  void Refill() {
+    while (bit_count_ <= 56) {
+      const uint64_t byte = position_ < size_ ? data_[position_] : 0;
+      position_++;
+      bits_ |= byte << bit_count_;
+      bit_count_ += 8;
+    }
+  }
+
+  uint32_t Peek(int bit_number) const {
+    return static_cast<uint32_t>(bits_ & ((1ull << bit_number) - 1));
+  }
+
+  void Consume(int bit_number) {
+    bits_ >>= bit_number;
+    bit_count_ -= bit_number;
+  }
+
+  uint32_t Read(int bit_number) {
+    Refill();
+    const uint32_t value = Peek(bit_number);
+    Consume(bit_number);
+    return value;
+  }
+
+  void AlignToByte() {
+    Consume(bit_count_ % 8);
+  }
+
+  bool Overrun() const {
+    return position_ * 8 - bit_count_ > size_ * 8;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_ = 0;
+  uint64_t bits_ = 0;
+  int bit_count_ = 0;
+};  // class BitReader
+
+// Canonical Huffman decoder: a 9 bit lookup table for short codes, a bit by bit walk for the rest.
+class HuffmanTable {
+ public:
+  static constexpr int kFastBits = 9;
+  static constexpr int kMaxBits = 15;
+
+  bool Build(const uint8_t* lengths, int symbol_number) {
+    std::memset(counts_, 0, sizeof(counts_));
+    std::memset(fast_, 0, sizeof(fast_));
+    for (int i = 0; i < symbol_number; ++i) {
+      counts_[lengths[i]]++;
+    }
+    counts_[0] = 0;
+
+    // Reject over-subscribed sets. Incomplete ones are legal (e.g. a single distance code).
+    int left = 1;
+    for (int length = 1; length <= kMaxBits; ++length) {
+      left <<= 1;
+      left -= counts_[length];
+      if (left < 0) {
+        return false;
+      }
+    }
+
+    int offsets[kMaxBits + 2] = {};
+    for (int length = 1; length <= kMaxBits; ++length) {
+      offsets[length + 1] = offsets[length] + counts_[length];
+    }
+    for (int i = 0; i < symbol_number; ++i) {
+      if (lengths[i] != 0) {
+        symbols_[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+      }
+    }
+
+    // Codes are stored bit reversed in the stream, so index the fast table by the reversed code.
+    int code = 0;
+    int symbol_index = 0;
+    for (int length = 1; length <= kMaxBits; ++length) {
+      for (int i = 0; i < counts_[length]; ++i, ++code, ++symbol_index) {
+        if (length <= kFastBits) {
+          int reversed = 0;
+          for (int bit = 0; bit < length; ++bit) {
+            reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+          }
+          const uint16_t entry = static_cast<uint16_t>((symbols_[symbol_index] << 4) | length);
+          for (int index = reversed; index < (1 << kFastBits); index += 1 << length) {
+            fast_[index] = entry;
+          }
+        }
+      }
+      code <<= 1;
+    }
+
+    return true;
+  }
+
+  // -1 for a code that isn't in the table.
+  int Decode(BitReader& reader) const {
+    reader.Refill();
+    const uint16_t entry = fast_[reader.Peek(kFastBits)];
+    if (entry != 0) {
+      reader.Consume(entry & 0xF);
+      return entry >> 4;
+    }
+
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= kMaxBits; ++length) {
+      code |= static_cast<int>(reader.Read(1));
+      const int count = counts_[length];
+      if (code - count < first) {
+        return symbols_[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+
+    return -1;
+  }
+
+ private:
+  uint16_t counts_[kMaxBits + 1];
+  uint16_t symbols_[288];
+  uint16_t fast_[1 << kFastBits];  // symbol << 4 | length, 0 when the code is longer
+};  // class HuffmanTable
+
+const uint16_t kLengthBases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t kLengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t kDistanceBases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t kDistanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// output is already sized to the most the stream may inflate to; going past it fails.
+bool InflateBlock(BitReader& reader, const HuffmanTable& literal_table, const HuffmanTable& distance_table, std::vector<uint8_t>& output, size_t& output_size)
+{
+  for (;;) {
+    const int symbol = literal_table.Decode(reader);
+    if (symbol < 0 || reader.Overrun()) {
+      return false;
+    }
+
+    if (symbol < 256) {
+      if (output_size == output.size()) {
+        return false;
+      }
+      output[output_size++] = static_cast<uint8_t>(symbol);
+      continue;
+    }
+    if (symbol == 256) {
+      return true;
+    }
+    if (symbol > 285) {
+      return false;
+    }
+
+    const int length_index = symbol - 257;
+    const size_t length = kLengthBases[length_index] + reader.Read(kLengthExtraBits[length_index]);
+    const int distance_symbol = distance_table.Decode(reader);
+    if (distance_symbol < 0 || distance_symbol >= 30) {
+      return false;
+    }
+    const size_t distance = kDistanceBases[distance_symbol] + reader.Read(kDistanceExtraBits[distance_symbol]);
+    if (distance > output_size || length > output.size() - output_size || reader.Overrun()) {
+      return false;
+    }
+
+    // Byte by byte, the source may overlap what is being written.
+    uint8_t* destination = output.data() + output_size;
+    const uint8_t* source = destination - distance;
+    for (size_t i = 0; i < length; ++i) {
+      destination[i] = source[i];
+    }
+    output_size += length;
+  }
+}
+
+}  // namespace
+
+bool Inflate(const uint8_t* data, size_t size, size_t max_size, std::vector<uint8_t>& output)
+{
+  // zlib header: deflate, no preset dictionary.
+  if (size < 2 || (data[0] & 0x0F) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20) != 0) {
+    return false;
+  }
+
+  BitReader reader(data + 2, size - 2);
+  size_t output_size = output.size();
+  output.resize(output_size + max_size);
+
+  HuffmanTable literal_table;
+  HuffmanTable distance_table;
+  bool last_block = false;
+  while (!last_block) {
+    last_block = reader.Read(1) != 0;
+    const uint32_t block_type = reader.Read(2);
+
+    if (block_type == 0) {
+      // Stored: byte aligned LEN, NLEN, then raw bytes.
+      reader.AlignToByte();
+      const uint32_t length = reader.Read(16);
+      const uint32_t inverted_length = reader.Read(16);
+      if ((length ^ 0xFFFF) != inverted_length) {
+        return false;
+      }
+      if (length > output.size() - output_size) {
+        return false;
+      }
+      for (uint32_t i = 0; i < length; ++i) {
+        output[output_size++] = static_cast<uint8_t>(reader.Read(8));
+      }
+      if (reader.Overrun()) {
+        return false;
+      }
+    } else if (block_type == 1) {
+      uint8_t lengths[288 + 32];
+      std::memset(lengths, 8, 144);
+      std::memset(lengths + 144, 9, 112);
+      std::memset(lengths + 256, 7, 24);
+      std::memset(lengths + 280, 8, 8);
+      std::memset(lengths + 288, 5, 32);
+      literal_table.Build(lengths, 288);
+      distance_table.Build(lengths + 288, 32);
+      if (!InflateBlock(reader, literal_table, distance_table, output, output_size)) {
+        return false;
+      }
+    } else if (block_type == 2) {
+      const int literal_number = static_cast<int>(reader.Read(5)) + 257;
+      const int distance_number = static_cast<int>(reader.Read(5)) + 1;
+      const int code_length_number = static_cast<int>(reader.Read(4)) + 4;
+      if (literal_number > 286 || distance_number > 30) {
+        return false;
+      }
+
+      static const uint8_t kCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+      uint8_t code_lengths[19] = {};
+      for (int i = 0; i < code_length_number; ++i) {
+        code_lengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(reader.Read(3));
+      }
+      HuffmanTable code_length_table;
+      if (!code_length_table.Build(code_lengths, 19)) {
+        return false;
+      }
+
+      // Literal/length and distance code lengths form one run length coded sequence.
+      uint8_t lengths[286 + 30] = {};
+      int index = 0;
+      while (index < literal_number + distance_number) {
+        const int symbol = code_length_table.Decode(reader);
+        if (symbol < 0 || reader.Overrun()) {
+          return false;
+        }
+        if (symbol < 16) {
+          lengths[index++] = static_cast<uint8_t>(symbol);
+          continue;
+        }
+
+        uint8_t repeated = 0;
+        int repeat = 0;
+        if (symbol == 16) {
+          if (index == 0) {
+            return false;
+          }
+          repeated = lengths[index - 1];
+          repeat = 3 + static_cast<int>(reader.Read(2));
+        } else if (symbol == 17) {
+          repeat = 3 + static_cast<int>(reader.Read(3));
+        } else {
+          repeat = 11 + static_cast<int>(reader.Read(7));
+        }
+        if (index + repeat > literal_number + distance_number) {
+          return false;
+        }
+        std::memset(lengths + index, repeated, repeat);
+        index += repeat;
+      }
+
+      if (lengths[256] == 0 ||
+          !literal_table.Build(lengths, literal_number) ||
+          !distance_table.Build(lengths + literal_number, distance_number)) {
+        return false;
+      }
+      if (!InflateBlock(reader, literal_table, distance_table, output, output_size)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  output.resize(output_size);
+  return true;
+}
+
+namespace {
+
+uint32_t ReadBigEndian32(const uint8_t* data)
+{
+  return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+uint8_t PaethPredictor(int a, int b, int c)
+{
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return static_cast<uint8_t>(a);
+  }
+  return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// Reverses the filter of one scanline in place. previous is the unfiltered line above (zeros for the first).
+bool Unfilter(uint8_t filter_type, uint8_t* line, const uint8_t* previous, size_t line_size, size_t pixel_size)
+{
+  switch (filter_type) {
+    case 0:
+      break;
+    case 1:
+      for (size_t i = pixel_size; i < line_size; ++i) {
+        line[i] = static_cast<uint8_t>(line[i] + line[i - pixel_size]);
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < line_size; ++i) {
+        line[i] = static_cast<uint8_t>(line[i] + previous[i]);
+      }
+      break;
+    case 3:
+      for (size_t i = 0; i < line_size; ++i) {
+        const int left = i >= pixel_size ? line[i - pixel_size] : 0;
+        line[i] = static_cast<uint8_t>(line[i] + ((left + previous[i]) >> 1));
+      }
+      break;
+    case 4:
+      for (size_t i = 0; i < line_size; ++i) {
+        const int left = i >= pixel_size ? line[i - pixel_size] : 0;
+        const int upper_left = i >= pixel_size ? previous[i - pixel_size] : 0;
+        line[i] = static_cast<uint8_t>(line[i] + PaethPredictor(left, previous[i], upper_left));
+      }
+      break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+struct PngInfo {
+  UINT width = 0;
+  UINT height = 0;
+  uint8_t bit_depth = 0;
+  uint8_t color_type = 0;
+  uint8_t channel_number = 0;
+  std::vector<uint8_t> palette;  // RGBA
+  bool has_transparent_color = false;
+  uint16_t transparent_color[3] = {};  // gray, or RGB, as stored
+};  // struct PngInfo
+
+// Sample x (channel included) of an unfiltered scanline, as stored.
+uint32_t ReadSample(const uint8_t* line, size_t sample_index, uint8_t bit_depth)
+{
+  switch (bit_depth) {
+    case 16:
+      return (line[sample_index * 2] << 8) | line[sample_index * 2 + 1];
+    case 8:
+      return line[sample_index];
+    default: {
+      const size_t bit_offset = sample_index * bit_depth;
+      const int shift = 8 - bit_depth - static_cast<int>(bit_offset % 8);
+      return (line[bit_offset / 8] >> shift) & ((1u << bit_depth) - 1);
+    }
+  }
+}
+
+// Expands pixel x of a scanline to RGBA, 8 or 16 bits per channel depending on the image.
+bool ConvertPixel(const PngInfo& info, const uint8_t* line, size_t x, uint8_t* destination)
+{
+  const size_t first_sample = x * info.channel_number;
+  if (info.color_type == 3) {
+    const uint32_t index = ReadSample(line, first_sample, info.bit_depth);
+    if (index * 4 >= info.palette.size()) {
+      return false;
+    }
+    std::memcpy(destination, &info.palette[index * 4], 4);
+    return true;
+  }
+
+  uint32_t samples[4] = {};
+  for (uint8_t channel = 0; channel < info.channel_number; ++channel) {
+    samples[channel] = ReadSample(line, first_sample + channel, info.bit_depth);
+  }
+
+  uint32_t rgba[4] = {};
+  const uint32_t max_value = (1u << info.bit_depth) - 1;
+  switch (info.color_type) {
+    case 0:  // gray
+      rgba[0] = rgba[1] = rgba[2] = samples[0];
+      rgba[3] = (info.has_transparent_color && samples[0] == info.transparent_color[0]) ? 0 : max_value;
+      break;
+    case 2:  // RGB
+      rgba[0] = samples[0];
+      rgba[1] = samples[1];
+      rgba[2] = samples[2];
+      rgba[3] = (info.has_transparent_color && samples[0] == info.transparent_color[0] &&
+        samples[1] == info.transparent_color[1] && samples[2] == info.transparent_color[2]) ? 0 : max_value;
+      break;
+    case 4:  // gray, alpha
+      rgba[0] = rgba[1] = rgba[2] = samples[0];
+      rgba[3] = samples[1];
+      break;
+    default:  // RGBA
+      std::memcpy(rgba, samples, sizeof(rgba));
+      break;
+  }
+
+  if (info.bit_depth == 16) {
+    uint16_t* destination16 = reinterpret_cast<uint16_t*>(destination);
+    for (int channel = 0; channel < 4; ++channel) {
+      destination16[channel] = static_cast<uint16_t>(rgba[channel]);
+    }
+  } else {
+    // 1, 2 and 4 bit gray scale up to the full 8 bit range.
+    const uint32_t scale = 255 / max_value;
+    for (int channel = 0; channel < 4; ++channel) {
+      destination[channel] = static_cast<uint8_t>(rgba[channel] * scale);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool DecodePng(const uint8_t* data, size_t size, DecodedImageWriter& writer)
+{
+  PngInfo info;
+  uint8_t interlace_method = 0;
+  std::vector<uint8_t> compressed;
+  bool header_read = false;
+
+  // Chunks: length, type, data, CRC. The CRCs aren't checked, zlib and the filters catch most damage.
+  size_t offset = 8;
+  for (;;) {
+    if (offset + 8 > size) {
+      return false;
+    }
+    const uint32_t chunk_size = ReadBigEndian32(data + offset);
+    const uint8_t* chunk_type = data + offset + 4;
+    const uint8_t* chunk_data = data + offset + 8;
+    if (chunk_size > size - offset - 8 || size - offset - 8 - chunk_size < 4) {
+      return false;
+    }
+    offset += 12 + static_cast<size_t>(chunk_size);
+
+    if (std::memcmp(chunk_type, "IHDR", 4) == 0) {
+      if (chunk_size != 13) {
+        return false;
+      }
+      info.width = ReadBigEndian32(chunk_data);
+      info.height = ReadBigEndian32(chunk_data + 4);
+      info.bit_depth = chunk_data[8];
+      info.color_type = chunk_data[9];
+      interlace_method = chunk_data[12];
+      if (chunk_data[10] != 0 || chunk_data[11] != 0 || interlace_method > 1) {
+        return false;
+      }
+
+      const uint8_t depth = info.bit_depth;
+      switch (info.color_type) {
+        case 0:
+          info.channel_number = 1;
+          if (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16) return false;
+          break;
+        case 2:
+          info.channel_number = 3;
+          if (depth != 8 && depth != 16) return false;
+          break;
+        case 3:
+          info.channel_number = 1;
+          if (depth != 1 && depth != 2 && depth != 4 && depth != 8) return false;
+          break;
+        case 4:
+          info.channel_number = 2;
+          if (depth != 8 && depth != 16) return false;
+          break;
+        case 6:
+          info.channel_number = 4;
+          if (depth != 8 && depth != 16) return false;
+          break;
+        default:
+          return false;
+      }
+      header_read = true;
+    } else if (std::memcmp(chunk_type, "PLTE", 4) == 0) {
+      if (chunk_size % 3 != 0 || chunk_size / 3 > 256) {
+        return false;
+      }
+      info.palette.resize(chunk_size / 3 * 4);
+      for (uint32_t i = 0; i < chunk_size / 3; ++i) {
+        info.palette[i * 4 + 0] = chunk_data[i * 3 + 0];
+        info.palette[i * 4 + 1] = chunk_data[i * 3 + 1];
+        info.palette[i * 4 + 2] = chunk_data[i * 3 + 2];
+        info.palette[i * 4 + 3] = 255;
+      }
+    } else if (std::memcmp(chunk_type, "tRNS", 4) == 0) {
+      if (info.color_type == 3) {
+        for (uint32_t i = 0; i < chunk_size && i * 4 < info.palette.size(); ++i) {
+          info.palette[i * 4 + 3] = chunk_data[i];
+        }
+      } else if (info.color_type == 0 && chunk_size >= 2) {
+        info.has_transparent_color = true;
+        info.transparent_color[0] = static_cast<uint16_t>((chunk_data[0] << 8) | chunk_data[1]);
+      } else if (info.color_type == 2 && chunk_size >= 6) {
+        info.has_transparent_color = true;
+        for (int i = 0; i < 3; ++i) {
+          info.transparent_color[i] = static_cast<uint16_t>((chunk_data[i * 2] << 8) | chunk_data[i * 2 + 1]);
+        }
+      }
+    } else if (std::memcmp(chunk_type, "IDAT", 4) == 0) {
+      compressed.insert(compressed.end(), chunk_data, chunk_data + chunk_size);
+    } else if (std::memcmp(chunk_type, "IEND", 4) == 0) {
+      break;
+    } else if ((chunk_type[0] & 0x20) == 0) {
+      return false;  // unknown critical chunk
+    }
+  }
+
+  if (!header_read || (info.color_type == 3 && info.palette.empty()) ||
+      info.width == 0 || info.height == 0 || info.width > kMaxDimension || info.height > kMaxDimension) {
+    return false;
+  }
+
+  // Adam7 passes; a non-interlaced image is one pass over everything.
+  struct Pass {
+    UINT x0, y0, dx, dy;
+  };
+  static const Pass kAdam7Passes[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+  static const Pass kSinglePass[1] = { { 0, 0, 1, 1 } };
+  const Pass* passes = interlace_method == 1 ? kAdam7Passes : kSinglePass;
+  const int pass_number = interlace_method == 1 ? 7 : 1;
+
+  const size_t bits_per_pixel = static_cast<size_t>(info.channel_number) * info.bit_depth;
+  const size_t filter_pixel_size = bits_per_pixel >= 8 ? bits_per_pixel / 8 : 1;
+  size_t expected_size = 0;
+  for (int pass = 0; pass < pass_number; ++pass) {
+    const size_t pass_width = (info.width + passes[pass].dx - 1 - passes[pass].x0) / passes[pass].dx;
+    const size_t pass_height = (info.height + passes[pass].dy - 1 - passes[pass].y0) / passes[pass].dy;
+    if (pass_width > 0 && pass_height > 0) {
+      expected_size += pass_height * (1 + (pass_width * bits_per_pixel + 7) / 8);
+    }
+  }
+
+  std::vector<uint8_t> filtered;
+  if (!Inflate(compressed.data(), compressed.size(), expected_size, filtered) || filtered.size() < expected_size) {
+    return false;
+  }
+
+  if (!writer.Begin(info.width, info.height, info.bit_depth == 16 ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM)) {
+    return false;
+  }
+  const size_t output_pixel_size = info.bit_depth == 16 ? 8 : 4;
+
+  std::vector<uint8_t> previous_line;
+  size_t filtered_offset = 0;
+  for (int pass = 0; pass < pass_number; ++pass) {
+    const Pass& p = passes[pass];
+    const size_t pass_width = (info.width + p.dx - 1 - p.x0) / p.dx;
+    const size_t pass_height = (info.height + p.dy - 1 - p.y0) / p.dy;
+    if (pass_width == 0 || pass_height == 0) {
+      continue;
+    }
+
+    const size_t line_size = (pass_width * bits_per_pixel + 7) / 8;
+    previous_line.assign(line_size, 0);
+    for (size_t row = 0; row < pass_height; ++row) {
+      const uint8_t filter_type = filtered[filtered_offset];
+      uint8_t* line = &filtered[filtered_offset + 1];
+      filtered_offset += 1 + line_size;
+      if (!Unfilter(filter_type, line, previous_line.data(), line_size, filter_pixel_size)) {
+        return false;
+      }
+
+      uint8_t* destination = writer.GetRow(static_cast<UINT>(p.y0 + row * p.dy));
+      for (size_t x = 0; x < pass_width; ++x) {
+        if (!ConvertPixel(info, line, x, destination + (p.x0 + x * p.dx) * output_pixel_size)) {
+          return false;
+        }
+      }
+      std::memcpy(previous_line.data(), line, line_size);
+    }
+  }
+
+  return true;
+}
+
+}  // namespace PortableImage
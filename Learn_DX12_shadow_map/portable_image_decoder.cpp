@@ -0,0 +1,421 @@
+#include "portable_image_decoder.h"
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "portable_image_formats.h"
+#include "thread_pool.h"
+
+namespace PortableImage {
+
+bool DecodedImageWriter::Begin(UINT width, UINT height, DXGI_FORMAT format)
+{
+  if (width == 0 || height == 0 || width > kMaxDimension || height > kMaxDimension) {
+    return false;
+  }
+
+  UINT bytes_per_pixel = 0;
+  switch (format) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+      bytes_per_pixel = 4;
+      break;
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+      bytes_per_pixel = 8;
+      break;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+      bytes_per_pixel = 16;
+      break;
+    default:
+      return false;
+  }
+  if (static_cast<size_t>(width) * bytes_per_pixel * height > INT_MAX) {
+    return false;
+  }
+
+  width_ = width;
+  height_ = height;
+  bytes_per_row_ = static_cast<int>(width * bytes_per_pixel);
+
+  // Same description the WIC backend produces.
+  texture_desc_.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+  texture_desc_.Alignment = 0;
+  texture_desc_.Width = width;
+  texture_desc_.Height = height;
+  texture_desc_.DepthOrArraySize = 1;
+  texture_desc_.MipLevels = 1;
+  texture_desc_.Format = format;
+  texture_desc_.SampleDesc = { 1, 0 };
+  texture_desc_.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+  texture_desc_.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+  row_pitch_ = static_cast<UINT>(bytes_per_row_);
+  rows_ = allocate_rows_(texture_desc_, row_pitch_);
+  return rows_ != nullptr && row_pitch_ >= static_cast<UINT>(bytes_per_row_);
+}
+
+namespace {
+
+uint16_t ReadLittleEndian16(const uint8_t* data)
+{
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+// 5 bit channel to 8 bits.
+uint8_t Expand5To8(uint32_t value)
+{
+  return static_cast<uint8_t>((value * 255 + 15) / 31);
+}
+
+}  // namespace
+
+bool DecodeTga(const uint8_t* data, size_t size, DecodedImageWriter& writer)
+{
+  constexpr size_t kHeaderSize = 18;
+  if (size < kHeaderSize) {
+    return false;
+  }
+
+  const uint8_t id_length = data[0];
+  const uint8_t color_map_type = data[1];
+  const uint8_t image_type = data[2];
+  const uint16_t color_map_first = ReadLittleEndian16(data + 3);
+  const uint16_t color_map_length = ReadLittleEndian16(data + 5);
+  const uint8_t color_map_depth = data[7];
+  const UINT width = ReadLittleEndian16(data + 12);
+  const UINT height = ReadLittleEndian16(data + 14);
+  const uint8_t pixel_depth = data[16];
+  const uint8_t descriptor = data[17];
+
+  // 1: color mapped, 2: true color, 3: gray; +8 for RLE.
+  const bool rle = image_type >= 9 && image_type <= 11;
+  const uint8_t base_type = rle ? image_type - 8 : image_type;
+  if (base_type < 1 || base_type > 3 || color_map_type > 1) {
+    return false;
+  }
+  if ((base_type == 1 && (color_map_type != 1 || (pixel_depth != 8 && pixel_depth != 16))) ||
+      (base_type == 2 && pixel_depth != 15 && pixel_depth != 16 && pixel_depth != 24 && pixel_depth != 32) ||
+      (base_type == 3 && pixel_depth != 8)) {
+    return false;
+  }
+
+  const uint8_t alpha_bits = descriptor & 0x0F;
+
+  // Converts one stored 15/16/24/32 bit true color value (BGR(A) order) to RGBA.
+  auto convert_true_color = [alpha_bits](const uint8_t* source, uint8_t depth, uint8_t* rgba) {
+    if (depth == 15 || depth == 16) {
+      const uint16_t value = ReadLittleEndian16(source);
+      rgba[0] = Expand5To8((value >> 10) & 0x1F);
+      rgba[1] = Expand5To8((value >> 5) & 0x1F);
+      rgba[2] = Expand5To8(value & 0x1F);
+      rgba[3] = (depth == 16 && alpha_bits == 1 && (value & 0x8000) == 0) ? 0 : 255;
+    } else {
+      rgba[0] = source[2];
+      rgba[1] = source[1];
+      rgba[2] = source[0];
+      // Files that declare no alpha bits often leave garbage there.
+      rgba[3] = (depth == 32 && alpha_bits != 0) ? source[3] : 255;
+    }
+  };
+
+  size_t offset = kHeaderSize + id_length;
+  std::vector<uint8_t> palette;  // RGBA
+  if (color_map_type == 1) {
+    const size_t entry_size = (color_map_depth + 7) / 8;
+    if (color_map_depth != 15 && color_map_depth != 16 && color_map_depth != 24 && color_map_depth != 32) {
+      return false;
+    }
+    if (offset + color_map_length * entry_size > size) {
+      return false;
+    }
+    if (base_type == 1) {
+      palette.resize(color_map_length * 4);
+      for (size_t i = 0; i < color_map_length; ++i) {
+        convert_true_color(data + offset + i * entry_size, color_map_depth, &palette[i * 4]);
+      }
+    }
+    offset += color_map_length * entry_size;
+  }
+
+  if (!writer.Begin(width, height, DXGI_FORMAT_R8G8B8A8_UNORM)) {
+    return false;
+  }
+
+  const size_t pixel_size = (pixel_depth + 7) / 8;
+  const bool top_to_bottom = (descriptor & 0x20) != 0;
+  const bool right_to_left = (descriptor & 0x10) != 0;
+
+  const uint8_t* pixel = nullptr;
+  size_t packet_remaining = 0;
+  bool packet_repeats = false;
+  for (UINT y = 0; y < height; ++y) {
+    uint8_t* row = writer.GetRow(top_to_bottom ? y : height - 1 - y);
+    for (UINT x = 0; x < width; ++x) {
+      // RLE packets may run across rows.
+      if (rle) {
+        if (packet_remaining == 0) {
+          if (offset >= size) {
+            return false;
+          }
+          const uint8_t packet_header = data[offset++];
+          packet_remaining = (packet_header & 0x7F) + 1;
+          packet_repeats = (packet_header & 0x80) != 0;
+          if (packet_repeats) {
+            if (offset + pixel_size > size) {
+              return false;
+            }
+            pixel = data + offset;
+            offset += pixel_size;
+          }
+        }
+        if (!packet_repeats) {
+          if (offset + pixel_size > size) {
+            return false;
+          }
+          pixel = data + offset;
+          offset += pixel_size;
+        }
+        packet_remaining--;
+      } else {
+        if (offset + pixel_size > size) {
+          return false;
+        }
+        pixel = data + offset;
+        offset += pixel_size;
+      }
+
+      uint8_t* rgba = row + (right_to_left ? width - 1 - x : x) * 4;
+      if (base_type == 1) {
+        const size_t index = (pixel_depth == 8 ? pixel[0] : ReadLittleEndian16(pixel)) - static_cast<size_t>(color_map_first);
+        if (index >= color_map_length) {
+          return false;
+        }
+        std::memcpy(rgba, &palette[index * 4], 4);
+      } else if (base_type == 3) {
+        rgba[0] = rgba[1] = rgba[2] = pixel[0];
+        rgba[3] = 255;
+      } else {
+        convert_true_color(pixel, pixel_depth, rgba);
+      }
+    }
+  }
+
+  return true;
+}
+
+bool DecodeHdr(const uint8_t* data, size_t size, DecodedImageWriter& writer)
+{
+  size_t offset = 0;
+  auto read_line = [data, size, &offset](std::string& line) {
+    line.clear();
+    while (offset < size && data[offset] != '\n') {
+      line.push_back(static_cast<char>(data[offset++]));
+    }
+    if (offset >= size) {
+      return false;
+    }
+    offset++;  // '\n'
+    return true;
+  };
+
+  // Header: "#?RADIANCE" (or another program name), variables, an empty line, then the resolution.
+  std::string line;
+  if (!read_line(line) || line.compare(0, 2, "#?") != 0) {
+    return false;
+  }
+  for (;;) {
+    if (!read_line(line)) {
+      return false;
+    }
+    if (line.empty()) {
+      break;
+    }
+    if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+      return false;  // XYZE
+    }
+  }
+
+  // Only the standard orientation: rows top to bottom, pixels left to right.
+  int height = 0;
+  int width = 0;
+  if (!read_line(line) || std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+    return false;
+  }
+
+  if (!writer.Begin(static_cast<UINT>(width), static_cast<UINT>(height), DXGI_FORMAT_R32G32B32A32_FLOAT)) {
+    return false;
+  }
+
+  std::vector<uint8_t> scanline(static_cast<size_t>(width) * 4);
+  for (int y = 0; y < height; ++y) {
+    const bool new_rle = width >= 8 && width < 32768 && offset + 4 <= size &&
+      data[offset] == 2 && data[offset + 1] == 2 && (data[offset + 2] & 0x80) == 0;
+    if (new_rle) {
+      if (((data[offset + 2] << 8) | data[offset + 3]) != width) {
+        return false;
+      }
+      offset += 4;
+
+      // Each of the four components is run length encoded on its own.
+      for (int component = 0; component < 4; ++component) {
+        int x = 0;
+        while (x < width) {
+          if (offset >= size) {
+            return false;
+          }
+          int count = data[offset++];
+          if (count > 128) {
+            count -= 128;
+            if (count > width - x || offset >= size) {
+              return false;
+            }
+            const uint8_t value = data[offset++];
+            for (int i = 0; i < count; ++i) {
+              scanline[(x++) * 4 + component] = value;
+            }
+          } else {
+            if (count == 0 || count > width - x || offset + count > size) {
+              return false;
+            }
+            for (int i = 0; i < count; ++i) {
+              scanline[(x++) * 4 + component] = data[offset++];
+            }
+          }
+        }
+      }
+    } else {
+      // Flat pixels, possibly with old style runs (1, 1, 1, count) repeating the previous pixel.
+      int x = 0;
+      int shift = 0;
+      while (x < width) {
+        if (offset + 4 > size) {
+          return false;
+        }
+        const uint8_t* pixel = data + offset;
+        offset += 4;
+        if (pixel[0] == 1 && pixel[1] == 1 && pixel[2] == 1) {
+          // Consecutive runs scale their count by 256 more each. Past the third, any count is longer than a row
+          // may be (kMaxDimension) or shifts out of the int.
+          if (x == 0 || shift > 16) {
+            return false;
+          }
+          const int count = pixel[3] << shift;
+          if (count > width - x) {
+            return false;
+          }
+          for (int i = 0; i < count; ++i, ++x) {
+            std::memcpy(&scanline[x * 4], &scanline[(x - 1) * 4], 4);
+          }
+          shift += 8;
+        } else {
+          std::memcpy(&scanline[(x++) * 4], pixel, 4);
+          shift = 0;
+        }
+      }
+    }
+
+    float* row = reinterpret_cast<float*>(writer.GetRow(static_cast<UINT>(y)));
+    for (int x = 0; x < width; ++x) {
+      const uint8_t* rgbe = &scanline[x * 4];
+      const float scale = rgbe[3] == 0 ? 0.0f : std::ldexp(1.0f, rgbe[3] - (128 + 8));
+      row[x * 4 + 0] = rgbe[0] * scale;
+      row[x * 4 + 1] = rgbe[1] * scale;
+      row[x * 4 + 2] = rgbe[2] * scale;
+      row[x * 4 + 3] = 1.0f;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace PortableImage
+
+int PortableImageDecoder::Decode(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows)
+{
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return 0;
+  }
+
+  const std::streamoff file_size = file.tellg();
+  if (file_size <= 0) {
+    return 0;
+  }
+
+  std::vector<uint8_t> file_data(static_cast<size_t>(file_size));
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char*>(file_data.data()), file_size)) {
+    return 0;
+  }
+
+  return DecodeMemory(file_data.data(), file_data.size(), texture_desc, bytesPerRow, allocate_rows);
+}
+
+int PortableImageDecoder::DecodeMemory(const uint8_t* data, size_t size, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows)
+{
+  static const uint8_t kPngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+  PortableImage::DecodedImageWriter writer(texture_desc, bytesPerRow, allocate_rows);
+  bool decoded = false;
+  if (size >= 8 && std::memcmp(data, kPngSignature, 8) == 0) {
+    decoded = PortableImage::DecodePng(data, size, writer);
+  } else if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+    decoded = PortableImage::DecodeJpeg(data, size, writer);
+  } else if (size >= 2 && data[0] == '#' && data[1] == '?') {
+    decoded = PortableImage::DecodeHdr(data, size, writer);
+  } else {
+    // TGA has no signature, it is whatever is left.
+    decoded = PortableImage::DecodeTga(data, size, writer);
+  }
+
+  return decoded ? static_cast<int>(writer.GetImageSize()) : 0;
+}
+
+PortableImageDecoder::BenchmarkReport PortableImageDecoder::Benchmark(const uint8_t* data, size_t size, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (iteration_number == 0) {
+    return report;
+  }
+
+  ThreadPool thread_pool;
+  report.thread_number = thread_pool.GetWorkerNumber() + 1;
+  std::vector<std::vector<uint8_t>> worker_rows(report.thread_number);
+  const auto decode = [data, size, &worker_rows](size_t worker_index) {
+    std::vector<uint8_t>& rows = worker_rows[worker_index];
+    D3D12_RESOURCE_DESC texture_desc;
+    int bytes_per_row = 0;
+    return DecodeMemory(data, size, texture_desc, bytes_per_row, [&rows](const D3D12_RESOURCE_DESC& desc, UINT& row_pitch) {
+      rows.resize(static_cast<size_t>(row_pitch) * desc.Height);
+      return rows.data();
+      });
+  };
+  report.decoded_size = static_cast<size_t>(decode(0));
+  if (report.decoded_size == 0) {
+    return report;
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    decode(0);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  if (seconds > 0.0) {
+    report.encoded_megabytes_per_second = static_cast<double>(size) * iteration_number / (seconds * 1e6);
+    report.decoded_megabytes_per_second = static_cast<double>(report.decoded_size) * iteration_number / (seconds * 1e6);
+  }
+
+  start_time = std::chrono::steady_clock::now();
+  thread_pool.ParallelFor(report.thread_number * iteration_number, [&decode](size_t /*index*/, size_t worker_index) {
+    decode(worker_index);
+    });
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  if (seconds > 0.0) {
+    report.decoded_megabytes_per_second_per_thread = static_cast<double>(report.decoded_size) * iteration_number / (seconds * 1e6);
+  }
+  return report;
+}
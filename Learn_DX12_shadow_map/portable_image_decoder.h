@@ -0,0 +1,31 @@
+#pragma once
+
+#include "image_decoder.h"
+
+// Backend without any OS dependency, so textures can be decoded (and profiled) off Windows too. The format
+// is taken from the file contents, not the extension:
+//   PNG  - all color types and bit depths, interlaced or not, with tRNS transparency.
+//          8 bit and below -> DXGI_FORMAT_R8G8B8A8_UNORM, 16 bit -> DXGI_FORMAT_R16G16B16A16_UNORM.
+//   JPEG - baseline and extended sequential Huffman, gray or YCbCr, any subsampling. -> R8G8B8A8_UNORM
+//          (progressive and arithmetic coded files are rejected).
+//   TGA  - color mapped, true color and gray, raw or RLE. -> R8G8B8A8_UNORM
+//   HDR  - Radiance RGBE, flat or RLE scanlines. -> R32G32B32A32_FLOAT
+// Gray and RGB images are expanded to RGBA, so shaders can always sample .rgb.
+class PortableImageDecoder : public ImageDecoder {
+ public:
+  struct BenchmarkReport {
+    size_t decoded_size;  // in bytes, 0 if the image can't be decoded
+    double encoded_megabytes_per_second;  // of the input, on one thread
+    double decoded_megabytes_per_second;  // of the output, on one thread
+    size_t thread_number;  // one per hardware thread
+    double decoded_megabytes_per_second_per_thread;  // with every thread decoding its own copy
+  };  // struct BenchmarkReport
+
+  // Decodes an encoded image iteration_number times on one thread, then iteration_number times on each thread.
+  static BenchmarkReport Benchmark(const uint8_t* data, size_t size, UINT iteration_number);
+
+  int Decode(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows) override;
+
+  // Same as Decode, for an encoded image already in memory.
+  static int DecodeMemory(const uint8_t* data, size_t size, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows);
+};  // class PortableImageDecoder
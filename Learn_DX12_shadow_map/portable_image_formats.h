@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "image_decoder.h"
+
+// Internals of PortableImageDecoder, shared by the per-format decoders.
+namespace PortableImage {
+
+// Where a format decoder puts its output. Begin() once the size is known, then fill every row.
+class DecodedImageWriter {
+ public:
+  DecodedImageWriter(D3D12_RESOURCE_DESC& texture_desc, int& bytes_per_row, const ImageDecoder::RowsDestinationAllocator& allocate_rows)
+    : texture_desc_(texture_desc), bytes_per_row_(bytes_per_row), allocate_rows_(allocate_rows) {
+
+  }
+
+  // format is one of R8G8B8A8_UNORM, R16G16B16A16_UNORM or R32G32B32A32_FLOAT. Returns false if the size is
+  // unusable (ImageDecoder::Decode reports it as an int, so it must fit one) or the destination was refused.
+  bool Begin(UINT width, UINT height, DXGI_FORMAT format);
+
+  uint8_t* GetRow(UINT y) const {
+    return rows_ + static_cast<size_t>(y) * row_pitch_;
+  }
+
+  UINT GetWidth() const {
+    return width_;
+  }
+
+  UINT GetHeight() const {
+    return height_;
+  }
+
+  size_t GetImageSize() const {
+    return static_cast<size_t>(bytes_per_row_) * height_;
+  }
+
+ private:
+  D3D12_RESOURCE_DESC& texture_desc_;
+  int& bytes_per_row_;
+  const ImageDecoder::RowsDestinationAllocator& allocate_rows_;
+  uint8_t* rows_ = nullptr;
+  UINT row_pitch_ = 0;
+  UINT width_ = 0;
+  UINT height_ = 0;
+};  // class DecodedImageWriter
+
+// Images larger than this in either dimension are rejected, like D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION.
+constexpr UINT kMaxDimension = 16384;
+
+// Each returns false for malformed or unsupported data. Partially written rows are left as they are.
+bool DecodePng(const uint8_t* data, size_t size, DecodedImageWriter& writer);
+bool DecodeJpeg(const uint8_t* data, size_t size, DecodedImageWriter& writer);
+bool DecodeTga(const uint8_t* data, size_t size, DecodedImageWriter& writer);
+bool DecodeHdr(const uint8_t* data, size_t size, DecodedImageWriter& writer);
+
+// zlib stream (RFC 1950/1951) into output, appended. Fails as soon as it would append more than max_size
+// bytes, so a stream can't make the output grow past what the caller expects.
+bool Inflate(const uint8_t* data, size_t size, size_t max_size, std::vector<uint8_t>& output);
+
+}  // namespace PortableImage
@@ -6,26 +6,9 @@ namespace Asset {
 
 class QuadModel : public Model {
  public:
-  std::unique_ptr<Vertex[]> GetVertexData() const override {
-    std::unique_ptr<Vertex[]> vertices_data = std::make_unique<Vertex[]>(4);
-
-    vertices_data[0].position = XMFLOAT3(-1.0f, 0.0f, -1.0f);
-    vertices_data[0].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-    vertices_data[0].uv = XMFLOAT2(0.0f, 1.0f);
-
-    vertices_data[1].position = XMFLOAT3(-1.0f, 0.0f, 1.0f);
-    vertices_data[1].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-    vertices_data[1].uv = XMFLOAT2(0.0f, 0.0f);
-
-    vertices_data[2].position = XMFLOAT3(1.0f, 0.0f, -1.0f);
-    vertices_data[2].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-    vertices_data[2].uv = XMFLOAT2(1.0f, 1.0f);
-
-    vertices_data[3].position = XMFLOAT3(1.0f, 0.0f, 1.0f);
-    vertices_data[3].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-    vertices_data[3].uv = XMFLOAT2(1.0f, 0.0f);
-
-    return vertices_data;
+  const Vertex* GetVertexData() const override {
+    static const std::vector<Vertex> vertices_data = BuildVertexData();
+    return vertices_data.data();
   }
 
   size_t GetVertexDataSize() const override {
@@ -36,16 +19,11 @@ class QuadModel : public Model {
     return 4;
   }
 
-  std::unique_ptr<DWORD[]> GetIndexData() const override {
-    std::unique_ptr<DWORD[]> indices_data = std::make_unique<DWORD[]>(6);
-
-    indices_data[0] = 0;
-    indices_data[1] = 1;
-    indices_data[2] = 2;
-    indices_data[3] = 2;
-    indices_data[4] = 1;
-    indices_data[5] = 3;
-
+  const DWORD* GetIndexData() const override {
+    static const DWORD indices_data[6] = {
+      0, 1, 2,
+      2, 1, 3,
+    };
     return indices_data;
   }
 
@@ -62,7 +40,27 @@ class QuadModel : public Model {
   }
 
  private:
+  static std::vector<Vertex> BuildVertexData() {
+    std::vector<Vertex> vertices_data(4);
+
+    vertices_data[0].position = XMFLOAT3(-1.0f, 0.0f, -1.0f);
+    vertices_data[0].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    vertices_data[0].uv = XMFLOAT2(0.0f, 1.0f);
 
+    vertices_data[1].position = XMFLOAT3(-1.0f, 0.0f, 1.0f);
+    vertices_data[1].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    vertices_data[1].uv = XMFLOAT2(0.0f, 0.0f);
+
+    vertices_data[2].position = XMFLOAT3(1.0f, 0.0f, -1.0f);
+    vertices_data[2].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    vertices_data[2].uv = XMFLOAT2(1.0f, 1.0f);
+
+    vertices_data[3].position = XMFLOAT3(1.0f, 0.0f, 1.0f);
+    vertices_data[3].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+    vertices_data[3].uv = XMFLOAT2(1.0f, 0.0f);
+
+    return vertices_data;
+  }
 };  // class QuadModel
 
 }  // namespace Asset
\ No newline at end of file
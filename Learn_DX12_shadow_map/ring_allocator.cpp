@@ -0,0 +1,89 @@
+#include "ring_allocator.h"
+
+#include <chrono>
+
+constexpr UINT64 RingAllocator::kAlignment;
+constexpr UINT64 RingAllocator::kInvalidOffset;
+
+namespace {
+
+UINT64 AlignUp(UINT64 size)
+{
+  return (size + RingAllocator::kAlignment - 1) & ~(RingAllocator::kAlignment - 1);
+}
+
+}  // namespace
+
+RingAllocator::BenchmarkReport RingAllocator::Benchmark(UINT64 allocation_size, UINT allocation_number, UINT frame_number, UINT frames_in_flight)
+{
+  BenchmarkReport report{};
+  if (allocation_number == 0 || frame_number == 0) {
+    return report;
+  }
+
+  // Room for the frames in flight and the one being recorded, plus what wrapping around may waste.
+  RingAllocator ring(AlignUp(allocation_size) * allocation_number * (frames_in_flight + 1) + AlignUp(allocation_size));
+  UINT64 offset_sum = 0;  // keeps the allocations from being optimized out
+  const auto start_time = std::chrono::steady_clock::now();
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    // Frame f signals fence value f + 1; the GPU trails frames_in_flight frames behind.
+    const UINT64 fence_value = frame + 1;
+    ring.BeginFrame(fence_value, fence_value > frames_in_flight + 1 ? fence_value - frames_in_flight - 1 : 0);
+    for (UINT i = 0; i < allocation_number; ++i) {
+      const UINT64 offset = ring.Allocate(allocation_size);
+      if (offset == kInvalidOffset) {
+        report.failed_allocation_number++;
+      }
+      else {
+        offset_sum += offset;
+      }
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  report.allocation_number = static_cast<UINT64>(allocation_number) * frame_number;
+  report.allocations_per_second = seconds > 0.0 && offset_sum != kInvalidOffset ? report.allocation_number / seconds : 0.0;
+  return report;
+}
+
+RingAllocator::RingAllocator(UINT64 capacity)
+{
+  Reset(capacity);
+}
+
+void RingAllocator::Reset(UINT64 capacity)
+{
+  capacity_ = AlignUp(capacity);
+  head_ = 0;
+  tail_ = 0;
+  frames_.clear();
+  frame_open_ = false;
+}
+
+void RingAllocator::BeginFrame(UINT64 fence_value, UINT64 completed_fence_value)
+{
+  if (frame_open_) {
+    frames_.push_back({ frame_fence_value_, head_ });
+  }
+  while (!frames_.empty() && frames_.front().fence_value <= completed_fence_value) {
+    tail_ = frames_.front().end;
+    frames_.pop_front();
+  }
+  frame_fence_value_ = fence_value;
+  frame_open_ = true;
+}
+
+UINT64 RingAllocator::Allocate(UINT64 size)
+{
+  const UINT64 aligned_size = AlignUp(size);
+  if (aligned_size == 0 || aligned_size > capacity_) {
+    return kInvalidOffset;
+  }
+
+  const UINT64 offset = head_ % capacity_;
+  const UINT64 padding = offset + aligned_size > capacity_ ? capacity_ - offset : 0;
+  if (head_ + padding + aligned_size - tail_ > capacity_) {
+    return kInvalidOffset;
+  }
+  head_ += padding + aligned_size;
+  return padding > 0 ? 0 : offset;
+}
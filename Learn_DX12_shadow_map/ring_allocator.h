@@ -0,0 +1,66 @@
+#pragma once
+
+#include <deque>
+
+#include "common_headers.h"
+
+// The bookkeeping of ConstantBufferRing, without a device: offsets into a ring of capacity bytes, handed out in
+// allocation order and given back a whole frame at a time, once the GPU's fence has passed the frame. Sizes are
+// rounded up to kAlignment, so every offset is a valid constant buffer placement; an allocation that would run
+// past the end starts over at 0 instead, wasting the rest.
+class RingAllocator {
+ public:
+  struct BenchmarkReport {
+    UINT64 allocation_number;
+    UINT64 failed_allocation_number;  // the ring was full, 0 unless it is too small for the frames in flight
+    double allocations_per_second;
+  };  // struct BenchmarkReport
+
+  static constexpr UINT64 kAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+  static constexpr UINT64 kInvalidOffset = ~0ull;
+
+  // Allocates allocation_number allocations of allocation_size bytes per frame for frame_number frames, with
+  // frames_in_flight frames the GPU has not finished at any time.
+  static BenchmarkReport Benchmark(UINT64 allocation_size, UINT allocation_number, UINT frame_number, UINT frames_in_flight);
+
+  // capacity is rounded up to kAlignment.
+  explicit RingAllocator(UINT64 capacity = 0);
+
+  // Forgets every allocation and frame, e.g. after moving to a larger buffer.
+  void Reset(UINT64 capacity);
+
+  // Closes the previous frame, if any, then gives back the frames whose fence value is at most
+  // completed_fence_value. The allocations until the next BeginFrame are the GPU's until its fence reaches
+  // fence_value, which must not be lower than any earlier frame's.
+  void BeginFrame(UINT64 fence_value, UINT64 completed_fence_value);
+
+  // Returns the offset of size bytes, or kInvalidOffset when they don't fit beside the frames in flight.
+  UINT64 Allocate(UINT64 size);
+
+  UINT64 GetCapacity() const {
+    return capacity_;
+  }
+
+  // Handed out and not given back yet, the waste at the end of the ring included.
+  UINT64 GetUsedSize() const {
+    return head_ - tail_;
+  }
+
+  UINT64 GetFrameFenceValue() const {
+    return frame_fence_value_;
+  }
+
+ private:
+  struct Frame {
+    UINT64 fence_value;
+    UINT64 end;  // head_ once the frame was closed
+  };  // struct Frame
+
+  UINT64 capacity_ = 0;
+  // Bytes handed out and given back since Reset, never wrapped: the ring offset is head_ % capacity_.
+  UINT64 head_ = 0;
+  UINT64 tail_ = 0;
+  std::deque<Frame> frames_;  // closed and still in flight, oldest first
+  UINT64 frame_fence_value_ = 0;  // of the open frame
+  bool frame_open_ = false;
+};  // class RingAllocator
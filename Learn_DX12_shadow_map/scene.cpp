@@ -1,10 +1,16 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <string>
+
 #include "dx_sample_helper.h"
 #include "assets_manager.h"
 #include "quad_model.h"
 #include "cube_model.h"
-#include "image_loader.h"
+#include "texture_load_queue.h"
 
 namespace {
 
@@ -74,8 +80,237 @@ inline HRESULT CreateDepthStencilTexture2D(
 
 }
 
+// Like CreateDepthStencilTexture2D, with a DSV per array slice starting at dsv_cpu_descriptor_handle and one
+// Texture2DArray SRV.
+inline HRESULT CreateDepthStencilTexture2DArray(
+  ID3D12Device* device,
+  UINT width,
+  UINT height,
+  UINT16 array_size,
+  DXGI_FORMAT typeless_format,
+  DXGI_FORMAT dsv_format,
+  DXGI_FORMAT srv_format,
+  ID3D12Resource** pp_resource,
+  D3D12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle,
+  UINT dsv_descriptor_size,
+  D3D12_CPU_DESCRIPTOR_HANDLE srv_cpu_descriptor_handle,
+  D3D12_RESOURCE_STATES init_state = D3D12_RESOURCE_STATE_DEPTH_WRITE,
+  float init_depth_value = 1.0f,
+  UINT8 init_stencil_value = 0)
+{
+  try
+  {
+    *pp_resource = nullptr;
+
+    CD3DX12_RESOURCE_DESC depth_texture_desc(
+      D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+      0,
+      width,
+      height,
+      array_size,
+      1,
+      typeless_format,
+      1,
+      0,
+      D3D12_TEXTURE_LAYOUT_UNKNOWN,
+      D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+
+    CD3DX12_HEAP_PROPERTIES default_heap_properties(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_CLEAR_VALUE depth_buffer_clear_value(dsv_format, init_depth_value, init_stencil_value);
+    ThrowIfFailed(device->CreateCommittedResource(
+      &default_heap_properties,
+      D3D12_HEAP_FLAG_NONE,
+      &depth_texture_desc,
+      init_state,
+      &depth_buffer_clear_value,
+      IID_PPV_ARGS(pp_resource)));
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE slice_dsv_cpu_descriptor_handle(dsv_cpu_descriptor_handle);
+    for (UINT16 slice = 0; slice < array_size; ++slice) {
+      D3D12_DEPTH_STENCIL_VIEW_DESC dsv_desc = {};
+      dsv_desc.Format = dsv_format;
+      dsv_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+      dsv_desc.Texture2DArray.MipSlice = 0;
+      dsv_desc.Texture2DArray.FirstArraySlice = slice;
+      dsv_desc.Texture2DArray.ArraySize = 1;
+      device->CreateDepthStencilView(*pp_resource, &dsv_desc, slice_dsv_cpu_descriptor_handle);
+      slice_dsv_cpu_descriptor_handle.Offset(dsv_descriptor_size);
+    }
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+    srv_desc.Format = srv_format;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.Texture2DArray.MipLevels = 1;
+    srv_desc.Texture2DArray.ArraySize = array_size;
+    device->CreateShaderResourceView(*pp_resource, &srv_desc, srv_cpu_descriptor_handle);
+  }
+  catch (HrException& e)
+  {
+    SAFE_RELEASE(*pp_resource);
+    return e.Error();
+  }
+  return S_OK;
+}
+
+// Six square slices, one DSV over all of them (the geometry shader picks the slice) and a TextureCube SRV.
+inline HRESULT CreateDepthStencilTextureCube(
+  ID3D12Device* device,
+  UINT size,
+  DXGI_FORMAT typeless_format,
+  DXGI_FORMAT dsv_format,
+  DXGI_FORMAT srv_format,
+  ID3D12Resource** pp_resource,
+  D3D12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle,
+  D3D12_CPU_DESCRIPTOR_HANDLE srv_cpu_descriptor_handle,
+  D3D12_RESOURCE_STATES init_state = D3D12_RESOURCE_STATE_DEPTH_WRITE,
+  float init_depth_value = 1.0f,
+  UINT8 init_stencil_value = 0)
+{
+  try
+  {
+    *pp_resource = nullptr;
+
+    CD3DX12_RESOURCE_DESC depth_texture_desc(
+      D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+      0,
+      size,
+      size,
+      CubeShadowMap::kFaceNumber,
+      1,
+      typeless_format,
+      1,
+      0,
+      D3D12_TEXTURE_LAYOUT_UNKNOWN,
+      D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+
+    CD3DX12_HEAP_PROPERTIES default_heap_properties(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_CLEAR_VALUE depth_buffer_clear_value(dsv_format, init_depth_value, init_stencil_value);
+    ThrowIfFailed(device->CreateCommittedResource(
+      &default_heap_properties,
+      D3D12_HEAP_FLAG_NONE,
+      &depth_texture_desc,
+      init_state,
+      &depth_buffer_clear_value,
+      IID_PPV_ARGS(pp_resource)));
+
+    D3D12_DEPTH_STENCIL_VIEW_DESC dsv_desc = {};
+    dsv_desc.Format = dsv_format;
+    dsv_desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+    dsv_desc.Texture2DArray.MipSlice = 0;
+    dsv_desc.Texture2DArray.FirstArraySlice = 0;
+    dsv_desc.Texture2DArray.ArraySize = CubeShadowMap::kFaceNumber;
+    device->CreateDepthStencilView(*pp_resource, &dsv_desc, dsv_cpu_descriptor_handle);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+    srv_desc.Format = srv_format;
+    srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+    srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srv_desc.TextureCube.MipLevels = 1;
+    device->CreateShaderResourceView(*pp_resource, &srv_desc, srv_cpu_descriptor_handle);
+  }
+  catch (HrException& e)
+  {
+    SAFE_RELEASE(*pp_resource);
+    return e.Error();
+  }
+  return S_OK;
+}
+
+// A plain texture with source's layout, for keeping a copy of all of it aside with CopyResource. It is never
+// bound, so it gets no views.
+inline HRESULT CreateCopyTexture(
+  ID3D12Device* device,
+  ID3D12Resource* source,
+  ID3D12Resource** pp_resource,
+  D3D12_RESOURCE_STATES init_state = D3D12_RESOURCE_STATE_COPY_DEST)
+{
+  try
+  {
+    *pp_resource = nullptr;
+
+    D3D12_RESOURCE_DESC texture_desc = source->GetDesc();
+    texture_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    CD3DX12_HEAP_PROPERTIES default_heap_properties(D3D12_HEAP_TYPE_DEFAULT);
+    ThrowIfFailed(device->CreateCommittedResource(
+      &default_heap_properties,
+      D3D12_HEAP_FLAG_NONE,
+      &texture_desc,
+      init_state,
+      nullptr,
+      IID_PPV_ARGS(pp_resource)));
+  }
+  catch (HrException& e)
+  {
+    SAFE_RELEASE(*pp_resource);
+    return e.Error();
+  }
+  return S_OK;
+}
+
 }  // namespace
 
+constexpr UINT Scene::kShadowAtlasGutterTexels_;
+
+// With a single part the items go into the open command_list_, whose state the pass has already set. Otherwise
+// each part gets a list of its own, starting from set_state, and the lists are queued after command_list_.
+class Scene::PassRecorder : public ParallelRecorder::Target {
+ public:
+  PassRecorder(Scene& scene, const std::function<void(ID3D12GraphicsCommandList*)>& set_state,
+               const std::function<void(ID3D12GraphicsCommandList*, size_t, size_t)>& record) : scene_(scene),
+    set_state_(set_state),
+    record_(record)
+  {
+  }
+
+  void BeginParts(UINT part_number) override
+  {
+    part_command_lists_.clear();
+    if (part_number == 1) {
+      return;
+    }
+
+    ThrowIfFailed(scene_.command_list_->Close());
+    scene_.submitted_command_lists_.push_back(scene_.command_list_.Get());
+    for (UINT i = 0; i < part_number; ++i) {
+      part_command_lists_.push_back(scene_.AcquireCommandList());
+    }
+  }
+
+  void RecordPart(UINT part_index, UINT worker_index, size_t item_begin, size_t item_end) override
+  {
+    if (part_command_lists_.empty()) {
+      record_(scene_.command_list_.Get(), item_begin, item_end);
+      return;
+    }
+
+    ID3D12GraphicsCommandList* command_list = part_command_lists_[part_index];
+    ID3D12CommandAllocator* command_allocator = scene_.part_command_allocators_[scene_.current_frame_index_ * scene_.recording_thread_number_ + worker_index].Get();
+    ThrowIfFailed(command_list->Reset(command_allocator, nullptr));
+    set_state_(command_list);
+    record_(command_list, item_begin, item_end);
+    ThrowIfFailed(command_list->Close());
+  }
+
+  void EndParts(UINT /*part_number*/) override
+  {
+    if (part_command_lists_.empty()) {
+      return;
+    }
+
+    scene_.submitted_command_lists_.insert(scene_.submitted_command_lists_.end(), part_command_lists_.begin(), part_command_lists_.end());
+    scene_.command_list_ = scene_.AcquireCommandList();
+    ThrowIfFailed(scene_.command_list_->Reset(scene_.command_allocators_[scene_.current_frame_index_].Get(), nullptr));
+  }
+
+ private:
+  Scene& scene_;
+  const std::function<void(ID3D12GraphicsCommandList*)>& set_state_;
+  const std::function<void(ID3D12GraphicsCommandList*, size_t, size_t)>& record_;
+  std::vector<ID3D12GraphicsCommandList*> part_command_lists_;
+};  // class Scene::PassRecorder
+
 Scene::Scene(UINT frame_count, UINT width, UINT height) : frame_count_(frame_count),
   view_port_(0.0f, 0.0f, (float)width, (float)height),
   scissor_rect_(0, 0, width, height)
@@ -98,7 +333,13 @@ void Scene::Initialize(ID3D12Device* device, ID3D12CommandQueue* command_queue,
 
   SetCameras();
 
+  // Pipeline states and vertex buffers below are built for whatever layout is chosen here.
+  AssetsManager::GetSharedInstance().SetVertexStreamLayout(vertex_stream_layout_);
+
+  // The models come first: the CBV/SRV/UAV heap is sized for their textures.
+  InsertModels();
   CreateDescriptorHeaps(device);
+  CreateShadowMap(device);
   CreatePipelineStates(device);
   CreateAndMapConstantBuffers(device);
 
@@ -106,12 +347,25 @@ void Scene::Initialize(ID3D12Device* device, ID3D12CommandQueue* command_queue,
   for (UINT i = 0; i < frame_count_; ++i) {
     ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&command_allocators_[i])));
   }
+  parallel_recorder_ = std::make_unique<ParallelRecorder>(recording_thread_number_);
+  part_command_allocators_.clear();
+  if (recording_thread_number_ > 1) {
+    part_command_allocators_.resize(frame_count_ * recording_thread_number_);
+    for (UINT i = 0; i < part_command_allocators_.size(); ++i) {
+      ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&part_command_allocators_[i])));
+      NAME_D3D12_OBJECT_INDEXED(part_command_allocators_, i);
+    }
+  }
  
   ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, command_allocators_[current_frame_index_].Get(), scene_pipeline_state_.Get(), IID_PPV_ARGS(&command_list_)));
+  command_list_pool_.assign(1, command_list_);
 
   LoadAssets(device);
 
   CreateCameraPoints(device);
+  CreateAndMapInstanceTransformBuffers(device);
+  CreateCommandSignatures(device);
+  CreateAndMapIndirectArgumentBuffers(device);
 
   ThrowIfFailed(command_list_->Close());
   ID3D12CommandList* command_lists[] = { command_list_.Get() };
@@ -128,19 +382,12 @@ void Scene::LoadSizeDependentResources(ID3D12Device* device, ComPtr<ID3D12Resour
     rtv_cpu_descriptor_handle.Offset(rtv_descriptor_increment_size_);
   }
 
-  // Create the depth stencil views (DSVs).
-  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart());
-  dsv_descriptor_size_ = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
-  CD3DX12_CPU_DESCRIPTOR_HANDLE depth_srv_descriptor_handle(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart());
-  // i == 0: shadow; i == 1: scene
-  for (auto i = 0; i < kDepthBufferCount_; ++i) {
-    ThrowIfFailed(CreateDepthStencilTexture2D(device, width, height, DXGI_FORMAT_R32_TYPELESS, DXGI_FORMAT_D32_FLOAT, DXGI_FORMAT_R32_FLOAT,
-      &depth_textures_[i], dsv_cpu_descriptor_handle, depth_srv_descriptor_handle));
-
-    dsv_cpu_descriptor_handle.Offset(dsv_descriptor_size_);
-    depth_srv_descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
-    NAME_D3D12_OBJECT_INDEXED(depth_textures_, i);
-  }
+  // Create the scene depth stencil view (DSV). The shadow map doesn't depend on the window size, see CreateShadowMap.
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kSceneDepthDsvIndex_, dsv_descriptor_size_);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE depth_srv_descriptor_handle(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), 1, cbv_srv_descriptor_increment_size_);
+  ThrowIfFailed(CreateDepthStencilTexture2D(device, width, height, DXGI_FORMAT_R32_TYPELESS, DXGI_FORMAT_D32_FLOAT, DXGI_FORMAT_R32_FLOAT,
+    &depth_textures_[1], dsv_cpu_descriptor_handle, depth_srv_descriptor_handle));
+  NAME_D3D12_OBJECT_INDEXED(depth_textures_, 1);
 }
 
 void Scene::Update()
@@ -161,6 +408,9 @@ void Scene::Update()
   }
 
   UpdateConstantBuffers();
+  CullObjects();
+  CullOccludedObjects();
+  UpdateShadowCache();
   CommitConstantBuffersForAllObjects();
 }
 
@@ -168,8 +418,7 @@ void Scene::Render(ID3D12CommandQueue* command_queue)
 {
   PopulateCommandLists();
 
-  ID3D12CommandList* command_lists[] = { command_list_.Get() };
-  command_queue->ExecuteCommandLists(1, command_lists);
+  command_queue->ExecuteCommandLists(static_cast<UINT>(submitted_command_lists_.size()), submitted_command_lists_.data());
 }
 
 void Scene::KeyDown(UINT8 key)
@@ -235,23 +484,6 @@ void Scene::KeyUp(UINT8 key)
   }
 }
 
-void Scene::CreateConstanfBuffer(ID3D12Device* device, UINT size, ID3D12Resource** ppResource, D3D12_RESOURCE_STATES initState)
-{
-  *ppResource = nullptr;
-
-  const UINT alignedSize = CalculateConstantBufferByteSize(size);
-  auto upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-  auto constant_buffer_resource_desc = CD3DX12_RESOURCE_DESC::Buffer(alignedSize * 2);  // TODO: replace 2 with variable
-  ThrowIfFailed(device->CreateCommittedResource(
-    &upload_heap_properties,
-    D3D12_HEAP_FLAG_NONE,
-    &constant_buffer_resource_desc,
-    initState,
-    nullptr,
-    IID_PPV_ARGS(ppResource)));
-
-}
-
 void Scene::CreateDescriptorHeaps(ID3D12Device* device)
 {
   // Describe and create a render target view (RTV) descriptor heap.
@@ -266,16 +498,22 @@ void Scene::CreateDescriptorHeaps(ID3D12Device* device)
   // Describe and create a depth stencil view (DSV) descriptor heap.
   D3D12_DESCRIPTOR_HEAP_DESC dsv_descriptor_heap_desc{};
   dsv_descriptor_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-  dsv_descriptor_heap_desc.NumDescriptors = kDepthBufferCount_;
+  dsv_descriptor_heap_desc.NumDescriptors = kCubeShadowDsvIndex_ + 1;
   dsv_descriptor_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
   dsv_descriptor_heap_desc.NodeMask = 0;
   ThrowIfFailed(device->CreateDescriptorHeap(&dsv_descriptor_heap_desc, IID_PPV_ARGS(&dsv_descriptor_heap_)));
+  dsv_descriptor_size_ = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 
   // Describe and create a shader resource view (SRV) and constant 
   // buffer view (CBV) descriptor heap.  
   // Heap layout: 
   // 1) depth buffer views
-  // 2) object diffuse textures views
+  // 2) shadow moments views, see kMomentsDescriptorIndex_
+  // 3) the default texture view, then object diffuse textures views, see kDiffuseTextureDescriptorIndex_
+  std::vector<std::string> model_textures_file_names;
+  AssetsManager::GetSharedInstance().GetModelTexturesFileNames(model_textures_file_names);
+  diffuse_texture_number_ = static_cast<UINT>(std::count_if(model_textures_file_names.cbegin(), model_textures_file_names.cend(),
+    [](const std::string& file_name) { return !file_name.empty(); }));
   D3D12_DESCRIPTOR_HEAP_DESC cbv_descriptor_heap_desc = {};
   cbv_descriptor_heap_desc.NumDescriptors = GetCbvSrvUavDescriptorsNumber();
   cbv_descriptor_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
@@ -284,17 +522,130 @@ void Scene::CreateDescriptorHeaps(ID3D12Device* device)
   cbv_srv_descriptor_increment_size_ = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 }
 
+void Scene::CreateShadowMap(ID3D12Device* device)
+{
+  CascadedShadowMap::Options cascade_options;
+  cascade_options.cascade_number = shadow_settings_.cascade_number;
+  cascade_options.resolution = shadow_settings_.resolution;
+  cascaded_shadow_map_ = CascadedShadowMap(cascade_options);
+
+  // A square slice per cascade, whatever the window size; point and spot lights only render into the first one.
+  const UINT resolution = shadow_settings_.resolution;
+  shadow_view_port_ = CD3DX12_VIEWPORT(0.0f, 0.0f, (float)resolution, (float)resolution);
+  shadow_scissor_rect_ = CD3DX12_RECT(0, 0, resolution, resolution);
+  shadow_tile_view_port_ = shadow_view_port_;
+  shadow_tile_scissor_rect_ = shadow_scissor_rect_;
+  shadow_tile_clear_rect_ = shadow_scissor_rect_;
+  shadow_atlas_ = ShadowAtlas(resolution);
+  ThrowIfFailed(CreateDepthStencilTexture2DArray(device, resolution, resolution, static_cast<UINT16>(cascaded_shadow_map_.GetOptions().cascade_number),
+    ShadowQuality::GetTypelessFormat(shadow_settings_.depth_format), shadow_settings_.depth_format, ShadowQuality::GetSrvFormat(shadow_settings_.depth_format), &depth_textures_[0],
+    dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), dsv_descriptor_size_, cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart()));
+  NAME_D3D12_OBJECT_INDEXED(depth_textures_, 0);
+  CreateMomentsTextures(device);
+
+  // The point light's cube, a slice per face.
+  const UINT cube_resolution = shadow_settings_.cube_resolution;
+  cube_shadow_view_port_ = CD3DX12_VIEWPORT(0.0f, 0.0f, (float)cube_resolution, (float)cube_resolution);
+  cube_shadow_scissor_rect_ = CD3DX12_RECT(0, 0, cube_resolution, cube_resolution);
+  ThrowIfFailed(CreateDepthStencilTextureCube(device, cube_resolution,
+    ShadowQuality::GetTypelessFormat(shadow_settings_.depth_format), shadow_settings_.depth_format, ShadowQuality::GetSrvFormat(shadow_settings_.depth_format), &depth_textures_[2],
+    CD3DX12_CPU_DESCRIPTOR_HANDLE(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kCubeShadowDsvIndex_, dsv_descriptor_size_),
+    CD3DX12_CPU_DESCRIPTOR_HANDLE(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), 2, cbv_srv_descriptor_increment_size_)));
+  NAME_D3D12_OBJECT_INDEXED(depth_textures_, 2);
+
+  // Only the split keeps the static casters' depth aside.
+  if (shadow_cache_.GetMode() == ShadowCache::Mode::kStaticDynamicSplit) {
+    ThrowIfFailed(CreateCopyTexture(device, depth_textures_[0].Get(), &static_shadow_layer_));
+    NAME_D3D12_OBJECT(static_shadow_layer_);
+  }
+  if (cube_shadow_cache_.GetMode() == ShadowCache::Mode::kStaticDynamicSplit) {
+    ThrowIfFailed(CreateCopyTexture(device, depth_textures_[2].Get(), &static_cube_shadow_layer_));
+    NAME_D3D12_OBJECT(static_cube_shadow_layer_);
+  }
+  shadow_cache_.Invalidate();
+  cube_shadow_cache_.Invalidate();
+}
+
+void Scene::CreateMomentsTextures(ID3D12Device* device)
+{
+  const DXGI_FORMAT format = ShadowFilter::GetMomentsFormat(shadow_filter_mode_);
+  const UINT16 slice_number = static_cast<UINT16>(cascaded_shadow_map_.GetOptions().cascade_number);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE descriptor_handle(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kMomentsDescriptorIndex_, cbv_srv_descriptor_increment_size_);
+  D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+  srv_desc.Format = format;
+  srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+  srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+  srv_desc.Texture2DArray.MipLevels = 1;
+  srv_desc.Texture2DArray.ArraySize = slice_number;
+  if (!ShadowFilter::IsMomentMode(shadow_filter_mode_)) {
+    // The scene root signature always has the moments table; a null view keeps it valid.
+    device->CreateShaderResourceView(nullptr, &srv_desc, descriptor_handle);
+    moments_mip_number_ = 0;
+    return;
+  }
+
+  // Half the shadow map's resolution, with mips down to 1x1.
+  const UINT size = std::max(shadow_settings_.resolution / 2, 1u);
+  moments_mip_number_ = 1;
+  while ((size >> moments_mip_number_) > 0 && moments_mip_number_ < kMaxMomentsMipNumber_) {
+    moments_mip_number_++;
+  }
+  CD3DX12_RESOURCE_DESC texture_desc = CD3DX12_RESOURCE_DESC::Tex2D(format, size, size, slice_number, static_cast<UINT16>(moments_mip_number_),
+    1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+  CD3DX12_HEAP_PROPERTIES default_heap_properties(D3D12_HEAP_TYPE_DEFAULT);
+  ThrowIfFailed(device->CreateCommittedResource(
+    &default_heap_properties,
+    D3D12_HEAP_FLAG_NONE,
+    &texture_desc,
+    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+    nullptr,
+    IID_PPV_ARGS(&moments_texture_)));
+  NAME_D3D12_OBJECT(moments_texture_);
+  texture_desc.MipLevels = 1;
+  ThrowIfFailed(device->CreateCommittedResource(
+    &default_heap_properties,
+    D3D12_HEAP_FLAG_NONE,
+    &texture_desc,
+    D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+    nullptr,
+    IID_PPV_ARGS(&moments_blur_texture_)));
+  NAME_D3D12_OBJECT(moments_blur_texture_);
+
+  D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
+  uav_desc.Format = format;
+  uav_desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2DARRAY;
+  uav_desc.Texture2DArray.ArraySize = slice_number;
+
+  srv_desc.Texture2DArray.MipLevels = moments_mip_number_;
+  device->CreateShaderResourceView(moments_texture_.Get(), &srv_desc, descriptor_handle);
+  descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
+  srv_desc.Texture2DArray.MipLevels = 1;
+  device->CreateShaderResourceView(moments_blur_texture_.Get(), &srv_desc, descriptor_handle);
+  descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
+  device->CreateUnorderedAccessView(moments_blur_texture_.Get(), nullptr, &uav_desc, descriptor_handle);
+  descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
+  for (UINT mip = 0; mip < moments_mip_number_; ++mip) {
+    srv_desc.Texture2DArray.MostDetailedMip = mip;
+    device->CreateShaderResourceView(moments_texture_.Get(), &srv_desc, descriptor_handle);
+    descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
+    uav_desc.Texture2DArray.MipSlice = mip;
+    device->CreateUnorderedAccessView(moments_texture_.Get(), nullptr, &uav_desc, descriptor_handle);
+    descriptor_handle.Offset(cbv_srv_descriptor_increment_size_);
+  }
+}
+
 void Scene::CreatePipelineStates(ID3D12Device* device)
 {
   CreateShadowPipelineState(device);
+  CreateCubeShadowPipelineState(device);
+  CreateMomentsPipelineStates(device);
   CreateScenePipelineState(device);
   CreateCameraDrawPipelineState(device);
 }
 
 void Scene::CreateAndMapConstantBuffers(ID3D12Device* device)
 {
-  CreateAndMapShadowConstantBuffer(device);
-  CreateAndMapSceneConstantBuffer(device);
+  constant_buffer_ring_.Initialize(device, kInitialConstantBufferRingSize_);
 }
 
 void Scene::CreateShadowPipelineState(ID3D12Device* device)
@@ -308,8 +659,10 @@ void Scene::CreateShadowPipelineState(ID3D12Device* device)
     featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
   }
 
-  CD3DX12_ROOT_PARAMETER1 root_parameters[1]{};
+  CD3DX12_ROOT_PARAMETER1 root_parameters[3]{};
   root_parameters[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_VERTEX);
+  root_parameters[1].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_VERTEX);  // cascade index, register b1
+  root_parameters[2].InitAsShaderResourceView(0, 1, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_VERTEX);  // instance transforms, register t0 space1
   CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
   root_signature_desc.Init_1_1(_countof(root_parameters), root_parameters,
     0, nullptr,
@@ -327,11 +680,9 @@ void Scene::CreateShadowPipelineState(ID3D12Device* device)
   ComPtr<ID3DBlob> vertex_shader = CompileShader(L"shadow_vertex_shader.hlsl", nullptr, "main", "vs_5_0");
   ComPtr<ID3DBlob> pixel_shader = CompileShader(L"shadow_pixel_shader.hlsl", nullptr, "main", "ps_5_0");
 
+  // Position only: slot 0 is either the interleaved vertices (the stride skips the rest) or the position stream.
   D3D12_INPUT_ELEMENT_DESC input_element_descs[] = {
-    {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+    {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
   };
   D3D12_INPUT_LAYOUT_DESC input_layout_desc{};
   input_layout_desc.pInputElementDescs = input_element_descs;
@@ -349,15 +700,109 @@ void Scene::CreateShadowPipelineState(ID3D12Device* device)
   pipeline_state_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
   pipeline_state_desc.NumRenderTargets = 1;
   pipeline_state_desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-  pipeline_state_desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+  pipeline_state_desc.DSVFormat = shadow_settings_.depth_format;
   pipeline_state_desc.SampleDesc.Count = 1;
   pipeline_state_desc.NodeMask = 0;
   ThrowIfFailed(device->CreateGraphicsPipelineState(&pipeline_state_desc, IID_PPV_ARGS(&shadow_pipeline_state_)));
 }
 
-void Scene::CreateAndMapShadowConstantBuffer(ID3D12Device* device)
+void Scene::CreateCubeShadowPipelineState(ID3D12Device* device)
 {
-  
+  D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+  // This is the highest version the sample supports. If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
+  featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+
+  if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+  {
+    featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+  }
+
+  CD3DX12_ROOT_PARAMETER1 root_parameters[3]{};
+  root_parameters[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_VERTEX);  // per object, register b0
+  root_parameters[1].InitAsConstants(1, 1, 0, D3D12_SHADER_VISIBILITY_GEOMETRY);  // face mask, register b1
+  root_parameters[2].InitAsConstantBufferView(2, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_GEOMETRY);  // face matrices, register b2
+  CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
+  root_signature_desc.Init_1_1(_countof(root_parameters), root_parameters,
+    0, nullptr,
+    D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
+    D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+    D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+    D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS
+  );
+  ComPtr<ID3DBlob> root_signature_blob;
+  ComPtr<ID3DBlob> error;
+  ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&root_signature_desc, featureData.HighestVersion, &root_signature_blob, &error));
+  ThrowIfFailed(device->CreateRootSignature(0, root_signature_blob->GetBufferPointer(), root_signature_blob->GetBufferSize(), IID_PPV_ARGS(&cube_shadow_root_signature_)));
+
+  ComPtr<ID3DBlob> vertex_shader = CompileShader(L"cube_shadow_vertex_shader.hlsl", nullptr, "main", "vs_5_0");
+  ComPtr<ID3DBlob> geometry_shader = CompileShader(L"cube_shadow_geometry_shader.hlsl", nullptr, "main", "gs_5_0");
+
+  // Position only, like the cascaded shadow pass.
+  D3D12_INPUT_ELEMENT_DESC input_element_descs[] = {
+    {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+  };
+  D3D12_INPUT_LAYOUT_DESC input_layout_desc{};
+  input_layout_desc.pInputElementDescs = input_element_descs;
+  input_layout_desc.NumElements = _countof(input_element_descs);
+
+  D3D12_GRAPHICS_PIPELINE_STATE_DESC pipeline_state_desc{};
+  pipeline_state_desc.pRootSignature = cube_shadow_root_signature_.Get();
+  pipeline_state_desc.VS = CD3DX12_SHADER_BYTECODE(vertex_shader.Get());
+  pipeline_state_desc.GS = CD3DX12_SHADER_BYTECODE(geometry_shader.Get());
+  pipeline_state_desc.BlendState = CD3DX12_BLEND_DESC(CD3DX12_DEFAULT());
+  pipeline_state_desc.SampleMask = UINT_MAX;
+  pipeline_state_desc.RasterizerState = CD3DX12_RASTERIZER_DESC(CD3DX12_DEFAULT());
+  pipeline_state_desc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(CD3DX12_DEFAULT());
+  pipeline_state_desc.InputLayout = input_layout_desc;
+  pipeline_state_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+  pipeline_state_desc.NumRenderTargets = 0;
+  pipeline_state_desc.DSVFormat = shadow_settings_.depth_format;
+  pipeline_state_desc.SampleDesc.Count = 1;
+  pipeline_state_desc.NodeMask = 0;
+  ThrowIfFailed(device->CreateGraphicsPipelineState(&pipeline_state_desc, IID_PPV_ARGS(&cube_shadow_pipeline_state_)));
+}
+
+void Scene::CreateMomentsPipelineStates(ID3D12Device* device)
+{
+  if (!ShadowFilter::IsMomentMode(shadow_filter_mode_)) {
+    return;
+  }
+
+  D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+  // This is the highest version the sample supports. If CheckFeatureSupport succeeds, the HighestVersion returned will not be greater than this.
+  featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+
+  if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+  {
+    featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+  }
+
+  // Every step reads one view and writes another, see the heap layout of the moments.
+  CD3DX12_DESCRIPTOR_RANGE1 ranges[2]{};
+  ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0);
+  ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0);
+  CD3DX12_ROOT_PARAMETER1 root_parameters[3]{};
+  root_parameters[0].InitAsConstants(2, 0, 0);  // blur direction, register b0
+  root_parameters[1].InitAsDescriptorTable(1, &ranges[0]);  // input, register t0
+  root_parameters[2].InitAsDescriptorTable(1, &ranges[1]);  // output, register u0
+  CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
+  root_signature_desc.Init_1_1(_countof(root_parameters), root_parameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE);
+  ComPtr<ID3DBlob> root_signature_blob;
+  ComPtr<ID3DBlob> error;
+  ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&root_signature_desc, featureData.HighestVersion, &root_signature_blob, &error));
+  ThrowIfFailed(device->CreateRootSignature(0, root_signature_blob->GetBufferPointer(), root_signature_blob->GetBufferSize(), IID_PPV_ARGS(&moments_root_signature_)));
+
+  // The same defines as the scene pixel shader pick the moments' layout.
+  const char* const entry_points[] = { "GenerateMoments", "BlurMoments", "DownsampleMoments" };
+  ComPtr<ID3D12PipelineState>* const pipeline_states[] = { &generate_moments_pipeline_state_, &blur_moments_pipeline_state_, &downsample_moments_pipeline_state_ };
+  for (size_t i = 0; i < _countof(entry_points); ++i) {
+    ComPtr<ID3DBlob> compute_shader = CompileShader(L"shadow_moments_compute_shader.hlsl", ShadowFilter::GetShaderDefines(shadow_filter_mode_), entry_points[i], "cs_5_0");
+    D3D12_COMPUTE_PIPELINE_STATE_DESC pipeline_state_desc{};
+    pipeline_state_desc.pRootSignature = moments_root_signature_.Get();
+    pipeline_state_desc.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    pipeline_state_desc.NodeMask = 0;
+    ThrowIfFailed(device->CreateComputePipelineState(&pipeline_state_desc, IID_PPV_ARGS(pipeline_states[i]->ReleaseAndGetAddressOf())));
+  }
 }
 
 void Scene::CreateScenePipelineState(ID3D12Device* device)
@@ -373,29 +818,48 @@ void Scene::CreateScenePipelineState(ID3D12Device* device)
   }
 
   // texture
-  CD3DX12_DESCRIPTOR_RANGE1 ranges[3]{};
+  CD3DX12_DESCRIPTOR_RANGE1 ranges[4]{};
   // object diffuse texture
   ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
   // shadow map
   ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1, 0);
+  // point light shadow cube
+  ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2, 0);
+  // shadow moments
+  ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3, 0);
   // Performance tip: Order root parameters from most frequently accessed to least frequently accessed.
-  CD3DX12_ROOT_PARAMETER1 root_parameters[3]{};
+  CD3DX12_ROOT_PARAMETER1 root_parameters[6]{};
   // scene constant buffer
   root_parameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_PIXEL);  // 1 frequently changed diffuse textures - starting in register t0. Per object part.
   root_parameters[1].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_ALL);  // 1 frequently changed constant buffer, register b0. Per object.
   root_parameters[2].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_PIXEL);  // 1 infrequently changed shadow texture - starting in register t1.
+  root_parameters[3].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_PIXEL);  // 1 infrequently changed shadow cube - starting in register t2.
+  root_parameters[4].InitAsDescriptorTable(1, &ranges[3], D3D12_SHADER_VISIBILITY_PIXEL);  // 1 infrequently changed shadow moments texture - starting in register t3.
+  root_parameters[5].InitAsShaderResourceView(0, 1, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_VERTEX);  // instance transforms of a batch, register t0 space1.
 
   // static sampler (Note: there is also dynamic sampler)
-  CD3DX12_STATIC_SAMPLER_DESC static_sampler_desc{};
-  static_sampler_desc.Init(0, D3D12_FILTER_MIN_MAG_MIP_POINT,
+  CD3DX12_STATIC_SAMPLER_DESC static_sampler_descs[3]{};
+  static_sampler_descs[0].Init(0, D3D12_FILTER_MIN_MAG_MIP_POINT,
     D3D12_TEXTURE_ADDRESS_MODE_BORDER, D3D12_TEXTURE_ADDRESS_MODE_BORDER, D3D12_TEXTURE_ADDRESS_MODE_BORDER,
     0.0f, 0, D3D12_COMPARISON_FUNC_NEVER, D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK,
     0.0f, D3D12_FLOAT32_MAX,
     D3D12_SHADER_VISIBILITY_PIXEL, 0);
+  // Shadow comparisons: lit where the reference is not behind the stored depth, and off the map.
+  static_sampler_descs[1].Init(1, D3D12_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT,
+    D3D12_TEXTURE_ADDRESS_MODE_BORDER, D3D12_TEXTURE_ADDRESS_MODE_BORDER, D3D12_TEXTURE_ADDRESS_MODE_BORDER,
+    0.0f, 0, D3D12_COMPARISON_FUNC_LESS_EQUAL, D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE,
+    0.0f, 0.0f,
+    D3D12_SHADER_VISIBILITY_PIXEL, 0);
+  // Shadow moments: trilinear over the prefiltered mips, edges clamped.
+  static_sampler_descs[2].Init(2, D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+    D3D12_TEXTURE_ADDRESS_MODE_CLAMP, D3D12_TEXTURE_ADDRESS_MODE_CLAMP, D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+    0.0f, 0, D3D12_COMPARISON_FUNC_NEVER, D3D12_STATIC_BORDER_COLOR_OPAQUE_WHITE,
+    0.0f, D3D12_FLOAT32_MAX,
+    D3D12_SHADER_VISIBILITY_PIXEL, 0);
 
   CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC root_signature_desc;
   root_signature_desc.Init_1_1(_countof(root_parameters), root_parameters,
-    1, &static_sampler_desc,
+    _countof(static_sampler_descs), static_sampler_descs,
     D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
     D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
     D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
@@ -407,13 +871,15 @@ void Scene::CreateScenePipelineState(ID3D12Device* device)
   ThrowIfFailed(device->CreateRootSignature(0, root_signature_blob->GetBufferPointer(), root_signature_blob->GetBufferSize(), IID_PPV_ARGS(&scene_root_signature_)));
 
   ComPtr<ID3DBlob> vertex_shader = CompileShader(L"scene_vertex_shader.hlsl", nullptr, "main", "vs_5_0");
-  ComPtr<ID3DBlob> pixel_shader = CompileShader(L"scene_pixel_shader.hlsl", nullptr, "main", "ps_5_0");
+  ComPtr<ID3DBlob> pixel_shader = CompileShader(L"scene_pixel_shader.hlsl", ShadowFilter::GetShaderDefines(shadow_filter_mode_), "main", "ps_5_0");
 
+  // With the de-interleaved layout the attributes come from slot 1.
+  const UINT attributes_slot = AssetsManager::GetSharedInstance().GetVertexStreamLayout() == AssetsManager::VertexStreamLayout::kDeinterleaved ? 1 : 0;
   D3D12_INPUT_ELEMENT_DESC input_element_descs[] = {
     {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-    {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+    {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, attributes_slot, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+    {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, attributes_slot, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+    {"COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, attributes_slot, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
   };
   D3D12_INPUT_LAYOUT_DESC input_layout_desc{};
   input_layout_desc.pInputElementDescs = input_element_descs;
@@ -437,20 +903,6 @@ void Scene::CreateScenePipelineState(ID3D12Device* device)
   ThrowIfFailed(device->CreateGraphicsPipelineState(&pipeline_state_desc, IID_PPV_ARGS(&scene_pipeline_state_)));
 }
 
-void Scene::CreateAndMapSceneConstantBuffer(ID3D12Device* device)
-{
-  scene_constant_buffer_views_.clear();
-  scene_constant_buffer_views_.resize(frame_count_);
-  scene_constant_buffer_pointers_.clear();
-  scene_constant_buffer_pointers_.resize(frame_count_);
-  scene_constant_buffer_aligned_size_ = CalculateConstantBufferByteSize(sizeof(SceneConstantBuffer));
-  for (auto i = 0; i < frame_count_; ++i) {
-    CreateConstanfBuffer(device, sizeof(SceneConstantBuffer), &(scene_constant_buffer_views_[i]), D3D12_RESOURCE_STATE_GENERIC_READ);
-    const CD3DX12_RANGE readRange(0, 0);
-    scene_constant_buffer_views_[i]->Map(0, &readRange, &(scene_constant_buffer_pointers_[i]));
-  }
-}
-
 void Scene::CreateCameraDrawPipelineState(ID3D12Device* device)
 {
   D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
@@ -517,22 +969,26 @@ void Scene::LoadAssets(ID3D12Device* device)
   LoadTextures(device);
 }
 
-void Scene::LoadModelVerticesAndIndices(ID3D12Device* device)
+void Scene::InsertModels()
 {
-  std::unique_ptr<Asset::Model> quad_model_ptr = std::make_unique<Asset::QuadModel>(Asset::QuadModel());
-  std::unique_ptr<Asset::Model> cube_model_ptr = std::make_unique<Asset::CubeModel>(Asset::CubeModel());
-  XMMATRIX quad_model_transform_matrix = XMMatrixIdentity();
-  quad_model_ptr->SetModelTransform(quad_model_transform_matrix);
-  XMMATRIX cube_model_transform_matrix = XMMatrixTranslation(0.0f, 1.0f, 0.0f);
-  cube_model_ptr->SetModelTransform(XMMatrixTranspose(cube_model_transform_matrix));
-
-  AssetsManager::GetSharedInstance().InsertModel(std::move(quad_model_ptr));
-  AssetsManager::GetSharedInstance().InsertModel(std::move(cube_model_ptr));
+  // A baked mesh cache is mapped and used in place; fall back to building the models in code.
+  if (mesh_cache_file_name_.empty() || !AssetsManager::GetSharedInstance().LoadMeshCache(mesh_cache_file_name_)) {
+    std::unique_ptr<Asset::Model> quad_model_ptr = std::make_unique<Asset::QuadModel>(Asset::QuadModel());
+    std::unique_ptr<Asset::Model> cube_model_ptr = std::make_unique<Asset::CubeModel>(Asset::CubeModel());
+    XMMATRIX quad_model_transform_matrix = XMMatrixIdentity();
+    XMMATRIX cube_model_transform_matrix = XMMatrixTranslation(0.0f, 1.0f, 0.0f);
+
+    AssetsManager::GetSharedInstance().InsertModel(std::move(quad_model_ptr), quad_model_transform_matrix);
+    AssetsManager::GetSharedInstance().InsertModel(std::move(cube_model_ptr), XMMatrixTranspose(cube_model_transform_matrix));
+  }
 
-  std::unique_ptr<Asset::Model::Vertex[]> vertices_data = nullptr;
-  std::unique_ptr<DWORD[]> indices_data = nullptr;
-  AssetsManager::GetSharedInstance().GetMergedVerticesAndIndices(vertices_data, indices_data);
+  if (!cook_mesh_cache_file_name_.empty() && !AssetsManager::GetSharedInstance().CookMeshCache(cook_mesh_cache_file_name_)) {
+    OutputDebugStringA("Failed to write the mesh cache.\n");
+  }
+}
 
+void Scene::LoadModelVerticesAndIndices(ID3D12Device* device)
+{
   size_t vertex_data_size = AssetsManager::GetSharedInstance().GetTotalModelVertexSize();
   CD3DX12_HEAP_PROPERTIES default_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
   CD3DX12_RESOURCE_DESC vertex_buffer_resource_desc = CD3DX12_RESOURCE_DESC::Buffer(vertex_data_size);
@@ -551,15 +1007,24 @@ void Scene::LoadModelVerticesAndIndices(ID3D12Device* device)
     nullptr,
     IID_PPV_ARGS(&vertex_upload_heap_)));
 
-  D3D12_SUBRESOURCE_DATA vertex_subresource_data{};
-  vertex_subresource_data.pData = vertices_data.get();
-  vertex_subresource_data.RowPitch = vertex_data_size;
-  vertex_subresource_data.SlicePitch = vertex_data_size;
-  UpdateSubresources(command_list_.Get(), vertex_buffer_.Get(), vertex_upload_heap_.Get(), 0, 0, 1, &vertex_subresource_data);
-
-  vertex_buffer_view_.BufferLocation = vertex_buffer_->GetGPUVirtualAddress();
-  vertex_buffer_view_.SizeInBytes = static_cast<UINT>(vertex_data_size);
-  vertex_buffer_view_.StrideInBytes = static_cast<UINT>(Asset::Model::GetVertexStride());
+  const size_t vertex_number = AssetsManager::GetSharedInstance().GetTotalModelVertexNumber();
+  const bool deinterleaved = AssetsManager::GetSharedInstance().GetVertexStreamLayout() == AssetsManager::VertexStreamLayout::kDeinterleaved;
+  if (deinterleaved) {
+    // Same total size: the position stream, then the attribute stream.
+    const size_t positions_size = vertex_number * Asset::Model::GetPositionStride();
+    vertex_buffer_views_[0].BufferLocation = vertex_buffer_->GetGPUVirtualAddress();
+    vertex_buffer_views_[0].SizeInBytes = static_cast<UINT>(positions_size);
+    vertex_buffer_views_[0].StrideInBytes = static_cast<UINT>(Asset::Model::GetPositionStride());
+    vertex_buffer_views_[1].BufferLocation = vertex_buffer_->GetGPUVirtualAddress() + positions_size;
+    vertex_buffer_views_[1].SizeInBytes = static_cast<UINT>(vertex_number * Asset::Model::GetVertexAttributesStride());
+    vertex_buffer_views_[1].StrideInBytes = static_cast<UINT>(Asset::Model::GetVertexAttributesStride());
+    vertex_buffer_view_number_ = 2;
+  } else {
+    vertex_buffer_views_[0].BufferLocation = vertex_buffer_->GetGPUVirtualAddress();
+    vertex_buffer_views_[0].SizeInBytes = static_cast<UINT>(vertex_data_size);
+    vertex_buffer_views_[0].StrideInBytes = static_cast<UINT>(Asset::Model::GetVertexStride());
+    vertex_buffer_view_number_ = 1;
+  }
 
   size_t index_data_size = AssetsManager::GetSharedInstance().GetTotalModelIndexSize();
   CD3DX12_RESOURCE_DESC index_buffer_resource_desc = CD3DX12_RESOURCE_DESC::Buffer(index_data_size);
@@ -577,11 +1042,31 @@ void Scene::LoadModelVerticesAndIndices(ID3D12Device* device)
     nullptr,
     IID_PPV_ARGS(&index_upload_heap_)));
 
-  D3D12_SUBRESOURCE_DATA index_subresource_data{};
-  index_subresource_data.pData = indices_data.get();
-  index_subresource_data.RowPitch = index_data_size;
-  index_subresource_data.SlicePitch = index_data_size;
-  UpdateSubresources(command_list_.Get(), index_buffer_.Get(), index_upload_heap_.Get(), 0, 0, 1, &index_subresource_data);
+  // Merge the models straight into the upload heaps, no intermediate CPU copy of the whole scene.
+  Asset::Model::Vertex* mapped_vertices = nullptr;
+  DWORD* mapped_indices = nullptr;
+  CD3DX12_RANGE read_range(0, 0);
+  ThrowIfFailed(vertex_upload_heap_->Map(0, &read_range, reinterpret_cast<void**>(&mapped_vertices)));
+  ThrowIfFailed(index_upload_heap_->Map(0, &read_range, reinterpret_cast<void**>(&mapped_indices)));
+  if (deinterleaved) {
+    XMFLOAT3* mapped_positions = reinterpret_cast<XMFLOAT3*>(mapped_vertices);
+    Asset::Model::VertexAttributes* mapped_attributes = reinterpret_cast<Asset::Model::VertexAttributes*>(mapped_positions + vertex_number);
+    AssetsManager::GetSharedInstance().CopyMergedVertexStreamsAndIndices(mapped_positions, mapped_attributes, mapped_indices);
+  } else {
+    AssetsManager::GetSharedInstance().CopyMergedVerticesAndIndices(mapped_vertices, mapped_indices);
+  }
+  vertex_upload_heap_->Unmap(0, nullptr);
+  index_upload_heap_->Unmap(0, nullptr);
+
+  // The occlusion culler rasterizes occluders from its own copy of the positions; the upload heaps are write-combined.
+  std::vector<XMFLOAT3> occluder_positions(vertex_number);
+  std::vector<Asset::Model::VertexAttributes> occluder_attributes(vertex_number);
+  std::vector<DWORD> occluder_indices(AssetsManager::GetSharedInstance().GetTotalModelIndexNumber());
+  AssetsManager::GetSharedInstance().CopyMergedVertexStreamsAndIndices(occluder_positions.data(), occluder_attributes.data(), occluder_indices.data());
+  occlusion_culler_.SetGeometry(std::move(occluder_positions), std::move(occluder_indices));
+
+  command_list_->CopyBufferRegion(vertex_buffer_.Get(), 0, vertex_upload_heap_.Get(), 0, vertex_data_size);
+  command_list_->CopyBufferRegion(index_buffer_.Get(), 0, index_upload_heap_.Get(), 0, index_data_size);
 
   index_buffer_view_.BufferLocation = index_buffer_->GetGPUVirtualAddress();
   index_buffer_view_.SizeInBytes = static_cast<UINT>(index_data_size);
@@ -596,51 +1081,39 @@ void Scene::LoadTextures(ID3D12Device* device)
 
   model_textures_upload_heap_.resize(model_textures_file_names.size());
 
+  // Every texture is decoded on the pool straight into its upload heap; here we only record the copies,
+  // in order, as each one becomes ready.
+  const auto load_start_time = std::chrono::steady_clock::now();
+  TextureLoadQueue texture_load_queue(device);
+  texture_load_queue.EnableMipChainGeneration(MipChainGenerator::Filter::kBox);
+  texture_load_queue.EnableBlockCompression(BlockCompressor::Format::kBC1);  // diffuse maps are opaque
+  texture_load_queue.Load(model_textures_file_names);
+
   int texture_index = 0;
-  CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_srv_cpuHandle(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart());
   // See srv descriptor heap layout
-  for (auto i = 0; i < kDepthBufferCount_; ++i) {
+  CD3DX12_CPU_DESCRIPTOR_HANDLE cbv_srv_cpuHandle(cbv_srv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kDefaultTextureDescriptorIndex_, cbv_srv_descriptor_increment_size_);
+  {
+    // The scene pass binds this slot before any batch sets its texture, and keeps it for the batches without one.
+    D3D12_SHADER_RESOURCE_VIEW_DESC null_srv_desc = {};
+    null_srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    null_srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    null_srv_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    null_srv_desc.Texture2D.MipLevels = 1;
+    device->CreateShaderResourceView(nullptr, &null_srv_desc, cbv_srv_cpuHandle);
     cbv_srv_cpuHandle.Offset(cbv_srv_descriptor_increment_size_);
   }
   for (const auto& model_texture_file_name : model_textures_file_names) {
     if (!model_texture_file_name.empty()) {
-      std::vector<uint8_t> texture_image_data;
-      D3D12_RESOURCE_DESC texture_resource_desc{};
-      int bytes_per_row = 0;
-      auto image_size = ImageLoader::LoadImageDataFromFile(texture_image_data, texture_resource_desc, model_texture_file_name, bytes_per_row);
-
-      CD3DX12_HEAP_PROPERTIES default_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-      ThrowIfFailed(device->CreateCommittedResource(&default_heap_properties,
-        D3D12_HEAP_FLAG_NONE,
-        &texture_resource_desc,
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&model_textures_[texture_index])));
-
-      UINT64 texture_upload_buffer_size;
-      // this function gets the size an upload buffer needs to be to upload a texture to the gpu.
-      // each row must be 256 byte aligned except for the last row, which can just be the size in bytes of the row
-      // eg. textureUploadBufferSize = ((((width * numBytesPerPixel) + 255) & ~255) * (height - 1)) + (width * numBytesPerPixel);
-      //textureUploadBufferSize = (((imageBytesPerRow + 255) & ~255) * (textureDesc.Height - 1)) + imageBytesPerRow;
-      device->GetCopyableFootprints(&texture_resource_desc, 0, 1, 0, nullptr, nullptr, nullptr, &texture_upload_buffer_size);
-
-      CD3DX12_HEAP_PROPERTIES upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-      CD3DX12_RESOURCE_DESC upload_buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(texture_upload_buffer_size);
-      ThrowIfFailed(device->CreateCommittedResource(&upload_heap_properties,
-        D3D12_HEAP_FLAG_NONE,
-        &upload_buffer_desc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&model_textures_upload_heap_[texture_index])));
-
-      // Copy data to the intermediate upload heap and then schedule a copy
-      // from the upload heap to the Texture2D.
-      D3D12_SUBRESOURCE_DATA texture_data = {};
-      texture_data.pData = texture_image_data.data();
-      texture_data.RowPitch = bytes_per_row;
-      texture_data.SlicePitch = image_size;  // size before aligned or aligned size?
+      TextureLoadQueue::LoadedTexture& loaded_texture = texture_load_queue.Wait(texture_index);
+      model_textures_[texture_index] = loaded_texture.texture;
+      model_textures_upload_heap_[texture_index] = loaded_texture.upload_heap;
 
-      UpdateSubresources(command_list_.Get(), model_textures_[texture_index].Get(), model_textures_upload_heap_[texture_index].Get(), 0, 0, 1, &texture_data);
+      // Schedule a copy of every subresource from the upload heap, which already holds the texels, to the Texture2D.
+      for (UINT subresource = 0; subresource < loaded_texture.footprints.size(); ++subresource) {
+        CD3DX12_TEXTURE_COPY_LOCATION destination(model_textures_[texture_index].Get(), subresource);
+        CD3DX12_TEXTURE_COPY_LOCATION source(model_textures_upload_heap_[texture_index].Get(), loaded_texture.footprints[subresource]);
+        command_list_->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+      }
 
       // transition the texture default heap to a pixel shader resource (we will be sampling from this heap in the pixel shader to get the color of pixels)
       CD3DX12_RESOURCE_BARRIER texture_resource_barrier = CD3DX12_RESOURCE_BARRIER::Transition(model_textures_[texture_index].Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
@@ -650,8 +1123,8 @@ void Scene::LoadTextures(ID3D12Device* device)
       D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
       srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
       srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-      srv_desc.Format = texture_resource_desc.Format;
-      srv_desc.Texture2D.MipLevels = texture_resource_desc.MipLevels;
+      srv_desc.Format = loaded_texture.texture_desc.Format;
+      srv_desc.Texture2D.MipLevels = loaded_texture.texture_desc.MipLevels;
       srv_desc.Texture2D.MostDetailedMip = 0;
       srv_desc.Texture2D.ResourceMinLODClamp = 0.0f;
       device->CreateShaderResourceView(model_textures_[texture_index].Get(), &srv_desc, cbv_srv_cpuHandle);
@@ -661,6 +1134,9 @@ void Scene::LoadTextures(ID3D12Device* device)
     texture_index++;
   }
 
+  // Time from the first load to the last copy recorded, to compare e.g. DDS with JPEG texture sets.
+  const double load_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start_time).count();
+  OutputDebugStringA(("Loaded " + std::to_string(model_textures_file_names.size()) + " textures in " + std::to_string(load_milliseconds) + " ms.\n").c_str());
 }
 
 void Scene::CreateCameraPoints(ID3D12Device* device)
@@ -692,7 +1168,7 @@ void Scene::CreateCameraPoints(ID3D12Device* device)
 void Scene::UpdateConstantBuffers()
 {
   XMStoreFloat4x4(&scene_constant_buffer_.model, XMMatrixIdentity());
-  cameras_[camera_index_].Get3DViewProjMatricesLH(&scene_constant_buffer_.view, &scene_constant_buffer_.proj, 90.f, view_port_.Width, view_port_.Height, 0.01f, 10.0f);
+  cameras_[camera_index_].Get3DViewProjMatricesLH(&scene_constant_buffer_.view, &scene_constant_buffer_.proj, kCameraFovDegrees_, view_port_.Width, view_port_.Height, kCameraNearPlane_, kCameraFarPlane_);
 
   // update light related
   XMStoreFloat4(&scene_constant_buffer_.camera_world_pos, cameras_[camera_index_].mEye);
@@ -719,10 +1195,44 @@ void Scene::UpdateConstantBuffers()
   }
 
   // update shadow mapping related
-  XMVECTOR light_camera_eye = XMLoadFloat4(&scene_constant_buffer_.light_world_direction_or_position);
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  object_bounds_.clear();
+  for (const auto& draw_argument : draw_arguments) {
+    object_bounds_.push_back(draw_argument.world_bounding_box);
+  }
+
+  // Light frustums are fitted to the viewing camera's frustum; its matrices were stored transposed above.
+  const XMMATRIX camera_view = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.view));
+  const XMMATRIX camera_proj = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.proj));
   if (light_type_ == LightType::kDirectionLight) {
-    light_camera_eye = XMVectorScale(light_camera_eye, -4.0f);
+    UpdateShadowAtlas(false, 0.0f);
+    cascaded_shadow_map_.Fit(camera_view, camera_proj, kCameraNearPlane_, kCameraFarPlane_, XMLoadFloat4(&scene_constant_buffer_.light_world_direction_or_position),
+      object_bounds_.data(), object_bounds_.size());
+
+    const UINT cascade_number = cascaded_shadow_map_.GetOptions().cascade_number;
+    float split_distances[CascadedShadowMap::kMaxCascadeNumber]{};
+    float depth_biases[CascadedShadowMap::kMaxCascadeNumber]{};
+    for (UINT i = 0; i < cascade_number; ++i) {
+      const CascadedShadowMap::Cascade& cascade = cascaded_shadow_map_.GetCascade(i);
+      XMStoreFloat4x4(&scene_constant_buffer_.light_view_proj_transforms[i], XMMatrixTranspose(XMLoadFloat4x4(&cascade.view_proj)));
+      split_distances[i] = cascade.split_distance;
+      // Depth is linear in an orthographic projection: allow for a 2 texel slope, plus UNORM rounding.
+      depth_biases[i] = 2.0f * cascade.texel_size / cascade.depth_range + ShadowQuality::GetDepthQuantization(shadow_settings_.depth_format);
+      scene_constant_buffer_.shadow_depth_params[i] = ShadowFilter::ComputeOrthographicDepthParams(cascade.depth_range, cascade.texel_size);
+    }
+    scene_constant_buffer_.cascade_split_distances = XMFLOAT4(split_distances[0], split_distances[1], split_distances[2], split_distances[3]);
+    scene_constant_buffer_.cascade_depth_biases = XMFLOAT4(depth_biases[0], depth_biases[1], depth_biases[2], depth_biases[3]);
+    scene_constant_buffer_.cascade_number = static_cast<int>(cascade_number);
+    return;
   }
+
+  if (light_type_ == LightType::kPointLight) {
+    UpdateShadowAtlas(false, 0.0f);
+    UpdateCubeShadowConstantBuffer();
+    return;
+  }
+
+  XMVECTOR light_camera_eye = XMLoadFloat4(&scene_constant_buffer_.light_world_direction_or_position);
   XMVECTOR light_camera_at = XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
   XMVECTOR light_camera_up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
   // Note: up vector cannot be parallel to looking vector, it's OK that they have a small angle.
@@ -733,29 +1243,334 @@ void Scene::UpdateConstantBuffers()
   light_camera_.Set(light_camera_eye, light_camera_at, light_camera_up);
   XMFLOAT4X4 light_camera_view;
   XMFLOAT4X4 light_camera_proj;
-  // light_camera_.GetOrthoProjMatricesLH(&light_camera_view, &light_camera_proj, view_port_.Width, view_port_.Height, 0.01f, 10.0f);  // TOOD: explore why not work
-  light_camera_.Get3DViewProjMatricesLH(&light_camera_view, &light_camera_proj, 90.0f, view_port_.Width, view_port_.Height, 0.01f, 10.0f);  // TODO: explore why spotlight not work
+  light_camera_.Get3DViewProjMatricesLH(&light_camera_view, &light_camera_proj, 90.0f, shadow_view_port_.Width, shadow_view_port_.Height, 0.01f, 10.0f);  // TODO: explore why spotlight not work
   XMMATRIX light_camera_view_matrix = XMLoadFloat4x4(&light_camera_view);
   XMMATRIX light_camera_proj_matrix = XMLoadFloat4x4(&light_camera_proj);
+  float spot_light_screen_coverage = 0.0f;  // until something it shadows is in view
+  float light_near_plane = 0.01f;  // of light_camera_proj, until it is fitted
+  float light_far_plane = 10.0f;
+  if (light_type_ == LightType::kSpotLight) {
+    // Narrow the cone down to what the camera sees and what shadows it.
+    XMVECTOR frustum_corners[8];
+    CascadedShadowMap::ComputeFrustumCorners(XMMatrixInverse(nullptr, XMMatrixMultiply(camera_view, camera_proj)), frustum_corners);
+    LightFrustumFitter::PerspectiveBounds bounds;
+    if (LightFrustumFitter::FitPerspective(XMMatrixTranspose(light_camera_view_matrix), frustum_corners, object_bounds_.data(), object_bounds_.size(),
+        kSpotLightMaxTanHalfAngle_, 0.01f, bounds)) {
+      light_camera_proj_matrix = XMMatrixTranspose(XMMatrixPerspectiveOffCenterLH(bounds.left * bounds.near_plane, bounds.right * bounds.near_plane,
+        bounds.bottom * bounds.near_plane, bounds.top * bounds.near_plane, bounds.near_plane, bounds.far_plane));
+      light_near_plane = bounds.near_plane;
+      light_far_plane = bounds.far_plane;
+
+      // How much of the screen the fitted frustum covers, from its bounding sphere.
+      const float zs[2] = { bounds.near_plane, bounds.far_plane };
+      XMVECTOR corners[8];
+      XMVECTOR center = XMVectorZero();
+      for (int i = 0; i < 8; ++i) {
+        const float z = zs[i >> 2];
+        corners[i] = XMVectorSet(((i & 1) ? bounds.right : bounds.left) * z, ((i & 2) ? bounds.top : bounds.bottom) * z, z, 1.0f);
+        center = XMVectorAdd(center, XMVectorScale(corners[i], 1.0f / 8.0f));
+      }
+      float radius = 0.0f;
+      for (int i = 0; i < 8; ++i) {
+        radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(corners[i], center))));
+      }
+      const XMVECTOR world_center = XMVector3TransformCoord(center, XMMatrixInverse(nullptr, XMMatrixTranspose(light_camera_view_matrix)));
+      const float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(world_center, cameras_[camera_index_].mEye)));
+      spot_light_screen_coverage = ShadowAtlas::ComputeScreenCoverage(radius, distance, std::tan(XMConvertToRadians(kCameraFovDegrees_) * 0.5f));
+    }
+  }
+  UpdateShadowAtlas(light_type_ == LightType::kSpotLight, spot_light_screen_coverage);
   // XMMATRIX light_view_proj_transform_matrix = XMMatrixMultiply(light_camera_view_matrix, light_camera_proj_matrix);  // Note: wrong
   XMMATRIX light_view_proj_transform_matrix = XMMatrixMultiply(light_camera_proj_matrix, light_camera_view_matrix);
-  XMStoreFloat4x4(&scene_constant_buffer_.light_view_proj_transform, light_view_proj_transform_matrix);
+  XMStoreFloat4x4(&scene_constant_buffer_.light_view_proj_transforms[0], light_view_proj_transform_matrix);
+  scene_constant_buffer_.shadow_depth_params[0] = ShadowFilter::ComputePerspectiveDepthParams(light_near_plane, light_far_plane);
+  scene_constant_buffer_.cascade_split_distances = XMFLOAT4(kCameraFarPlane_, kCameraFarPlane_, kCameraFarPlane_, kCameraFarPlane_);
+  // A smaller tile has larger texels, which need a larger slope bias.
+  const float depth_bias = 0.00004f * shadow_view_port_.Width / shadow_tile_view_port_.Width + ShadowQuality::GetDepthQuantization(shadow_settings_.depth_format);
+  scene_constant_buffer_.cascade_depth_biases = XMFLOAT4(depth_bias, depth_bias, depth_bias, depth_bias);
+  scene_constant_buffer_.cascade_number = 1;
+}
+
+void Scene::UpdateShadowAtlas(bool is_spot_light, float spot_light_screen_coverage)
+{
+  // The directional light's cascades fill whole slices; the spot light gets a tile of the first one, as large
+  // as the share of the screen it shadows calls for.
+  const UINT resolution = shadow_settings_.resolution;
+  std::vector<ShadowAtlas::Request> requests;
+  if (is_spot_light) {
+    requests.push_back({ kSpotLightAtlasId_, ShadowAtlas::ComputeTileSize(spot_light_screen_coverage, resolution / 8, resolution) });
+  }
+  const ShadowAtlas::UpdateStats stats = shadow_atlas_.Update(requests);
+
+  ShadowAtlas::Tile tile = { 0, 0, resolution };
+  UINT gutter = 0;
+  if (is_spot_light && shadow_atlas_.GetTile(kSpotLightAtlasId_, tile)) {
+    gutter = std::min(kShadowAtlasGutterTexels_, tile.size / 4);
+    if (log_frame_stats_ && stats.placed_number > 0) {
+      const std::string line = "Shadow atlas: spot light tile of " + std::to_string(tile.size) + " texels at (" + std::to_string(tile.x) + ", " +
+        std::to_string(tile.y) + ")" + (stats.repacked ? ", repacked" : "") + "\n";
+      OutputDebugStringA(line.c_str());
+    }
+  }
+
+  const UINT inner_size = tile.size - 2 * gutter;
+  shadow_tile_view_port_ = CD3DX12_VIEWPORT((float)(tile.x + gutter), (float)(tile.y + gutter), (float)inner_size, (float)inner_size);
+  shadow_tile_scissor_rect_ = CD3DX12_RECT(tile.x + gutter, tile.y + gutter, tile.x + gutter + inner_size, tile.y + gutter + inner_size);
+  shadow_tile_clear_rect_ = CD3DX12_RECT(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size);
+  const float texel_size = 1.0f / resolution;
+  scene_constant_buffer_.shadow_atlas_tile = XMFLOAT4(inner_size * texel_size, inner_size * texel_size, (tile.x + gutter) * texel_size, (tile.y + gutter) * texel_size);
+}
+
+void Scene::UpdateCubeShadowConstantBuffer()
+{
+  const XMVECTOR light_position = XMLoadFloat4(&scene_constant_buffer_.light_world_direction_or_position);
+  const XMMATRIX face_proj = CubeShadowMap::ComputeFaceProj(kPointLightNearPlane_, kPointLightFarPlane_);
+  for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+    const XMMATRIX face_view_proj = XMMatrixMultiply(CubeShadowMap::ComputeFaceView(light_position, face), face_proj);
+    XMStoreFloat4x4(&cube_shadow_constant_buffer_.face_view_projs[face], XMMatrixTranspose(face_view_proj));
+  }
+  cube_shadow_constants_address_ = constant_buffer_ring_.Commit(cube_shadow_constant_buffer_);
+
+  const XMFLOAT2 depth_params = CubeShadowMap::ComputeDepthParams(kPointLightNearPlane_, kPointLightFarPlane_);
+  const float depth_bias = 0.00004f + ShadowQuality::GetDepthQuantization(shadow_settings_.depth_format);
+  scene_constant_buffer_.cube_shadow_depth_params = XMFLOAT4(depth_params.x, depth_params.y, depth_bias, 0.0f);
+
+  // Each object is drawn once, into the faces it overlaps only.
+  cube_face_masks_.resize(object_bounds_.size());
+  const CubeShadowMap::DrawStats draw_stats = CubeShadowMap::ComputeFaceMasks(light_position, object_bounds_.data(), object_bounds_.size(),
+    kPointLightNearPlane_, kPointLightFarPlane_, cube_face_masks_.data());
+  if (log_frame_stats_ && (draw_stats.draw_number != cube_shadow_draw_stats_.draw_number || draw_stats.face_draw_number != cube_shadow_draw_stats_.face_draw_number ||
+      draw_stats.naive_draw_number != cube_shadow_draw_stats_.naive_draw_number)) {
+    const std::string line = "Cube shadow: " + std::to_string(draw_stats.draw_number) + " draws covering " + std::to_string(draw_stats.face_draw_number) +
+      " faces, instead of " + std::to_string(draw_stats.naive_draw_number) + " draws in six passes\n";
+    OutputDebugStringA(line.c_str());
+  }
+  cube_shadow_draw_stats_ = draw_stats;
+}
+
+void Scene::CullObjects()
+{
+  // Both frustums come from the untransposed matrices; light passes keep casters in front of the light's near plane.
+  FrustumCuller::Frustum frustums[1 + CascadedShadowMap::kMaxCascadeNumber];
+  const XMMATRIX camera_view = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.view));
+  const XMMATRIX camera_proj = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.proj));
+  frustums[0] = FrustumCuller::ComputeFrustum(XMMatrixMultiply(camera_view, camera_proj), true);
+  const UINT light_frustum_number = light_type_ == LightType::kPointLight ? 0 : static_cast<UINT>(scene_constant_buffer_.cascade_number);
+  for (UINT i = 0; i < light_frustum_number; ++i) {
+    frustums[1 + i] = FrustumCuller::ComputeFrustum(XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.light_view_proj_transforms[i])), false);
+  }
+  for (UINT i = light_frustum_number; i < CascadedShadowMap::kMaxCascadeNumber; ++i) {
+    visible_objects_[1 + i].clear();
+  }
+
+  // Past a few chunks, skipping whole branches of the tree beats the flat sweep, as most objects are out of view.
+  if (object_bounds_.size() >= kBvhCullingMinObjectNumber_) {
+    AssetsManager::GetSharedInstance().GetModelBvh().QueryFrustums(frustums, 1 + light_frustum_number, visible_objects_);
+  }
+  else {
+    frustum_culler_.SetBounds(object_bounds_.data(), object_bounds_.size());
+    frustum_culler_.Cull(frustums, 1 + light_frustum_number, visible_objects_);
+  }
+
+  std::string line = "Frustum culling: " + std::to_string(visible_objects_[0].size()) + " of " + std::to_string(object_bounds_.size()) + " objects in view";
+  for (UINT i = 0; i < light_frustum_number; ++i) {
+    line += (i == 0 ? ", " : " + ") + std::to_string(visible_objects_[1 + i].size());
+  }
+  line += light_frustum_number > 0 ? " shadow casters\n" : "\n";
+  if (log_frame_stats_ && line != culling_stats_line_) {
+    OutputDebugStringA(line.c_str());
+    culling_stats_line_ = line;
+  }
+}
+
+void Scene::CullOccludedObjects()
+{
+  // The previous update's job ran while that frame was recorded; its answer is a frame old, like the transforms
+  // it saw, but only objects inside this frame's frustum are taken out of it. Inserted or removed models void it.
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  OcclusionCuller::Stats stats{};
+  const bool has_result = occlusion_culler_.EndCull(occluded_objects_, stats);
+  const bool result_usable = has_result && occlusion_object_number_ == draw_arguments.size();
+  if (!result_usable) {
+    occluded_objects_.clear();
+  }
+
+  // The whole frustum list goes to the next job, so objects hidden now are tested again.
+  std::vector<UINT> candidates = visible_objects_[0];
+  if (!occluded_objects_.empty()) {
+    std::vector<UINT> unoccluded_objects;
+    unoccluded_objects.reserve(candidates.size());
+    std::set_difference(candidates.cbegin(), candidates.cend(), occluded_objects_.cbegin(), occluded_objects_.cend(), std::back_inserter(unoccluded_objects));
+    visible_objects_[0].swap(unoccluded_objects);
+  }
+
+  if (log_frame_stats_ && result_usable) {
+    const std::string line = "Occlusion culling: " + std::to_string(stats.occluded_number) + " of " + std::to_string(stats.tested_number) +
+      " objects hidden by " + std::to_string(stats.occluder_number) + " occluders\n";
+    if (line != occlusion_stats_line_) {
+      OutputDebugStringA(line.c_str());
+      occlusion_stats_line_ = line;
+    }
+  }
+
+  const XMMATRIX camera_view = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.view));
+  const XMMATRIX camera_proj = XMMatrixTranspose(XMLoadFloat4x4(&scene_constant_buffer_.proj));
+  occlusion_object_number_ = draw_arguments.size();
+  occlusion_culler_.BeginCull(XMMatrixMultiply(camera_view, camera_proj), cameras_[camera_index_].mEye, draw_arguments, candidates);
+}
+
+void Scene::UpdateShadowCache()
+{
+  // Casters are only hashed again when the draw table changed.
+  AssetsManager& assets_manager = AssetsManager::GetSharedInstance();
+  const UINT64 draw_arguments_version = assets_manager.GetDrawArgumentsVersion();
+  if (draw_arguments_version != hashed_draw_arguments_version_) {
+    static_casters_version_ = ShadowCache::kHashSeed;
+    dynamic_casters_version_ = ShadowCache::kHashSeed;
+    const std::vector<AssetsManager::DrawArgument>& draw_arguments = assets_manager.GetModelDrawArguments();
+    for (UINT object_index = 0; object_index < draw_arguments.size(); ++object_index) {
+      const AssetsManager::DrawArgument& draw_argument = draw_arguments[object_index];
+      UINT64& version = draw_argument.dynamic ? dynamic_casters_version_ : static_casters_version_;
+      version = ShadowCache::Hash(&object_index, sizeof(object_index), version);
+      version = ShadowCache::Hash(&draw_argument.index_count, sizeof(draw_argument.index_count), version);
+      version = ShadowCache::Hash(&draw_argument.index_start, sizeof(draw_argument.index_start), version);
+      version = ShadowCache::Hash(&draw_argument.vertex_base, sizeof(draw_argument.vertex_base), version);
+      version = ShadowCache::Hash(&draw_argument.model_transform, sizeof(draw_argument.model_transform), version);
+    }
+    hashed_draw_arguments_version_ = draw_arguments_version;
+  }
+
+  // The light's matrices cover everything else the map depends on, cascades following the camera included.
+  UINT64 light_version = ShadowCache::Hash(&scene_constant_buffer_.light_type, sizeof(scene_constant_buffer_.light_type));
+  light_version = ShadowCache::Hash(&scene_constant_buffer_.light_world_direction_or_position, sizeof(scene_constant_buffer_.light_world_direction_or_position), light_version);
+  const bool is_point_light = scene_constant_buffer_.light_type == static_cast<int>(LightType::kPointLight);
+  if (is_point_light) {
+    light_version = ShadowCache::Hash(cube_shadow_constant_buffer_.face_view_projs, sizeof(cube_shadow_constant_buffer_.face_view_projs), light_version);
+  }
+  else {
+    light_version = ShadowCache::Hash(&scene_constant_buffer_.cascade_number, sizeof(scene_constant_buffer_.cascade_number), light_version);
+    light_version = ShadowCache::Hash(scene_constant_buffer_.light_view_proj_transforms, scene_constant_buffer_.cascade_number * sizeof(XMFLOAT4X4), light_version);
+    light_version = ShadowCache::Hash(&scene_constant_buffer_.shadow_atlas_tile, sizeof(scene_constant_buffer_.shadow_atlas_tile), light_version);
+  }
+
+  ShadowCache& shadow_cache = is_point_light ? cube_shadow_cache_ : shadow_cache_;
+  shadow_cache_action_ = shadow_cache.Update({ light_version, static_casters_version_, dynamic_casters_version_ });
 }
 
 void Scene::CommitConstantBuffers(UINT object_index)
 {
-  memcpy(reinterpret_cast<uint8_t*>(scene_constant_buffer_pointers_[current_frame_index_]) + object_index * scene_constant_buffer_aligned_size_, &scene_constant_buffer_, sizeof(scene_constant_buffer_));
+  object_constants_addresses_[object_index] = constant_buffer_ring_.Commit(scene_constant_buffer_);
 }
 
 void Scene::CommitConstantBuffersForAllObjects()
 {
-  std::vector<AssetsManager::DrawArgument> draw_arguments;
-  AssetsManager::GetSharedInstance().GetModelDrawArguments(draw_arguments);
-  UINT object_index = 0;
-  for (const auto& draw_argument : draw_arguments) {
-    scene_constant_buffer_.model = draw_argument.model_transform;
-    CommitConstantBuffers(object_index);
-    object_index++;
+  // The instanced passes and the cameras share one copy, whose model they don't read. Only the cube shadow pass
+  // draws objects one by one, with their own.
+  scene_constants_address_ = constant_buffer_ring_.Commit(scene_constant_buffer_);
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  object_constants_addresses_.resize(draw_arguments.size());
+  if (scene_constant_buffer_.light_type == static_cast<int>(LightType::kPointLight)) {
+    UINT object_index = 0;
+    for (const auto& draw_argument : draw_arguments) {
+      scene_constant_buffer_.model = draw_argument.model_transform;
+      CommitConstantBuffers(object_index);
+      object_index++;
+    }
+  }
+
+  if (log_frame_stats_ && constant_buffer_ring_.GetGrowthNumber() != logged_constant_buffer_ring_growth_number_) {
+    const std::string line = "Constant buffer ring grown to " + std::to_string(constant_buffer_ring_.GetCapacity()) + " bytes\n";
+    OutputDebugStringA(line.c_str());
+    logged_constant_buffer_ring_growth_number_ = constant_buffer_ring_.GetGrowthNumber();
+  }
+}
+
+void Scene::CreateAndMapInstanceTransformBuffers(ID3D12Device* device)
+{
+  const size_t object_number = AssetsManager::GetSharedInstance().GetModelDrawArguments().size();
+  instance_transform_capacity_ = static_cast<UINT>(std::max<size_t>((1 + CascadedShadowMap::kMaxCascadeNumber) * object_number, 1));
+  instance_transform_buffers_.clear();
+  instance_transform_buffers_.resize(frame_count_);
+  instance_transform_pointers_.clear();
+  instance_transform_pointers_.resize(frame_count_);
+
+  CD3DX12_HEAP_PROPERTIES upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  CD3DX12_RESOURCE_DESC buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(XMFLOAT4X4) * instance_transform_capacity_);
+  for (UINT i = 0; i < frame_count_; ++i) {
+    ThrowIfFailed(device->CreateCommittedResource(&upload_heap_properties,
+      D3D12_HEAP_FLAG_NONE,
+      &buffer_desc,
+      D3D12_RESOURCE_STATE_GENERIC_READ,
+      nullptr,
+      IID_PPV_ARGS(&instance_transform_buffers_[i])));
+    NAME_D3D12_OBJECT_INDEXED(instance_transform_buffers_, i);
+    const CD3DX12_RANGE read_range(0, 0);
+    ThrowIfFailed(instance_transform_buffers_[i]->Map(0, &read_range, reinterpret_cast<void**>(&instance_transform_pointers_[i])));
+  }
+}
+
+void Scene::CreateCommandSignatures(ID3D12Device* device)
+{
+  if (indirect_draw_mode_ == IndirectDrawBuilder::Mode::kOff) {
+    return;
+  }
+
+  // Laid out as IndirectDrawBuilder::DrawRecord: the root SRV of the batch's instance transforms, then the draw.
+  D3D12_INDIRECT_ARGUMENT_DESC argument_descs[2]{};
+  argument_descs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+  argument_descs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+  D3D12_COMMAND_SIGNATURE_DESC command_signature_desc{};
+  command_signature_desc.ByteStride = IndirectDrawBuilder::kRecordStride;
+  command_signature_desc.NumArgumentDescs = _countof(argument_descs);
+  command_signature_desc.pArgumentDescs = argument_descs;
+
+  argument_descs[0].ShaderResourceView.RootParameterIndex = 2;  // see CreateShadowPipelineState
+  ThrowIfFailed(device->CreateCommandSignature(&command_signature_desc, shadow_root_signature_.Get(), IID_PPV_ARGS(&shadow_command_signature_)));
+  NAME_D3D12_OBJECT(shadow_command_signature_);
+  argument_descs[0].ShaderResourceView.RootParameterIndex = 5;  // see CreateScenePipelineState
+  ThrowIfFailed(device->CreateCommandSignature(&command_signature_desc, scene_root_signature_.Get(), IID_PPV_ARGS(&scene_command_signature_)));
+  NAME_D3D12_OBJECT(scene_command_signature_);
+}
+
+void Scene::CreateAndMapIndirectArgumentBuffers(ID3D12Device* device)
+{
+  indirect_argument_buffers_.clear();
+  indirect_argument_pointers_.clear();
+  indirect_count_buffers_.clear();
+  indirect_count_pointers_.clear();
+  if (indirect_draw_mode_ == IndirectDrawBuilder::Mode::kOff) {
+    return;
+  }
+
+  // Upload heaps stay in GENERIC_READ, which covers INDIRECT_ARGUMENT.
+  indirect_argument_buffers_.resize(frame_count_);
+  indirect_argument_pointers_.resize(frame_count_);
+  indirect_count_buffers_.resize(frame_count_);
+  indirect_count_pointers_.resize(frame_count_);
+  CD3DX12_HEAP_PROPERTIES upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  CD3DX12_RESOURCE_DESC argument_buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(static_cast<UINT64>(IndirectDrawBuilder::kRecordStride) * instance_transform_capacity_);
+  CD3DX12_RESOURCE_DESC count_buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT) * instance_transform_capacity_);
+  const CD3DX12_RANGE read_range(0, 0);
+  for (UINT i = 0; i < frame_count_; ++i) {
+    ThrowIfFailed(device->CreateCommittedResource(&upload_heap_properties,
+      D3D12_HEAP_FLAG_NONE,
+      &argument_buffer_desc,
+      D3D12_RESOURCE_STATE_GENERIC_READ,
+      nullptr,
+      IID_PPV_ARGS(&indirect_argument_buffers_[i])));
+    NAME_D3D12_OBJECT_INDEXED(indirect_argument_buffers_, i);
+    ThrowIfFailed(indirect_argument_buffers_[i]->Map(0, &read_range, reinterpret_cast<void**>(&indirect_argument_pointers_[i])));
+
+    if (indirect_draw_mode_ == IndirectDrawBuilder::Mode::kCounted) {
+      ThrowIfFailed(device->CreateCommittedResource(&upload_heap_properties,
+        D3D12_HEAP_FLAG_NONE,
+        &count_buffer_desc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&indirect_count_buffers_[i])));
+      NAME_D3D12_OBJECT_INDEXED(indirect_count_buffers_, i);
+      ThrowIfFailed(indirect_count_buffers_[i]->Map(0, &read_range, reinterpret_cast<void**>(&indirect_count_pointers_[i])));
+    }
   }
 }
 
@@ -776,101 +1591,448 @@ void Scene::SetCameras()
 void Scene::PopulateCommandLists()
 {
   ThrowIfFailed(command_allocators_[current_frame_index_]->Reset());
+  for (UINT worker_index = 0; worker_index < recording_thread_number_ && !part_command_allocators_.empty(); ++worker_index) {
+    ThrowIfFailed(part_command_allocators_[current_frame_index_ * recording_thread_number_ + worker_index]->Reset());
+  }
+  used_command_list_number_ = 0;
+  submitted_command_lists_.clear();
+  command_list_ = AcquireCommandList();
   ThrowIfFailed(command_list_->Reset(command_allocators_[current_frame_index_].Get(), nullptr));
+  instance_transform_number_ = 0;
+  instanced_object_number_ = 0;
+  instance_batch_number_ = 0;
+  indirect_record_number_ = 0;
+  indirect_call_number_ = 0;
   CD3DX12_RESOURCE_BARRIER resource_barrier = CD3DX12_RESOURCE_BARRIER::Transition(render_targets_[current_frame_index_].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
   command_list_->ResourceBarrier(1, &resource_barrier);
 
-  ShadowPass();
+  ShadowMapPass();
 
-  CD3DX12_RESOURCE_BARRIER depth_resource_barrier = CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[0].Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-  command_list_->ResourceBarrier(1, &depth_resource_barrier);
+  // The shadow map is also read by the moments' compute shader.
+  const D3D12_RESOURCE_STATES shadow_map_read_state = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+  D3D12_RESOURCE_BARRIER depth_resource_barriers[]{
+    CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[0].Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, shadow_map_read_state),
+    CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[2].Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+  };
+  command_list_->ResourceBarrier(_countof(depth_resource_barriers), depth_resource_barriers);
 
+  MomentsPass();
   ScenePass();
   DrawCameras();
 
   resource_barrier = CD3DX12_RESOURCE_BARRIER::Transition(render_targets_[current_frame_index_].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-  depth_resource_barrier = CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[0].Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-  D3D12_RESOURCE_BARRIER resource_barriers[]{ resource_barrier, depth_resource_barrier };
-  command_list_->ResourceBarrier(2, resource_barriers);
+  D3D12_RESOURCE_BARRIER resource_barriers[]{
+    resource_barrier,
+    CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[0].Get(), shadow_map_read_state, D3D12_RESOURCE_STATE_DEPTH_WRITE),
+    CD3DX12_RESOURCE_BARRIER::Transition(depth_textures_[2].Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE),
+  };
+  command_list_->ResourceBarrier(_countof(resource_barriers), resource_barriers);
 
+  ThrowIfFailed(command_list_->Close());
+  submitted_command_lists_.push_back(command_list_.Get());
 
+  std::string line = "Instancing: " + std::to_string(instanced_object_number_) + " objects in " + std::to_string(instance_batch_number_) + " draws";
+  if (indirect_draw_mode_ != IndirectDrawBuilder::Mode::kOff) {
+    line += " through " + std::to_string(indirect_call_number_.load()) + " ExecuteIndirect calls";
+  }
+  line += "\n";
+  if (log_frame_stats_ && line != instancing_stats_line_) {
+    OutputDebugStringA(line.c_str());
+    instancing_stats_line_ = line;
+  }
 
-  ThrowIfFailed(command_list_->Close());
+  if (log_frame_stats_ && recording_thread_number_ > 1) {
+    line = "Recording: " + std::to_string(submitted_command_lists_.size()) + " command lists on " + std::to_string(recording_thread_number_) + " threads\n";
+    if (line != recording_stats_line_) {
+      OutputDebugStringA(line.c_str());
+      recording_stats_line_ = line;
+    }
+  }
 }
 
-void Scene::ShadowPass()
+ID3D12GraphicsCommandList* Scene::AcquireCommandList()
 {
-  command_list_->SetPipelineState(shadow_pipeline_state_.Get());
-  command_list_->SetGraphicsRootSignature(shadow_root_signature_.Get());
-  // command_list_->SetGraphicsRootConstantBufferView(0, scene_constant_buffer_view_->GetGPUVirtualAddress());
+  // Handed out closed. Only called while no list records into the frame's allocator, so a new list can be
+  // created on it and closed straight away.
+  if (used_command_list_number_ == command_list_pool_.size()) {
+    ComPtr<ID3D12Device> device;
+    ThrowIfFailed(command_list_pool_.front()->GetDevice(IID_PPV_ARGS(&device)));
+    ComPtr<ID3D12GraphicsCommandList> command_list;
+    ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, command_allocators_[current_frame_index_].Get(), nullptr, IID_PPV_ARGS(&command_list)));
+    ThrowIfFailed(command_list->Close());
+    command_list_pool_.push_back(command_list);
+    NAME_D3D12_OBJECT_INDEXED(command_list_pool_, static_cast<UINT>(command_list_pool_.size() - 1));
+  }
+  return command_list_pool_[used_command_list_number_++].Get();
+}
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart());
-  command_list_->ClearDepthStencilView(dsv_cpu_descriptor_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
-  dsv_cpu_descriptor_handle.Offset(dsv_descriptor_size_);
-  command_list_->ClearDepthStencilView(dsv_cpu_descriptor_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+void Scene::RecordPass(size_t item_number, const std::function<void(ID3D12GraphicsCommandList*)>& set_state,
+                       const std::function<void(ID3D12GraphicsCommandList*, size_t, size_t)>& record)
+{
+  // The items are split in contiguous parts and the lists submitted in part order, so the GPU sees the draws in
+  // the order one list would have recorded them.
+  PassRecorder pass_recorder(*this, set_state, record);
+  parallel_recorder_->Record(item_number, pass_recorder);
+}
 
-  command_list_->IASetVertexBuffers(0, 1, &vertex_buffer_view_);
-  command_list_->IASetIndexBuffer(&index_buffer_view_);
-  command_list_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+void Scene::ShadowMapPass()
+{
+  // The light the constants were last updated for.
+  const bool is_point_light = scene_constant_buffer_.light_type == static_cast<int>(LightType::kPointLight);
+  ShadowCache& shadow_cache = is_point_light ? cube_shadow_cache_ : shadow_cache_;
+  ID3D12Resource* shadow_map = depth_textures_[is_point_light ? 2 : 0].Get();
+  ID3D12Resource* static_layer = is_point_light ? static_cube_shadow_layer_.Get() : static_shadow_layer_.Get();
+  const auto draw_casters = [this, is_point_light](CasterSet caster_set, bool clear) {
+    return is_point_light ? CubeShadowPass(caster_set, clear) : ShadowPass(caster_set, clear);
+  };
 
-  command_list_->RSSetViewports(1, &view_port_);
-  command_list_->RSSetScissorRects(1, &scissor_rect_);
+  // The map is shared by every frame in flight; left alone, it still holds what an earlier frame drew.
+  UINT draw_number = 0;
+  switch (shadow_cache_action_) {
+    case ShadowCache::Action::kRedrawDynamic:
+      CopyStaticShadowLayer(shadow_map, static_layer, false);
+      draw_number = draw_casters(CasterSet::kDynamic, false);
+      break;
 
-  dsv_cpu_descriptor_handle = dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart();
-  command_list_->OMSetRenderTargets(0, nullptr, false, &dsv_cpu_descriptor_handle);
+    case ShadowCache::Action::kRedrawAll:
+      if (shadow_cache.GetMode() == ShadowCache::Mode::kStaticDynamicSplit) {
+        draw_number = draw_casters(CasterSet::kStatic, true);
+        CopyStaticShadowLayer(shadow_map, static_layer, true);
+        draw_number += draw_casters(CasterSet::kDynamic, false);
+      }
+      else {
+        draw_number = draw_casters(CasterSet::kAll, true);
+      }
+      break;
 
-  std::vector<AssetsManager::DrawArgument> draw_arguments;
-  AssetsManager::GetSharedInstance().GetModelDrawArguments(draw_arguments);
-  UINT object_index = 0;
-  for (const auto& draw_argument : draw_arguments) {
-    command_list_->SetGraphicsRootConstantBufferView(0, scene_constant_buffer_views_[current_frame_index_]->GetGPUVirtualAddress() + object_index * scene_constant_buffer_aligned_size_);
-    command_list_->DrawIndexedInstanced(draw_argument.index_count, 1, draw_argument.index_start, draw_argument.vertex_base, 0);
+    default:
+      break;
+  }
 
-    object_index++;
+  UINT full_draw_number = is_point_light ? cube_shadow_draw_stats_.draw_number : 0;
+  for (UINT cascade_index = 0; !is_point_light && cascade_index < static_cast<UINT>(scene_constant_buffer_.cascade_number); ++cascade_index) {
+    full_draw_number += static_cast<UINT>(visible_objects_[1 + cascade_index].size());
+  }
+  const ShadowCache::FrameStats previous_stats = shadow_cache.GetFrameStats();
+  const ShadowCache::FrameStats& stats = shadow_cache.RecordFrame(draw_number, full_draw_number);
+  if (log_frame_stats_ && (stats.action != previous_stats.action || stats.draw_number != previous_stats.draw_number || stats.saved_draw_number != previous_stats.saved_draw_number)) {
+    const std::wstring line = std::wstring(L"Shadow cache: map ") + ShadowCache::GetActionName(stats.action) + L", " + std::to_wstring(stats.draw_number) +
+      L" draws, " + std::to_wstring(stats.saved_draw_number) + L" saved; " + std::to_wstring(shadow_cache.GetTotalSavedDrawNumber()) + L" saved over " +
+      std::to_wstring(shadow_cache.GetFrameNumber()) + L" frames, " + std::to_wstring(shadow_cache.GetReusedFrameNumber()) + L" of them reused\n";
+    OutputDebugStringW(line.c_str());
   }
 }
 
-void Scene::ScenePass()
+void Scene::CopyStaticShadowLayer(ID3D12Resource* shadow_map, ID3D12Resource* static_layer, bool save)
 {
-  command_list_->SetPipelineState(scene_pipeline_state_.Get());
-  // Set descriptor heaps.
+  // The shadow map rests in DEPTH_WRITE, the static layer in COPY_DEST.
+  const D3D12_RESOURCE_STATES shadow_map_copy_state = save ? D3D12_RESOURCE_STATE_COPY_SOURCE : D3D12_RESOURCE_STATE_COPY_DEST;
+  const D3D12_RESOURCE_STATES static_layer_copy_state = save ? D3D12_RESOURCE_STATE_COPY_DEST : D3D12_RESOURCE_STATE_COPY_SOURCE;
+  D3D12_RESOURCE_BARRIER copy_barriers[]{
+    CD3DX12_RESOURCE_BARRIER::Transition(shadow_map, D3D12_RESOURCE_STATE_DEPTH_WRITE, shadow_map_copy_state),
+    CD3DX12_RESOURCE_BARRIER::Transition(static_layer, D3D12_RESOURCE_STATE_COPY_DEST, static_layer_copy_state),
+  };
+  const UINT copy_barrier_number = save ? 1 : 2;
+  command_list_->ResourceBarrier(copy_barrier_number, copy_barriers);
+
+  if (save) {
+    command_list_->CopyResource(static_layer, shadow_map);
+  }
+  else {
+    command_list_->CopyResource(shadow_map, static_layer);
+  }
+
+  D3D12_RESOURCE_BARRIER rest_barriers[]{
+    CD3DX12_RESOURCE_BARRIER::Transition(shadow_map, shadow_map_copy_state, D3D12_RESOURCE_STATE_DEPTH_WRITE),
+    CD3DX12_RESOURCE_BARRIER::Transition(static_layer, static_layer_copy_state, D3D12_RESOURCE_STATE_COPY_DEST),
+  };
+  command_list_->ResourceBarrier(copy_barrier_number, rest_barriers);
+}
+
+void Scene::MomentsPass()
+{
+  // The moments only change with the map they are built from; the point light's cube is filtered directly.
+  const bool is_point_light = scene_constant_buffer_.light_type == static_cast<int>(LightType::kPointLight);
+  if (moments_texture_ == nullptr || is_point_light || shadow_cache_action_ == ShadowCache::Action::kReuse) {
+    return;
+  }
+
+  command_list_->SetComputeRootSignature(moments_root_signature_.Get());
   ID3D12DescriptorHeap* ppHeaps[] = { cbv_srv_descriptor_heap_.Get() };
   command_list_->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+  const D3D12_GPU_DESCRIPTOR_HANDLE cbv_srv_heap_start = cbv_srv_descriptor_heap_->GetGPUDescriptorHandleForHeapStart();
+  const auto get_moments_descriptor = [this, &cbv_srv_heap_start](UINT offset) {
+    return CD3DX12_GPU_DESCRIPTOR_HANDLE(cbv_srv_heap_start, kMomentsDescriptorIndex_ + offset, cbv_srv_descriptor_increment_size_);
+  };
+  const UINT blur_srv_offset = 1;
+  const UINT blur_uav_offset = 2;
+  const auto get_mip_srv_offset = [](UINT mip) { return 3 + 2 * mip; };
+  const auto get_mip_uav_offset = [](UINT mip) { return 4 + 2 * mip; };
+  const auto get_group_number = [](UINT texel_number) { return (texel_number + 7) / 8; };
+  const UINT size = std::max(shadow_settings_.resolution / 2, 1u);
+  const UINT slice_number = static_cast<UINT>(scene_constant_buffer_.cascade_number);
+
+  // The shadow map's moments into mip 0.
+  TransitionMomentsMip(0, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  command_list_->SetPipelineState(generate_moments_pipeline_state_.Get());
+  command_list_->SetComputeRootDescriptorTable(1, cbv_srv_heap_start);  // the shadow map's SRV comes first
+  command_list_->SetComputeRootDescriptorTable(2, get_moments_descriptor(get_mip_uav_offset(0)));
+  command_list_->Dispatch(get_group_number(size), get_group_number(size), slice_number);
+
+  // Blurred horizontally into the blur texture, then vertically back into mip 0.
+  TransitionMomentsMip(0, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  CD3DX12_RESOURCE_BARRIER blur_barrier = CD3DX12_RESOURCE_BARRIER::Transition(moments_blur_texture_.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  command_list_->ResourceBarrier(1, &blur_barrier);
+  command_list_->SetPipelineState(blur_moments_pipeline_state_.Get());
+  const INT horizontal[] = { 1, 0 };
+  command_list_->SetComputeRoot32BitConstants(0, _countof(horizontal), horizontal, 0);
+  command_list_->SetComputeRootDescriptorTable(1, get_moments_descriptor(get_mip_srv_offset(0)));
+  command_list_->SetComputeRootDescriptorTable(2, get_moments_descriptor(blur_uav_offset));
+  command_list_->Dispatch(get_group_number(size), get_group_number(size), slice_number);
+
+  blur_barrier = CD3DX12_RESOURCE_BARRIER::Transition(moments_blur_texture_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+  command_list_->ResourceBarrier(1, &blur_barrier);
+  TransitionMomentsMip(0, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+  const INT vertical[] = { 0, 1 };
+  command_list_->SetComputeRoot32BitConstants(0, _countof(vertical), vertical, 0);
+  command_list_->SetComputeRootDescriptorTable(1, get_moments_descriptor(blur_srv_offset));
+  command_list_->SetComputeRootDescriptorTable(2, get_moments_descriptor(get_mip_uav_offset(0)));
+  command_list_->Dispatch(get_group_number(size), get_group_number(size), slice_number);
+
+  // Each mip averages the one above it.
+  command_list_->SetPipelineState(downsample_moments_pipeline_state_.Get());
+  for (UINT mip = 1; mip < moments_mip_number_; ++mip) {
+    TransitionMomentsMip(mip - 1, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    TransitionMomentsMip(mip, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    command_list_->SetComputeRootDescriptorTable(1, get_moments_descriptor(get_mip_srv_offset(mip - 1)));
+    command_list_->SetComputeRootDescriptorTable(2, get_moments_descriptor(get_mip_uav_offset(mip)));
+    const UINT mip_size = std::max(size >> mip, 1u);
+    command_list_->Dispatch(get_group_number(mip_size), get_group_number(mip_size), slice_number);
+  }
 
-  command_list_->SetGraphicsRootSignature(scene_root_signature_.Get());
-  // command_list_->SetGraphicsRootConstantBufferView(1, scene_constant_buffer_view_->GetGPUVirtualAddress());
+  // Back to where the scene pass samples them.
+  TransitionMomentsMip(moments_mip_number_ - 1, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  for (UINT mip = 0; mip + 1 < moments_mip_number_; ++mip) {
+    TransitionMomentsMip(mip, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+  }
+}
 
-  CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_cpu_descriptor_handle(rtv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), current_frame_index_, rtv_descriptor_increment_size_);
-  const FLOAT clear_color[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-  command_list_->ClearRenderTargetView(rtv_cpu_descriptor_handle, clear_color, 0, nullptr);
+void Scene::TransitionMomentsMip(UINT mip, D3D12_RESOURCE_STATES before_state, D3D12_RESOURCE_STATES after_state)
+{
+  // A mip of a texture array is a subresource in every slice.
+  D3D12_RESOURCE_BARRIER barriers[CascadedShadowMap::kMaxCascadeNumber];
+  const UINT slice_number = moments_texture_->GetDesc().DepthOrArraySize;
+  for (UINT slice = 0; slice < slice_number; ++slice) {
+    barriers[slice] = CD3DX12_RESOURCE_BARRIER::Transition(moments_texture_.Get(), before_state, after_state,
+      D3D12CalcSubresource(mip, slice, 0, moments_mip_number_, slice_number));
+  }
+  command_list_->ResourceBarrier(slice_number, barriers);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS Scene::PrepareInstanceBatches(const std::vector<UINT>& objects, bool match_textures)
+{
+  // Batch i's transforms start first_instance transforms past the returned address, which its root SRV points at.
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  AssetsManager::BuildInstanceBatches(draw_arguments, objects, match_textures, instance_batches_, instance_objects_);
+  if (instance_objects_.size() > instance_transform_capacity_ - instance_transform_number_) {
+    // Only if models were inserted after the buffers were sized; better to drop the draws than to overrun.
+    instance_batches_.clear();
+    instance_objects_.clear();
+    return 0;
+  }
 
-  command_list_->IASetVertexBuffers(0, 1, &vertex_buffer_view_);
+  XMFLOAT4X4* transforms = instance_transform_pointers_[current_frame_index_] + instance_transform_number_;
+  for (size_t i = 0; i < instance_objects_.size(); ++i) {
+    transforms[i] = draw_arguments[instance_objects_[i]].model_transform;
+  }
+  const D3D12_GPU_VIRTUAL_ADDRESS transforms_address = instance_transform_buffers_[current_frame_index_]->GetGPUVirtualAddress() +
+    sizeof(XMFLOAT4X4) * instance_transform_number_;
+  instance_transform_number_ += static_cast<UINT>(instance_objects_.size());
+  instanced_object_number_ += static_cast<UINT>(instance_objects_.size());
+  instance_batch_number_ += static_cast<UINT>(instance_batches_.size());
+  // A record per batch, which never outnumber the transforms, so they fit too.
+  indirect_record_base_ = indirect_record_number_;
+  indirect_record_number_ += static_cast<UINT>(instance_batches_.size());
+  return transforms_address;
+}
+
+void Scene::DrawInstanceBatches(ID3D12GraphicsCommandList* command_list, UINT transforms_root_parameter_index, ID3D12CommandSignature* command_signature,
+                                D3D12_GPU_VIRTUAL_ADDRESS transforms_address, size_t batch_begin, size_t batch_end)
+{
+  if (indirect_draw_mode_ == IndirectDrawBuilder::Mode::kOff) {
+    for (size_t i = batch_begin; i < batch_end; ++i) {
+      const AssetsManager::InstanceBatch& batch = instance_batches_[i];
+      command_list->SetGraphicsRootShaderResourceView(transforms_root_parameter_index, transforms_address + sizeof(XMFLOAT4X4) * batch.first_instance);
+      command_list->DrawIndexedInstanced(batch.index_count, batch.instance_number, batch.index_start, batch.vertex_base, 0);
+    }
+    return;
+  }
+
+  // Batch i's record is at indirect_record_base_ + i, so the recording threads never write the same one; the
+  // command signature sets the root SRV itself. A call's count goes in the slot of its first record.
+  const UINT record_index = indirect_record_base_ + static_cast<UINT>(batch_begin);
+  IndirectDrawBuilder::DrawRecord* records = indirect_argument_pointers_[current_frame_index_] + record_index;
+  const UINT record_number = IndirectDrawBuilder::WriteRecords(instance_batches_.data() + batch_begin, static_cast<UINT>(batch_end - batch_begin),
+    transforms_address, sizeof(XMFLOAT4X4), records, static_cast<UINT>(batch_end - batch_begin));
+  if (record_number == 0) {
+    return;
+  }
+  const UINT64 argument_offset = static_cast<UINT64>(IndirectDrawBuilder::kRecordStride) * record_index;
+  if (indirect_draw_mode_ == IndirectDrawBuilder::Mode::kCounted) {
+    // The GPU draws the smaller of the count and MaxCommandCount.
+    indirect_count_pointers_[current_frame_index_][record_index] = record_number;
+    command_list->ExecuteIndirect(command_signature, record_number, indirect_argument_buffers_[current_frame_index_].Get(), argument_offset,
+      indirect_count_buffers_[current_frame_index_].Get(), sizeof(UINT) * static_cast<UINT64>(record_index));
+  }
+  else {
+    command_list->ExecuteIndirect(command_signature, record_number, indirect_argument_buffers_[current_frame_index_].Get(), argument_offset, nullptr, 0);
+  }
+  indirect_call_number_++;
+}
+
+UINT Scene::ShadowPass(CasterSet caster_set, bool clear)
+{
+  // Every object inside a cascade's frustum is drawn into the cascade's slice of the shadow map, an instanced draw
+  // per mesh. Only the model transform differs between the objects' constants, so any object's will do.
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  UINT draw_number = 0;
+  for (UINT cascade_index = 0; cascade_index < static_cast<UINT>(scene_constant_buffer_.cascade_number); ++cascade_index) {
+    CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), cascade_index, dsv_descriptor_size_);
+    if (clear) {
+      command_list_->ClearDepthStencilView(dsv_cpu_descriptor_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 1, &shadow_tile_clear_rect_);
+    }
+    const auto set_state = [this, cascade_index, &dsv_cpu_descriptor_handle](ID3D12GraphicsCommandList* command_list) {
+      command_list->SetPipelineState(shadow_pipeline_state_.Get());
+      command_list->SetGraphicsRootSignature(shadow_root_signature_.Get());
+
+      command_list->IASetVertexBuffers(0, 1, vertex_buffer_views_);  // positions only
+      command_list->IASetIndexBuffer(&index_buffer_view_);
+      command_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+      command_list->RSSetViewports(1, &shadow_tile_view_port_);
+      command_list->RSSetScissorRects(1, &shadow_tile_scissor_rect_);
+
+      command_list->OMSetRenderTargets(0, nullptr, false, &dsv_cpu_descriptor_handle);
+      command_list->SetGraphicsRootConstantBufferView(0, scene_constants_address_);
+      command_list->SetGraphicsRoot32BitConstant(1, cascade_index, 0);
+    };
+    set_state(command_list_.Get());
+
+    caster_objects_.clear();
+    for (UINT object_index : visible_objects_[1 + cascade_index]) {
+      if (object_index < draw_arguments.size() && IsInCasterSet(draw_arguments[object_index].dynamic, caster_set)) {
+        caster_objects_.push_back(object_index);
+      }
+    }
+    const D3D12_GPU_VIRTUAL_ADDRESS transforms_address = PrepareInstanceBatches(caster_objects_, false);
+    RecordPass(instance_batches_.size(), set_state, [this, transforms_address](ID3D12GraphicsCommandList* command_list, size_t batch_begin, size_t batch_end) {
+      DrawInstanceBatches(command_list, 2, shadow_command_signature_.Get(), transforms_address, batch_begin, batch_end);
+      });
+    draw_number += static_cast<UINT>(instance_objects_.size());
+  }
+  // Objects drawn rather than draws, as the shadow cache weighs them against the frustum lists.
+  return draw_number;
+}
+
+UINT Scene::CubeShadowPass(CasterSet caster_set, bool clear)
+{
+  command_list_->SetPipelineState(cube_shadow_pipeline_state_.Get());
+  command_list_->SetGraphicsRootSignature(cube_shadow_root_signature_.Get());
+  command_list_->SetGraphicsRootConstantBufferView(2, cube_shadow_constants_address_);
+
+  command_list_->IASetVertexBuffers(0, 1, vertex_buffer_views_);  // positions only
   command_list_->IASetIndexBuffer(&index_buffer_view_);
   command_list_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-  command_list_->RSSetViewports(1, &view_port_);
-  command_list_->RSSetScissorRects(1, &scissor_rect_);
+  command_list_->RSSetViewports(1, &cube_shadow_view_port_);
+  command_list_->RSSetScissorRects(1, &cube_shadow_scissor_rect_);
 
-  // 1: scene depth texture (0: shadow depth texture)
-  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), 1, dsv_descriptor_size_);
-  command_list_->OMSetRenderTargets(1, &rtv_cpu_descriptor_handle, false, &dsv_cpu_descriptor_handle);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kCubeShadowDsvIndex_, dsv_descriptor_size_);
+  if (clear) {
+    command_list_->ClearDepthStencilView(dsv_cpu_descriptor_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+  }
+  command_list_->OMSetRenderTargets(0, nullptr, false, &dsv_cpu_descriptor_handle);
 
-  std::vector<AssetsManager::DrawArgument> draw_arguments;
-  AssetsManager::GetSharedInstance().GetModelDrawArguments(draw_arguments);
-  const D3D12_GPU_DESCRIPTOR_HANDLE cbv_srv_heap_start = cbv_srv_descriptor_heap_->GetGPUDescriptorHandleForHeapStart();
-  command_list_->SetGraphicsRootDescriptorTable(2, cbv_srv_heap_start);
-  UINT object_index = 0;
-  for (const auto& draw_argument : draw_arguments) {
-    if (draw_argument.diffuse_texture_index >= 0) {
-      CD3DX12_GPU_DESCRIPTOR_HANDLE texture_descritptor(cbv_srv_heap_start, kDepthBufferCount_ + draw_argument.diffuse_texture_index, cbv_srv_descriptor_increment_size_);
-      command_list_->SetGraphicsRootDescriptorTable(0, texture_descritptor);
+  // One draw per object for all six faces; the geometry shader routes its triangles to the faces in its mask.
+  const std::vector<AssetsManager::DrawArgument>& draw_arguments = AssetsManager::GetSharedInstance().GetModelDrawArguments();
+  UINT draw_number = 0;
+  for (UINT object_index = 0; object_index < draw_arguments.size() && object_index < cube_face_masks_.size(); ++object_index) {
+    const AssetsManager::DrawArgument& draw_argument = draw_arguments[object_index];
+    if (cube_face_masks_[object_index] == 0 || !IsInCasterSet(draw_argument.dynamic, caster_set)) {
+      continue;
     }
-
-    command_list_->SetGraphicsRootConstantBufferView(1, scene_constant_buffer_views_[current_frame_index_]->GetGPUVirtualAddress() + object_index * scene_constant_buffer_aligned_size_);
+    command_list_->SetGraphicsRootConstantBufferView(0, object_constants_addresses_[object_index]);
+    command_list_->SetGraphicsRoot32BitConstant(1, cube_face_masks_[object_index], 0);
     command_list_->DrawIndexedInstanced(draw_argument.index_count, 1, draw_argument.index_start, draw_argument.vertex_base, 0);
+    draw_number++;
+  }
+  return draw_number;
+}
+
+void Scene::ScenePass()
+{
+  CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_cpu_descriptor_handle(rtv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), current_frame_index_, rtv_descriptor_increment_size_);
+  const FLOAT clear_color[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  command_list_->ClearRenderTargetView(rtv_cpu_descriptor_handle, clear_color, 0, nullptr);
 
-    object_index++;
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dsv_cpu_descriptor_handle(dsv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), kSceneDepthDsvIndex_, dsv_descriptor_size_);
+  command_list_->ClearDepthStencilView(dsv_cpu_descriptor_handle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+  const D3D12_GPU_DESCRIPTOR_HANDLE cbv_srv_heap_start = cbv_srv_descriptor_heap_->GetGPUDescriptorHandleForHeapStart();
+  const auto set_state = [this, &rtv_cpu_descriptor_handle, &dsv_cpu_descriptor_handle, cbv_srv_heap_start](ID3D12GraphicsCommandList* command_list) {
+    command_list->SetPipelineState(scene_pipeline_state_.Get());
+    // Set descriptor heaps.
+    ID3D12DescriptorHeap* ppHeaps[] = { cbv_srv_descriptor_heap_.Get() };
+    command_list->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+
+    command_list->SetGraphicsRootSignature(scene_root_signature_.Get());
+
+    command_list->IASetVertexBuffers(0, vertex_buffer_view_number_, vertex_buffer_views_);
+    command_list->IASetIndexBuffer(&index_buffer_view_);
+    command_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    command_list->RSSetViewports(1, &view_port_);
+    command_list->RSSetScissorRects(1, &scissor_rect_);
+
+    command_list->OMSetRenderTargets(1, &rtv_cpu_descriptor_handle, false, &dsv_cpu_descriptor_handle);
+
+    // Every list starts with a valid texture table, as its part's first batches may have no texture.
+    command_list->SetGraphicsRootDescriptorTable(0, CD3DX12_GPU_DESCRIPTOR_HANDLE(cbv_srv_heap_start, kDefaultTextureDescriptorIndex_, cbv_srv_descriptor_increment_size_));
+    command_list->SetGraphicsRootDescriptorTable(2, cbv_srv_heap_start);
+    command_list->SetGraphicsRootDescriptorTable(3, CD3DX12_GPU_DESCRIPTOR_HANDLE(cbv_srv_heap_start, 2, cbv_srv_descriptor_increment_size_));
+    command_list->SetGraphicsRootDescriptorTable(4, CD3DX12_GPU_DESCRIPTOR_HANDLE(cbv_srv_heap_start, kMomentsDescriptorIndex_, cbv_srv_descriptor_increment_size_));
+    // An instanced draw per mesh and texture; the objects' constants only differ by the model transform.
+    command_list->SetGraphicsRootConstantBufferView(1, scene_constants_address_);
+  };
+  set_state(command_list_.Get());
+
+  const D3D12_GPU_VIRTUAL_ADDRESS transforms_address = PrepareInstanceBatches(visible_objects_[0], true);
+  if (indirect_draw_mode_ != IndirectDrawBuilder::Mode::kOff) {
+    // The texture table can't change inside an ExecuteIndirect, so the batches of a texture are drawn together.
+    std::stable_sort(instance_batches_.begin(), instance_batches_.end(), [](const AssetsManager::InstanceBatch& a, const AssetsManager::InstanceBatch& b) {
+      return a.diffuse_texture_index < b.diffuse_texture_index;
+      });
   }
+  // Each part sets the texture of its first batch, as it may start in the middle of another part's run.
+  RecordPass(instance_batches_.size(), set_state,
+    [this, transforms_address, cbv_srv_heap_start](ID3D12GraphicsCommandList* command_list, size_t part_begin, size_t part_end) {
+      for (size_t batch_begin = part_begin; batch_begin < part_end;) {
+        const int diffuse_texture_index = instance_batches_[batch_begin].diffuse_texture_index;
+        size_t batch_end = batch_begin + 1;
+        while (batch_end < part_end && instance_batches_[batch_end].diffuse_texture_index == diffuse_texture_index) {
+          batch_end++;
+        }
+        if (diffuse_texture_index >= 0) {
+          CD3DX12_GPU_DESCRIPTOR_HANDLE texture_descritptor(cbv_srv_heap_start, kDiffuseTextureDescriptorIndex_ + diffuse_texture_index, cbv_srv_descriptor_increment_size_);
+          command_list->SetGraphicsRootDescriptorTable(0, texture_descritptor);
+        } else {
+          command_list->SetGraphicsRootDescriptorTable(0, CD3DX12_GPU_DESCRIPTOR_HANDLE(cbv_srv_heap_start, kDefaultTextureDescriptorIndex_, cbv_srv_descriptor_increment_size_));
+        }
+
+        DrawInstanceBatches(command_list, 5, scene_command_signature_.Get(), transforms_address, batch_begin, batch_end);
+        batch_begin = batch_end;
+      }
+    });
 }
 
 void Scene::DrawCameras()
@@ -878,7 +2040,7 @@ void Scene::DrawCameras()
   command_list_->SetPipelineState(camera_draw_pipeline_state_.Get());
   command_list_->SetGraphicsRootSignature(camera_draw_root_signature_.Get());
   // TODO: need to call? yes
-  command_list_->SetGraphicsRootConstantBufferView(0, scene_constant_buffer_views_[current_frame_index_]->GetGPUVirtualAddress());
+  command_list_->SetGraphicsRootConstantBufferView(0, scene_constants_address_);
   
   UpdateVerticesOfCameraPoints();
   
@@ -886,6 +2048,10 @@ void Scene::DrawCameras()
   command_list_->IASetVertexBuffers(0, 1, &camera_points_vertex_buffer_view_);
   command_list_->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
 
+  // Set again, as the scene pass may have left them in another list.
+  command_list_->RSSetViewports(1, &view_port_);
+  command_list_->RSSetScissorRects(1, &scissor_rect_);
+
   CD3DX12_CPU_DESCRIPTOR_HANDLE rtv_cpu_descriptor_handle(rtv_descriptor_heap_->GetCPUDescriptorHandleForHeapStart(), current_frame_index_, rtv_descriptor_increment_size_);
   command_list_->OMSetRenderTargets(1, &rtv_cpu_descriptor_handle, false, nullptr);
   command_list_->DrawInstanced(kTotalCameraCount_ - 1, 1, 0, 0);
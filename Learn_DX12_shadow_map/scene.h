@@ -1,12 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "common_headers.h"
 #include "d3dx12.h"
+#include "assets_manager.h"
 #include "camera.h"
+#include "constant_buffer_ring.h"
+#include "cascaded_shadow_map.h"
+#include "cube_shadow_map.h"
 #include "directional_light.h"
+#include "frustum_culler.h"
+#include "indirect_draw_builder.h"
+#include "occlusion_culler.h"
+#include "parallel_recorder.h"
 #include "point_light.h"
+#include "shadow_atlas.h"
+#include "shadow_cache.h"
+#include "shadow_filter.h"
+#include "shadow_quality.h"
 #include "spot_light.h"
 
 using Microsoft::WRL::ComPtr;
@@ -26,8 +42,19 @@ struct SceneConstantBuffer {
   XMFLOAT4 light_world_direction_or_position;  // direction: directional_light, position: point light or spot light
   XMFLOAT4 light_color;
   XMFLOAT4 camera_world_pos;
-  XMFLOAT4X4 light_view_proj_transform;
+  XMFLOAT4X4 light_view_proj_transforms[CascadedShadowMap::kMaxCascadeNumber];  // the spot light only uses the first
+  XMFLOAT4 cascade_split_distances;  // view space depth where each cascade ends
+  XMFLOAT4 cascade_depth_biases;
+  XMFLOAT4 shadow_depth_params[CascadedShadowMap::kMaxCascadeNumber];  // for PCSS, see ShadowFilter::ComputePerspectiveDepthParams
+  XMFLOAT4 cube_shadow_depth_params;  // point light: x + y / view depth is the stored depth (CubeShadowMap::ComputeDepthParams), z: depth bias
+  XMFLOAT4 shadow_atlas_tile;  // spot light: uv scale in xy and offset in zw of its tile in the first slice
   int light_type;
+  int cascade_number;
+};
+
+// Read by the geometry shader of the point light's cube shadow pass.
+struct CubeShadowConstantBuffer {
+  XMFLOAT4X4 face_view_projs[CubeShadowMap::kFaceNumber];  // transposed
 };
 
 class Scene {
@@ -46,6 +73,63 @@ public:
     current_frame_index_ = frame_index;
   }
 
+  // Before each Update: the fence value the queue signals once the GPU is done with the frame about to be
+  // recorded, and the value it has reached, below which the constant buffer ring reuses what frames allocated.
+  void SetFrameFence(UINT64 fence_value, UINT64 completed_fence_value) {
+    constant_buffer_ring_.BeginFrame(fence_value, completed_fence_value);
+  }
+
+  // Must be called before Initialize. An empty name disables loading or cooking respectively.
+  void SetMeshCacheFileNames(const std::wstring& mesh_cache_file_name, const std::wstring& cook_mesh_cache_file_name) {
+    mesh_cache_file_name_ = mesh_cache_file_name;
+    cook_mesh_cache_file_name_ = cook_mesh_cache_file_name;
+  }
+
+  // Must be called before Initialize. Defaults to ShadowQuality::Tier::kHigh.
+  void SetShadowQuality(ShadowQuality::Tier tier) {
+    shadow_settings_ = ShadowQuality::GetSettings(tier);
+  }
+
+  // Must be called before Initialize: the mode is compiled into the scene pixel shader, and the moment modes
+  // need their own textures. Defaults to ShadowFilter::Mode::kPoint.
+  void SetShadowFilter(ShadowFilter::Mode mode) {
+    shadow_filter_mode_ = mode;
+  }
+
+  // Must be called before Initialize: the split needs a copy of each shadow map. Defaults to ShadowCache::Mode::kOn.
+  void SetShadowCacheMode(ShadowCache::Mode mode) {
+    shadow_cache_.SetMode(mode);
+    cube_shadow_cache_.SetMode(mode);
+  }
+
+  // Must be called before Initialize: pipeline states and vertex buffers are built for the layout. Defaults to
+  // AssetsManager::VertexStreamLayout::kDeinterleaved, so the shadow pass only fetches positions.
+  void SetVertexStreamLayout(AssetsManager::VertexStreamLayout vertex_stream_layout) {
+    vertex_stream_layout_ = vertex_stream_layout;
+  }
+
+  // Must be called before Initialize: command signatures and argument buffers are only made for the indirect
+  // modes. Defaults to IndirectDrawBuilder::Mode::kOff.
+  void SetIndirectDrawMode(IndirectDrawBuilder::Mode mode) {
+    indirect_draw_mode_ = mode;
+  }
+
+  // Must be called before Initialize: each recording thread gets command allocators of its own. Defaults to 1,
+  // every pass recorded on the render thread into one command list.
+  void SetRecordingThreadNumber(UINT thread_number) {
+    recording_thread_number_ = thread_number > 0 ? thread_number : 1;
+  }
+
+  // Logs the per frame stats of culling, batching, shadow caching and recording when they change. Defaults to off.
+  void SetFrameStatsLogging(bool enabled) {
+    log_frame_stats_ = enabled;
+  }
+
+  // What the last rendered frame did to the current light's shadow map.
+  const ShadowCache::FrameStats& GetShadowCacheFrameStats() const {
+    return scene_constant_buffer_.light_type == static_cast<int>(LightType::kPointLight) ? cube_shadow_cache_.GetFrameStats() : shadow_cache_.GetFrameStats();
+  }
+
 private:
   enum class LightType {
     kDirectionLight = 0,
@@ -54,31 +138,65 @@ private:
     kLightTypeNumber = 3,
   };
 
-  void CreateConstanfBuffer(ID3D12Device* device, UINT size, ID3D12Resource** ppResource, D3D12_RESOURCE_STATES initState);
+  // Which casters a shadow pass draws, see AssetsManager::SetModelDynamic.
+  enum class CasterSet {
+    kAll,
+    kStatic,
+    kDynamic,
+  };
+
+  static bool IsInCasterSet(bool dynamic, CasterSet caster_set) {
+    return caster_set == CasterSet::kAll || dynamic == (caster_set == CasterSet::kDynamic);
+  }
+
+  // Records the parts of a pass for parallel_recorder_, see RecordPass.
+  class PassRecorder;
 
   void CreateDescriptorHeaps(ID3D12Device* device);
+  void CreateShadowMap(ID3D12Device* device);
+  void CreateMomentsTextures(ID3D12Device* device);
   void CreatePipelineStates(ID3D12Device* device);
   void CreateAndMapConstantBuffers(ID3D12Device* device);
   void CreateShadowPipelineState(ID3D12Device* device);
-  void CreateAndMapShadowConstantBuffer(ID3D12Device* device);
+  void CreateCubeShadowPipelineState(ID3D12Device* device);
+  void CreateMomentsPipelineStates(ID3D12Device* device);
   void CreateScenePipelineState(ID3D12Device* device);
-  void CreateAndMapSceneConstantBuffer(ID3D12Device* device);
   void CreateCameraDrawPipelineState(ID3D12Device* device);
+  void InsertModels();
   void LoadAssets(ID3D12Device* device);
   void LoadModelVerticesAndIndices(ID3D12Device* device);
   void LoadTextures(ID3D12Device* device);
   void CreateCameraPoints(ID3D12Device* device);
+  void CreateAndMapInstanceTransformBuffers(ID3D12Device* device);
+  void CreateCommandSignatures(ID3D12Device* device);
+  void CreateAndMapIndirectArgumentBuffers(ID3D12Device* device);
   void UpdateConstantBuffers();
+  void UpdateCubeShadowConstantBuffer();
+  void UpdateShadowCache();
+  void UpdateShadowAtlas(bool is_spot_light, float spot_light_screen_coverage);
+  void CullObjects();
+  void CullOccludedObjects();
   void CommitConstantBuffers(UINT object_index);
   void CommitConstantBuffersForAllObjects();
   void SetCameras();
   void PopulateCommandLists();
-  void ShadowPass();
+  ID3D12GraphicsCommandList* AcquireCommandList();
+  void RecordPass(size_t item_number, const std::function<void(ID3D12GraphicsCommandList*)>& set_state,
+                  const std::function<void(ID3D12GraphicsCommandList*, size_t, size_t)>& record);
+  void ShadowMapPass();
+  D3D12_GPU_VIRTUAL_ADDRESS PrepareInstanceBatches(const std::vector<UINT>& objects, bool match_textures);
+  void DrawInstanceBatches(ID3D12GraphicsCommandList* command_list, UINT transforms_root_parameter_index, ID3D12CommandSignature* command_signature,
+                           D3D12_GPU_VIRTUAL_ADDRESS transforms_address, size_t batch_begin, size_t batch_end);
+  UINT ShadowPass(CasterSet caster_set, bool clear);
+  UINT CubeShadowPass(CasterSet caster_set, bool clear);
+  void CopyStaticShadowLayer(ID3D12Resource* shadow_map, ID3D12Resource* static_layer, bool save);
+  void MomentsPass();
+  void TransitionMomentsMip(UINT mip, D3D12_RESOURCE_STATES before_state, D3D12_RESOURCE_STATES after_state);
   void ScenePass();
   void DrawCameras();
 
   UINT GetCbvSrvUavDescriptorsNumber() const {
-    return  kDepthBufferCount_ + 1;  // 1 means the number of diffuse textures is 1.
+    return kDiffuseTextureDescriptorIndex_ + diffuse_texture_number_;
   }
 
   // Update vertices of camera points
@@ -87,31 +205,106 @@ private:
   UINT frame_count_ = 0;
   UINT current_frame_index_ = 0;
   static constexpr UINT kTotalCameraCount_ = 4;
-  static constexpr UINT kDepthBufferCount_ = 2;
+  static constexpr UINT kDepthBufferCount_ = 3;
+  // DSV heap layout: one DSV per shadow cascade, then the scene depth, then the whole shadow cube.
+  static constexpr UINT kSceneDepthDsvIndex_ = CascadedShadowMap::kMaxCascadeNumber;
+  static constexpr UINT kCubeShadowDsvIndex_ = kSceneDepthDsvIndex_ + 1;
+  static constexpr float kCameraFovDegrees_ = 90.0f;
+  static constexpr float kCameraNearPlane_ = 0.01f;
+  static constexpr float kCameraFarPlane_ = 10.0f;
+  static constexpr float kSpotLightMaxTanHalfAngle_ = 1.7320508f;  // tan(60 degrees), the outer cone in the pixel shader
+  static constexpr float kPointLightNearPlane_ = 0.01f;
+  static constexpr float kPointLightFarPlane_ = 10.0f;
+  static constexpr UINT kSpotLightAtlasId_ = 0;
+  static constexpr UINT kShadowAtlasGutterTexels_ = 16;  // around each tile, so filter taps past its edge read cleared depth
+  static constexpr UINT64 kInitialConstantBufferRingSize_ = 64 * 1024;  // grows with the objects the point light draws
+  // From this many objects on, CullObjects walks AssetsManager's tree instead of testing every box.
+  static constexpr size_t kBvhCullingMinObjectNumber_ = 4 * FrustumCuller::kChunkSize;
+  // CBV/SRV/UAV heap layout of the moments, right after the depth buffers: the SRV of all mips, the blur texture's
+  // SRV and UAV, then an SRV and a UAV per mip.
+  static constexpr UINT kMomentsDescriptorIndex_ = kDepthBufferCount_;
+  static constexpr UINT kMaxMomentsMipNumber_ = 12;
+  static constexpr UINT kMomentsDescriptorNumber_ = 3 + 2 * kMaxMomentsMipNumber_;
+  // Then a null texture view for the draws without a diffuse texture, followed by one view per diffuse texture,
+  // in DrawArgument::diffuse_texture_index order.
+  static constexpr UINT kDefaultTextureDescriptorIndex_ = kMomentsDescriptorIndex_ + kMomentsDescriptorNumber_;
+  static constexpr UINT kDiffuseTextureDescriptorIndex_ = kDefaultTextureDescriptorIndex_ + 1;
 
   // D3D objects
   ComPtr<ID3D12RootSignature> shadow_root_signature_;
   ComPtr<ID3D12PipelineState> shadow_pipeline_state_;
+  ComPtr<ID3D12RootSignature> cube_shadow_root_signature_;
+  ComPtr<ID3D12PipelineState> cube_shadow_pipeline_state_;
+  ComPtr<ID3D12RootSignature> moments_root_signature_;
+  ComPtr<ID3D12PipelineState> generate_moments_pipeline_state_;
+  ComPtr<ID3D12PipelineState> blur_moments_pipeline_state_;
+  ComPtr<ID3D12PipelineState> downsample_moments_pipeline_state_;
   ComPtr<ID3D12RootSignature> scene_root_signature_;
   ComPtr<ID3D12PipelineState> scene_pipeline_state_;
-  std::vector<ComPtr<ID3D12Resource>> scene_constant_buffer_views_;  // each frame has its own constant buffer view
+  // Per frame, the model transforms of the instance batches drawn, appended pass after pass. Sized for every
+  // object in the camera's pass and in each cascade's.
+  std::vector<ComPtr<ID3D12Resource>> instance_transform_buffers_;
+  std::vector<XMFLOAT4X4*> instance_transform_pointers_;
+  UINT instance_transform_capacity_ = 0;  // per frame
+  UINT instance_transform_number_ = 0;  // written this frame
+  IndirectDrawBuilder::Mode indirect_draw_mode_ = IndirectDrawBuilder::Mode::kOff;
+  // Set the batch's root SRV of instance transforms, then draw it.
+  ComPtr<ID3D12CommandSignature> shadow_command_signature_;
+  ComPtr<ID3D12CommandSignature> scene_command_signature_;
+  // Per frame, the records of every ExecuteIndirect, appended pass after pass, and with kCounted the count of each
+  // ExecuteIndirect, in the slot of its first record. A batch holds at least one instance, so both are sized like
+  // the instance transforms.
+  std::vector<ComPtr<ID3D12Resource>> indirect_argument_buffers_;
+  std::vector<IndirectDrawBuilder::DrawRecord*> indirect_argument_pointers_;
+  std::vector<ComPtr<ID3D12Resource>> indirect_count_buffers_;
+  std::vector<UINT*> indirect_count_pointers_;
+  UINT indirect_record_number_ = 0;  // reserved this frame
+  UINT indirect_record_base_ = 0;  // of instance_batches_' records, one per batch
+  std::atomic<UINT> indirect_call_number_{ 0 };  // this frame, counted by the recording threads
   ComPtr<ID3D12RootSignature> camera_draw_root_signature_;
   ComPtr<ID3D12PipelineState> camera_draw_pipeline_state_;
   std::vector<ComPtr<ID3D12CommandAllocator>> command_allocators_;
+  // The list open on the render thread. A pass recorded in parallel closes it, queues the parts' lists after it
+  // and opens another, so a frame submits several lists in recording order.
   ComPtr<ID3D12GraphicsCommandList> command_list_;
+  UINT recording_thread_number_ = 1;
+  bool log_frame_stats_ = false;
+  std::unique_ptr<ParallelRecorder> parallel_recorder_;
+  // Per frame, an allocator per recording thread for the parts' lists: frame index * recording_thread_number_ +
+  // worker index.
+  std::vector<ComPtr<ID3D12CommandAllocator>> part_command_allocators_;
+  // Grows to the most lists a frame has recorded. A list is only reset after the frame that used it was submitted.
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> command_list_pool_;
+  size_t used_command_list_number_ = 0;  // this frame
+  std::vector<ID3D12CommandList*> submitted_command_lists_;  // this frame, in order
+  std::string recording_stats_line_;  // last logged
   std::vector<ComPtr<ID3D12Resource>> render_targets_;
   ComPtr<ID3D12Resource> vertex_buffer_;
   ComPtr<ID3D12Resource> vertex_upload_heap_;
   ComPtr<ID3D12Resource> index_buffer_;
   ComPtr<ID3D12Resource> index_upload_heap_;
-  D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view_{};
+  // Slot 0 is the interleaved vertices, or the position stream with the de-interleaved layout; slot 1 is
+  // the attribute stream of the de-interleaved layout.
+  D3D12_VERTEX_BUFFER_VIEW vertex_buffer_views_[2]{};
+  UINT vertex_buffer_view_number_ = 0;
   D3D12_INDEX_BUFFER_VIEW index_buffer_view_{};
   ComPtr<ID3D12Resource> camera_points_vertex_buffer_;
   ComPtr<ID3D12Resource> camera_points_vertex_upload_heap_;
   D3D12_VERTEX_BUFFER_VIEW camera_points_vertex_buffer_view_{};
   std::vector<ComPtr<ID3D12Resource>> model_textures_;
+  UINT diffuse_texture_number_ = 0;  // models with a texture, counted before the CBV/SRV/UAV heap is sized
   std::vector<ComPtr<ID3D12Resource>> model_textures_upload_heap_;
-  std::vector<ComPtr<ID3D12Resource>> depth_textures_;  // 0: shadow depth texture; 1: scene depth texture
+  // 0: shadow depth texture array, a slice per cascade; 1: scene depth texture; 2: point light shadow cube
+  std::vector<ComPtr<ID3D12Resource>> depth_textures_;
+  // With ShadowCache::Mode::kStaticDynamicSplit, the static casters' depth of depth_textures_[0] and of
+  // depth_textures_[2] respectively, kept in COPY_DEST.
+  ComPtr<ID3D12Resource> static_shadow_layer_;
+  ComPtr<ID3D12Resource> static_cube_shadow_layer_;
+  // With the moment filter modes, depth_textures_[0]'s moments at half its resolution, with mips, resting in
+  // PIXEL_SHADER_RESOURCE; and the horizontal blur's output, one mip, resting in NON_PIXEL_SHADER_RESOURCE.
+  ComPtr<ID3D12Resource> moments_texture_;
+  ComPtr<ID3D12Resource> moments_blur_texture_;
+  UINT moments_mip_number_ = 0;
 
   // Heap objects
   ComPtr<ID3D12DescriptorHeap> rtv_descriptor_heap_;
@@ -123,20 +316,69 @@ private:
 
   CD3DX12_VIEWPORT view_port_;
   CD3DX12_RECT scissor_rect_;
+  CD3DX12_VIEWPORT shadow_view_port_;
+  CD3DX12_RECT shadow_scissor_rect_;
+  // Where ShadowPass draws in each slice: all of it for the directional light, the spot light's atlas tile inside its gutter.
+  CD3DX12_VIEWPORT shadow_tile_view_port_;
+  CD3DX12_RECT shadow_tile_scissor_rect_;
+  CD3DX12_RECT shadow_tile_clear_rect_;  // gutter included
+  CD3DX12_VIEWPORT cube_shadow_view_port_;
+  CD3DX12_RECT cube_shadow_scissor_rect_;
 
   InputState keyboard_input_;
 
+  std::wstring mesh_cache_file_name_;
+  std::wstring cook_mesh_cache_file_name_;
+
   std::vector<Camera> cameras_;
   UINT camera_index_ = 0;  // camera index of current viewing camera
 
   SceneConstantBuffer scene_constant_buffer_;
-  std::vector<void*> scene_constant_buffer_pointers_;
-  UINT scene_constant_buffer_aligned_size_ = 0;
+  CubeShadowConstantBuffer cube_shadow_constant_buffer_;
+  // Every constant buffer of a frame is committed to the ring during Update, at the addresses below.
+  ConstantBufferRing constant_buffer_ring_;
+  D3D12_GPU_VIRTUAL_ADDRESS scene_constants_address_ = 0;
+  D3D12_GPU_VIRTUAL_ADDRESS cube_shadow_constants_address_ = 0;  // point light only
+  std::vector<D3D12_GPU_VIRTUAL_ADDRESS> object_constants_addresses_;  // per object, point light only
+  UINT logged_constant_buffer_ring_growth_number_ = 0;
 
   // light related
   DirectionalLight directional_light_;
   PointLight point_light_;
   SpotLight spot_light_;
   LightType light_type_ = LightType::kDirectionLight;
-  Camera light_camera_;  // for shadow mapping
+  Camera light_camera_;  // for shadow mapping of point and spot lights
+  CascadedShadowMap cascaded_shadow_map_;  // for shadow mapping of the directional light
+  ShadowQuality::Settings shadow_settings_ = ShadowQuality::GetSettings(ShadowQuality::Tier::kHigh);
+  ShadowFilter::Mode shadow_filter_mode_ = ShadowFilter::Mode::kPoint;
+  AssetsManager::VertexStreamLayout vertex_stream_layout_ = AssetsManager::VertexStreamLayout::kDeinterleaved;
+  std::vector<LightFrustumFitter::BoundingBox> object_bounds_;  // world space, refreshed every update for fitting light frustums
+  std::vector<UINT> cube_face_masks_;  // per object, the cube faces it is drawn into
+  FrustumCuller frustum_culler_;
+  // Objects inside the camera's frustum for ScenePass, then inside each cascade's for ShadowPass; the point light
+  // culls with cube_face_masks_ instead.
+  std::vector<UINT> visible_objects_[1 + CascadedShadowMap::kMaxCascadeNumber];
+  std::string culling_stats_line_;  // last logged
+  // Culls visible_objects_[0] further with the occluders of the previous update; shadow passes are left alone, as
+  // what the camera cannot see still casts shadows into what it can.
+  OcclusionCuller occlusion_culler_;
+  std::vector<UINT> occluded_objects_;
+  size_t occlusion_object_number_ = 0;  // of the job in flight
+  std::string occlusion_stats_line_;  // last logged
+  // Scratch of PrepareInstanceBatches and ShadowPass, kept to reuse their storage.
+  std::vector<AssetsManager::InstanceBatch> instance_batches_;
+  std::vector<UINT> instance_objects_;
+  std::vector<UINT> caster_objects_;
+  UINT instanced_object_number_ = 0;  // this frame
+  UINT instance_batch_number_ = 0;
+  std::string instancing_stats_line_;  // last logged
+  ShadowAtlas shadow_atlas_;  // over the first slice of depth_textures_[0]
+  CubeShadowMap::DrawStats cube_shadow_draw_stats_{};
+  // shadow_cache_ for depth_textures_[0] (directional and spot lights), cube_shadow_cache_ for depth_textures_[2].
+  ShadowCache shadow_cache_;
+  ShadowCache cube_shadow_cache_;
+  ShadowCache::Action shadow_cache_action_ = ShadowCache::Action::kRedrawAll;  // for the current light's map this frame
+  UINT64 hashed_draw_arguments_version_ = ~0ull;  // of the draw table the caster versions were hashed from
+  UINT64 static_casters_version_ = 0;
+  UINT64 dynamic_casters_version_ = 0;
 };
\ No newline at end of file
@@ -6,13 +6,59 @@ cbuffer SceneConstantBuffer : register(b0)
   float4 light_world_direction_or_position;
   float4 light_color;
   float4 camera_world_pos;
-  float4x4 light_view_proj_transform;
+  float4x4 light_view_proj_transforms[4];  // one per cascade; the spot light only uses the first
+  float4 cascade_split_distances;  // view space depth where each cascade ends
+  float4 cascade_depth_biases;
+  float4 shadow_depth_params[4];  // per cascade: light view depth (x + y d) / (1 + z d) of a stored depth d, w: PCSS penumbra scale
+  float4 cube_shadow_depth_params;  // point light: x + y / view depth is the stored depth, z: depth bias
+  float4 shadow_atlas_tile;  // spot light: uv scale in xy and offset in zw of its tile in the first slice
   int light_type;  // 0: directional light; 1: point light; 2: spot light
+  int cascade_number;
 };
 
 Texture2D diffuse_map : register(t0);
-Texture2D shadow_map : register(t1);
+Texture2DArray shadow_maps : register(t1);  // a slice per cascade
+TextureCube shadow_cube : register(t2);  // point light, a face per direction
 SamplerState simple_sampler : register(s0);
+SamplerComparisonState shadow_comparison_sampler : register(s1);  // LESS_EQUAL, linear, white border
+SamplerState moments_sampler : register(s2);  // trilinear, clamped
+
+// SHADOW_FILTER picks the permutation, see ShadowFilter::Mode.
+#define SHADOW_FILTER_POINT 0
+#define SHADOW_FILTER_HARDWARE_PCF 1
+#define SHADOW_FILTER_POISSON_PCF 2
+#define SHADOW_FILTER_PCSS 3
+#define SHADOW_FILTER_VSM 4
+#define SHADOW_FILTER_EVSM 5
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER SHADOW_FILTER_POINT
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_EVSM
+Texture2DArray<float4> shadow_moments : register(t3);  // see shadow_moments_compute_shader.hlsl
+#elif SHADOW_FILTER == SHADOW_FILTER_VSM
+Texture2DArray<float2> shadow_moments : register(t3);
+#endif
+
+// Same as ShadowFilter's constants.
+static const int kPoissonTapNumber = 16;
+static const float2 kPoissonDisk[16] = {
+  float2(-0.94201624f, -0.39906216f), float2(0.94558609f, -0.76890725f), float2(-0.09418410f, -0.92938870f), float2(0.34495938f, 0.29387760f),
+  float2(-0.91588581f, 0.45771432f), float2(-0.81544232f, -0.87912464f), float2(-0.38277543f, 0.27676845f), float2(0.97484398f, 0.75648379f),
+  float2(0.44323325f, -0.97511554f), float2(0.53742981f, -0.47373420f), float2(-0.26496911f, -0.41893023f), float2(0.79197514f, 0.19090188f),
+  float2(-0.24188840f, 0.99706507f), float2(-0.81409955f, 0.91437590f), float2(0.19984126f, 0.78641367f), float2(0.14383161f, -0.14100790f),
+};
+static const float kPcfRadiusTexels = 2.5f;
+static const float kPcssSearchRadiusTexels = 8.0f;
+static const float kPcssLightSizeTexels = 16.0f;
+static const float kPcssMaxFilterRadiusTexels = 8.0f;
+static const float kEvsmPositiveExponent = 40.0f;
+static const float kEvsmNegativeExponent = 5.0f;
+static const float kMomentsMinVariance = 1e-5f;
+static const float kLightBleedingReduction = 0.2f;
+// The spot light's tile is surrounded by a 16 texel gutter (Scene::kShadowAtlasGutterTexels_), 8 moments texels:
+// mips past 2 would blend in other tiles.
+static const float kSpotLightMaxMomentsLod = 2.0f;
 
 struct PSInput {
 	float4 pos : SV_POSITION;
@@ -22,14 +68,158 @@ struct PSInput {
   float3 world_normal : NORMAL;
 };
 
-bool PixelIsInShadow(PSInput ps_input) {
-  float4 light_space_clip_coordinate = mul(float4(ps_input.world_pos, 1.0f), light_view_proj_transform);
+uint SelectCascade(float3 world_pos) {
+  // The first cascade whose far split lies beyond the pixel; the last one ends at the far plane.
+  float view_depth = mul(float4(world_pos, 1.0f), view).z;
+  uint cascade_index = 0;
+  for (int i = 0; i < cascade_number - 1; ++i) {
+    if (view_depth > cascade_split_distances[i]) {
+      cascade_index = i + 1;
+    }
+  }
+  return cascade_index;
+}
+
+float ComputeLitFractionOfPointLight(PSInput ps_input) {
+  // The face the direction falls on is the one whose axis is the largest; the depth along that axis is what
+  // the face's projection turned into the stored depth.
+  float3 light_to_pixel = ps_input.world_pos - light_world_direction_or_position.xyz;
+  float3 distances = abs(light_to_pixel);
+  float view_depth = max(distances.x, max(distances.y, distances.z));
+  float curr_depth = cube_shadow_depth_params.x + cube_shadow_depth_params.y / view_depth;
+  if (curr_depth > 1.0f) {
+    return 1.0f;  // beyond the far plane, nothing was rendered there
+  }
+#if SHADOW_FILTER == SHADOW_FILTER_POINT
+  float min_depth = shadow_cube.Sample(simple_sampler, light_to_pixel);
+  return curr_depth > min_depth + cube_shadow_depth_params.z ? 0.0f : 1.0f;
+#else
+  // Offsets on a cube are left out: every filtered mode uses the hardware 2x2 PCF here.
+  return shadow_cube.SampleCmpLevelZero(shadow_comparison_sampler, light_to_pixel, curr_depth - cube_shadow_depth_params.z);
+#endif
+}
+
+#if SHADOW_FILTER == SHADOW_FILTER_POISSON_PCF || SHADOW_FILTER == SHADOW_FILTER_PCSS
+// Rotation of the Poisson disk in turns, interleaved gradient noise of the pixel position.
+float ComputeRotation(float2 pixel_pos) {
+  return frac(52.9829189f * frac(dot(pixel_pos, float2(0.06711056f, 0.00583715f))));
+}
+
+// Light view depth of a stored depth, see ShadowFilter::ComputePerspectiveDepthParams.
+float LinearizeDepth(float depth, float4 depth_params) {
+  return (depth_params.x + depth_params.y * depth) / (1.0f + depth_params.z * depth);
+}
+
+float PoissonPcf(float3 shadow_map_uvw, float reference, float radius, float2 texel_size, float2x2 rotation) {
+  float lit = 0.0f;
+  for (int i = 0; i < kPoissonTapNumber; ++i) {
+    float2 offset = mul(kPoissonDisk[i], rotation) * radius * texel_size;
+    lit += shadow_maps.SampleCmpLevelZero(shadow_comparison_sampler, float3(shadow_map_uvw.xy + offset, shadow_map_uvw.z), reference);
+  }
+  return lit / kPoissonTapNumber;
+}
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_VSM || SHADOW_FILTER == SHADOW_FILTER_EVSM
+// One-tailed Chebyshev inequality: the largest fraction of the filtered depths that can lie at or beyond
+// reference. Fractions under kLightBleedingReduction are cut off, as that is where light leaks.
+float ChebyshevUpperBound(float2 moments, float reference, float min_variance) {
+  if (reference <= moments.x) {
+    return 1.0f;
+  }
+  float variance = max(moments.y - moments.x * moments.x, min_variance);
+  float distance = reference - moments.x;
+  float lit = variance / (variance + distance * distance);
+  return saturate((lit - kLightBleedingReduction) / (1.0f - kLightBleedingReduction));
+}
+
+float ComputeLitFractionFromMoments(float3 shadow_map_uvw, float reference) {
+  // Mips hold the moments prefiltered over ever larger areas, so one sample filters the whole pixel footprint.
+  float lod = shadow_moments.CalculateLevelOfDetail(moments_sampler, shadow_map_uvw.xy);
+  if (light_type == 2) {
+    lod = min(lod, kSpotLightMaxMomentsLod);
+  }
+#if SHADOW_FILTER == SHADOW_FILTER_VSM
+  float2 moments = shadow_moments.SampleLevel(moments_sampler, shadow_map_uvw, lod);
+  return ChebyshevUpperBound(moments, reference, kMomentsMinVariance);
+#else
+  float4 moments = shadow_moments.SampleLevel(moments_sampler, shadow_map_uvw, lod);
+  // The minimum variance is in depth squared; each warp stretches it by the square of its slope.
+  float warped_depth = 2.0f * reference - 1.0f;
+  float positive = exp(kEvsmPositiveExponent * warped_depth);
+  float negative = -exp(-kEvsmNegativeExponent * warped_depth);
+  float positive_slope = 2.0f * kEvsmPositiveExponent * positive;
+  float negative_slope = 2.0f * kEvsmNegativeExponent * negative;
+  float positive_lit = ChebyshevUpperBound(moments.xy, positive, kMomentsMinVariance * positive_slope * positive_slope);
+  float negative_lit = ChebyshevUpperBound(moments.zw, negative, kMomentsMinVariance * negative_slope * negative_slope);
+  return min(positive_lit, negative_lit);
+#endif
+}
+#endif
+
+// 0: fully shadowed, 1: fully lit. The kernels are mirrored by ShadowFilter::Filter and
+// ShadowFilter::FilterMoments on the CPU.
+float ComputeLitFraction(PSInput ps_input) {
+  if (light_type == 1) {
+    return ComputeLitFractionOfPointLight(ps_input);
+  }
+
+  uint cascade_index = SelectCascade(ps_input.world_pos);
+  float4 light_space_clip_coordinate = mul(float4(ps_input.world_pos, 1.0f), light_view_proj_transforms[cascade_index]);
   float4 light_space_ndc_coordinate = light_space_clip_coordinate / light_space_clip_coordinate.w;
   float2 shadow_map_uv = float2(0.5f * light_space_ndc_coordinate.x + 0.5f, 1.0f - (0.5f * light_space_ndc_coordinate.y + 0.5f));
-  float min_depth = shadow_map.Sample(simple_sampler, shadow_map_uv);
+  if (light_type == 2) {
+    // The spot light's map is a tile of the atlas; clamped to it, filters reach no further than its gutter.
+    shadow_map_uv = saturate(shadow_map_uv) * shadow_atlas_tile.xy + shadow_atlas_tile.zw;
+  }
+  float3 shadow_map_uvw = float3(shadow_map_uv, cascade_index);
   float curr_depth = light_space_ndc_coordinate.b;
-  float bias = 0.00004f;
-  return curr_depth > min_depth + bias;
+  float bias = cascade_depth_biases[cascade_index];
+
+#if SHADOW_FILTER == SHADOW_FILTER_POINT
+  float min_depth = shadow_maps.Sample(simple_sampler, shadow_map_uvw);
+  return curr_depth > min_depth + bias ? 0.0f : 1.0f;
+#elif SHADOW_FILTER == SHADOW_FILTER_HARDWARE_PCF
+  return shadow_maps.SampleCmpLevelZero(shadow_comparison_sampler, shadow_map_uvw, curr_depth - bias);
+#elif SHADOW_FILTER == SHADOW_FILTER_VSM || SHADOW_FILTER == SHADOW_FILTER_EVSM
+  return ComputeLitFractionFromMoments(shadow_map_uvw, curr_depth - bias);
+#else
+  float width, height, elements;
+  shadow_maps.GetDimensions(width, height, elements);
+  float2 texel_size = float2(1.0f / width, 1.0f / height);
+  float angle = ComputeRotation(ps_input.pos.xy) * 6.28318531f;
+  float2x2 rotation = float2x2(cos(angle), sin(angle), -sin(angle), cos(angle));
+  float reference = curr_depth - bias;
+#if SHADOW_FILTER == SHADOW_FILTER_POISSON_PCF
+  return PoissonPcf(shadow_map_uvw, reference, kPcfRadiusTexels, texel_size, rotation);
+#else
+  // Average depth of what is in front of the receiver around it; the map's edge is clamped, not a blocker.
+  // Averaged in light view depth, as a perspective light's stored depths are not linear in it.
+  float4 depth_params = shadow_depth_params[cascade_index];
+  int2 texel = int2(floor(shadow_map_uv * float2(width, height)));
+  float blocker_depth_sum = 0.0f;
+  int blocker_number = 0;
+  for (int i = 0; i < kPoissonTapNumber; ++i) {
+    float2 offset = mul(kPoissonDisk[i], rotation) * kPcssSearchRadiusTexels;
+    int2 tap = clamp(texel + int2(floor(offset + 0.5f)), int2(0, 0), int2(width, height) - 1);
+    float depth = shadow_maps.Load(int4(tap, cascade_index, 0));
+    if (depth < reference) {
+      blocker_depth_sum += LinearizeDepth(depth, depth_params);
+      blocker_number++;
+    }
+  }
+  if (blocker_number == 0) {
+    return 1.0f;
+  }
+
+  // Similar triangles between the light, the blockers and the receiver; a directional light's penumbra only
+  // grows with the distance between them (ShadowFilter::ComputeOrthographicDepthParams).
+  float blocker_depth = blocker_depth_sum / blocker_number;
+  float receiver_view_depth = LinearizeDepth(curr_depth, depth_params);
+  float penumbra = depth_params.w * (receiver_view_depth - blocker_depth) / (depth_params.z != 0.0f ? max(blocker_depth, 1e-4f) : 1.0f);
+  return PoissonPcf(shadow_map_uvw, reference, clamp(penumbra, 1.0f, kPcssMaxFilterRadiusTexels), texel_size, rotation);
+#endif
+#endif
 }
 
 float4 main(PSInput ps_input) : SV_TARGET
@@ -39,8 +229,8 @@ float4 main(PSInput ps_input) : SV_TARGET
   color = diffuse_map.Sample(simple_sampler, ps_input.uv).rgb;
   float3 ambient_color = 0.05f * color;
 
-  float is_in_shadow = PixelIsInShadow(ps_input);
-  if (is_in_shadow) {
+  float lit_fraction = ComputeLitFraction(ps_input);
+  if (lit_fraction <= 0.0f) {
     return float4(ambient_color, 1.0f);
   }
 
@@ -79,6 +269,6 @@ float4 main(PSInput ps_input) : SV_TARGET
   float spec = pow(saturate(dot(world_normal, half_way_direction)), 32.0f);
   float3 specular_color = float3(0.3f, 0.3f, 0.3f) * spec;
 
-	return float4(ambient_color + diffuse_color + specular_color, 1.0f);
+	return float4(ambient_color + lit_fraction * (diffuse_color + specular_color), 1.0f);
   
 }
\ No newline at end of file
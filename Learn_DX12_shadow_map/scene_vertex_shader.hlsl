@@ -1,10 +1,13 @@
 cbuffer SceneConstantBuffer : register(b0)
 {
-  float4x4 model;
+  float4x4 model;  // unused, instances take theirs from instance_transforms
   float4x4 view;
   float4x4 proj;
 };
 
+// Model transforms of the batch's instances, uploaded transposed like the constant buffer's.
+StructuredBuffer<float4x4> instance_transforms : register(t0, space1);
+
 struct PSInput {
 	float4 pos : SV_POSITION;
 	float2 uv : TEXCOORD;
@@ -13,17 +16,18 @@ struct PSInput {
 	float3 world_normal : NORMAL;
 };
 
-PSInput main( float3 pos : POSITION, float3 normal : NORMAL, float2 uv : TEXCOORD, float3 color : COLOR)
+PSInput main( float3 pos : POSITION, float3 normal : NORMAL, float2 uv : TEXCOORD, float3 color : COLOR, uint instance_id : SV_InstanceID)
 {
+	const float4x4 instance_model = instance_transforms[instance_id];
 	PSInput ps_input;
 	ps_input.pos = float4(pos, 1.0f);
-	ps_input.pos = mul(ps_input.pos, model);
+	ps_input.pos = mul(ps_input.pos, instance_model);
 	ps_input.world_pos = ps_input.pos.xyz;
 	ps_input.pos = mul(ps_input.pos, view);
 	ps_input.pos = mul(ps_input.pos, proj);
 	ps_input.color = color;
 	ps_input.uv = uv;
 
-	ps_input.world_normal = normalize(mul(float4(normal, 0.0f), model)).xyz;
+	ps_input.world_normal = normalize(mul(float4(normal, 0.0f), instance_model)).xyz;
 	return ps_input;
 }
\ No newline at end of file
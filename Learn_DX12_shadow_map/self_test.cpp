@@ -0,0 +1,942 @@
+#include "self_test.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "bounding_volume_hierarchy.h"
+#include "cascaded_shadow_map.h"
+#include "cube_shadow_map.h"
+#include "frustum_culler.h"
+#include "indirect_draw_builder.h"
+#include "light_frustum_fitter.h"
+#include "portable_image_formats.h"
+#include "ring_allocator.h"
+#include "shadow_atlas.h"
+#include "shadow_cache.h"
+
+namespace {
+
+// Sizes the rows as the decoder asks, for the decoders' checks.
+class DecodedImage {
+ public:
+  DecodedImage() : writer_(texture_desc_, bytes_per_row_, allocate_rows_) {
+
+  }
+
+  PortableImage::DecodedImageWriter& GetWriter() {
+    return writer_;
+  }
+
+ private:
+  D3D12_RESOURCE_DESC texture_desc_{};
+  int bytes_per_row_ = 0;
+  std::vector<uint8_t> rows_;
+  const ImageDecoder::RowsDestinationAllocator allocate_rows_ = [this](const D3D12_RESOURCE_DESC& desc, UINT& row_pitch) {
+    rows_.resize(static_cast<size_t>(row_pitch) * desc.Height);
+    return rows_.data();
+  };
+  PortableImage::DecodedImageWriter writer_;
+};  // class DecodedImage
+
+// Deflate bits, LSB first; Huffman codes go MSB first.
+class DeflateBitWriter {
+ public:
+  void Write(uint32_t value, int bit_number) {
+    for (int i = 0; i < bit_number; ++i) {
+      WriteBit((value >> i) & 1);
+    }
+  }
+
+  void WriteCode(uint32_t code, int length) {
+    for (int i = length - 1; i >= 0; --i) {
+      WriteBit((code >> i) & 1);
+    }
+  }
+
+  const std::vector<uint8_t>& GetBytes() const {
+    return bytes_;
+  }
+
+ private:
+  void WriteBit(uint32_t bit) {
+    if (bit_count_ % 8 == 0) {
+      bytes_.push_back(0);
+    }
+    bytes_.back() |= static_cast<uint8_t>(bit << (bit_count_ % 8));
+    bit_count_++;
+  }
+
+  std::vector<uint8_t> bytes_;
+  size_t bit_count_ = 0;
+};  // class DeflateBitWriter
+
+// A DHT segment with 200 one-bit codes: only 2 fit, and storing the rest would run past the table's fast lookup.
+std::wstring CheckJpegRejectsOverSubscribedHuffmanTable()
+{
+  const size_t value_number = 200;
+  std::vector<uint8_t> jpeg = { 0xFF, 0xD8, 0xFF, 0xC4 };
+  const size_t segment_size = 2 + 1 + 16 + value_number;
+  jpeg.push_back(static_cast<uint8_t>(segment_size >> 8));
+  jpeg.push_back(static_cast<uint8_t>(segment_size & 0xFF));
+  jpeg.push_back(0x00);  // DC table 0
+  jpeg.push_back(static_cast<uint8_t>(value_number));
+  jpeg.insert(jpeg.end(), 15, 0);
+  for (size_t i = 0; i < value_number; ++i) {
+    jpeg.push_back(static_cast<uint8_t>(i));
+  }
+  jpeg.push_back(0xFF);
+  jpeg.push_back(0xD9);
+
+  DecodedImage image;
+  if (PortableImage::DecodeJpeg(jpeg.data(), jpeg.size(), image.GetWriter())) {
+    return L"the table was accepted";
+  }
+  return L"";
+}
+
+// Old style runs (1, 1, 1, count) in a row shift their count 8 bits further each; the fifth would shift it by
+// 32, past the int.
+std::wstring CheckHdrRejectsLongRunsOfRuns()
+{
+  const char header[] = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 1 +X 4\n";
+  std::vector<uint8_t> hdr(header, header + sizeof(header) - 1);
+  const uint8_t pixels[] = { 10, 10, 10, 128, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1 };
+  hdr.insert(hdr.end(), pixels, pixels + sizeof(pixels));
+
+  DecodedImage image;
+  if (PortableImage::DecodeHdr(hdr.data(), hdr.size(), image.GetWriter())) {
+    return L"the runs were accepted";
+  }
+  return L"";
+}
+
+// A fixed Huffman block of one literal and match_number copies of the longest match, 1 + 258 * match_number
+// bytes: inflating it must stop at the size the caller allows.
+std::wstring CheckInflateStopsAtMaxSize()
+{
+  const size_t match_number = 100;
+  DeflateBitWriter writer;
+  writer.Write(0x78, 8);  // zlib header: deflate, 32K window, no dictionary
+  writer.Write(0x01, 8);
+  writer.Write(1, 1);  // last block
+  writer.Write(1, 2);  // fixed Huffman codes
+  writer.WriteCode(0x30 + 'a', 8);  // literal 'a'
+  for (size_t i = 0; i < match_number; ++i) {
+    writer.WriteCode(0xC0 + (285 - 280), 8);  // length 258
+    writer.WriteCode(0, 5);  // distance 1
+  }
+  writer.WriteCode(0, 7);  // end of block
+  writer.Write(0, 32);  // Adler-32, not checked
+  const std::vector<uint8_t>& stream = writer.GetBytes();
+  const size_t inflated_size = 1 + 258 * match_number;
+
+  std::vector<uint8_t> output;
+  if (PortableImage::Inflate(stream.data(), stream.size(), inflated_size - 1, output)) {
+    return L"inflated past the maximum size";
+  }
+  output.clear();
+  if (!PortableImage::Inflate(stream.data(), stream.size(), inflated_size, output) || output.size() != inflated_size) {
+    return L"failed to inflate within the maximum size";
+  }
+  for (uint8_t byte : output) {
+    if (byte != 'a') {
+      return L"inflated the wrong bytes";
+    }
+  }
+  return L"";
+}
+
+// The largest float image has 4 GiB of texels, more than the int image size ImageDecoder::Decode returns.
+std::wstring CheckImageSizeFitsInt()
+{
+  D3D12_RESOURCE_DESC texture_desc{};
+  int bytes_per_row = 0;
+  uint8_t row = 0;
+  UINT allocation_number = 0;
+  const ImageDecoder::RowsDestinationAllocator allocate_rows = [&row, &allocation_number](const D3D12_RESOURCE_DESC&, UINT&) {
+    allocation_number++;
+    return &row;  // never written to, the rows are only sized
+  };
+  PortableImage::DecodedImageWriter writer(texture_desc, bytes_per_row, allocate_rows);
+  if (writer.Begin(PortableImage::kMaxDimension, PortableImage::kMaxDimension, DXGI_FORMAT_R32G32B32A32_FLOAT) || allocation_number != 0) {
+    return L"a 4 GiB image was accepted";
+  }
+  if (!writer.Begin(4096, 4096, DXGI_FORMAT_R32G32B32A32_FLOAT) || writer.GetImageSize() != 4096ull * 4096 * 16) {
+    return L"a 256 MiB image was refused or mis-sized";
+  }
+  return L"";
+}
+
+// Every cascade must start where the previous one ended and reach a little further, the last one exactly the far
+// plane, whatever the blend of the split schemes.
+std::wstring CheckCascadeSplitsIncrease()
+{
+  const float near_plane = 0.1f;
+  const float far_plane = 1000.0f;
+  const float split_lambdas[] = { 0.0f, 0.5f, 0.95f, 1.0f };
+  for (UINT cascade_number = 1; cascade_number <= CascadedShadowMap::kMaxCascadeNumber; ++cascade_number) {
+    for (float split_lambda : split_lambdas) {
+      float split_distances[CascadedShadowMap::kMaxCascadeNumber];
+      CascadedShadowMap::ComputeSplitDistances(near_plane, far_plane, cascade_number, split_lambda, split_distances);
+      float previous_split = near_plane;
+      for (UINT i = 0; i < cascade_number; ++i) {
+        if (!(split_distances[i] > previous_split)) {
+          return L"cascade " + std::to_wstring(i) + L" of " + std::to_wstring(cascade_number) + L" doesn't end past the one before, lambda " +
+            std::to_wstring(split_lambda);
+        }
+        previous_split = split_distances[i];
+      }
+      if (split_distances[cascade_number - 1] != far_plane) {
+        return L"the last of " + std::to_wstring(cascade_number) + L" cascades doesn't end at the far plane";
+      }
+    }
+  }
+
+  // The fitted cascades keep the splits, and the farther ones cover more ground with each texel.
+  CascadedShadowMap cascaded_shadow_map;
+  const XMMATRIX camera_view = XMMatrixLookToLH(XMVectorSet(0.0f, 5.0f, 0.0f, 1.0f), XMVectorSet(0.0f, -0.3f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  cascaded_shadow_map.Fit(camera_view, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, near_plane, 100.0f), near_plane, 100.0f, XMVectorSet(-1.0f, -2.0f, 1.0f, 0.0f));
+  for (UINT i = 1; i < cascaded_shadow_map.GetOptions().cascade_number; ++i) {
+    const CascadedShadowMap::Cascade& previous = cascaded_shadow_map.GetCascade(i - 1);
+    const CascadedShadowMap::Cascade& cascade = cascaded_shadow_map.GetCascade(i);
+    if (!(cascade.split_distance > previous.split_distance) || !(cascade.texel_size >= previous.texel_size)) {
+      return L"fitted cascade " + std::to_wstring(i) + L" is nearer or finer than the one before";
+    }
+  }
+  return L"";
+}
+
+// A camera at the origin looking down +x sees a receiver; of the objects outside its view, one stands between the
+// receiver and a light shining down +z, one is behind the receiver and one is off to the side. Only the first
+// may pull the light's near plane in, and nothing but the receiver may widen its sides.
+std::wstring CheckLightFrustumFitsReceiversAndCasters()
+{
+  const LightFrustumFitter::BoundingBox object_bounds[] = {
+    { XMFLOAT3(5.0f, -1.0f, 0.0f), XMFLOAT3(6.0f, 1.0f, 1.0f) },  // receiver
+    { XMFLOAT3(5.0f, -1.0f, -30.0f), XMFLOAT3(6.0f, 1.0f, -29.0f) },  // caster
+    { XMFLOAT3(5.0f, -1.0f, 40.0f), XMFLOAT3(6.0f, 1.0f, 41.0f) },  // behind the receiver
+    { XMFLOAT3(50.0f, 10.0f, -30.0f), XMFLOAT3(51.0f, 11.0f, -29.0f) },  // off to the side
+  };
+  const size_t object_number = sizeof(object_bounds) / sizeof(object_bounds[0]);
+  const XMMATRIX camera_view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  const XMMATRIX camera_proj = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 20.0f);
+  XMVECTOR frustum_corners[8];
+  CascadedShadowMap::ComputeFrustumCorners(XMMatrixInverse(nullptr, XMMatrixMultiply(camera_view, camera_proj)), frustum_corners);
+  for (size_t i = 1; i < object_number; ++i) {
+    if (LightFrustumFitter::IntersectsFrustum(frustum_corners, object_bounds[i])) {
+      return L"object " + std::to_wstring(i) + L" is taken to be in view";
+    }
+  }
+
+  const float tolerance = 1e-3f;
+  LightFrustumFitter::BoundingBox light_space_bounds;
+  if (!LightFrustumFitter::FitOrthographic(XMMatrixIdentity(), frustum_corners, object_bounds, object_number, light_space_bounds)) {
+    return L"no receiver was found for the directional light";
+  }
+  if (std::fabs(light_space_bounds.min.x - 5.0f) > tolerance || std::fabs(light_space_bounds.max.x - 6.0f) > tolerance ||
+      std::fabs(light_space_bounds.min.y + 1.0f) > tolerance || std::fabs(light_space_bounds.max.y - 1.0f) > tolerance) {
+    return L"the directional light's sides don't hug the receiver";
+  }
+  if (std::fabs(light_space_bounds.min.z + 30.0f) > tolerance || std::fabs(light_space_bounds.max.z - 1.0f) > tolerance) {
+    return L"the directional light's depth range doesn't run from the caster to the receiver";
+  }
+
+  // The same for a spot light 50 units before the receiver.
+  const XMMATRIX light_view = XMMatrixLookToLH(XMVectorSet(5.5f, 0.0f, -50.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+  LightFrustumFitter::PerspectiveBounds bounds;
+  if (!LightFrustumFitter::FitPerspective(light_view, frustum_corners, object_bounds, object_number, 1.0f, 0.1f, bounds)) {
+    return L"no receiver was found for the spot light";
+  }
+  if (std::fabs(bounds.right - 0.5f / 50.0f) > tolerance || std::fabs(bounds.left + 0.5f / 50.0f) > tolerance ||
+      std::fabs(bounds.top - 1.0f / 50.0f) > tolerance || std::fabs(bounds.bottom + 1.0f / 50.0f) > tolerance) {
+    return L"the spot light's sides don't hug the receiver";
+  }
+  if (std::fabs(bounds.near_plane - 20.0f) > tolerance || std::fabs(bounds.far_plane - 51.0f) > tolerance) {
+    return L"the spot light's depth range doesn't run from the caster to the receiver";
+  }
+  return L"";
+}
+
+// Boxes straight along each axis reach only that face; one holding the light reaches all of them and one past
+// the far plane none. Random boxes must get the bit of every face a point inside them is seen by.
+std::wstring CheckCubeFaceMasks()
+{
+  const float near_plane = 0.1f;
+  const float far_plane = 50.0f;
+  const XMVECTOR light_position = XMVectorSet(1.0f, 2.0f, 3.0f, 1.0f);
+  auto box_around = [light_position](float x, float y, float z, float half_size) {
+    XMFLOAT3 center;
+    XMStoreFloat3(&center, XMVectorAdd(light_position, XMVectorSet(x, y, z, 0.0f)));
+    return CubeShadowMap::BoundingBox{ XMFLOAT3(center.x - half_size, center.y - half_size, center.z - half_size),
+                                       XMFLOAT3(center.x + half_size, center.y + half_size, center.z + half_size) };
+  };
+
+  const float axes[CubeShadowMap::kFaceNumber][3] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+  for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+    const CubeShadowMap::BoundingBox bounding_box = box_around(10.0f * axes[face][0], 10.0f * axes[face][1], 10.0f * axes[face][2], 0.5f);
+    const UINT face_mask = CubeShadowMap::ComputeFaceMask(light_position, bounding_box, near_plane, far_plane);
+    if (face_mask != 1u << face) {
+      return L"a box along face " + std::to_wstring(face) + L" got the mask " + std::to_wstring(face_mask);
+    }
+  }
+  if (CubeShadowMap::ComputeFaceMask(light_position, box_around(0.0f, 0.0f, 0.0f, 1.0f), near_plane, far_plane) != CubeShadowMap::kAllFacesMask) {
+    return L"a box around the light doesn't reach every face";
+  }
+  if (CubeShadowMap::ComputeFaceMask(light_position, box_around(100.0f, 0.0f, 0.0f, 1.0f), near_plane, far_plane) != 0) {
+    return L"a box past the far plane reaches a face";
+  }
+
+  const size_t object_number = 500;
+  std::vector<CubeShadowMap::BoundingBox> object_bounds(object_number);
+  uint32_t state = 0x2545f491u;
+  auto random = [&state](float low, float high) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return low + (high - low) * (state & 0xFFFF) / 65535.0f;
+  };
+  for (CubeShadowMap::BoundingBox& bounding_box : object_bounds) {
+    bounding_box = box_around(random(-40.0f, 40.0f), random(-40.0f, 40.0f), random(-40.0f, 40.0f), random(0.1f, 5.0f));
+  }
+  std::vector<UINT> face_masks(object_number);
+  const CubeShadowMap::DrawStats draw_stats = CubeShadowMap::ComputeFaceMasks(light_position, object_bounds.data(), object_number, near_plane, far_plane, face_masks.data());
+
+  UINT draw_number = 0;
+  UINT face_draw_number = 0;
+  const int sample_number = 6;  // per axis of a box
+  for (size_t i = 0; i < object_number; ++i) {
+    const CubeShadowMap::BoundingBox& bounding_box = object_bounds[i];
+    draw_number += face_masks[i] != 0 ? 1 : 0;
+    for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+      face_draw_number += (face_masks[i] >> face) & 1;
+    }
+
+    for (int x = 0; x < sample_number; ++x) {
+      for (int y = 0; y < sample_number; ++y) {
+        for (int z = 0; z < sample_number; ++z) {
+          const float t[3] = { x / (sample_number - 1.0f), y / (sample_number - 1.0f), z / (sample_number - 1.0f) };
+          const XMVECTOR point = XMVectorSet(bounding_box.min.x + t[0] * (bounding_box.max.x - bounding_box.min.x),
+                                             bounding_box.min.y + t[1] * (bounding_box.max.y - bounding_box.min.y),
+                                             bounding_box.min.z + t[2] * (bounding_box.max.z - bounding_box.min.z), 1.0f);
+          XMFLOAT3 offset;
+          XMStoreFloat3(&offset, XMVectorSubtract(point, light_position));
+          const float components[3] = { offset.x, offset.y, offset.z };
+          int axis = 0;
+          for (int j = 1; j < 3; ++j) {
+            if (std::fabs(components[j]) > std::fabs(components[axis])) {
+              axis = j;
+            }
+          }
+          const float depth = std::fabs(components[axis]);
+          const UINT face = static_cast<UINT>(axis * 2 + (components[axis] < 0.0f ? 1 : 0));
+          if (depth >= near_plane && depth <= far_plane && ((face_masks[i] >> face) & 1) == 0) {
+            return L"box " + std::to_wstring(i) + L" is missing face " + std::to_wstring(face);
+          }
+        }
+      }
+    }
+  }
+  if (draw_stats.draw_number != draw_number || draw_stats.face_draw_number != face_draw_number || draw_stats.naive_draw_number != CubeShadowMap::kFaceNumber * object_number) {
+    return L"the draw stats don't add up to the masks";
+  }
+  return L"";
+}
+
+// Walks each mode through a light that moves, static and dynamic casters that move and frames where nothing does.
+std::wstring CheckShadowCacheActions()
+{
+  using Action = ShadowCache::Action;
+  struct Step {
+    ShadowCache::Versions versions;
+    Action actions[3];  // off, on, split
+  };  // struct Step
+  const Step steps[] = {
+    { { 1, 1, 1 }, { Action::kRedrawAll, Action::kRedrawAll, Action::kRedrawAll } },  // first frame
+    { { 1, 1, 1 }, { Action::kRedrawAll, Action::kReuse, Action::kReuse } },
+    { { 1, 1, 2 }, { Action::kRedrawAll, Action::kRedrawAll, Action::kRedrawDynamic } },
+    { { 1, 1, 3 }, { Action::kRedrawAll, Action::kRedrawAll, Action::kRedrawDynamic } },
+    { { 1, 1, 3 }, { Action::kRedrawAll, Action::kReuse, Action::kReuse } },
+    { { 1, 2, 3 }, { Action::kRedrawAll, Action::kRedrawAll, Action::kRedrawAll } },
+    { { 2, 2, 3 }, { Action::kRedrawAll, Action::kRedrawAll, Action::kRedrawAll } },
+    { { 2, 2, 3 }, { Action::kRedrawAll, Action::kReuse, Action::kReuse } },
+  };
+  const UINT full_draw_number = 10;
+  const UINT dynamic_draw_number = 3;
+
+  for (int mode = 0; mode < static_cast<int>(ShadowCache::Mode::kModeNumber); ++mode) {
+    ShadowCache cache;
+    cache.SetMode(static_cast<ShadowCache::Mode>(mode));
+    UINT64 reused_frame_number = 0;
+    UINT64 saved_draw_number = 0;
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+      const Action action = cache.Update(steps[i].versions);
+      if (action != steps[i].actions[mode]) {
+        return L"step " + std::to_wstring(i) + L" in " + ShadowCache::GetModeName(static_cast<ShadowCache::Mode>(mode)) + L" mode: " +
+          ShadowCache::GetActionName(action);
+      }
+      const UINT draw_number = action == Action::kReuse ? 0 : (action == Action::kRedrawDynamic ? dynamic_draw_number : full_draw_number);
+      const ShadowCache::FrameStats& frame_stats = cache.RecordFrame(draw_number, full_draw_number);
+      if (frame_stats.action != action || frame_stats.draw_number + frame_stats.saved_draw_number != full_draw_number) {
+        return L"the frame stats don't match the action at step " + std::to_wstring(i);
+      }
+      reused_frame_number += action == Action::kReuse ? 1 : 0;
+      saved_draw_number += full_draw_number - draw_number;
+    }
+    if (cache.GetReusedFrameNumber() != reused_frame_number || cache.GetTotalSavedDrawNumber() != saved_draw_number) {
+      return L"the totals don't add up to the frames";
+    }
+
+    cache.Invalidate();
+    if (cache.Update(steps[0].versions) != Action::kRedrawAll) {
+      return L"an invalidated map wasn't redrawn";
+    }
+  }
+
+  ShadowCache::Mode mode = ShadowCache::Mode::kOff;
+  if (!ShadowCache::ParseMode(L"SPLIT", mode) || mode != ShadowCache::Mode::kStaticDynamicSplit || ShadowCache::ParseMode(L"spl", mode)) {
+    return L"mode names aren't parsed case-insensitively and in full";
+  }
+
+  const char bytes[] = "light0";
+  if (ShadowCache::Hash(bytes + 3, 3, ShadowCache::Hash(bytes, 3)) != ShadowCache::Hash(bytes, 6) || ShadowCache::Hash(bytes, 5) == ShadowCache::Hash(bytes, 6)) {
+    return L"chained hashes don't match the hash of the whole";
+  }
+  return L"";
+}
+
+// Tiles of the requested lights must lie inside the atlas without overlapping, no larger than asked (smaller
+// only once a repack shrunk them), and account for the used area.
+std::wstring CheckShadowAtlasTiles(const ShadowAtlas& atlas, const std::vector<ShadowAtlas::Request>& requests, const ShadowAtlas::UpdateStats& stats)
+{
+  std::vector<ShadowAtlas::Tile> tiles;
+  UINT shrunk_number = 0;
+  for (const ShadowAtlas::Request& request : requests) {
+    ShadowAtlas::Tile tile;
+    if (!atlas.GetTile(request.light_id, tile)) {
+      continue;
+    }
+    if (tile.x + tile.size > atlas.GetSize() || tile.y + tile.size > atlas.GetSize() || tile.size > request.size || (tile.size & (tile.size - 1)) != 0) {
+      return L"light " + std::to_wstring(request.light_id) + L" got a tile outside the atlas or of the wrong size";
+    }
+    shrunk_number += tile.size < request.size ? 1 : 0;
+    for (const ShadowAtlas::Tile& other : tiles) {
+      if (tile.x < other.x + other.size && other.x < tile.x + tile.size && tile.y < other.y + other.size && other.y < tile.y + tile.size) {
+        return L"light " + std::to_wstring(request.light_id) + L" got a tile overlapping another";
+      }
+    }
+    tiles.push_back(tile);
+  }
+  UINT64 used_area = 0;
+  for (const ShadowAtlas::Tile& tile : tiles) {
+    used_area += static_cast<UINT64>(tile.size) * tile.size;
+  }
+  if (tiles.size() != atlas.GetTileNumber() || used_area != atlas.GetUsedArea()) {
+    return L"the atlas holds tiles of lights that weren't requested";
+  }
+  if (tiles.size() + stats.unplaced_number != requests.size() || (stats.repacked && shrunk_number != stats.shrunk_number)) {
+    return L"the update stats don't match the tiles";
+  }
+  return L"";
+}
+
+// Fills an atlas exactly, frees it tile by tile into room for one tile as large as the atlas, overfills it and
+// then runs updates of random lights, checking the tiles after each.
+std::wstring CheckShadowAtlasPacking()
+{
+  const UINT atlas_size = 1024;
+  ShadowAtlas atlas(atlas_size);
+  std::vector<ShadowAtlas::Request> requests;
+  for (UINT i = 0; i < 16; ++i) {
+    requests.push_back({ i, atlas_size / 4 });
+  }
+  ShadowAtlas::UpdateStats stats = atlas.Update(requests);
+  std::wstring failure = CheckShadowAtlasTiles(atlas, requests, stats);
+  if (!failure.empty()) {
+    return failure;
+  }
+  if (stats.placed_number != 16 || stats.repacked || atlas.GetUsedArea() != static_cast<UINT64>(atlas_size) * atlas_size) {
+    return L"16 quarter tiles didn't fill the atlas";
+  }
+
+  // Lights keeping their size keep their tile while the others leave.
+  ShadowAtlas::Tile kept_tile;
+  atlas.GetTile(5, kept_tile);
+  requests = { { 5, atlas_size / 4 } };
+  stats = atlas.Update(requests);
+  ShadowAtlas::Tile tile;
+  if (stats.kept_number != 1 || !atlas.GetTile(5, tile) || tile.x != kept_tile.x || tile.y != kept_tile.y || tile.size != kept_tile.size) {
+    return L"a light keeping its size lost its tile";
+  }
+
+  // The freed tiles merge back into the whole atlas.
+  requests = { { 100, atlas_size } };
+  stats = atlas.Update(requests);
+  if (stats.placed_number != 1 || stats.repacked || !atlas.GetTile(100, tile) || tile.size != atlas_size) {
+    return L"the freed tiles didn't merge back into the whole atlas";
+  }
+
+  // One quarter of the atlas too many: a tile must be shrunk.
+  requests.clear();
+  for (UINT i = 0; i < 5; ++i) {
+    requests.push_back({ i, atlas_size / 2 });
+  }
+  stats = atlas.Update(requests);
+  failure = CheckShadowAtlasTiles(atlas, requests, stats);
+  if (!failure.empty()) {
+    return failure;
+  }
+  if (!stats.repacked || stats.shrunk_number == 0 || stats.unplaced_number != 0) {
+    return L"an overfull atlas wasn't repacked with shrunk tiles";
+  }
+
+  uint32_t state = 0x6b43a9b5u;
+  auto random = [&state](UINT range) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % range;
+  };
+  for (UINT frame = 0; frame < 200; ++frame) {
+    requests.clear();
+    const UINT light_number = 1 + random(40);
+    for (UINT i = 0; i < light_number; ++i) {
+      requests.push_back({ random(60), ShadowAtlas::kMinTileSize << random(6) });
+    }
+    // Later requests for a light override earlier ones, as in Update.
+    std::vector<ShadowAtlas::Request> unique_requests;
+    for (auto it = requests.rbegin(); it != requests.rend(); ++it) {
+      if (std::none_of(unique_requests.begin(), unique_requests.end(), [it](const ShadowAtlas::Request& request) { return request.light_id == it->light_id; })) {
+        unique_requests.push_back(*it);
+      }
+    }
+    stats = atlas.Update(unique_requests);
+    failure = CheckShadowAtlasTiles(atlas, unique_requests, stats);
+    if (!failure.empty()) {
+      return L"frame " + std::to_wstring(frame) + L": " + failure;
+    }
+  }
+  return L"";
+}
+
+// Whether a world space point is inside a view projection's clip volume, depth in [0, w].
+bool IsInsideClipVolume(FXMMATRIX view_proj, FXMVECTOR point, bool include_near_plane)
+{
+  XMFLOAT4 clip;
+  XMStoreFloat4(&clip, XMVector4Transform(XMVectorSetW(point, 1.0f), view_proj));
+  return std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && (!include_near_plane || clip.z >= 0.0f) && clip.z <= clip.w;
+}
+
+// Random boxes over several chunks (and a partial group of four) culled against a camera and a light, against
+// IsVisible one box at a time; no box whose center is in view may be culled, and a few known boxes land on
+// the right side of each plane.
+std::wstring CheckFrustumCulling()
+{
+  const XMMATRIX camera_view_proj = XMMatrixMultiply(
+    XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+    XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 1.0f, 100.0f));
+  const XMMATRIX light_view_proj = XMMatrixMultiply(
+    XMMatrixLookToLH(XMVectorSet(0.0f, 50.0f, 0.0f, 1.0f), XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)),
+    XMMatrixOrthographicLH(60.0f, 60.0f, 10.0f, 100.0f));
+  const FrustumCuller::Frustum frustums[] = {
+    FrustumCuller::ComputeFrustum(camera_view_proj, true),
+    FrustumCuller::ComputeFrustum(light_view_proj, false),
+  };
+  const bool include_near_planes[] = { true, false };
+  const XMMATRIX view_projs[] = { camera_view_proj, light_view_proj };
+  const size_t frustum_number = sizeof(frustums) / sizeof(frustums[0]);
+
+  struct KnownBox {
+    FrustumCuller::BoundingBox bounds;
+    bool visible[2];  // camera, light
+  };  // struct KnownBox
+  const KnownBox known_boxes[] = {
+    { { XMFLOAT3(-1.0f, -1.0f, 10.0f), XMFLOAT3(1.0f, 1.0f, 12.0f) }, { true, true } },
+    { { XMFLOAT3(-1.0f, -1.0f, -12.0f), XMFLOAT3(1.0f, 1.0f, -10.0f) }, { false, true } },  // behind the camera
+    { { XMFLOAT3(-1.0f, -1.0f, 110.0f), XMFLOAT3(1.0f, 1.0f, 112.0f) }, { false, false } },  // past the far planes
+    { { XMFLOAT3(-1.0f, 45.0f, 50.0f), XMFLOAT3(1.0f, 47.0f, 52.0f) }, { true, false } },  // off the light's sides
+    { { XMFLOAT3(-1.0f, 45.0f, 10.0f), XMFLOAT3(1.0f, 47.0f, 12.0f) }, { false, true } },  // before the light's near plane
+  };
+  for (size_t i = 0; i < sizeof(known_boxes) / sizeof(known_boxes[0]); ++i) {
+    for (size_t f = 0; f < frustum_number; ++f) {
+      if (FrustumCuller::IsVisible(frustums[f], known_boxes[i].bounds) != known_boxes[i].visible[f]) {
+        return L"known box " + std::to_wstring(i) + L" is on the wrong side of frustum " + std::to_wstring(f);
+      }
+    }
+  }
+
+  const size_t object_number = 3 * FrustumCuller::kChunkSize + 3;
+  std::vector<FrustumCuller::BoundingBox> object_bounds(object_number);
+  uint32_t state = 0x1b873593u;
+  auto random = [&state](float low, float high) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return low + (high - low) * (state & 0xFFFF) / 65535.0f;
+  };
+  for (FrustumCuller::BoundingBox& bounding_box : object_bounds) {
+    bounding_box.min = XMFLOAT3(random(-120.0f, 120.0f), random(-120.0f, 120.0f), random(-120.0f, 120.0f));
+    bounding_box.max = XMFLOAT3(bounding_box.min.x + random(0.1f, 8.0f), bounding_box.min.y + random(0.1f, 8.0f), bounding_box.min.z + random(0.1f, 8.0f));
+  }
+
+  FrustumCuller culler(2);
+  culler.SetBounds(object_bounds.data(), object_number);
+  std::vector<UINT> visible_lists[frustum_number];
+  culler.Cull(frustums, frustum_number, visible_lists);
+  for (size_t f = 0; f < frustum_number; ++f) {
+    std::vector<UINT> expected_list;
+    for (size_t i = 0; i < object_number; ++i) {
+      const FrustumCuller::BoundingBox& bounding_box = object_bounds[i];
+      const bool visible = FrustumCuller::IsVisible(frustums[f], bounding_box);
+      const XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&bounding_box.min), XMLoadFloat3(&bounding_box.max)), 0.5f);
+      if (!visible && IsInsideClipVolume(view_projs[f], center, include_near_planes[f])) {
+        return L"box " + std::to_wstring(i) + L" is culled from frustum " + std::to_wstring(f) + L" with its center in view";
+      }
+      if (visible) {
+        expected_list.push_back(static_cast<UINT>(i));
+      }
+    }
+    if (visible_lists[f] != expected_list) {
+      return L"culling frustum " + std::to_wstring(f) + L" four boxes at a time doesn't match one at a time";
+    }
+    if (expected_list.empty() || expected_list.size() == object_number) {
+      return L"frustum " + std::to_wstring(f) + L" sees all or none of the boxes, the check proves nothing";
+    }
+  }
+  return L"";
+}
+
+// Whether every node holds its children or objects, and every object is in exactly one leaf.
+std::wstring CheckBoundingVolumeHierarchyNodes(const BoundingVolumeHierarchy& bvh, const std::vector<BoundingVolumeHierarchy::BoundingBox>& object_bounds)
+{
+  auto contains = [](const BoundingVolumeHierarchy::BoundingBox& outer, const BoundingVolumeHierarchy::BoundingBox& inner) {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+      outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+  };
+  const std::vector<BoundingVolumeHierarchy::Node>& nodes = bvh.GetNodes();
+  const std::vector<UINT>& object_indices = bvh.GetObjectIndices();
+  std::vector<UINT> leaf_numbers(object_bounds.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const BoundingVolumeHierarchy::Node& node = nodes[i];
+    if (node.first_child != 0) {
+      if (!contains(node.bounds, nodes[node.first_child].bounds) || !contains(node.bounds, nodes[node.first_child + 1].bounds)) {
+        return L"node " + std::to_wstring(i) + L" doesn't hold its children";
+      }
+      continue;
+    }
+    for (UINT j = node.object_begin; j < node.object_begin + node.object_number; ++j) {
+      leaf_numbers[object_indices[j]]++;
+      if (!contains(node.bounds, object_bounds[object_indices[j]])) {
+        return L"leaf " + std::to_wstring(i) + L" doesn't hold its objects";
+      }
+    }
+  }
+  if (std::any_of(leaf_numbers.begin(), leaf_numbers.end(), [](UINT leaf_number) { return leaf_number != 1; })) {
+    return L"an object isn't in exactly one leaf";
+  }
+  return L"";
+}
+
+// Distance along the ray to where it enters the box, 0 from inside, FLT_MAX if it misses; in double, slab by slab.
+float ComputeRayBoxDistance(const XMFLOAT3& origin, const XMFLOAT3& direction, const BoundingVolumeHierarchy::BoundingBox& box)
+{
+  const double origins[3] = { origin.x, origin.y, origin.z };
+  const double directions[3] = { direction.x, direction.y, direction.z };
+  const double mins[3] = { box.min.x, box.min.y, box.min.z };
+  const double maxs[3] = { box.max.x, box.max.y, box.max.z };
+  double enter = 0.0;
+  double exit = DBL_MAX;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (directions[axis] == 0.0) {
+      if (origins[axis] < mins[axis] || origins[axis] > maxs[axis]) {
+        return FLT_MAX;
+      }
+      continue;
+    }
+    const double t0 = (mins[axis] - origins[axis]) / directions[axis];
+    const double t1 = (maxs[axis] - origins[axis]) / directions[axis];
+    enter = std::max(enter, std::min(t0, t1));
+    exit = std::min(exit, std::max(t0, t1));
+  }
+  return enter <= exit ? static_cast<float>(enter) : FLT_MAX;
+}
+
+// A tree over random boxes, built on two threads, answers frustum, ray and nearest queries as testing every box
+// would, before and after a refit of moved boxes.
+std::wstring CheckBoundingVolumeHierarchyQueries()
+{
+  const size_t object_number = 10000;
+  std::vector<BoundingVolumeHierarchy::BoundingBox> object_bounds(object_number);
+  uint32_t state = 0x85ebca6bu;
+  auto random = [&state](float low, float high) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return low + (high - low) * (state & 0xFFFF) / 65535.0f;
+  };
+  auto random_box = [&random]() {
+    BoundingVolumeHierarchy::BoundingBox bounding_box;
+    bounding_box.min = XMFLOAT3(random(-200.0f, 200.0f), random(-50.0f, 50.0f), random(-200.0f, 200.0f));
+    bounding_box.max = XMFLOAT3(bounding_box.min.x + random(0.1f, 6.0f), bounding_box.min.y + random(0.1f, 6.0f), bounding_box.min.z + random(0.1f, 6.0f));
+    return bounding_box;
+  };
+  for (BoundingVolumeHierarchy::BoundingBox& bounding_box : object_bounds) {
+    bounding_box = random_box();
+  }
+
+  // A camera, a light without its near plane and the six faces of a point light.
+  std::vector<FrustumCuller::Frustum> frustums = {
+    FrustumCuller::ComputeFrustum(XMMatrixMultiply(
+      XMMatrixLookToLH(XMVectorSet(0.0f, 10.0f, -150.0f, 1.0f), XMVectorSet(0.3f, -0.1f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+      XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 250.0f)), true),
+    FrustumCuller::ComputeFrustum(XMMatrixMultiply(
+      XMMatrixLookToLH(XMVectorSet(0.0f, 100.0f, 0.0f, 1.0f), XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f)),
+      XMMatrixOrthographicLH(150.0f, 150.0f, 1.0f, 200.0f)), false),
+  };
+  const XMVECTOR light_position = XMVectorSet(20.0f, 0.0f, 20.0f, 1.0f);
+  for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+    frustums.push_back(FrustumCuller::ComputeFrustum(XMMatrixMultiply(CubeShadowMap::ComputeFaceView(light_position, face),
+                                                                      CubeShadowMap::ComputeFaceProj(0.1f, 60.0f)), true));
+  }
+
+  BoundingVolumeHierarchy bvh(2);
+  bvh.Build(object_bounds.data(), object_number);
+  for (int pass = 0; pass < 2; ++pass) {
+    const std::wstring when = pass == 0 ? L"built: " : L"refitted: ";
+    std::wstring failure = CheckBoundingVolumeHierarchyNodes(bvh, object_bounds);
+    if (!failure.empty()) {
+      return when + failure;
+    }
+
+    std::vector<std::vector<UINT>> visible_lists(frustums.size());
+    bvh.QueryFrustums(frustums.data(), static_cast<UINT>(frustums.size()), visible_lists.data());
+    for (size_t f = 0; f < frustums.size(); ++f) {
+      std::vector<UINT> expected_list;
+      for (size_t i = 0; i < object_number; ++i) {
+        if (FrustumCuller::IsVisible(frustums[f], object_bounds[i])) {
+          expected_list.push_back(static_cast<UINT>(i));
+        }
+      }
+      if (visible_lists[f] != expected_list) {
+        return when + L"frustum " + std::to_wstring(f) + L" sees other objects than testing every box";
+      }
+    }
+
+    for (int query = 0; query < 200; ++query) {
+      const XMFLOAT3 origin(random(-250.0f, 250.0f), random(-60.0f, 60.0f), random(-250.0f, 250.0f));
+      const XMFLOAT3 direction(random(-1.0f, 1.0f), random(-0.2f, 0.2f), random(-1.0f, 1.0f));
+      float expected_distance = FLT_MAX;
+      float expected_nearest_distance = FLT_MAX;
+      for (const BoundingVolumeHierarchy::BoundingBox& bounding_box : object_bounds) {
+        expected_distance = std::min(expected_distance, ComputeRayBoxDistance(origin, direction, bounding_box));
+        const float dx = std::max(std::max(bounding_box.min.x - origin.x, origin.x - bounding_box.max.x), 0.0f);
+        const float dy = std::max(std::max(bounding_box.min.y - origin.y, origin.y - bounding_box.max.y), 0.0f);
+        const float dz = std::max(std::max(bounding_box.min.z - origin.z, origin.z - bounding_box.max.z), 0.0f);
+        expected_nearest_distance = std::min(expected_nearest_distance, std::sqrt(dx * dx + dy * dy + dz * dz));
+      }
+
+      const float max_distance = 1000.0f;
+      BoundingVolumeHierarchy::RayHit ray_hit;
+      const bool ray_found = bvh.Raycast(XMLoadFloat3(&origin), XMLoadFloat3(&direction), max_distance, ray_hit);
+      if (ray_found != (expected_distance <= max_distance) ||
+          (ray_found && std::fabs(ray_hit.distance - expected_distance) > 1e-3f * std::max(1.0f, expected_distance))) {
+        return when + L"ray " + std::to_wstring(query) + L" hits another box than testing every box";
+      }
+      BoundingVolumeHierarchy::NearestHit nearest_hit;
+      if (!bvh.FindNearest(XMLoadFloat3(&origin), FLT_MAX, nearest_hit) ||
+          std::fabs(nearest_hit.distance - expected_nearest_distance) > 1e-3f * std::max(1.0f, expected_nearest_distance)) {
+        return when + L"point " + std::to_wstring(query) + L" is nearest another box than testing every box";
+      }
+    }
+
+    // Every tenth box moves anywhere.
+    std::vector<size_t> changed_object_indices;
+    std::vector<BoundingVolumeHierarchy::BoundingBox> changed_object_bounds;
+    for (size_t i = 0; i < object_number; i += 10) {
+      object_bounds[i] = random_box();
+      changed_object_indices.push_back(i);
+      changed_object_bounds.push_back(object_bounds[i]);
+    }
+    bvh.Refit(changed_object_indices.data(), changed_object_bounds.data(), changed_object_indices.size());
+  }
+  return L"";
+}
+
+// Records read back at the command signature's stride as the GPU would, a root SRV address and then
+// D3D12_DRAW_INDEXED_ARGUMENTS, and never written past max_record_number.
+std::wstring CheckIndirectDrawRecords()
+{
+  const AssetsManager::InstanceBatch batches[] = {
+    { 36, 0, 0, 0, 0, 5 },
+    { 6, 36, 24, 1, 5, 1 },
+    { 3000, 42, 28, -1, 6, 100 },
+  };
+  const UINT batch_number = sizeof(batches) / sizeof(batches[0]);
+  const UINT64 transforms_address = 0x12340000ull;
+  const UINT transform_stride = sizeof(XMFLOAT4X4);
+  const uint8_t kUnwritten = 0xCD;
+  std::vector<uint8_t> buffer((batch_number + 1) * IndirectDrawBuilder::kRecordStride, kUnwritten);
+
+  if (IndirectDrawBuilder::WriteRecords(batches, batch_number, transforms_address, transform_stride,
+                                        reinterpret_cast<IndirectDrawBuilder::DrawRecord*>(buffer.data()), batch_number - 1) != batch_number - 1) {
+    return L"more records were written than allowed";
+  }
+  if (buffer[(batch_number - 1) * IndirectDrawBuilder::kRecordStride] != kUnwritten) {
+    return L"a record was written past the maximum";
+  }
+  if (IndirectDrawBuilder::WriteRecords(batches, batch_number, transforms_address, transform_stride,
+                                        reinterpret_cast<IndirectDrawBuilder::DrawRecord*>(buffer.data()), batch_number + 1) != batch_number) {
+    return L"not every batch got a record";
+  }
+  for (UINT i = 0; i < batch_number; ++i) {
+    const uint8_t* record = buffer.data() + i * IndirectDrawBuilder::kRecordStride;
+    UINT64 address;
+    D3D12_DRAW_INDEXED_ARGUMENTS arguments;
+    std::memcpy(&address, record, sizeof(address));
+    std::memcpy(&arguments, record + sizeof(address), sizeof(arguments));
+    if (address != transforms_address + static_cast<UINT64>(transform_stride) * batches[i].first_instance) {
+      return L"record " + std::to_wstring(i) + L" points at the wrong transforms";
+    }
+    if (arguments.IndexCountPerInstance != batches[i].index_count || arguments.InstanceCount != batches[i].instance_number ||
+        arguments.StartIndexLocation != batches[i].index_start || arguments.BaseVertexLocation != static_cast<INT>(batches[i].vertex_base) ||
+        arguments.StartInstanceLocation != 0) {
+      return L"record " + std::to_wstring(i) + L" doesn't read back as the batch's draw arguments";
+    }
+  }
+  if (buffer[batch_number * IndirectDrawBuilder::kRecordStride] != kUnwritten) {
+    return L"a record was written past the batches";
+  }
+  return L"";
+}
+
+// A ring of four slots filled up, wrapped around and given back a frame at a time as the fence passes, then
+// random frames whose live allocations must never overlap.
+std::wstring CheckRingAllocator()
+{
+  const UINT64 slot = RingAllocator::kAlignment;
+  RingAllocator ring(4 * slot - 1);
+  if (ring.GetCapacity() != 4 * slot || ring.Allocate(0) != RingAllocator::kInvalidOffset || ring.Allocate(4 * slot + 1) != RingAllocator::kInvalidOffset) {
+    return L"the capacity isn't aligned or impossible sizes were allocated";
+  }
+
+  ring.BeginFrame(1, 0);
+  if (ring.Allocate(1) != 0 || ring.Allocate(slot) != slot || ring.GetUsedSize() != 2 * slot) {
+    return L"frame 1 didn't get the first two slots";
+  }
+  ring.BeginFrame(2, 0);
+  if (ring.Allocate(3 * slot) != RingAllocator::kInvalidOffset) {
+    return L"frame 2 got three slots with frame 1 in flight";
+  }
+  if (ring.Allocate(slot) != 2 * slot || ring.Allocate(slot) != 3 * slot || ring.Allocate(1) != RingAllocator::kInvalidOffset) {
+    return L"frame 2 didn't fill the ring up";
+  }
+
+  ring.BeginFrame(3, 1);  // frame 1 is done, frame 2 isn't
+  if (ring.GetUsedSize() != 2 * slot) {
+    return L"frame 1 wasn't given back once its fence passed";
+  }
+  if (ring.Allocate(slot) != 0 || ring.Allocate(slot) != slot || ring.Allocate(1) != RingAllocator::kInvalidOffset) {
+    return L"frame 3 didn't wrap around into frame 1's slots alone";
+  }
+
+  ring.BeginFrame(4, 3);  // frame 3 is closed first, then frames 2 and 3 are given back
+  if (ring.GetUsedSize() != 0 || ring.GetFrameFenceValue() != 4) {
+    return L"frames 2 and 3 weren't given back";
+  }
+  if (ring.Allocate(3 * slot) != RingAllocator::kInvalidOffset || ring.Allocate(2 * slot) != 2 * slot) {
+    return L"frame 4 didn't continue after frame 3 up to the end";
+  }
+  ring.BeginFrame(5, 4);
+  if (ring.Allocate(3 * slot) != 0) {
+    return L"frame 5 didn't start over at 0";
+  }
+  ring.BeginFrame(6, 5);
+  // Two slots don't fit after frame 5's three: the last one is wasted and the allocation starts over at 0.
+  if (ring.Allocate(2 * slot) != 0 || ring.GetUsedSize() != 3 * slot) {
+    return L"an allocation past the end didn't start over at 0, wasting the rest";
+  }
+
+  // Frame f signals fence f + 1 and the GPU trails two frames behind; every live allocation is checked
+  // against the others, live meaning its frame's fence hasn't been passed.
+  struct LiveAllocation {
+    UINT64 fence_value;
+    UINT64 offset;
+    UINT64 size;
+  };  // struct LiveAllocation
+  const UINT frames_in_flight = 2;
+  RingAllocator random_ring(64 * slot);
+  std::vector<LiveAllocation> live_allocations;
+  uint32_t state = 0xc2b2ae35u;
+  auto random = [&state](UINT range) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % range;
+  };
+  UINT64 allocation_number = 0;
+  for (UINT frame = 0; frame < 1000; ++frame) {
+    const UINT64 fence_value = frame + 1;
+    const UINT64 completed_fence_value = fence_value > frames_in_flight + 1 ? fence_value - frames_in_flight - 1 : 0;
+    random_ring.BeginFrame(fence_value, completed_fence_value);
+    live_allocations.erase(std::remove_if(live_allocations.begin(), live_allocations.end(), [completed_fence_value](const LiveAllocation& allocation) {
+      return allocation.fence_value <= completed_fence_value;
+      }), live_allocations.end());
+
+    const UINT frame_allocation_number = random(12);
+    for (UINT i = 0; i < frame_allocation_number; ++i) {
+      const UINT64 size = 1 + random(static_cast<UINT>(3 * slot));
+      const UINT64 offset = random_ring.Allocate(size);
+      if (offset == RingAllocator::kInvalidOffset) {
+        continue;
+      }
+      allocation_number++;
+      if (offset % RingAllocator::kAlignment != 0 || offset + size > random_ring.GetCapacity()) {
+        return L"frame " + std::to_wstring(frame) + L" got a misaligned or out of range offset";
+      }
+      for (const LiveAllocation& allocation : live_allocations) {
+        if (offset < allocation.offset + allocation.size && allocation.offset < offset + size) {
+          return L"frame " + std::to_wstring(frame) + L" got memory still in flight";
+        }
+      }
+      live_allocations.push_back({ fence_value, offset, size });
+    }
+  }
+  if (allocation_number == 0) {
+    return L"no random allocation succeeded";
+  }
+  return L"";
+}
+
+struct Check {
+  const wchar_t* name;
+  std::wstring (*run)();
+};  // struct Check
+
+const Check kChecks[] = {
+  { L"JPEG over-subscribed Huffman table", CheckJpegRejectsOverSubscribedHuffmanTable },
+  { L"HDR runs of runs", CheckHdrRejectsLongRunsOfRuns },
+  { L"PNG inflate size limit", CheckInflateStopsAtMaxSize },
+  { L"Decoded image size overflow", CheckImageSizeFitsInt },
+  { L"Cascade splits increase", CheckCascadeSplitsIncrease },
+  { L"Light frustum fitting", CheckLightFrustumFitsReceiversAndCasters },
+  { L"Cube shadow face masks", CheckCubeFaceMasks },
+  { L"Shadow cache actions", CheckShadowCacheActions },
+  { L"Shadow atlas packing", CheckShadowAtlasPacking },
+  { L"Frustum culling", CheckFrustumCulling },
+  { L"Bounding volume hierarchy queries", CheckBoundingVolumeHierarchyQueries },
+  { L"Indirect draw record layout", CheckIndirectDrawRecords },
+  { L"Ring allocator wrap-around and retirement", CheckRingAllocator },
+};
+
+}  // namespace
+
+std::vector<SelfTest::Result> SelfTest::Run()
+{
+  std::vector<Result> results;
+  for (const Check& check : kChecks) {
+    results.push_back({ check.name, check.run() });
+  }
+  return results;
+}
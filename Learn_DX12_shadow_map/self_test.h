@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Known-answer checks of the CPU modules, run with -selfTest before the window and the device are created, so
+// they work on machines without a GPU.
+class SelfTest {
+ public:
+  struct Result {
+    const wchar_t* name;
+    std::wstring failure;  // what went wrong, empty if the check passed
+  };  // struct Result
+
+  static std::vector<Result> Run();
+};  // class SelfTest
@@ -0,0 +1,317 @@
+#include "shadow_atlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+constexpr UINT ShadowAtlas::kMinTileSize;
+
+namespace {
+
+// Largest first, then by id so equal updates pack the same way.
+void SortRequests(std::vector<ShadowAtlas::Request>& requests)
+{
+  std::sort(requests.begin(), requests.end(), [](const ShadowAtlas::Request& a, const ShadowAtlas::Request& b) {
+    return a.size != b.size ? a.size > b.size : a.light_id < b.light_id;
+  });
+}
+
+bool IsSameTile(const ShadowAtlas::Tile& a, const ShadowAtlas::Tile& b)
+{
+  return a.x == b.x && a.y == b.y && a.size == b.size;
+}
+
+}  // namespace
+
+UINT ShadowAtlas::ComputeTileSize(float screen_coverage, UINT min_size, UINT max_size)
+{
+  const float side = std::sqrt(std::min(std::max(screen_coverage, 0.0f), 1.0f)) * max_size;
+  UINT size = std::max(min_size, 1u);
+  while (size < side && size < max_size) {
+    size <<= 1;
+  }
+  return std::min(size, max_size);
+}
+
+float ShadowAtlas::ComputeScreenCoverage(float sphere_radius, float distance, float tan_half_fov_y)
+{
+  if (distance <= sphere_radius) {
+    return 1.0f;
+  }
+  // The projected radius over half the screen height, squared.
+  const float projected_radius = sphere_radius / (std::sqrt(distance * distance - sphere_radius * sphere_radius) * tan_half_fov_y);
+  return std::min(projected_radius * projected_radius, 1.0f);
+}
+
+ShadowAtlas::BenchmarkReport ShadowAtlas::Benchmark(UINT atlas_size, UINT light_number, UINT frame_number)
+{
+  BenchmarkReport report{};
+  if (light_number == 0 || frame_number == 0) {
+    return report;
+  }
+
+  std::mt19937 random_engine(light_number);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  // Most lights are small on screen, a few cover much of it.
+  const auto random_coverage = [&random_engine, &unit]() {
+    const float u = unit(random_engine);
+    return u * u * u * 0.25f;
+  };
+
+  struct Light {
+    UINT id;
+    float coverage;
+  };  // struct Light
+  std::vector<Light> lights(light_number);
+  UINT next_light_id = 0;
+  for (Light& light : lights) {
+    light = { next_light_id++, random_coverage() };
+  }
+
+  ShadowAtlas atlas(atlas_size);
+  std::vector<Request> requests(light_number);
+  double total_microseconds = 0.0;
+  UINT repack_number = 0;
+  UINT64 placed_number = 0;
+  double occupancy_sum = 0.0;
+  for (UINT frame = 0; frame < frame_number; ++frame) {
+    for (Light& light : lights) {
+      const float u = unit(random_engine);
+      if (u < 0.02f) {
+        light = { next_light_id++, random_coverage() };
+      }
+      else if (u < 0.12f) {
+        light.coverage = std::min(light.coverage * (0.7f + 0.6f * unit(random_engine)), 1.0f);
+      }
+    }
+    for (UINT i = 0; i < light_number; ++i) {
+      requests[i] = { lights[i].id, ComputeTileSize(lights[i].coverage, kMinTileSize, atlas_size / 8) };
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const UpdateStats stats = atlas.Update(requests);
+    const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+
+    total_microseconds += microseconds;
+    report.max_microseconds_per_update = std::max(report.max_microseconds_per_update, microseconds);
+    repack_number += stats.repacked ? 1 : 0;
+    placed_number += stats.placed_number;
+    report.shrunk_number += stats.shrunk_number;
+    report.unplaced_number += stats.unplaced_number;
+    occupancy_sum += static_cast<double>(atlas.GetUsedArea()) / (static_cast<double>(atlas_size) * atlas_size);
+  }
+
+  report.microseconds_per_update = total_microseconds / frame_number;
+  report.repack_fraction = static_cast<double>(repack_number) / frame_number;
+  report.placed_per_update = static_cast<double>(placed_number) / frame_number;
+  report.occupancy = occupancy_sum / frame_number;
+  return report;
+}
+
+ShadowAtlas::ShadowAtlas(UINT size) : size_(size)
+{
+  Clear();
+}
+
+ShadowAtlas::UpdateStats ShadowAtlas::Update(const std::vector<Request>& requests)
+{
+  UpdateStats stats{};
+  std::unordered_map<UINT, UINT> requested_sizes;
+  for (const Request& request : requests) {
+    requested_sizes[request.light_id] = request.size;
+  }
+
+  // Gone and resized lights give their tiles back first, so the others can reuse the space.
+  for (auto it = tiles_.begin(); it != tiles_.end();) {
+    const auto requested_size = requested_sizes.find(it->first);
+    if (requested_size == requested_sizes.end() || requested_size->second != it->second.requested_size) {
+      Release(it->second.tile);
+      it = tiles_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  stats.kept_number = static_cast<UINT>(tiles_.size());
+
+  std::vector<Request> new_requests;
+  for (const Request& request : requests) {
+    if (tiles_.find(request.light_id) == tiles_.end()) {
+      new_requests.push_back(request);
+    }
+  }
+  SortRequests(new_requests);
+  for (const Request& request : new_requests) {
+    Tile tile;
+    if (!Allocate(std::min(std::max(request.size, kMinTileSize), size_), tile)) {
+      Repack(requests, stats);
+      return stats;
+    }
+    tiles_[request.light_id] = { tile, request.size };
+    stats.placed_number++;
+  }
+  return stats;
+}
+
+bool ShadowAtlas::GetTile(UINT light_id, Tile& tile) const
+{
+  const auto it = tiles_.find(light_id);
+  if (it == tiles_.end()) {
+    return false;
+  }
+  tile = it->second.tile;
+  return true;
+}
+
+UINT64 ShadowAtlas::GetUsedArea() const
+{
+  UINT64 used_area = 0;
+  for (const auto& placement : tiles_) {
+    used_area += static_cast<UINT64>(placement.second.tile.size) * placement.second.tile.size;
+  }
+  return used_area;
+}
+
+void ShadowAtlas::Clear()
+{
+  tiles_.clear();
+  free_rects_.clear();
+  if (size_ > 0) {
+    free_rects_.push_back({ 0, 0, size_, size_ });
+  }
+}
+
+bool ShadowAtlas::Allocate(UINT size, Tile& tile)
+{
+  // Best short side fit: the free rectangle the tile leaves the thinnest strip of.
+  size_t best_index = free_rects_.size();
+  UINT best_short_side = 0;
+  UINT64 best_area = 0;
+  for (size_t i = 0; i < free_rects_.size(); ++i) {
+    const Rect& rect = free_rects_[i];
+    if (rect.width < size || rect.height < size) {
+      continue;
+    }
+    const UINT short_side = std::min(rect.width - size, rect.height - size);
+    const UINT64 area = static_cast<UINT64>(rect.width) * rect.height;
+    if (best_index == free_rects_.size() || short_side < best_short_side || (short_side == best_short_side && area < best_area)) {
+      best_index = i;
+      best_short_side = short_side;
+      best_area = area;
+    }
+  }
+  if (best_index == free_rects_.size()) {
+    return false;
+  }
+
+  const Rect rect = free_rects_[best_index];
+  free_rects_[best_index] = free_rects_.back();
+  free_rects_.pop_back();
+  tile = { rect.x, rect.y, size };
+
+  // Split along the shorter leftover side, which keeps the larger of the two pieces as large as possible.
+  const UINT leftover_width = rect.width - size;
+  const UINT leftover_height = rect.height - size;
+  Rect right;
+  Rect bottom;
+  if (leftover_width < leftover_height) {
+    right = { rect.x + size, rect.y, leftover_width, size };
+    bottom = { rect.x, rect.y + size, rect.width, leftover_height };
+  }
+  else {
+    right = { rect.x + size, rect.y, leftover_width, rect.height };
+    bottom = { rect.x, rect.y + size, size, leftover_height };
+  }
+  if (right.width > 0 && right.height > 0) {
+    free_rects_.push_back(right);
+  }
+  if (bottom.width > 0 && bottom.height > 0) {
+    free_rects_.push_back(bottom);
+  }
+  return true;
+}
+
+void ShadowAtlas::Release(const Tile& tile)
+{
+  Rect merged = { tile.x, tile.y, tile.size, tile.size };
+  // Grow the freed rectangle with every free neighbour sharing one of its whole edges, until none is left.
+  bool grew = true;
+  while (grew) {
+    grew = false;
+    for (size_t i = 0; i < free_rects_.size(); ++i) {
+      const Rect& rect = free_rects_[i];
+      if (rect.x == merged.x && rect.width == merged.width && (rect.y + rect.height == merged.y || merged.y + merged.height == rect.y)) {
+        merged = { merged.x, std::min(rect.y, merged.y), merged.width, merged.height + rect.height };
+      }
+      else if (rect.y == merged.y && rect.height == merged.height && (rect.x + rect.width == merged.x || merged.x + merged.width == rect.x)) {
+        merged = { std::min(rect.x, merged.x), merged.y, merged.width + rect.width, merged.height };
+      }
+      else {
+        continue;
+      }
+      free_rects_[i] = free_rects_.back();
+      free_rects_.pop_back();
+      grew = true;
+      break;
+    }
+  }
+  free_rects_.push_back(merged);
+}
+
+void ShadowAtlas::Repack(const std::vector<Request>& requests, UpdateStats& stats)
+{
+  const std::unordered_map<UINT, Placement> previous_tiles = tiles_;
+  Clear();
+  stats = UpdateStats{};
+  stats.repacked = true;
+
+  // Power of two squares placed from the largest down leave no holes, so everything fits as long as the areas
+  // add up to at most the atlas'. Until they do, the largest tiles give up half their side, as they lose the
+  // least detail on screen for it.
+  std::vector<Request> fitted_requests = requests;
+  UINT64 total_area = 0;
+  for (Request& request : fitted_requests) {
+    request.size = std::min(std::max(request.size, kMinTileSize), size_);
+    total_area += static_cast<UINT64>(request.size) * request.size;
+  }
+  SortRequests(fitted_requests);
+  while (total_area > static_cast<UINT64>(size_) * size_ && !fitted_requests.empty() && fitted_requests.front().size > kMinTileSize) {
+    const UINT largest_size = fitted_requests.front().size;
+    for (size_t i = 0; i < fitted_requests.size() && fitted_requests[i].size == largest_size; ++i) {
+      fitted_requests[i].size >>= 1;
+      total_area -= static_cast<UINT64>(largest_size) * largest_size - static_cast<UINT64>(fitted_requests[i].size) * fitted_requests[i].size;
+    }
+    SortRequests(fitted_requests);
+  }
+
+  std::unordered_map<UINT, UINT> requested_sizes;
+  for (const Request& request : requests) {
+    requested_sizes[request.light_id] = request.size;
+  }
+  for (const Request& request : fitted_requests) {
+    // Only sizes that aren't powers of two can still miss, or kMinTileSize tiles once the atlas is full.
+    UINT size = request.size;
+    Tile tile;
+    bool allocated = Allocate(size, tile);
+    while (!allocated && size > kMinTileSize) {
+      size >>= 1;
+      allocated = Allocate(size, tile);
+    }
+    if (!allocated) {
+      stats.unplaced_number++;
+      continue;
+    }
+
+    const UINT requested_size = requested_sizes[request.light_id];
+    tiles_[request.light_id] = { tile, requested_size };
+    stats.shrunk_number += size < requested_size ? 1 : 0;
+    const auto previous_tile = previous_tiles.find(request.light_id);
+    if (previous_tile != previous_tiles.end() && IsSameTile(previous_tile->second.tile, tile)) {
+      stats.kept_number++;
+    }
+    else {
+      stats.placed_number++;
+    }
+  }
+}
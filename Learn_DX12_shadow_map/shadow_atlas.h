@@ -0,0 +1,103 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "common_headers.h"
+
+// Packs the shadow maps of many lights into square tiles of one large depth texture, with a guillotine packer:
+// a tile is cut out of the corner of the free rectangle that fits it best, and the rest of that rectangle is
+// split in two along the shorter leftover side. Freed tiles are merged back with free neighbours sharing a
+// whole edge.
+//
+// Updates are incremental: lights keeping their tile size keep their tile, so their shadow maps stay valid;
+// only new and resized lights are placed. When one of them no longer fits, everything is repacked from the
+// largest tile down, and tiles that still don't fit are halved until they do. Only the texture space is handled
+// here; the scene renders into the tiles.
+class ShadowAtlas {
+ public:
+  // Square, in texels from the atlas' top left.
+  struct Tile {
+    UINT x;
+    UINT y;
+    UINT size;
+  };  // struct Tile
+
+  struct Request {
+    UINT light_id;
+    UINT size;  // a power of two, see ComputeTileSize
+  };  // struct Request
+
+  struct UpdateStats {
+    UINT kept_number;  // lights whose tile didn't move
+    UINT placed_number;  // lights given a new tile, whose shadow map must be redrawn
+    UINT shrunk_number;  // lights given a smaller tile than requested
+    UINT unplaced_number;  // lights left without a tile
+    bool repacked;  // everything was placed again
+  };  // struct UpdateStats
+
+  struct BenchmarkReport {
+    double microseconds_per_update;
+    double max_microseconds_per_update;
+    double repack_fraction;  // of updates
+    double placed_per_update;
+    double occupancy;  // average fraction of the atlas covered by tiles
+    UINT64 shrunk_number;
+    UINT64 unplaced_number;
+  };  // struct BenchmarkReport
+
+  static constexpr UINT kMinTileSize = 16;
+
+  // A power of two between min_size and max_size, proportional to the side of the screen fraction a light
+  // covers, so its shadow map texels keep roughly the same size on screen.
+  static UINT ComputeTileSize(float screen_coverage, UINT min_size, UINT max_size);
+
+  // Screen fraction covered by a sphere distance away from the camera, with a vertical field of view of
+  // twice atan(tan_half_fov_y). 1 when the camera is inside.
+  static float ComputeScreenCoverage(float sphere_radius, float distance, float tan_half_fov_y);
+
+  // Runs frame_number updates of light_number lights on an atlas of atlas_size texels, where each frame
+  // some lights come and go and the rest change importance, as a moving camera would make them.
+  static BenchmarkReport Benchmark(UINT atlas_size, UINT light_number, UINT frame_number);
+
+  explicit ShadowAtlas(UINT size = 0);
+
+  UINT GetSize() const {
+    return size_;
+  }
+
+  // Gives a tile to every light in requests; lights missing from it lose theirs.
+  UpdateStats Update(const std::vector<Request>& requests);
+
+  // Returns false if the light has no tile.
+  bool GetTile(UINT light_id, Tile& tile) const;
+
+  size_t GetTileNumber() const {
+    return tiles_.size();
+  }
+
+  // Texels covered by tiles.
+  UINT64 GetUsedArea() const;
+
+ private:
+  struct Rect {
+    UINT x;
+    UINT y;
+    UINT width;
+    UINT height;
+  };  // struct Rect
+
+  struct Placement {
+    Tile tile;
+    UINT requested_size;  // tile.size is smaller if it was shrunk to fit
+  };  // struct Placement
+
+  void Clear();
+  bool Allocate(UINT size, Tile& tile);
+  void Release(const Tile& tile);
+  void Repack(const std::vector<Request>& requests, UpdateStats& stats);
+
+  UINT size_ = 0;
+  std::vector<Rect> free_rects_;
+  std::unordered_map<UINT, Placement> tiles_;  // by light id
+};  // class ShadowAtlas
@@ -0,0 +1,85 @@
+#include "shadow_cache.h"
+
+#include <algorithm>
+#include <cwctype>
+
+constexpr UINT64 ShadowCache::kHashSeed;
+
+namespace {
+
+const wchar_t* const kModeNames[] = {
+  L"off",
+  L"on",
+  L"split",
+};
+
+const wchar_t* const kActionNames[] = {
+  L"reused",
+  L"dynamic casters redrawn",
+  L"redrawn",
+};
+
+constexpr UINT64 kFnvPrime = 1099511628211ull;
+
+}  // namespace
+
+const wchar_t* ShadowCache::GetModeName(Mode mode)
+{
+  return kModeNames[static_cast<int>(mode)];
+}
+
+bool ShadowCache::ParseMode(const std::wstring& name, Mode& mode)
+{
+  for (int i = 0; i < static_cast<int>(Mode::kModeNumber); ++i) {
+    const std::wstring mode_name = kModeNames[i];
+    if (name.size() == mode_name.size() && std::equal(name.begin(), name.end(), mode_name.begin(),
+        [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; })) {
+      mode = static_cast<Mode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const wchar_t* ShadowCache::GetActionName(Action action)
+{
+  return kActionNames[static_cast<int>(action)];
+}
+
+UINT64 ShadowCache::Hash(const void* data, size_t size, UINT64 hash)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+ShadowCache::Action ShadowCache::Update(const Versions& versions)
+{
+  if (mode_ == Mode::kOff || !valid_ || versions.light != versions_.light || versions.static_casters != versions_.static_casters) {
+    action_ = Action::kRedrawAll;
+  }
+  else if (versions.dynamic_casters != versions_.dynamic_casters) {
+    action_ = mode_ == Mode::kStaticDynamicSplit ? Action::kRedrawDynamic : Action::kRedrawAll;
+  }
+  else {
+    action_ = Action::kReuse;
+  }
+
+  versions_ = versions;
+  valid_ = true;
+  return action_;
+}
+
+const ShadowCache::FrameStats& ShadowCache::RecordFrame(UINT draw_number, UINT full_draw_number)
+{
+  frame_stats_.action = action_;
+  frame_stats_.draw_number = draw_number;
+  frame_stats_.saved_draw_number = full_draw_number > draw_number ? full_draw_number - draw_number : 0;
+
+  frame_number_++;
+  reused_frame_number_ += action_ == Action::kReuse ? 1 : 0;
+  total_saved_draw_number_ += frame_stats_.saved_draw_number;
+  return frame_stats_;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+
+#include "common_headers.h"
+
+// Decides each frame whether a shadow map still holds what would be drawn into it, so the shadow pass can be
+// skipped while the light and the casters stand still. The scene hashes what a map depends on into versions
+// every update: the light (its type, position or direction and the view projections it renders with) and the
+// casters' draw arguments, the static and the dynamic ones apart.
+//
+// With the static/dynamic split the map's static layer is also kept in a copy, so when only dynamic casters
+// moved the copy is restored and just the dynamic casters are drawn over it. The scene owns the textures and
+// one cache per shadow map; nothing here needs a device.
+class ShadowCache {
+ public:
+  enum class Mode {
+    kOff,  // redraw every frame, the original behavior
+    kOn,  // redraw everything when any version changed
+    kStaticDynamicSplit,  // as kOn, but dynamic casters alone are composited over a saved static layer
+    kModeNumber,
+  };  // enum class Mode
+
+  enum class Action {
+    kReuse,  // keep last frame's map
+    kRedrawDynamic,  // restore the static layer, draw the dynamic casters over it
+    kRedrawAll,  // draw every caster; with the split, the static ones first, saved as the layer
+  };  // enum class Action
+
+  struct Versions {
+    UINT64 light;
+    UINT64 static_casters;
+    UINT64 dynamic_casters;
+  };  // struct Versions
+
+  struct FrameStats {
+    Action action;
+    UINT draw_number;  // issued into the map this frame
+    UINT saved_draw_number;  // what a full redraw would have issued, minus draw_number
+  };  // struct FrameStats
+
+  static constexpr UINT64 kHashSeed = 14695981039346656037ull;  // FNV-1a offset basis
+
+  static const wchar_t* GetModeName(Mode mode);
+
+  // Matches the mode names case-insensitively. Returns false, leaving mode alone, for anything else.
+  static bool ParseMode(const std::wstring& name, Mode& mode);
+
+  static const wchar_t* GetActionName(Action action);
+
+  // FNV-1a over size bytes, carrying on from hash, so several fields can be chained into one version.
+  static UINT64 Hash(const void* data, size_t size, UINT64 hash = kHashSeed);
+
+  void SetMode(Mode mode) {
+    mode_ = mode;
+    Invalidate();
+  }
+
+  Mode GetMode() const {
+    return mode_;
+  }
+
+  // What brings the map up to versions. The caller must carry it out this frame: versions become the cached ones.
+  Action Update(const Versions& versions);
+
+  // Forgets the map's content, e.g. when its texture was created or drawn to behind the cache's back.
+  void Invalidate() {
+    valid_ = false;
+  }
+
+  // Draws issued for this frame's action, against full_draw_number for drawing every caster.
+  const FrameStats& RecordFrame(UINT draw_number, UINT full_draw_number);
+
+  const FrameStats& GetFrameStats() const {
+    return frame_stats_;
+  }
+
+  UINT64 GetFrameNumber() const {
+    return frame_number_;
+  }
+
+  UINT64 GetReusedFrameNumber() const {
+    return reused_frame_number_;
+  }
+
+  UINT64 GetTotalSavedDrawNumber() const {
+    return total_saved_draw_number_;
+  }
+
+ private:
+  Mode mode_ = Mode::kOn;
+  bool valid_ = false;
+  Versions versions_{};
+  Action action_ = Action::kRedrawAll;
+  FrameStats frame_stats_{};
+  UINT64 frame_number_ = 0;
+  UINT64 reused_frame_number_ = 0;
+  UINT64 total_saved_draw_number_ = 0;
+};  // class ShadowCache
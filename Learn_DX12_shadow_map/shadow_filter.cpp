@@ -0,0 +1,456 @@
+#include "shadow_filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+
+#include "dds_texture.h"
+
+constexpr int ShadowFilter::kPoissonTapNumber;
+constexpr float ShadowFilter::kPcfRadiusTexels;
+constexpr float ShadowFilter::kPcssSearchRadiusTexels;
+constexpr float ShadowFilter::kPcssLightSizeTexels;
+constexpr float ShadowFilter::kPcssMaxFilterRadiusTexels;
+constexpr float ShadowFilter::kPcssDirectionalLightTanAngle;
+constexpr int ShadowFilter::kMomentsBlurRadius;
+constexpr float ShadowFilter::kEvsmPositiveExponent;
+constexpr float ShadowFilter::kEvsmNegativeExponent;
+constexpr float ShadowFilter::kMomentsMinVariance;
+constexpr float ShadowFilter::kLightBleedingReduction;
+
+const XMFLOAT2 ShadowFilter::kPoissonDisk[kPoissonTapNumber] = {
+  {-0.94201624f, -0.39906216f}, {0.94558609f, -0.76890725f}, {-0.09418410f, -0.92938870f}, {0.34495938f, 0.29387760f},
+  {-0.91588581f, 0.45771432f}, {-0.81544232f, -0.87912464f}, {-0.38277543f, 0.27676845f}, {0.97484398f, 0.75648379f},
+  {0.44323325f, -0.97511554f}, {0.53742981f, -0.47373420f}, {-0.26496911f, -0.41893023f}, {0.79197514f, 0.19090188f},
+  {-0.24188840f, 0.99706507f}, {-0.81409955f, 0.91437590f}, {0.19984126f, 0.78641367f}, {0.14383161f, -0.14100790f},
+};
+
+const float ShadowFilter::kMomentsBlurWeights[kMomentsBlurRadius + 1] = {
+  0.27068215f, 0.21674532f, 0.11128076f, 0.03663285f,
+};
+
+namespace {
+
+const wchar_t* const kModeNames[] = {
+  L"point",
+  L"pcf",
+  L"poisson",
+  L"pcss",
+  L"vsm",
+  L"evsm",
+};
+
+const D3D_SHADER_MACRO kModeDefines[][2] = {
+  { {"SHADOW_FILTER", "0"}, {nullptr, nullptr} },
+  { {"SHADOW_FILTER", "1"}, {nullptr, nullptr} },
+  { {"SHADOW_FILTER", "2"}, {nullptr, nullptr} },
+  { {"SHADOW_FILTER", "3"}, {nullptr, nullptr} },
+  { {"SHADOW_FILTER", "4"}, {nullptr, nullptr} },
+  { {"SHADOW_FILTER", "5"}, {nullptr, nullptr} },
+};
+
+// Light view depth of a stored depth, see ShadowFilter::ComputePerspectiveDepthParams.
+float LinearizeDepth(float depth, const XMFLOAT4& depth_params)
+{
+  return (depth_params.x + depth_params.y * depth) / (1.0f + depth_params.z * depth);
+}
+
+// Nearest texel, like Sample with a point filter. outside is returned off the map.
+float LoadDepth(const ShadowFilter::DepthMap& depth_map, int x, int y, float outside)
+{
+  if (x < 0 || y < 0 || x >= static_cast<int>(depth_map.width) || y >= static_cast<int>(depth_map.height)) {
+    return outside;
+  }
+  return depth_map.depths[static_cast<size_t>(y) * depth_map.width + x];
+}
+
+// SampleCmpLevelZero with a linear comparison filter and LESS_EQUAL: the four texels around (u, v) are
+// compared with reference, then the results are blended bilinearly. Off the map texels pass (white border).
+float SampleCmp(const ShadowFilter::DepthMap& depth_map, float u, float v, float reference)
+{
+  const float x = u * depth_map.width - 0.5f;
+  const float y = v * depth_map.height - 0.5f;
+  const float x0 = std::floor(x);
+  const float y0 = std::floor(y);
+  const float fx = x - x0;
+  const float fy = y - y0;
+  const int ix = static_cast<int>(x0);
+  const int iy = static_cast<int>(y0);
+
+  const float c00 = reference <= LoadDepth(depth_map, ix, iy, 1.0f) ? 1.0f : 0.0f;
+  const float c10 = reference <= LoadDepth(depth_map, ix + 1, iy, 1.0f) ? 1.0f : 0.0f;
+  const float c01 = reference <= LoadDepth(depth_map, ix, iy + 1, 1.0f) ? 1.0f : 0.0f;
+  const float c11 = reference <= LoadDepth(depth_map, ix + 1, iy + 1, 1.0f) ? 1.0f : 0.0f;
+  return (c00 * (1.0f - fx) + c10 * fx) * (1.0f - fy) + (c01 * (1.0f - fx) + c11 * fx) * fy;
+}
+
+// Offset of Poisson tap i, rotated, in texels.
+void GetTapOffset(int i, float cosine, float sine, float radius, float& dx, float& dy)
+{
+  const XMFLOAT2& tap = ShadowFilter::kPoissonDisk[i];
+  dx = (tap.x * cosine - tap.y * sine) * radius;
+  dy = (tap.x * sine + tap.y * cosine) * radius;
+}
+
+ShadowFilter::Sample PoissonPcf(const ShadowFilter::DepthMap& depth_map, float u, float v, float reference, float radius, float cosine, float sine)
+{
+  float lit = 0.0f;
+  for (int i = 0; i < ShadowFilter::kPoissonTapNumber; ++i) {
+    float dx, dy;
+    GetTapOffset(i, cosine, sine, radius, dx, dy);
+    lit += SampleCmp(depth_map, u + dx / depth_map.width, v + dy / depth_map.height, reference);
+  }
+  return { lit / ShadowFilter::kPoissonTapNumber, 4 * ShadowFilter::kPoissonTapNumber };
+}
+
+// Eight depths of a row from x on, two vectors of four; columns past the edge repeat the last one.
+void LoadDepthRow(const float* row, UINT width, UINT x, XMVECTOR& first, XMVECTOR& second)
+{
+  if (x + 8 <= width) {
+    first = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + x));
+    second = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + x + 4));
+    return;
+  }
+  float depths[8];
+  for (UINT i = 0; i < 8; ++i) {
+    depths[i] = row[std::min(x + i, width - 1)];
+  }
+  first = XMVectorSet(depths[0], depths[1], depths[2], depths[3]);
+  second = XMVectorSet(depths[4], depths[5], depths[6], depths[7]);
+}
+
+// The depth mapped to [-1, 1], then through both exponential warps; negative is made increasing with depth.
+void WarpDepth(float depth, float& positive, float& negative)
+{
+  const float warped_depth = 2.0f * depth - 1.0f;
+  positive = std::exp(ShadowFilter::kEvsmPositiveExponent * warped_depth);
+  negative = -std::exp(-ShadowFilter::kEvsmNegativeExponent * warped_depth);
+}
+
+// One direction of the separable blur over line_number lines of line_length texels, texel_stride apart along a
+// line and line_stride apart between lines.
+void BlurLines(const XMFLOAT4* source, XMFLOAT4* destination, UINT line_length, UINT line_number, size_t texel_stride, size_t line_stride)
+{
+  const int last = static_cast<int>(line_length) - 1;
+  for (UINT line = 0; line < line_number; ++line) {
+    const XMFLOAT4* source_line = source + line * line_stride;
+    XMFLOAT4* destination_line = destination + line * line_stride;
+    for (int i = 0; i <= last; ++i) {
+      XMVECTOR sum = XMVectorScale(XMLoadFloat4(&source_line[i * texel_stride]), ShadowFilter::kMomentsBlurWeights[0]);
+      for (int k = 1; k <= ShadowFilter::kMomentsBlurRadius; ++k) {
+        // The kernel is symmetric: both taps k texels away share a weight.
+        const XMVECTOR pair = XMVectorAdd(XMLoadFloat4(&source_line[std::max(i - k, 0) * texel_stride]),
+          XMLoadFloat4(&source_line[std::min(i + k, last) * texel_stride]));
+        sum = XMVectorMultiplyAdd(pair, XMVectorReplicate(ShadowFilter::kMomentsBlurWeights[k]), sum);
+      }
+      XMStoreFloat4(&destination_line[i * texel_stride], sum);
+    }
+  }
+}
+
+// One-tailed Chebyshev inequality: the largest fraction of the filtered depths that can lie at or beyond
+// reference, given their mean and mean square. Fractions under kLightBleedingReduction are cut off, since
+// that is where light leaks behind a second caster.
+float ChebyshevUpperBound(float mean, float mean_square, float reference, float min_variance)
+{
+  if (reference <= mean) {
+    return 1.0f;
+  }
+  const float variance = std::max(mean_square - mean * mean, min_variance);
+  const float distance = reference - mean;
+  const float lit = variance / (variance + distance * distance);
+  return std::min(std::max((lit - ShadowFilter::kLightBleedingReduction) / (1.0f - ShadowFilter::kLightBleedingReduction), 0.0f), 1.0f);
+}
+
+}  // namespace
+
+const wchar_t* ShadowFilter::GetModeName(Mode mode)
+{
+  return kModeNames[static_cast<int>(mode)];
+}
+
+bool ShadowFilter::ParseMode(const std::wstring& name, Mode& mode)
+{
+  for (int i = 0; i < static_cast<int>(Mode::kModeNumber); ++i) {
+    const std::wstring mode_name = kModeNames[i];
+    if (name.size() == mode_name.size() && std::equal(name.begin(), name.end(), mode_name.begin(),
+        [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; })) {
+      mode = static_cast<Mode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const D3D_SHADER_MACRO* ShadowFilter::GetShaderDefines(Mode mode)
+{
+  return kModeDefines[static_cast<int>(mode)];
+}
+
+DXGI_FORMAT ShadowFilter::GetMomentsFormat(Mode mode)
+{
+  return mode == Mode::kEvsm ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R32G32_FLOAT;
+}
+
+XMFLOAT4 ShadowFilter::ComputePerspectiveDepthParams(float near_plane, float far_plane)
+{
+  // A left-handed perspective stores f / (f - n) - f n / ((f - n) z), so z = n / (1 - d (f - n) / f).
+  return XMFLOAT4(near_plane, 0.0f, -(far_plane - near_plane) / far_plane, kPcssLightSizeTexels);
+}
+
+XMFLOAT4 ShadowFilter::ComputeOrthographicDepthParams(float depth_range, float texel_size)
+{
+  // Only differences of depth matter, so the near plane is left out.
+  return XMFLOAT4(0.0f, depth_range, 0.0f, kPcssDirectionalLightTanAngle / texel_size);
+}
+
+float ShadowFilter::ComputeRotation(float pixel_x, float pixel_y)
+{
+  const float f = 0.06711056f * pixel_x + 0.00583715f * pixel_y;
+  const float g = 52.9829189f * (f - std::floor(f));
+  return g - std::floor(g);
+}
+
+ShadowFilter::Sample ShadowFilter::Filter(Mode mode, const DepthMap& depth_map, float u, float v, float receiver_depth, float bias, float rotation)
+{
+  const float reference = receiver_depth - bias;
+  const float angle = rotation * XM_2PI;
+  const float cosine = std::cos(angle);
+  const float sine = std::sin(angle);
+
+  switch (mode) {
+    case Mode::kPoint: {
+      const float depth = LoadDepth(depth_map, static_cast<int>(std::floor(u * depth_map.width)), static_cast<int>(std::floor(v * depth_map.height)), 0.0f);
+      return { receiver_depth > depth + bias ? 0.0f : 1.0f, 1 };
+    }
+
+    case Mode::kHardwarePcf:
+      return { SampleCmp(depth_map, u, v, reference), 4 };
+
+    case Mode::kPoissonPcf:
+      return PoissonPcf(depth_map, u, v, reference, kPcfRadiusTexels, cosine, sine);
+
+    case Mode::kPcss: {
+      // Average depth of what is in front of the receiver around it; the map's edge is clamped, not a blocker.
+      const int x = static_cast<int>(std::floor(u * depth_map.width));
+      const int y = static_cast<int>(std::floor(v * depth_map.height));
+      // Averaged in light view depth, as a perspective light's stored depths are not linear in it.
+      const XMFLOAT4& depth_params = depth_map.depth_params;
+      float blocker_depth_sum = 0.0f;
+      int blocker_number = 0;
+      for (int i = 0; i < kPoissonTapNumber; ++i) {
+        float dx, dy;
+        GetTapOffset(i, cosine, sine, kPcssSearchRadiusTexels, dx, dy);
+        const int tap_x = std::min(std::max(x + static_cast<int>(std::floor(dx + 0.5f)), 0), static_cast<int>(depth_map.width) - 1);
+        const int tap_y = std::min(std::max(y + static_cast<int>(std::floor(dy + 0.5f)), 0), static_cast<int>(depth_map.height) - 1);
+        const float depth = LoadDepth(depth_map, tap_x, tap_y, 1.0f);
+        if (depth < reference) {
+          blocker_depth_sum += LinearizeDepth(depth, depth_params);
+          blocker_number++;
+        }
+      }
+      if (blocker_number == 0) {
+        return { 1.0f, kPoissonTapNumber };
+      }
+
+      // Similar triangles between the light, the blockers and the receiver.
+      const float blocker_depth = blocker_depth_sum / blocker_number;
+      const float receiver_view_depth = LinearizeDepth(receiver_depth, depth_params);
+      const float penumbra = depth_params.w * (receiver_view_depth - blocker_depth) / (depth_params.z != 0.0f ? std::max(blocker_depth, 1e-4f) : 1.0f);
+      const float radius = std::min(std::max(penumbra, 1.0f), kPcssMaxFilterRadiusTexels);
+      Sample sample = PoissonPcf(depth_map, u, v, reference, radius, cosine, sine);
+      sample.fetch_number += kPoissonTapNumber;
+      return sample;
+    }
+
+    default:
+      return { 1.0f, 0 };
+  }
+}
+
+void ShadowFilter::ComputeMoments(Mode mode, const DepthMap& depth_map, MomentMap& moment_map)
+{
+  if (depth_map.width == 0 || depth_map.height == 0) {
+    moment_map = MomentMap();
+    return;
+  }
+  moment_map.width = std::max(depth_map.width / 2, 1u);
+  moment_map.height = std::max(depth_map.height / 2, 1u);
+  moment_map.moments.resize(static_cast<size_t>(moment_map.width) * moment_map.height);
+
+  const bool exponential = mode == Mode::kEvsm;
+  const XMVECTOR two = XMVectorReplicate(2.0f);
+  const XMVECTOR minus_one = XMVectorReplicate(-1.0f);
+  for (UINT y = 0; y < moment_map.height; ++y) {
+    const float* top_row = &depth_map.depths[static_cast<size_t>(std::min(2 * y, depth_map.height - 1)) * depth_map.width];
+    const float* bottom_row = &depth_map.depths[static_cast<size_t>(std::min(2 * y + 1, depth_map.height - 1)) * depth_map.width];
+    XMFLOAT4* moments = &moment_map.moments[static_cast<size_t>(y) * moment_map.width];
+    for (UINT x = 0; x < moment_map.width; x += 4) {
+      // Four quads side by side: their left texels are the even columns, their right ones the odd columns.
+      XMVECTOR top_first, top_second, bottom_first, bottom_second;
+      LoadDepthRow(top_row, depth_map.width, 2 * x, top_first, top_second);
+      LoadDepthRow(bottom_row, depth_map.width, 2 * x, bottom_first, bottom_second);
+      const XMVECTOR quad_depths[4] = {
+        XMVectorPermute<0, 2, 4, 6>(top_first, top_second),
+        XMVectorPermute<1, 3, 5, 7>(top_first, top_second),
+        XMVectorPermute<0, 2, 4, 6>(bottom_first, bottom_second),
+        XMVectorPermute<1, 3, 5, 7>(bottom_first, bottom_second),
+      };
+
+      // Each of the four moments of the four quads, summed over the quads' texels.
+      XMVECTOR sums[4] = { XMVectorZero(), XMVectorZero(), XMVectorZero(), XMVectorZero() };
+      for (const XMVECTOR& depths : quad_depths) {
+        if (exponential) {
+          const XMVECTOR warped_depths = XMVectorMultiplyAdd(depths, two, minus_one);
+          const XMVECTOR positive = XMVectorExpE(XMVectorScale(warped_depths, kEvsmPositiveExponent));
+          const XMVECTOR negative = XMVectorNegate(XMVectorExpE(XMVectorScale(warped_depths, -kEvsmNegativeExponent)));
+          sums[0] = XMVectorAdd(sums[0], positive);
+          sums[1] = XMVectorMultiplyAdd(positive, positive, sums[1]);
+          sums[2] = XMVectorAdd(sums[2], negative);
+          sums[3] = XMVectorMultiplyAdd(negative, negative, sums[3]);
+        }
+        else {
+          sums[0] = XMVectorAdd(sums[0], depths);
+          sums[1] = XMVectorMultiplyAdd(depths, depths, sums[1]);
+        }
+      }
+
+      // Rows are moments, columns quads: transposed, each row is one texel.
+      const XMMATRIX texels = XMMatrixTranspose(XMMATRIX(XMVectorScale(sums[0], 0.25f), XMVectorScale(sums[1], 0.25f),
+        XMVectorScale(sums[2], 0.25f), XMVectorScale(sums[3], 0.25f)));
+      const UINT texel_number = std::min(4u, moment_map.width - x);
+      for (UINT i = 0; i < texel_number; ++i) {
+        XMStoreFloat4(&moments[x + i], texels.r[i]);
+      }
+    }
+  }
+}
+
+void ShadowFilter::BlurMoments(MomentMap& moment_map)
+{
+  if (moment_map.moments.empty()) {
+    return;
+  }
+  std::vector<XMFLOAT4> blurred(moment_map.moments.size());
+  BlurLines(moment_map.moments.data(), blurred.data(), moment_map.width, moment_map.height, 1, moment_map.width);
+  BlurLines(blurred.data(), moment_map.moments.data(), moment_map.height, moment_map.width, moment_map.width, 1);
+}
+
+ShadowFilter::Sample ShadowFilter::FilterMoments(Mode mode, const MomentMap& moment_map, float u, float v, float receiver_depth, float bias)
+{
+  if (moment_map.moments.empty()) {
+    return { 1.0f, 0 };
+  }
+
+  // Bilinear, edges clamped, like the moments sampler.
+  const float x = u * moment_map.width - 0.5f;
+  const float y = v * moment_map.height - 0.5f;
+  const float x0 = std::floor(x);
+  const float y0 = std::floor(y);
+  const int ix = static_cast<int>(x0);
+  const int iy = static_cast<int>(y0);
+  const auto load_moments = [&moment_map](int texel_x, int texel_y) {
+    texel_x = std::min(std::max(texel_x, 0), static_cast<int>(moment_map.width) - 1);
+    texel_y = std::min(std::max(texel_y, 0), static_cast<int>(moment_map.height) - 1);
+    return XMLoadFloat4(&moment_map.moments[static_cast<size_t>(texel_y) * moment_map.width + texel_x]);
+  };
+  const XMVECTOR top = XMVectorLerp(load_moments(ix, iy), load_moments(ix + 1, iy), x - x0);
+  const XMVECTOR bottom = XMVectorLerp(load_moments(ix, iy + 1), load_moments(ix + 1, iy + 1), x - x0);
+  XMFLOAT4 moments;
+  XMStoreFloat4(&moments, XMVectorLerp(top, bottom, y - y0));
+
+  const float reference = receiver_depth - bias;
+  if (mode == Mode::kVsm) {
+    return { ChebyshevUpperBound(moments.x, moments.y, reference, kMomentsMinVariance), 4 };
+  }
+
+  // The minimum variance is in depth squared; each warp stretches it by the square of its slope.
+  float positive, negative;
+  WarpDepth(reference, positive, negative);
+  const float positive_slope = 2.0f * kEvsmPositiveExponent * positive;
+  const float negative_slope = 2.0f * kEvsmNegativeExponent * negative;
+  const float positive_lit = ChebyshevUpperBound(moments.x, moments.y, positive, kMomentsMinVariance * positive_slope * positive_slope);
+  const float negative_lit = ChebyshevUpperBound(moments.z, moments.w, negative, kMomentsMinVariance * negative_slope * negative_slope);
+  return { std::min(positive_lit, negative_lit), 4 };
+}
+
+ShadowFilter::Report ShadowFilter::Evaluate(Mode mode, const DepthMap& depth_map, float bias)
+{
+  Report report{};
+  const UINT64 pixel_number = static_cast<UINT64>(depth_map.width) * depth_map.height;
+  if (pixel_number == 0) {
+    return report;
+  }
+
+  // The moments are built once for the whole map, as the compute shader does after each shadow pass.
+  const bool moment_mode = IsMomentMode(mode);
+  MomentMap moment_map;
+  if (moment_mode) {
+    const auto prefilter_start_time = std::chrono::steady_clock::now();
+    ComputeMoments(mode, depth_map, moment_map);
+    BlurMoments(moment_map);
+    const auto prefilter_elapsed = std::chrono::steady_clock::now() - prefilter_start_time;
+    report.prefilter_nanoseconds_per_texel = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(prefilter_elapsed).count()) / pixel_number;
+  }
+
+  double lit_sum = 0.0;
+  UINT64 penumbra_number = 0;
+  UINT64 fetch_number = 0;
+  const auto start_time = std::chrono::steady_clock::now();
+  for (UINT y = 0; y < depth_map.height; ++y) {
+    for (UINT x = 0; x < depth_map.width; ++x) {
+      const float u = (x + 0.5f) / depth_map.width;
+      const float v = (y + 0.5f) / depth_map.height;
+      const float depth = depth_map.depths[static_cast<size_t>(y) * depth_map.width + x];
+      const Sample sample = moment_mode ? FilterMoments(mode, moment_map, u, v, depth, bias) :
+        Filter(mode, depth_map, u, v, depth, bias, ComputeRotation(x + 0.5f, y + 0.5f));
+      lit_sum += sample.lit;
+      penumbra_number += sample.lit > 0.0f && sample.lit < 1.0f ? 1 : 0;
+      fetch_number += sample.fetch_number;
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start_time;
+
+  report.average_lit = lit_sum / pixel_number;
+  report.penumbra_fraction = static_cast<double>(penumbra_number) / pixel_number;
+  report.fetches_per_pixel = static_cast<double>(fetch_number) / pixel_number;
+  report.nanoseconds_per_pixel = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / pixel_number;
+  return report;
+}
+
+bool ShadowFilter::LoadDepthMap(const std::wstring& file_name, DepthMap& depth_map)
+{
+  DdsTexture texture;
+  if (!texture.Load(file_name) || texture.GetSubresourceNumber() == 0) {
+    return false;
+  }
+
+  const D3D12_RESOURCE_DESC& texture_desc = texture.GetTextureDesc();
+  const bool is_float = texture_desc.Format == DXGI_FORMAT_R32_FLOAT || texture_desc.Format == DXGI_FORMAT_D32_FLOAT;
+  const bool is_unorm = texture_desc.Format == DXGI_FORMAT_R16_UNORM || texture_desc.Format == DXGI_FORMAT_D16_UNORM;
+  if (texture_desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || (!is_float && !is_unorm)) {
+    return false;
+  }
+
+  const DdsTexture::Subresource& subresource = texture.GetSubresource(0);
+  depth_map.width = static_cast<UINT>(texture_desc.Width);
+  depth_map.height = texture_desc.Height;
+  depth_map.depths.resize(static_cast<size_t>(depth_map.width) * depth_map.height);
+  for (UINT y = 0; y < depth_map.height; ++y) {
+    const uint8_t* row = subresource.data + static_cast<size_t>(y) * subresource.row_pitch;
+    float* depths = &depth_map.depths[static_cast<size_t>(y) * depth_map.width];
+    if (is_float) {
+      memcpy(depths, row, depth_map.width * sizeof(float));
+    }
+    else {
+      for (UINT x = 0; x < depth_map.width; ++x) {
+        uint16_t depth;
+        memcpy(&depth, row + x * sizeof(depth), sizeof(depth));
+        depths[x] = depth / 65535.0f;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common_headers.h"
+
+using namespace DirectX;
+
+// Shadow map filtering modes, chosen at startup ("-shadowFilter point|pcf|poisson|pcss|vsm|evsm"). Each one
+// is its own permutation of scene_pixel_shader.hlsl, selected by the SHADOW_FILTER define when the pipeline
+// state is created, so the shader never branches on the mode.
+//
+// The moment modes don't compare depths at all: after the shadow pass, shadow_moments_compute_shader.hlsl turns
+// the depth map into a half resolution map of depth moments, blurs it with a separable Gaussian and builds its
+// mips, and the pixel shader bounds the lit fraction from one trilinear sample of it. The cost per pixel is the
+// same whatever the filter's width.
+//
+// The kernels also have a CPU reference here that reads the same texels with the same weights, to compare
+// quality and cost per pixel without a GPU, e.g. on a depth map saved from a capture ("-shadowFilterReport
+// <file.dds>"). The constants below must match the ones in scene_pixel_shader.hlsl.
+class ShadowFilter {
+ public:
+  enum class Mode {
+    kPoint,  // one point sample, the original behavior
+    kHardwarePcf,  // one SampleCmpLevelZero: 2x2 bilinear weighted comparisons
+    kPoissonPcf,  // hardware PCF at each tap of a Poisson disk rotated per pixel
+    kPcss,  // blocker search, then Poisson PCF as wide as the estimated penumbra
+    kVsm,  // variance shadow map: mean and mean square of the depth, Chebyshev's inequality per pixel
+    kEvsm,  // exponential variance: the same on two exponential warps of the depth, which bleeds much less light
+    kModeNumber,
+  };  // enum class Mode
+
+  static constexpr int kPoissonTapNumber = 16;
+  static const XMFLOAT2 kPoissonDisk[kPoissonTapNumber];  // in the unit disk
+  static constexpr float kPcfRadiusTexels = 2.5f;
+  static constexpr float kPcssSearchRadiusTexels = 8.0f;
+  static constexpr float kPcssLightSizeTexels = 16.0f;
+  static constexpr float kPcssMaxFilterRadiusTexels = 8.0f;
+  static constexpr float kPcssDirectionalLightTanAngle = 0.02f;  // of the directional light's angular radius
+  static constexpr int kMomentsBlurRadius = 3;
+  static const float kMomentsBlurWeights[kMomentsBlurRadius + 1];  // Gaussian of 1.5 moment texels, the center first
+  static constexpr float kEvsmPositiveExponent = 40.0f;  // exp(40) squared still fits in a float
+  static constexpr float kEvsmNegativeExponent = 5.0f;
+  static constexpr float kMomentsMinVariance = 1e-5f;  // in depth squared, against acne where the variance is ~0
+  static constexpr float kLightBleedingReduction = 0.2f;  // lit fractions below this are cut to 0, the rest stretched
+
+  // A single slice of a shadow map, depths in [0, 1]. depth_params are those of the light's projection, see
+  // ComputePerspectiveDepthParams; by default an orthographic light's, with the depths as they are.
+  struct DepthMap {
+    std::vector<float> depths;
+    UINT width = 0;
+    UINT height = 0;
+    XMFLOAT4 depth_params = XMFLOAT4(0.0f, 1.0f, 0.0f, kPcssLightSizeTexels);
+  };  // struct DepthMap
+
+  // Half the size of the depth map it is built from, each texel from a 2x2 quad of depths. VSM uses x and y,
+  // EVSM all four: the positive warp and its square, then the negative warp and its square.
+  struct MomentMap {
+    std::vector<XMFLOAT4> moments;
+    UINT width = 0;
+    UINT height = 0;
+  };  // struct MomentMap
+
+  struct Sample {
+    float lit;  // 0: fully shadowed, 1: fully lit
+    UINT fetch_number;  // texels read
+  };  // struct Sample
+
+  struct Report {
+    double average_lit;
+    double penumbra_fraction;  // of pixels neither fully lit nor fully shadowed
+    double fetches_per_pixel;
+    double nanoseconds_per_pixel;  // of the CPU reference, only meaningful between modes
+    double prefilter_nanoseconds_per_texel;  // moment modes: building and blurring the moments, per depth texel
+  };  // struct Report
+
+  static const wchar_t* GetModeName(Mode mode);
+
+  // Matches the mode names case-insensitively. Returns false, leaving mode alone, for anything else.
+  static bool ParseMode(const std::wstring& name, Mode& mode);
+
+  // Null terminated, for CompileShader.
+  static const D3D_SHADER_MACRO* GetShaderDefines(Mode mode);
+
+  static bool IsMomentMode(Mode mode) {
+    return mode == Mode::kVsm || mode == Mode::kEvsm;
+  }
+
+  // Of the moments texture: R32G32_FLOAT for kVsm, R32G32B32A32_FLOAT for kEvsm.
+  static DXGI_FORMAT GetMomentsFormat(Mode mode);
+
+  // What PCSS needs to know of the light's projection. x, y and z turn a stored depth d into the light view depth
+  // (x + y d) / (1 + z d); w is the penumbra in texels per unit of light view depth between the receiver and its
+  // blockers. A perspective light (z != 0) is a disk whose penumbra also shrinks with the blockers' depth.
+  static XMFLOAT4 ComputePerspectiveDepthParams(float near_plane, float far_plane);
+
+  // An orthographic light is infinitely far: its penumbra only grows with the distance from the blockers, at
+  // kPcssDirectionalLightTanAngle. depth_range and texel_size in world units.
+  static XMFLOAT4 ComputeOrthographicDepthParams(float depth_range, float texel_size);
+
+  // Per pixel rotation of the Poisson disk in turns, from the pixel's position (interleaved gradient noise).
+  static float ComputeRotation(float pixel_x, float pixel_y);
+
+  // What the pixel shader computes for a receiver at (u, v) and receiver_depth, both in the shadow map's
+  // space; PCSS sizes its penumbra in light view depths, from the map's depth_params. Texels outside the map count as lit, except for kPoint, which reads 0 there like the original
+  // border color. The moment modes need the moments instead, see FilterMoments.
+  static Sample Filter(Mode mode, const DepthMap& depth_map, float u, float v, float receiver_depth, float bias, float rotation);
+
+  // GenerateMoments of shadow_moments_compute_shader.hlsl: the moments of mode averaged over each 2x2 quad of
+  // depths, four quads at a time.
+  static void ComputeMoments(Mode mode, const DepthMap& depth_map, MomentMap& moment_map);
+
+  // BlurMoments of shadow_moments_compute_shader.hlsl, horizontally then vertically, with the edges clamped.
+  static void BlurMoments(MomentMap& moment_map);
+
+  // What the pixel shader computes from the moments, sampled bilinearly at (u, v), for a receiver at
+  // receiver_depth.
+  static Sample FilterMoments(Mode mode, const MomentMap& moment_map, float u, float v, float receiver_depth, float bias);
+
+  // Filters every texel against its own depth, i.e. the surfaces the light sees as receivers, so shadows
+  // fall around depth discontinuities.
+  static Report Evaluate(Mode mode, const DepthMap& depth_map, float bias);
+
+  // Reads the first subresource of a DDS file in R32_FLOAT, D32_FLOAT, R16_UNORM or D16_UNORM.
+  static bool LoadDepthMap(const std::wstring& file_name, DepthMap& depth_map);
+};  // class ShadowFilter
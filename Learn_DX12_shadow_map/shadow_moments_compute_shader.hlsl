@@ -0,0 +1,105 @@
+// Turns the shadow map into the prefiltered moments the VSM and EVSM permutations of scene_pixel_shader.hlsl
+// sample. Each entry point runs one step over every slice, a thread per output texel, z being the slice:
+// GenerateMoments, BlurMoments twice (horizontally, then vertically) and DownsampleMoments once per mip.
+// ShadowFilter::ComputeMoments and ShadowFilter::BlurMoments are the CPU reference.
+
+#define SHADOW_FILTER_VSM 4
+#define SHADOW_FILTER_EVSM 5
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER SHADOW_FILTER_VSM
+#endif
+
+#if SHADOW_FILTER == SHADOW_FILTER_EVSM
+typedef float4 Moments;  // positive warp and its square, negative warp and its square
+#else
+typedef float2 Moments;  // depth and its square
+#endif
+
+cbuffer MomentsConstants : register(b0)
+{
+  int2 blur_direction;  // BlurMoments: (1, 0) or (0, 1)
+};
+
+// The depth maps for GenerateMoments, in x; the moments for the others.
+Texture2DArray<float4> input_texture : register(t0);
+RWTexture2DArray<Moments> output_moments : register(u0);
+
+// Same as ShadowFilter's constants.
+static const int kMomentsBlurRadius = 3;
+static const float kMomentsBlurWeights[4] = { 0.27068215f, 0.21674532f, 0.11128076f, 0.03663285f };
+static const float kEvsmPositiveExponent = 40.0f;
+static const float kEvsmNegativeExponent = 5.0f;
+
+Moments LoadMoments(int2 texel, uint slice) {
+  return (Moments)input_texture.Load(int4(texel, slice, 0));
+}
+
+Moments ComputeDepthMoments(float depth) {
+#if SHADOW_FILTER == SHADOW_FILTER_EVSM
+  float warped_depth = 2.0f * depth - 1.0f;
+  float positive = exp(kEvsmPositiveExponent * warped_depth);
+  float negative = -exp(-kEvsmNegativeExponent * warped_depth);
+  return Moments(positive, positive * positive, negative, negative * negative);
+#else
+  return Moments(depth, depth * depth);
+#endif
+}
+
+// Half the depth map's size: the moments of a 2x2 quad of depths, averaged.
+[numthreads(8, 8, 1)]
+void GenerateMoments(uint3 id : SV_DispatchThreadID) {
+  uint width, height, elements;
+  output_moments.GetDimensions(width, height, elements);
+  if (id.x >= width || id.y >= height) {
+    return;
+  }
+
+  uint depth_width, depth_height, depth_elements;
+  input_texture.GetDimensions(depth_width, depth_height, depth_elements);
+  int2 last = int2(depth_width, depth_height) - 1;
+  int2 texel = int2(id.xy) * 2;
+  Moments moments = ComputeDepthMoments(input_texture.Load(int4(min(texel, last), id.z, 0)).x);
+  moments += ComputeDepthMoments(input_texture.Load(int4(min(texel + int2(1, 0), last), id.z, 0)).x);
+  moments += ComputeDepthMoments(input_texture.Load(int4(min(texel + int2(0, 1), last), id.z, 0)).x);
+  moments += ComputeDepthMoments(input_texture.Load(int4(min(texel + int2(1, 1), last), id.z, 0)).x);
+  output_moments[id] = 0.25f * moments;
+}
+
+// One direction of the separable Gaussian, edges clamped.
+[numthreads(8, 8, 1)]
+void BlurMoments(uint3 id : SV_DispatchThreadID) {
+  uint width, height, elements;
+  output_moments.GetDimensions(width, height, elements);
+  if (id.x >= width || id.y >= height) {
+    return;
+  }
+
+  int2 last = int2(width, height) - 1;
+  Moments moments = kMomentsBlurWeights[0] * LoadMoments(int2(id.xy), id.z);
+  [unroll]
+  for (int k = 1; k <= kMomentsBlurRadius; ++k) {
+    int2 offset = blur_direction * k;
+    moments += kMomentsBlurWeights[k] * (LoadMoments(clamp(int2(id.xy) - offset, 0, last), id.z) + LoadMoments(clamp(int2(id.xy) + offset, 0, last), id.z));
+  }
+  output_moments[id] = moments;
+}
+
+// The next mip from input_texture, a view of the previous one: the moments average linearly.
+[numthreads(8, 8, 1)]
+void DownsampleMoments(uint3 id : SV_DispatchThreadID) {
+  uint width, height, elements;
+  output_moments.GetDimensions(width, height, elements);
+  if (id.x >= width || id.y >= height) {
+    return;
+  }
+
+  uint input_width, input_height, input_elements;
+  input_texture.GetDimensions(input_width, input_height, input_elements);
+  int2 last = int2(input_width, input_height) - 1;
+  int2 texel = int2(id.xy) * 2;
+  Moments moments = LoadMoments(min(texel, last), id.z);
+  moments += LoadMoments(min(texel + int2(1, 0), last), id.z);
+  moments += LoadMoments(min(texel + int2(0, 1), last), id.z);
+  moments += LoadMoments(min(texel + int2(1, 1), last), id.z);
+  output_moments[id] = 0.25f * moments;
+}
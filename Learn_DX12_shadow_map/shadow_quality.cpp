@@ -0,0 +1,77 @@
+#include "shadow_quality.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace {
+
+const ShadowQuality::Settings kTierSettings[] = {
+  {1024, 2, 512, DXGI_FORMAT_D16_UNORM},  // kLow
+  {2048, 3, 1024, DXGI_FORMAT_D16_UNORM},  // kMedium
+  {2048, 4, 1024, DXGI_FORMAT_D32_FLOAT},  // kHigh
+  {4096, 4, 2048, DXGI_FORMAT_D32_FLOAT},  // kUltra
+};
+
+const wchar_t* const kTierNames[] = {
+  L"low",
+  L"medium",
+  L"high",
+  L"ultra",
+};
+
+}  // namespace
+
+const ShadowQuality::Settings& ShadowQuality::GetSettings(Tier tier)
+{
+  return kTierSettings[static_cast<int>(tier)];
+}
+
+const wchar_t* ShadowQuality::GetTierName(Tier tier)
+{
+  return kTierNames[static_cast<int>(tier)];
+}
+
+bool ShadowQuality::ParseTier(const std::wstring& name, Tier& tier)
+{
+  for (int i = 0; i < static_cast<int>(Tier::kTierNumber); ++i) {
+    const std::wstring tier_name = kTierNames[i];
+    if (name.size() == tier_name.size() && std::equal(name.begin(), name.end(), tier_name.begin(),
+        [](wchar_t a, wchar_t b) { return static_cast<wchar_t>(std::towlower(a)) == b; })) {
+      tier = static_cast<Tier>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+DXGI_FORMAT ShadowQuality::GetTypelessFormat(DXGI_FORMAT depth_format)
+{
+  return depth_format == DXGI_FORMAT_D16_UNORM ? DXGI_FORMAT_R16_TYPELESS : DXGI_FORMAT_R32_TYPELESS;
+}
+
+DXGI_FORMAT ShadowQuality::GetSrvFormat(DXGI_FORMAT depth_format)
+{
+  return depth_format == DXGI_FORMAT_D16_UNORM ? DXGI_FORMAT_R16_UNORM : DXGI_FORMAT_R32_FLOAT;
+}
+
+UINT ShadowQuality::GetDepthSize(DXGI_FORMAT depth_format)
+{
+  return depth_format == DXGI_FORMAT_D16_UNORM ? 2 : 4;
+}
+
+float ShadowQuality::GetDepthQuantization(DXGI_FORMAT depth_format)
+{
+  return depth_format == DXGI_FORMAT_D16_UNORM ? 1.0f / 65535.0f : 0.0f;
+}
+
+ShadowQuality::Cost ShadowQuality::EstimateCost(const Settings& settings, UINT rendered_cascade_number, float overdraw)
+{
+  const UINT64 slice_texels = static_cast<UINT64>(settings.resolution) * settings.resolution;
+  const UINT64 depth_size = GetDepthSize(settings.depth_format);
+
+  Cost cost{};
+  cost.texels_rasterized = static_cast<UINT64>(slice_texels * rendered_cascade_number * overdraw);
+  cost.bytes_written = (slice_texels * rendered_cascade_number + cost.texels_rasterized) * depth_size;
+  cost.memory_bytes = slice_texels * settings.cascade_number * depth_size;
+  return cost;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+#include "common_headers.h"
+
+// Shadow map settings per quality tier, chosen at startup ("-shadowQuality low|medium|high|ultra"), and a
+// model of what the shadow pass costs with them. Nothing here needs a device.
+class ShadowQuality {
+ public:
+  enum class Tier {
+    kLow,
+    kMedium,
+    kHigh,
+    kUltra,
+    kTierNumber,
+  };  // enum class Tier
+
+  struct Settings {
+    UINT resolution;  // of each cascade, square
+    UINT cascade_number;  // for the directional light; the spot light always uses one
+    UINT cube_resolution;  // of each face of the point light's cube map, square
+    DXGI_FORMAT depth_format;  // DSV format, DXGI_FORMAT_D16_UNORM or DXGI_FORMAT_D32_FLOAT
+  };  // struct Settings
+
+  struct Cost {
+    UINT64 texels_rasterized;  // per frame, over all cascades
+    UINT64 bytes_written;  // per frame, the clears plus one depth write per rasterized texel
+    UINT64 memory_bytes;  // of the shadow map array
+  };  // struct Cost
+
+  static const Settings& GetSettings(Tier tier);
+
+  static const wchar_t* GetTierName(Tier tier);
+
+  // Matches the tier names case-insensitively. Returns false, leaving tier alone, for anything else.
+  static bool ParseTier(const std::wstring& name, Tier& tier);
+
+  // Typeless resource format and SRV format going with a DSV format.
+  static DXGI_FORMAT GetTypelessFormat(DXGI_FORMAT depth_format);
+  static DXGI_FORMAT GetSrvFormat(DXGI_FORMAT depth_format);
+
+  // Bytes per texel.
+  static UINT GetDepthSize(DXGI_FORMAT depth_format);
+
+  // The smallest step between two stored depths for UNORM formats, 0 for float ones.
+  static float GetDepthQuantization(DXGI_FORMAT depth_format);
+
+  // rendered_cascade_number is how many cascades the light renders; overdraw is the average number of
+  // shadow casters covering a texel.
+  static Cost EstimateCost(const Settings& settings, UINT rendered_cascade_number, float overdraw = 1.0f);
+};  // class ShadowQuality
@@ -1,17 +1,30 @@
 cbuffer SceneConstantBuffer : register(b0)
 {
-  float4x4 model;
+  float4x4 model;  // unused, instances take theirs from instance_transforms
   float4x4 view;
   float4x4 proj;
   float4 light_world_direction_or_position;
   float4 light_color;
   float4 camera_world_pos;
-  float4x4 light_view_proj_transform;
+  float4x4 light_view_proj_transforms[4];  // one per cascade; the spot light only uses the first
+  float4 cascade_split_distances;
+  float4 cascade_depth_biases;
+  float4 cube_shadow_depth_params;  // point light: x + y / view depth is the stored depth, z: depth bias
+  float4 shadow_atlas_tile;  // spot light: uv scale in xy and offset in zw of its tile in the first slice
   int light_type;  // 0: directional light; 1: point light; 2: spot light
+  int cascade_number;
 };
 
-float4 main(float3 pos : POSITION) : SV_POSITION
+cbuffer ShadowCascadeConstants : register(b1)
 {
-  float4 world_pos = mul(float4(pos, 1.0f), model);
-	return mul(world_pos, light_view_proj_transform);
+  uint cascade_index;
+};
+
+// Model transforms of the batch's instances, uploaded transposed like the constant buffer's.
+StructuredBuffer<float4x4> instance_transforms : register(t0, space1);
+
+float4 main(float3 pos : POSITION, uint instance_id : SV_InstanceID) : SV_POSITION
+{
+  float4 world_pos = mul(float4(pos, 1.0f), instance_transforms[instance_id]);
+	return mul(world_pos, light_view_proj_transforms[cascade_index]);
 }
\ No newline at end of file
@@ -0,0 +1,687 @@
+#include "software_rasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <fstream>
+
+#include "thread_pool.h"
+
+namespace {
+
+constexpr int kSubPixelBits = 8;
+constexpr int kSubPixelScale = 1 << kSubPixelBits;
+constexpr size_t kTrianglesPerChunk = 4096;
+// Triangles are only clipped against the x/y planes once they leave this multiple of the viewport,
+// which keeps the fixed point edge equations from overflowing.
+constexpr float kGuardBand = 8.0f;
+constexpr size_t kMaxClipVertexNumber = 9;  // a triangle clipped by 6 planes never exceeds 3 + 6 vertices
+constexpr size_t kClipVertexFloatNumber = 4 + 11;  // clip position + attributes
+
+struct ClipVertex {
+  float data[kClipVertexFloatNumber];  // x, y, z, w, attributes...
+};
+
+float ClipDistance(const ClipVertex& vertex, int plane)
+{
+  const float x = vertex.data[0];
+  const float y = vertex.data[1];
+  const float z = vertex.data[2];
+  const float w = vertex.data[3];
+  switch (plane) {
+  case 0: return z;  // near: 0 <= z
+  case 1: return w - z;  // far: z <= w
+  case 2: return x + kGuardBand * w;
+  case 3: return kGuardBand * w - x;
+  case 4: return y + kGuardBand * w;
+  default: return kGuardBand * w - y;
+  }
+}
+
+// Sutherland-Hodgman against the D3D clip volume. Returns the number of output vertices.
+size_t ClipPolygon(ClipVertex* polygon, size_t vertex_number)
+{
+  ClipVertex scratch[kMaxClipVertexNumber];
+  for (int plane = 0; plane < 6 && vertex_number >= 3; ++plane) {
+    bool all_inside = true;
+    for (size_t i = 0; i < vertex_number; ++i) {
+      all_inside = all_inside && ClipDistance(polygon[i], plane) >= 0.0f;
+    }
+    if (all_inside) {
+      continue;
+    }
+
+    size_t output_number = 0;
+    for (size_t i = 0; i < vertex_number; ++i) {
+      const ClipVertex& current = polygon[i];
+      const ClipVertex& next = polygon[(i + 1) % vertex_number];
+      const float current_distance = ClipDistance(current, plane);
+      const float next_distance = ClipDistance(next, plane);
+      if (current_distance >= 0.0f) {
+        scratch[output_number++] = current;
+      }
+      if ((current_distance >= 0.0f) != (next_distance >= 0.0f)) {
+        const float t = current_distance / (current_distance - next_distance);
+        ClipVertex& intersection = scratch[output_number++];
+        for (size_t k = 0; k < kClipVertexFloatNumber; ++k) {
+          intersection.data[k] = current.data[k] + (next.data[k] - current.data[k]) * t;
+        }
+      }
+    }
+
+    std::copy(scratch, scratch + output_number, polygon);
+    vertex_number = output_number;
+  }
+
+  return vertex_number >= 3 ? vertex_number : 0;
+}
+
+XMMATRIX LoadTransposed(const XMFLOAT4X4& matrix)
+{
+  // Scene stores matrices transposed for HLSL's column-major packing.
+  return XMMatrixTranspose(XMLoadFloat4x4(&matrix));
+}
+
+// Point sampling of the top mip with D3D12_TEXTURE_ADDRESS_MODE_BORDER and a transparent black border,
+// matching the static sampler in Scene::CreateScenePipelineState.
+XMVECTOR SampleTexture(const SoftwareRasterizer::Texture& texture, float u, float v)
+{
+  const float x = std::floor(u * texture.width);
+  const float y = std::floor(v * texture.height);
+  if (x < 0.0f || y < 0.0f || x >= texture.width || y >= texture.height) {
+    return XMVectorZero();
+  }
+
+  const uint8_t* texel = texture.texels.data() + (static_cast<size_t>(y) * texture.width + static_cast<size_t>(x)) * 4;
+  return XMVectorScale(XMVectorSet(texel[0], texel[1], texel[2], texel[3]), 1.0f / 255.0f);
+}
+
+uint32_t PackUnorm(const XMFLOAT4& color)
+{
+  auto to_unorm8 = [](float value) {
+    return static_cast<uint32_t>(std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+  };
+
+  return to_unorm8(color.x) | (to_unorm8(color.y) << 8) | (to_unorm8(color.z) << 16) | (to_unorm8(color.w) << 24);
+}
+
+// Edge function of the directed edge a->b at point p, all in 24.8 fixed point.
+inline int64_t EdgeFunction(int32_t ax, int32_t ay, int32_t bx, int32_t by, int64_t px, int64_t py)
+{
+  return static_cast<int64_t>(bx - ax) * (py - ay) - static_cast<int64_t>(by - ay) * (px - ax);
+}
+
+// D3D top-left fill rule for clockwise triangles in y-down screen space.
+inline bool IsTopLeftEdge(int32_t ax, int32_t ay, int32_t bx, int32_t by)
+{
+  return (ay == by && bx > ax) || by < ay;
+}
+
+// The TextureCube face a direction falls on: the axis of its largest component, +x, -x, +y, -y, +z, -z.
+UINT SelectCubeFace(const XMFLOAT3& direction)
+{
+  const float x = std::abs(direction.x);
+  const float y = std::abs(direction.y);
+  const float z = std::abs(direction.z);
+  if (x >= y && x >= z) {
+    return direction.x >= 0.0f ? 0 : 1;
+  }
+  if (y >= z) {
+    return direction.y >= 0.0f ? 2 : 3;
+  }
+  return direction.z >= 0.0f ? 4 : 5;
+}
+
+void AddStats(SoftwareRasterizer::RenderStats& total, const SoftwareRasterizer::RenderStats& stats)
+{
+  total.triangles_submitted += stats.triangles_submitted;
+  total.triangles_rasterized += stats.triangles_rasterized;
+  total.pixels_written += stats.pixels_written;
+  total.seconds += stats.seconds;
+}
+
+}  // namespace
+
+// A depth target (and a color one unless it is a shadow map), drawn through a viewport that also scissors.
+struct SoftwareRasterizer::RenderTarget {
+  UINT width = 0;
+  UINT height = 0;
+  UINT tile_columns = 0;
+  UINT tile_rows = 0;
+  uint32_t* color = nullptr;  // null for the depth-only passes
+  float* depth = nullptr;
+  int viewport_x = 0;
+  int viewport_y = 0;
+  int viewport_width = 0;
+  int viewport_height = 0;
+
+  RenderTarget(UINT target_width, UINT target_height, uint32_t* color_texels, float* depth_texels) :
+    width(target_width), height(target_height),
+    tile_columns((target_width + kTileSize - 1) / kTileSize), tile_rows((target_height + kTileSize - 1) / kTileSize),
+    color(color_texels), depth(depth_texels),
+    viewport_width(static_cast<int>(target_width)), viewport_height(static_cast<int>(target_height))
+  {
+  }
+};  // struct SoftwareRasterizer::RenderTarget
+
+SoftwareRasterizer::SoftwareRasterizer(ThreadPool* thread_pool) :
+  thread_pool_(thread_pool)
+{
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+}
+
+void SoftwareRasterizer::Resize(UINT width, UINT height, UINT shadow_resolution, UINT cube_resolution)
+{
+  width_ = width;
+  height_ = height;
+
+  color_target_.assign(static_cast<size_t>(width) * height, 0);
+  scene_depth_target_.assign(static_cast<size_t>(width) * height, 1.0f);
+  for (ShadowFilter::DepthMap& slice : shadow_slices_) {
+    slice.width = shadow_resolution;
+    slice.height = shadow_resolution;
+    slice.depths.assign(static_cast<size_t>(shadow_resolution) * shadow_resolution, 1.0f);
+  }
+  for (ShadowFilter::DepthMap& face : cube_faces_) {
+    face.width = cube_resolution;
+    face.height = cube_resolution;
+    face.depths.assign(static_cast<size_t>(cube_resolution) * cube_resolution, 1.0f);
+  }
+}
+
+void SoftwareRasterizer::SetGeometry(const Asset::Model::Vertex* vertices, size_t vertex_number, const DWORD* indices, size_t index_number)
+{
+  vertices_ = vertices;
+  vertex_number_ = vertex_number;
+  indices_ = indices;
+  index_number_ = index_number;
+}
+
+SoftwareRasterizer::RenderStats SoftwareRasterizer::ShadowPass(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants)
+{
+  RenderStats stats;
+  if (frame_constants.light_type == 1) {
+    for (UINT face = 0; face < CubeShadowMap::kFaceNumber; ++face) {
+      ShadowFilter::DepthMap& depth_map = cube_faces_[face];
+      std::fill(depth_map.depths.begin(), depth_map.depths.end(), 1.0f);
+      const RenderTarget target(depth_map.width, depth_map.height, nullptr, depth_map.depths.data());
+      AddStats(stats, Render(draw_arguments, frame_constants, &frame_constants.cube_face_view_projs[face], target));
+    }
+    return stats;
+  }
+
+  const bool is_spot_light = frame_constants.light_type == 2;
+  const int slice_number = is_spot_light ? 1 : std::min(std::max(frame_constants.cascade_number, 1), static_cast<int>(CascadedShadowMap::kMaxCascadeNumber));
+  for (int slice = 0; slice < slice_number; ++slice) {
+    ShadowFilter::DepthMap& depth_map = shadow_slices_[slice];
+    std::fill(depth_map.depths.begin(), depth_map.depths.end(), 1.0f);
+    depth_map.depth_params = frame_constants.shadow_depth_params[slice];
+    RenderTarget target(depth_map.width, depth_map.height, nullptr, depth_map.depths.data());
+    if (is_spot_light) {
+      // The tile's inner square, inside its gutter, like Scene::shadow_tile_view_port_.
+      const XMFLOAT4& tile = frame_constants.shadow_atlas_tile;
+      target.viewport_x = static_cast<int>(std::lround(tile.z * depth_map.width));
+      target.viewport_y = static_cast<int>(std::lround(tile.w * depth_map.height));
+      target.viewport_width = static_cast<int>(std::lround(tile.x * depth_map.width));
+      target.viewport_height = static_cast<int>(std::lround(tile.y * depth_map.height));
+    }
+    AddStats(stats, Render(draw_arguments, frame_constants, &frame_constants.light_view_proj_transforms[slice], target));
+
+    if (ShadowFilter::IsMomentMode(shadow_filter_mode_)) {
+      const auto start_time = std::chrono::steady_clock::now();
+      ShadowFilter::ComputeMoments(shadow_filter_mode_, depth_map, shadow_moments_[slice]);
+      ShadowFilter::BlurMoments(shadow_moments_[slice]);
+      stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+  }
+  return stats;
+}
+
+SoftwareRasterizer::RenderStats SoftwareRasterizer::ScenePass(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants)
+{
+  // Same clear values as Scene::ScenePass: opaque black color, depth 1.
+  std::fill(color_target_.begin(), color_target_.end(), 0xFF000000u);
+  std::fill(scene_depth_target_.begin(), scene_depth_target_.end(), 1.0f);
+  const RenderTarget target(width_, height_, color_target_.data(), scene_depth_target_.data());
+  return Render(draw_arguments, frame_constants, nullptr, target);
+}
+
+bool SoftwareRasterizer::WriteColorImage(const std::string& file_name) const
+{
+  std::ofstream file(file_name, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  const uint8_t header[18] = {
+    0, 0, 2,  // uncompressed true color
+    0, 0, 0, 0, 0,
+    0, 0, 0, 0,
+    static_cast<uint8_t>(width_ & 0xFF), static_cast<uint8_t>(width_ >> 8),
+    static_cast<uint8_t>(height_ & 0xFF), static_cast<uint8_t>(height_ >> 8),
+    32, 0x28  // 8 alpha bits, top-left origin
+  };
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+  std::vector<uint8_t> bgra(color_target_.size() * 4);
+  for (size_t i = 0; i < color_target_.size(); ++i) {
+    const uint32_t rgba = color_target_[i];
+    bgra[i * 4 + 0] = static_cast<uint8_t>(rgba >> 16);
+    bgra[i * 4 + 1] = static_cast<uint8_t>(rgba >> 8);
+    bgra[i * 4 + 2] = static_cast<uint8_t>(rgba);
+    bgra[i * 4 + 3] = static_cast<uint8_t>(rgba >> 24);
+  }
+  file.write(reinterpret_cast<const char*>(bgra.data()), bgra.size());
+
+  return static_cast<bool>(file);
+}
+
+bool SoftwareRasterizer::WriteDepthImage(const std::string& file_name, const std::vector<float>& depth, UINT width, UINT height)
+{
+  std::ofstream file(file_name, std::ios::binary);
+  if (!file || depth.size() < static_cast<size_t>(width) * height) {
+    return false;
+  }
+
+  // Negative scale marks little endian; PFM rows run bottom to top.
+  file << "Pf\n" << width << " " << height << "\n-1.0\n";
+  for (UINT row = height; row > 0; --row) {
+    file.write(reinterpret_cast<const char*>(depth.data() + static_cast<size_t>(row - 1) * width), width * sizeof(float));
+  }
+
+  return static_cast<bool>(file);
+}
+
+void SoftwareRasterizer::ForEach(size_t job_number, const std::function<void(size_t)>& job) const
+{
+  if (thread_pool_ == nullptr) {
+    for (size_t i = 0; i < job_number; ++i) {
+      job(i);
+    }
+    return;
+  }
+
+  thread_pool_->ParallelFor(job_number, [&job](size_t index, size_t) {
+    job(index);
+  });
+}
+
+SoftwareRasterizer::RenderStats SoftwareRasterizer::Render(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants,
+                                                           const XMFLOAT4X4* light_view_proj, const RenderTarget& target)
+{
+  const auto start_time = std::chrono::steady_clock::now();
+  const size_t tile_number = static_cast<size_t>(target.tile_columns) * target.tile_rows;
+
+  RenderStats stats;
+
+  // Split every draw into chunks; chunks never straddle draws so each one has a single model transform.
+  size_t chunk_number = 0;
+  for (size_t draw_index = 0; draw_index < draw_arguments.size(); ++draw_index) {
+    const size_t triangle_number = draw_arguments[draw_index].index_count / 3;
+    stats.triangles_submitted += triangle_number;
+    for (size_t first_triangle = 0; first_triangle < triangle_number; first_triangle += kTrianglesPerChunk) {
+      if (chunk_number == chunks_.size()) {
+        chunks_.emplace_back();
+      }
+      TriangleChunk& chunk = chunks_[chunk_number++];
+      chunk.draw_index = draw_index;
+      chunk.first_triangle = first_triangle;
+      chunk.triangle_number = std::min(kTrianglesPerChunk, triangle_number - first_triangle);
+    }
+  }
+
+  if (tile_number == 0 || target.viewport_width <= 0 || target.viewport_height <= 0 || vertices_ == nullptr || indices_ == nullptr) {
+    return stats;
+  }
+
+  ForEach(chunk_number, [&](size_t chunk_index) {
+    SetupChunk(chunks_[chunk_index], draw_arguments, frame_constants, light_view_proj, target);
+  });
+
+  for (size_t i = 0; i < chunk_number; ++i) {
+    stats.triangles_rasterized += chunks_[i].triangles.size();
+  }
+
+  std::vector<size_t> tile_pixels_written(tile_number, 0);
+  ForEach(tile_number, [&](size_t tile_index) {
+    tile_pixels_written[tile_index] = RasterizeTile(tile_index, chunk_number, frame_constants, target);
+  });
+
+  for (size_t pixels_written : tile_pixels_written) {
+    stats.pixels_written += pixels_written;
+  }
+
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  return stats;
+}
+
+void SoftwareRasterizer::SetupChunk(TriangleChunk& chunk, const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants,
+                                    const XMFLOAT4X4* light_view_proj, const RenderTarget& target) const
+{
+  const size_t tile_number = static_cast<size_t>(target.tile_columns) * target.tile_rows;
+  chunk.triangles.clear();
+  chunk.tile_bins.resize(tile_number);
+  for (auto& tile_bin : chunk.tile_bins) {
+    tile_bin.clear();
+  }
+
+  const bool depth_only = target.color == nullptr;
+  const AssetsManager::DrawArgument& draw_argument = draw_arguments[chunk.draw_index];
+  const XMMATRIX model = LoadTransposed(draw_argument.model_transform);
+  const XMMATRIX view_proj = light_view_proj != nullptr ?
+    LoadTransposed(*light_view_proj) :
+    XMMatrixMultiply(LoadTransposed(frame_constants.view), LoadTransposed(frame_constants.proj));
+
+  // Pixels the viewport covers; the scissor rectangle is the same in every pass.
+  const int scissor_min_x = std::max(0, target.viewport_x);
+  const int scissor_min_y = std::max(0, target.viewport_y);
+  const int scissor_max_x = std::min(static_cast<int>(target.width), target.viewport_x + target.viewport_width) - 1;
+  const int scissor_max_y = std::min(static_cast<int>(target.height), target.viewport_y + target.viewport_height) - 1;
+
+  for (size_t triangle = chunk.first_triangle; triangle < chunk.first_triangle + chunk.triangle_number; ++triangle) {
+    ClipVertex polygon[kMaxClipVertexNumber];
+    bool valid_indices = true;
+    for (size_t corner = 0; corner < 3; ++corner) {
+      const size_t index_position = draw_argument.index_start + triangle * 3 + corner;
+      const size_t vertex_index = index_position < index_number_ ? static_cast<size_t>(draw_argument.vertex_base) + indices_[index_position] : vertex_number_;
+      if (vertex_index >= vertex_number_) {
+        valid_indices = false;
+        break;
+      }
+
+      const Asset::Model::Vertex& vertex = vertices_[vertex_index];
+      const XMVECTOR world_position = XMVector3Transform(XMLoadFloat3(&vertex.position), model);
+      const XMVECTOR clip_position = XMVector4Transform(world_position, view_proj);
+      float* data = polygon[corner].data;
+      XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(data), clip_position);
+      if (!depth_only) {
+        const XMVECTOR world_normal = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.normal), model));
+        data[4] = vertex.uv.x;
+        data[5] = vertex.uv.y;
+        data[6] = vertex.color.x;
+        data[7] = vertex.color.y;
+        data[8] = vertex.color.z;
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(data + 9), world_position);
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(data + 12), world_normal);
+      }
+    }
+    if (!valid_indices) {
+      continue;
+    }
+
+    const size_t polygon_vertex_number = ClipPolygon(polygon, 3);
+
+    // Project the clipped polygon once, then fan it into triangles.
+    int32_t screen_x[kMaxClipVertexNumber];
+    int32_t screen_y[kMaxClipVertexNumber];
+    float screen_z[kMaxClipVertexNumber];
+    float inv_w[kMaxClipVertexNumber];
+    for (size_t i = 0; i < polygon_vertex_number; ++i) {
+      const float* data = polygon[i].data;
+      inv_w[i] = 1.0f / data[3];
+      const float ndc_x = data[0] * inv_w[i];
+      const float ndc_y = data[1] * inv_w[i];
+      screen_z[i] = data[2] * inv_w[i];
+      screen_x[i] = static_cast<int32_t>(std::lround((target.viewport_x + (ndc_x * 0.5f + 0.5f) * target.viewport_width) * kSubPixelScale));
+      screen_y[i] = static_cast<int32_t>(std::lround((target.viewport_y + (0.5f - ndc_y * 0.5f) * target.viewport_height) * kSubPixelScale));
+    }
+
+    for (size_t fan = 1; fan + 1 < polygon_vertex_number; ++fan) {
+      const size_t corners[3] = { 0, fan, fan + 1 };
+      const int64_t area = EdgeFunction(screen_x[corners[0]], screen_y[corners[0]], screen_x[corners[1]], screen_y[corners[1]],
+        screen_x[corners[2]], screen_y[corners[2]]);
+      // Default rasterizer state: clockwise triangles are front facing and back faces are culled.
+      if (area <= 0) {
+        continue;
+      }
+
+      Triangle setup_triangle;
+      int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+      for (size_t k = 0; k < 3; ++k) {
+        const size_t source = corners[k];
+        setup_triangle.x[k] = screen_x[source];
+        setup_triangle.y[k] = screen_y[source];
+        setup_triangle.z[k] = screen_z[source];
+        setup_triangle.inv_w[k] = inv_w[source];
+        if (!depth_only) {
+          for (size_t a = 0; a < kAttributeNumber; ++a) {
+            setup_triangle.attributes[k][a] = polygon[source].data[4 + a] * inv_w[source];
+          }
+        }
+        min_x = std::min(min_x, screen_x[source]);
+        min_y = std::min(min_y, screen_y[source]);
+        max_x = std::max(max_x, screen_x[source]);
+        max_y = std::max(max_y, screen_y[source]);
+      }
+
+      // Pixel centers sit at +0.5, so pixel p is covered when p + 0.5 lies within the fixed point bounds.
+      setup_triangle.min_x = std::max(scissor_min_x, (min_x - kSubPixelScale / 2 + kSubPixelScale - 1) >> kSubPixelBits);
+      setup_triangle.min_y = std::max(scissor_min_y, (min_y - kSubPixelScale / 2 + kSubPixelScale - 1) >> kSubPixelBits);
+      setup_triangle.max_x = std::min(scissor_max_x, (max_x - kSubPixelScale / 2) >> kSubPixelBits);
+      setup_triangle.max_y = std::min(scissor_max_y, (max_y - kSubPixelScale / 2) >> kSubPixelBits);
+      if (setup_triangle.min_x > setup_triangle.max_x || setup_triangle.min_y > setup_triangle.max_y) {
+        continue;
+      }
+      setup_triangle.diffuse_texture_index = draw_argument.diffuse_texture_index;
+
+      const uint32_t triangle_index = static_cast<uint32_t>(chunk.triangles.size());
+      chunk.triangles.push_back(setup_triangle);
+
+      const UINT first_tile_x = setup_triangle.min_x / kTileSize;
+      const UINT last_tile_x = setup_triangle.max_x / kTileSize;
+      const UINT first_tile_y = setup_triangle.min_y / kTileSize;
+      const UINT last_tile_y = setup_triangle.max_y / kTileSize;
+      for (UINT tile_y = first_tile_y; tile_y <= last_tile_y; ++tile_y) {
+        for (UINT tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x) {
+          chunk.tile_bins[static_cast<size_t>(tile_y) * target.tile_columns + tile_x].push_back(triangle_index);
+        }
+      }
+    }
+  }
+}
+
+size_t SoftwareRasterizer::RasterizeTile(size_t tile_index, size_t chunk_number, const FrameConstants& frame_constants, const RenderTarget& target) const
+{
+  const int tile_min_x = static_cast<int>((tile_index % target.tile_columns) * kTileSize);
+  const int tile_min_y = static_cast<int>((tile_index / target.tile_columns) * kTileSize);
+  const int tile_max_x = std::min(tile_min_x + static_cast<int>(kTileSize), static_cast<int>(target.width)) - 1;
+  const int tile_max_y = std::min(tile_min_y + static_cast<int>(kTileSize), static_cast<int>(target.height)) - 1;
+
+  size_t pixels_written = 0;
+  // Chunks are visited in submission order, which keeps depth ties resolved exactly like the GPU.
+  for (size_t chunk_index = 0; chunk_index < chunk_number; ++chunk_index) {
+    const TriangleChunk& chunk = chunks_[chunk_index];
+    for (uint32_t triangle_index : chunk.tile_bins[tile_index]) {
+      const Triangle& triangle = chunk.triangles[triangle_index];
+      const int min_x = std::max(triangle.min_x, tile_min_x);
+      const int min_y = std::max(triangle.min_y, tile_min_y);
+      const int max_x = std::min(triangle.max_x, tile_max_x);
+      const int max_y = std::min(triangle.max_y, tile_max_y);
+
+      const int32_t* x = triangle.x;
+      const int32_t* y = triangle.y;
+      // Edge i is opposite vertex i, so its value is the (unnormalized) barycentric weight of vertex i.
+      const int64_t bias0 = IsTopLeftEdge(x[1], y[1], x[2], y[2]) ? 0 : -1;
+      const int64_t bias1 = IsTopLeftEdge(x[2], y[2], x[0], y[0]) ? 0 : -1;
+      const int64_t bias2 = IsTopLeftEdge(x[0], y[0], x[1], y[1]) ? 0 : -1;
+      const int64_t step0 = -static_cast<int64_t>(y[2] - y[1]) * kSubPixelScale;
+      const int64_t step1 = -static_cast<int64_t>(y[0] - y[2]) * kSubPixelScale;
+      const int64_t step2 = -static_cast<int64_t>(y[1] - y[0]) * kSubPixelScale;
+      const float inv_area = 1.0f / static_cast<float>(EdgeFunction(x[0], y[0], x[1], y[1], x[2], y[2]));
+
+      for (int py = min_y; py <= max_y; ++py) {
+        const int64_t sample_y = static_cast<int64_t>(py) * kSubPixelScale + kSubPixelScale / 2;
+        const int64_t sample_x = static_cast<int64_t>(min_x) * kSubPixelScale + kSubPixelScale / 2;
+        int64_t edge0 = EdgeFunction(x[1], y[1], x[2], y[2], sample_x, sample_y);
+        int64_t edge1 = EdgeFunction(x[2], y[2], x[0], y[0], sample_x, sample_y);
+        int64_t edge2 = EdgeFunction(x[0], y[0], x[1], y[1], sample_x, sample_y);
+        const size_t row_offset = static_cast<size_t>(py) * target.width;
+
+        for (int px = min_x; px <= max_x; ++px, edge0 += step0, edge1 += step1, edge2 += step2) {
+          if ((edge0 + bias0) < 0 || (edge1 + bias1) < 0 || (edge2 + bias2) < 0) {
+            continue;
+          }
+
+          const float weight0 = edge0 * inv_area;
+          const float weight1 = edge1 * inv_area;
+          const float weight2 = edge2 * inv_area;
+          const float depth = weight0 * triangle.z[0] + weight1 * triangle.z[1] + weight2 * triangle.z[2];
+          float& stored_depth = target.depth[row_offset + px];
+          // D3D12_COMPARISON_FUNC_LESS, the CD3DX12_DEPTH_STENCIL_DESC default.
+          if (!(depth < stored_depth)) {
+            continue;
+          }
+          stored_depth = depth;
+          pixels_written++;
+
+          if (target.color == nullptr) {
+            continue;
+          }
+
+          const float perspective0 = weight0 * triangle.inv_w[0];
+          const float perspective1 = weight1 * triangle.inv_w[1];
+          const float perspective2 = weight2 * triangle.inv_w[2];
+          const float w = 1.0f / (perspective0 + perspective1 + perspective2);
+          float attributes[kAttributeNumber];
+          for (size_t a = 0; a < kAttributeNumber; ++a) {
+            attributes[a] = (weight0 * triangle.attributes[0][a] + weight1 * triangle.attributes[1][a] + weight2 * triangle.attributes[2][a]) * w;
+          }
+
+          target.color[row_offset + px] = PackUnorm(ShadePixel(attributes, triangle.diffuse_texture_index, px, py, frame_constants));
+        }
+      }
+    }
+  }
+
+  return pixels_written;
+}
+
+float SoftwareRasterizer::ComputeLitFraction(FXMVECTOR world_pos, int pixel_x, int pixel_y, const FrameConstants& frame_constants) const
+{
+  if (frame_constants.light_type == 1) {
+    // ComputeLitFractionOfPointLight: the depth along the face's axis is what the face's projection stored.
+    XMFLOAT3 light_to_pixel;
+    XMStoreFloat3(&light_to_pixel, XMVectorSubtract(world_pos, XMLoadFloat4(&frame_constants.light_world_direction_or_position)));
+    const float view_depth = std::max(std::abs(light_to_pixel.x), std::max(std::abs(light_to_pixel.y), std::abs(light_to_pixel.z)));
+    const XMFLOAT4& depth_params = frame_constants.cube_shadow_depth_params;
+    const float curr_depth = depth_params.x + depth_params.y / view_depth;
+    if (curr_depth > 1.0f) {
+      return 1.0f;  // beyond the far plane, nothing was rendered there
+    }
+
+    // Each face was rendered with its own view projection, so it also maps the pixel to the face's texels.
+    const UINT face = SelectCubeFace(light_to_pixel);
+    const XMVECTOR face_clip_coordinate = XMVector4Transform(world_pos, LoadTransposed(frame_constants.cube_face_view_projs[face]));
+    const XMVECTOR face_ndc_coordinate = XMVectorScale(face_clip_coordinate, 1.0f / XMVectorGetW(face_clip_coordinate));
+    const float u = 0.5f * XMVectorGetX(face_ndc_coordinate) + 0.5f;
+    const float v = 1.0f - (0.5f * XMVectorGetY(face_ndc_coordinate) + 0.5f);
+    // Offsets on a cube are left out: every filtered mode uses the hardware 2x2 PCF here.
+    const ShadowFilter::Mode mode = shadow_filter_mode_ == ShadowFilter::Mode::kPoint ? ShadowFilter::Mode::kPoint : ShadowFilter::Mode::kHardwarePcf;
+    return ShadowFilter::Filter(mode, cube_faces_[face], u, v, curr_depth, depth_params.z, 0.0f).lit;
+  }
+
+  // SelectCascade: the first cascade whose far split lies beyond the pixel; the last one ends at the far plane.
+  const float view_depth = XMVectorGetZ(XMVector4Transform(world_pos, LoadTransposed(frame_constants.view)));
+  const float split_distances[CascadedShadowMap::kMaxCascadeNumber] = {
+    frame_constants.cascade_split_distances.x, frame_constants.cascade_split_distances.y,
+    frame_constants.cascade_split_distances.z, frame_constants.cascade_split_distances.w,
+  };
+  const float depth_biases[CascadedShadowMap::kMaxCascadeNumber] = {
+    frame_constants.cascade_depth_biases.x, frame_constants.cascade_depth_biases.y,
+    frame_constants.cascade_depth_biases.z, frame_constants.cascade_depth_biases.w,
+  };
+  const int cascade_number = std::min(frame_constants.cascade_number, static_cast<int>(CascadedShadowMap::kMaxCascadeNumber));
+  UINT cascade_index = 0;
+  for (int i = 0; i < cascade_number - 1; ++i) {
+    if (view_depth > split_distances[i]) {
+      cascade_index = i + 1;
+    }
+  }
+
+  const XMVECTOR light_space_clip_coordinate = XMVector4Transform(world_pos, LoadTransposed(frame_constants.light_view_proj_transforms[cascade_index]));
+  const XMVECTOR light_space_ndc_coordinate = XMVectorScale(light_space_clip_coordinate, 1.0f / XMVectorGetW(light_space_clip_coordinate));
+  float shadow_map_u = 0.5f * XMVectorGetX(light_space_ndc_coordinate) + 0.5f;
+  float shadow_map_v = 1.0f - (0.5f * XMVectorGetY(light_space_ndc_coordinate) + 0.5f);
+  if (frame_constants.light_type == 2) {
+    // The spot light's map is a tile of the atlas; clamped to it, filters reach no further than its gutter.
+    const XMFLOAT4& tile = frame_constants.shadow_atlas_tile;
+    shadow_map_u = std::min(std::max(shadow_map_u, 0.0f), 1.0f) * tile.x + tile.z;
+    shadow_map_v = std::min(std::max(shadow_map_v, 0.0f), 1.0f) * tile.y + tile.w;
+  }
+  const float curr_depth = XMVectorGetZ(light_space_ndc_coordinate);
+  const float bias = depth_biases[cascade_index];
+
+  if (ShadowFilter::IsMomentMode(shadow_filter_mode_)) {
+    // The GPU picks a mip of the moments from the pixel's footprint; without mips this is its top level.
+    return ShadowFilter::FilterMoments(shadow_filter_mode_, shadow_moments_[cascade_index], shadow_map_u, shadow_map_v, curr_depth, bias).lit;
+  }
+  const float rotation = ShadowFilter::ComputeRotation(pixel_x + 0.5f, pixel_y + 0.5f);
+  return ShadowFilter::Filter(shadow_filter_mode_, shadow_slices_[cascade_index], shadow_map_u, shadow_map_v, curr_depth, bias, rotation).lit;
+}
+
+XMFLOAT4 SoftwareRasterizer::ShadePixel(const float* attributes, int diffuse_texture_index, int pixel_x, int pixel_y, const FrameConstants& frame_constants) const
+{
+  const float u = attributes[0];
+  const float v = attributes[1];
+  const XMVECTOR world_pos = XMVectorSet(attributes[5], attributes[6], attributes[7], 1.0f);
+  const XMVECTOR interpolated_normal = XMVectorSet(attributes[8], attributes[9], attributes[10], 0.0f);
+
+  // calculate ambient color
+  // Draws without a texture sample the null view Scene::ScenePass binds first, which reads 0.
+  XMVECTOR color = XMVectorZero();
+  if (diffuse_texture_index >= 0 && static_cast<size_t>(diffuse_texture_index) < diffuse_textures_.size()) {
+    color = SampleTexture(diffuse_textures_[diffuse_texture_index], u, v);
+  }
+  color = XMVectorSetW(color, 0.0f);
+  const XMVECTOR ambient_color = XMVectorScale(color, 0.05f);
+
+  const float lit_fraction = ComputeLitFraction(world_pos, pixel_x, pixel_y, frame_constants);
+  if (lit_fraction <= 0.0f) {
+    XMFLOAT4 result;
+    XMStoreFloat4(&result, XMVectorSetW(ambient_color, 1.0f));
+    return result;
+  }
+
+  // calculate diffuse color
+  const XMVECTOR light_world_direction_or_position = XMLoadFloat4(&frame_constants.light_world_direction_or_position);
+  XMVECTOR light_world_direction = XMVectorZero();
+  if (frame_constants.light_type == 0) {
+    light_world_direction = XMVectorNegate(XMVector3Normalize(light_world_direction_or_position));
+  }
+  else if (frame_constants.light_type == 1 || frame_constants.light_type == 2) {
+    light_world_direction = XMVector3Normalize(XMVectorSubtract(light_world_direction_or_position, world_pos));
+  }
+  const XMVECTOR world_normal = XMVector3Normalize(interpolated_normal);
+  float diff = std::min(1.0f, std::max(0.0f, XMVectorGetX(XMVector3Dot(light_world_direction, world_normal))));
+  if (frame_constants.light_type == 1) {
+    const float epsilon = 0.01f;
+    const float light_pixel_distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(light_world_direction_or_position, world_pos)));
+    const float cutoff_distance = 7.0f;
+    diff *= cutoff_distance * cutoff_distance / (light_pixel_distance * light_pixel_distance + epsilon);
+  }
+  if (frame_constants.light_type == 2) {
+    const float cosine_theta_p = 0.866f;  // 30 degrees
+    const float cosine_theta_u = 0.5f;  // 60 degrees
+    const XMVECTOR spot_light_direction = XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f);
+    const float cosine_theta_s = XMVectorGetX(XMVector3Dot(spot_light_direction, XMVectorNegate(light_world_direction)));
+    float t = std::min(1.0f, std::max(0.0f, (cosine_theta_s - cosine_theta_u) / (cosine_theta_p - cosine_theta_u)));
+    t *= t;
+    diff *= t;
+  }
+  const XMVECTOR diffuse_color = XMVectorScale(color, diff);
+
+  // calculate specular color
+  const XMVECTOR camera_world_pos = XMLoadFloat4(&frame_constants.camera_world_pos);
+  const XMVECTOR view_world_direction = XMVector3Normalize(XMVectorSubtract(camera_world_pos, world_pos));
+  const XMVECTOR half_way_direction = XMVector3Normalize(XMVectorAdd(light_world_direction, view_world_direction));
+  const float spec = std::pow(std::min(1.0f, std::max(0.0f, XMVectorGetX(XMVector3Dot(world_normal, half_way_direction)))), 32.0f);
+  const XMVECTOR specular_color = XMVectorScale(XMVectorSet(0.3f, 0.3f, 0.3f, 0.0f), spec);
+
+  XMFLOAT4 result;
+  XMStoreFloat4(&result, XMVectorSetW(XMVectorAdd(ambient_color, XMVectorScale(XMVectorAdd(diffuse_color, specular_color), lit_fraction)), 1.0f));
+  return result;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "assets_manager.h"
+#include "cascaded_shadow_map.h"
+#include "cube_shadow_map.h"
+#include "shadow_filter.h"
+
+class ThreadPool;
+
+// CPU reference of Scene::ShadowPass, Scene::CubeShadowPass and Scene::ScenePass. It consumes the merged buffers
+// from AssetsManager::GetMergedVerticesAndIndices and the same DrawArgument list, so frames can be rendered,
+// diffed and benchmarked on machines without a D3D12 device ("-softwareRasterizer <frame number>").
+//
+// The frame is split into square tiles. Triangles are set up in parallel, binned to the tiles they touch
+// (keeping submission order), then every tile is rasterized as one job on the pool, so each pixel is only ever
+// touched by a single thread.
+class SoftwareRasterizer {
+ public:
+  // Mirrors SceneConstantBuffer without the per-object model matrix (taken from the DrawArgument), plus the
+  // point light's face transforms of CubeShadowConstantBuffer. Matrices are expected in the same transposed
+  // layout Scene uploads to the GPU.
+  struct FrameConstants {
+    XMFLOAT4X4 view;
+    XMFLOAT4X4 proj;
+    XMFLOAT4 light_world_direction_or_position;
+    XMFLOAT4 light_color;
+    XMFLOAT4 camera_world_pos;
+    XMFLOAT4X4 light_view_proj_transforms[CascadedShadowMap::kMaxCascadeNumber];  // the spot light only uses the first
+    XMFLOAT4 cascade_split_distances;
+    XMFLOAT4 cascade_depth_biases;
+    XMFLOAT4 shadow_depth_params[CascadedShadowMap::kMaxCascadeNumber];
+    XMFLOAT4 cube_shadow_depth_params;
+    XMFLOAT4 shadow_atlas_tile = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+    XMFLOAT4X4 cube_face_view_projs[CubeShadowMap::kFaceNumber];
+    int light_type = 0;  // 0: directional light; 1: point light; 2: spot light
+    int cascade_number = 1;
+  };  // struct FrameConstants
+
+  // R8G8B8A8_UNORM texels, tightly packed.
+  struct Texture {
+    UINT width = 0;
+    UINT height = 0;
+    std::vector<uint8_t> texels;
+  };  // struct Texture
+
+  struct RenderStats {
+    size_t triangles_submitted = 0;
+    size_t triangles_rasterized = 0;  // survived clipping and culling
+    size_t pixels_written = 0;  // passed the depth test
+    double seconds = 0.0;
+  };  // struct RenderStats
+
+  static constexpr UINT kTileSize = 64;
+
+  // Tiles are spread over thread_pool, which may be null to render on the calling thread only.
+  explicit SoftwareRasterizer(ThreadPool* thread_pool = nullptr);
+  ~SoftwareRasterizer();
+
+  SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+  SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+  // shadow_resolution is of each slice of the shadow map array, cube_resolution of each face of the point
+  // light's cube map, as in ShadowQuality::Settings.
+  void Resize(UINT width, UINT height, UINT shadow_resolution, UINT cube_resolution);
+
+  void SetGeometry(const Asset::Model::Vertex* vertices, size_t vertex_number, const DWORD* indices, size_t index_number);
+
+  // Indexed by DrawArgument::diffuse_texture_index.
+  void SetDiffuseTextures(std::vector<Texture> diffuse_textures) {
+    diffuse_textures_ = std::move(diffuse_textures);
+  }
+
+  // The permutation of scene_pixel_shader.hlsl to reproduce.
+  void SetShadowFilter(ShadowFilter::Mode shadow_filter_mode) {
+    shadow_filter_mode_ = shadow_filter_mode;
+  }
+
+  // Depth-only pass of the light in frame_constants: a slice per cascade for the directional light, the atlas tile
+  // in the first slice for the spot light, the six cube faces for the point light. The moment filters then get
+  // their moments of each slice, as shadow_moments_compute_shader.hlsl does.
+  RenderStats ShadowPass(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants);
+
+  // Lit pass into the color and scene depth targets, a port of scene_pixel_shader.hlsl. Reads the shadow maps
+  // written by the last ShadowPass.
+  RenderStats ScenePass(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants);
+
+  const std::vector<uint32_t>& GetColorTarget() const {
+    return color_target_;
+  }
+
+  const std::vector<float>& GetSceneDepthTarget() const {
+    return scene_depth_target_;
+  }
+
+  // Slice i of the shadow map array, with the depth_params of its cascade.
+  const ShadowFilter::DepthMap& GetShadowSlice(UINT slice) const {
+    return shadow_slices_[slice];
+  }
+
+  // Face i of the point light's cube map, in TextureCube order.
+  const ShadowFilter::DepthMap& GetCubeFace(UINT face) const {
+    return cube_faces_[face];
+  }
+
+  UINT GetWidth() const {
+    return width_;
+  }
+
+  UINT GetHeight() const {
+    return height_;
+  }
+
+  // 32-bit uncompressed TGA.
+  bool WriteColorImage(const std::string& file_name) const;
+
+  // Single channel PFM, so depth keeps full float precision.
+  static bool WriteDepthImage(const std::string& file_name, const std::vector<float>& depth, UINT width, UINT height);
+
+ private:
+  struct RenderTarget;
+
+  // uv (2), color (3), world position (3), world normal (3), the scene_vertex_shader.hlsl outputs.
+  static constexpr size_t kAttributeNumber = 11;
+
+  struct Triangle {
+    int32_t x[3];  // screen position, 24.8 fixed point
+    int32_t y[3];
+    float z[3];
+    float inv_w[3];
+    float attributes[3][kAttributeNumber];  // already divided by w for perspective-correct interpolation
+    int min_x, min_y, max_x, max_y;  // pixel bounds, inclusive
+    int diffuse_texture_index;
+  };  // struct Triangle
+
+  // A run of triangles from one draw, set up and binned by a single job.
+  struct TriangleChunk {
+    size_t draw_index = 0;
+    size_t first_triangle = 0;
+    size_t triangle_number = 0;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> tile_bins;  // indices into triangles, per tile
+  };  // struct TriangleChunk
+
+  RenderStats Render(const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants,
+                     const XMFLOAT4X4* light_view_proj, const RenderTarget& target);
+  void SetupChunk(TriangleChunk& chunk, const std::vector<AssetsManager::DrawArgument>& draw_arguments, const FrameConstants& frame_constants,
+                  const XMFLOAT4X4* light_view_proj, const RenderTarget& target) const;
+  size_t RasterizeTile(size_t tile_index, size_t chunk_number, const FrameConstants& frame_constants, const RenderTarget& target) const;
+  void ForEach(size_t job_number, const std::function<void(size_t)>& job) const;
+
+  XMFLOAT4 ShadePixel(const float* attributes, int diffuse_texture_index, int pixel_x, int pixel_y, const FrameConstants& frame_constants) const;
+  float ComputeLitFraction(FXMVECTOR world_pos, int pixel_x, int pixel_y, const FrameConstants& frame_constants) const;
+
+  ThreadPool* thread_pool_ = nullptr;
+  ShadowFilter::Mode shadow_filter_mode_ = ShadowFilter::Mode::kPoint;
+
+  const Asset::Model::Vertex* vertices_ = nullptr;
+  size_t vertex_number_ = 0;
+  const DWORD* indices_ = nullptr;
+  size_t index_number_ = 0;
+
+  std::vector<Texture> diffuse_textures_;
+
+  UINT width_ = 0;
+  UINT height_ = 0;
+  std::vector<uint32_t> color_target_;
+  std::vector<float> scene_depth_target_;
+  ShadowFilter::DepthMap shadow_slices_[CascadedShadowMap::kMaxCascadeNumber];
+  ShadowFilter::MomentMap shadow_moments_[CascadedShadowMap::kMaxCascadeNumber];  // moment filters only
+  ShadowFilter::DepthMap cube_faces_[CubeShadowMap::kFaceNumber];
+
+  // Per-pass scratch, kept to avoid reallocating every frame.
+  std::vector<TriangleChunk> chunks_;
+};  // class SoftwareRasterizer
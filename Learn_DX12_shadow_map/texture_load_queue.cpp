@@ -0,0 +1,186 @@
+#include "texture_load_queue.h"
+
+#include <cstring>
+
+#include "d3dx12.h"
+#include "dds_texture.h"
+#include "dx_sample_helper.h"
+#include "image_loader.h"
+
+TextureLoadQueue::TextureLoadQueue(ID3D12Device* device, size_t worker_number)
+  : device_(device), thread_pool_(worker_number)
+{
+}
+
+void TextureLoadQueue::EnableMipChainGeneration(MipChainGenerator::Filter filter)
+{
+  generate_mip_chains_ = true;
+  mip_chain_options_.filter = filter;
+  mip_chain_options_.thread_pool = &thread_pool_;
+}
+
+void TextureLoadQueue::EnableBlockCompression(BlockCompressor::Format format)
+{
+  compress_textures_ = true;
+  block_compression_format_ = format;
+}
+
+void TextureLoadQueue::Load(const std::vector<std::string>& file_names)
+{
+  // Sized once up front, the jobs keep references into textures_.
+  textures_.clear();
+  completions_.clear();
+  textures_.resize(file_names.size());
+  completions_.resize(file_names.size());
+
+  for (size_t i = 0; i < file_names.size(); ++i) {
+    if (file_names[i].empty()) {
+      continue;
+    }
+
+    const std::string file_name = file_names[i];
+    LoadedTexture* loaded_texture = &textures_[i];
+    completions_[i] = thread_pool_.Submit([this, file_name, loaded_texture]() {
+      LoadTexture(file_name, *loaded_texture);
+    });
+  }
+}
+
+TextureLoadQueue::LoadedTexture& TextureLoadQueue::Wait(size_t texture_index)
+{
+  if (completions_[texture_index].valid()) {
+    completions_[texture_index].get();
+  }
+
+  return textures_[texture_index];
+}
+
+void TextureLoadQueue::LoadTexture(const std::string& file_name, LoadedTexture& loaded_texture)
+{
+  // ID3D12Device is free-threaded, so the resources are created right here on the worker.
+  if (DdsTexture::IsDdsFileName(file_name)) {
+    CopyDdsIntoUploadHeap(file_name, loaded_texture);
+  } else {
+    DecodeIntoUploadHeap(file_name, loaded_texture);
+  }
+
+  CD3DX12_HEAP_PROPERTIES default_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+  ThrowIfFailed(device_->CreateCommittedResource(&default_heap_properties,
+    D3D12_HEAP_FLAG_NONE,
+    &loaded_texture.texture_desc,
+    D3D12_RESOURCE_STATE_COPY_DEST,
+    nullptr,
+    IID_PPV_ARGS(&loaded_texture.texture)));
+}
+
+void TextureLoadQueue::CopyDdsIntoUploadHeap(const std::string& file_name, LoadedTexture& loaded_texture) const
+{
+  // Already in its final format with every mip level, so it is only copied row by row into the footprints.
+  DdsTexture dds_texture;
+  if (!dds_texture.Load(std::wstring(file_name.begin(), file_name.end()))) {
+    ThrowIfFailed(E_FAIL);
+  }
+
+  loaded_texture.texture_desc = dds_texture.GetTextureDesc();
+  loaded_texture.footprints.resize(dds_texture.GetSubresourceNumber());
+  UINT64 upload_heap_size = 0;
+  device_->GetCopyableFootprints(&loaded_texture.texture_desc, 0, dds_texture.GetSubresourceNumber(), 0, loaded_texture.footprints.data(), nullptr, nullptr, &upload_heap_size);
+
+  uint8_t* mapped_upload_heap = CreateUploadHeap(upload_heap_size, loaded_texture);
+  dds_texture.CopySubresources(loaded_texture.footprints.data(), mapped_upload_heap);
+  loaded_texture.upload_heap->Unmap(0, nullptr);
+}
+
+void TextureLoadQueue::DecodeIntoUploadHeap(const std::string& file_name, LoadedTexture& loaded_texture)
+{
+  // Texels go straight into the upload heap, unless they are block compressed: then they are decoded into
+  // CPU memory first.
+  std::vector<uint8_t> staging;
+  uint8_t* mapped_upload_heap = nullptr;
+  const auto allocate_subresources = [this, &loaded_texture, &staging, &mapped_upload_heap](const D3D12_RESOURCE_DESC& texture_desc, std::vector<ImageLoader::SubresourceDestination>& destinations) -> bool {
+    loaded_texture.footprints.resize(texture_desc.MipLevels);
+    UINT64 upload_heap_size = 0;
+    device_->GetCopyableFootprints(&texture_desc, 0, texture_desc.MipLevels, 0, loaded_texture.footprints.data(), nullptr, nullptr, &upload_heap_size);
+
+    uint8_t* subresources = nullptr;
+    if (compress_textures_) {
+      staging.resize(static_cast<size_t>(upload_heap_size));
+      subresources = staging.data();
+    } else {
+      mapped_upload_heap = CreateUploadHeap(upload_heap_size, loaded_texture);
+      subresources = mapped_upload_heap;
+    }
+    for (size_t level = 0; level < destinations.size(); ++level) {
+      destinations[level].data = subresources + loaded_texture.footprints[level].Offset;
+      destinations[level].row_pitch = loaded_texture.footprints[level].Footprint.RowPitch;
+    }
+    return true;
+  };
+
+  int bytes_per_row = 0;
+  int image_size = 0;
+  if (generate_mip_chains_) {
+    image_size = ImageLoader::LoadImageDataFromFile(file_name, loaded_texture.texture_desc, bytes_per_row, allocate_subresources, mip_chain_options_);
+  } else {
+    image_size = ImageLoader::LoadImageDataFromFile(file_name, loaded_texture.texture_desc, bytes_per_row,
+      [&allocate_subresources](const D3D12_RESOURCE_DESC& texture_desc, UINT& row_pitch) -> uint8_t* {
+        std::vector<ImageLoader::SubresourceDestination> destinations(1);
+        allocate_subresources(texture_desc, destinations);
+        row_pitch = destinations[0].row_pitch;
+        return destinations[0].data;
+      });
+  }
+
+  if (image_size != 0 && compress_textures_) {
+    mapped_upload_heap = CompressIntoUploadHeap(staging, loaded_texture);
+  }
+  if (mapped_upload_heap != nullptr) {
+    loaded_texture.upload_heap->Unmap(0, nullptr);
+  }
+  if (image_size == 0) {
+    ThrowIfFailed(E_FAIL);
+  }
+}
+
+uint8_t* TextureLoadQueue::CreateUploadHeap(UINT64 upload_heap_size, LoadedTexture& loaded_texture) const
+{
+  CD3DX12_HEAP_PROPERTIES upload_heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  CD3DX12_RESOURCE_DESC upload_buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(upload_heap_size);
+  ThrowIfFailed(device_->CreateCommittedResource(&upload_heap_properties,
+    D3D12_HEAP_FLAG_NONE,
+    &upload_buffer_desc,
+    D3D12_RESOURCE_STATE_GENERIC_READ,
+    nullptr,
+    IID_PPV_ARGS(&loaded_texture.upload_heap)));
+
+  uint8_t* mapped_upload_heap = nullptr;
+  CD3DX12_RANGE read_range(0, 0);
+  ThrowIfFailed(loaded_texture.upload_heap->Map(0, &read_range, reinterpret_cast<void**>(&mapped_upload_heap)));
+  return mapped_upload_heap;
+}
+
+uint8_t* TextureLoadQueue::CompressIntoUploadHeap(std::vector<uint8_t>& staging, LoadedTexture& loaded_texture)
+{
+  // staging is laid out by the uncompressed footprints. BC textures need a top level in whole 4x4 blocks;
+  // anything else is uploaded as decoded.
+  const D3D12_RESOURCE_DESC decoded_desc = loaded_texture.texture_desc;
+  if (!BlockCompressor::IsSourceFormatSupported(decoded_desc.Format) || decoded_desc.Width % 4 != 0 || decoded_desc.Height % 4 != 0) {
+    uint8_t* mapped_upload_heap = CreateUploadHeap(staging.size(), loaded_texture);
+    std::memcpy(mapped_upload_heap, staging.data(), staging.size());
+    return mapped_upload_heap;
+  }
+
+  const std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> decoded_footprints = loaded_texture.footprints;
+  loaded_texture.texture_desc.Format = BlockCompressor::GetDxgiFormat(block_compression_format_);
+  UINT64 upload_heap_size = 0;
+  device_->GetCopyableFootprints(&loaded_texture.texture_desc, 0, loaded_texture.texture_desc.MipLevels, 0, loaded_texture.footprints.data(), nullptr, nullptr, &upload_heap_size);
+
+  uint8_t* mapped_upload_heap = CreateUploadHeap(upload_heap_size, loaded_texture);
+  for (size_t level = 0; level < decoded_footprints.size(); ++level) {
+    const D3D12_SUBRESOURCE_FOOTPRINT& decoded_footprint = decoded_footprints[level].Footprint;
+    const MipChainGenerator::Surface source = { staging.data() + decoded_footprints[level].Offset, decoded_footprint.RowPitch, decoded_footprint.Width, decoded_footprint.Height };
+    BlockCompressor::CompressImage(block_compression_format_, decoded_desc.Format, source,
+      mapped_upload_heap + loaded_texture.footprints[level].Offset, loaded_texture.footprints[level].Footprint.RowPitch, &thread_pool_);
+  }
+  return mapped_upload_heap;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "block_compressor.h"
+#include "common_headers.h"
+#include "mip_chain_generator.h"
+#include "thread_pool.h"
+
+using Microsoft::WRL::ComPtr;
+
+// Decodes textures concurrently on a worker pool. Each job creates the texture and an upload heap sized by
+// GetCopyableFootprints, then lets ImageLoader write the decoded rows straight into the mapped upload heap
+// at the footprint's row pitch, so nothing is copied on the CPU after decoding. ".dds" files skip decoding
+// (and mip generation and compression): their subresources are copied from the mapped file as they are.
+// The thread that recorded the loads only waits for each texture in turn and records its copies.
+class TextureLoadQueue {
+ public:
+  struct LoadedTexture {
+    ComPtr<ID3D12Resource> texture;  // default heap, in D3D12_RESOURCE_STATE_COPY_DEST
+    ComPtr<ID3D12Resource> upload_heap;  // holds the decoded texels, laid out by footprint
+    D3D12_RESOURCE_DESC texture_desc{};
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;  // one per subresource
+  };  // struct LoadedTexture
+
+  // worker_number == 0 means one worker per hardware thread.
+  explicit TextureLoadQueue(ID3D12Device* device, size_t worker_number = 0);
+
+  TextureLoadQueue(const TextureLoadQueue&) = delete;
+  TextureLoadQueue& operator=(const TextureLoadQueue&) = delete;
+
+  // Off by default. Call before Load: each texture then gets its full mip chain, generated by the job that
+  // decoded it with the rows of every level spread over the pool.
+  void EnableMipChainGeneration(MipChainGenerator::Filter filter);
+
+  // Off by default. Call before Load: 8 bit RGBA textures whose size is a multiple of 4 are then encoded to
+  // format on the pool after decoding (and mip generation), others are uploaded as decoded.
+  void EnableBlockCompression(BlockCompressor::Format format);
+
+  // Starts loading every file and returns immediately. Empty names are skipped but keep their index.
+  void Load(const std::vector<std::string>& file_names);
+
+  size_t GetTextureNumber() const {
+    return textures_.size();
+  }
+
+  // Blocks until texture_index is loaded. Rethrows the HrException of a failed load. A skipped texture
+  // comes back with no resources.
+  LoadedTexture& Wait(size_t texture_index);
+
+ private:
+  void LoadTexture(const std::string& file_name, LoadedTexture& loaded_texture);
+  void CopyDdsIntoUploadHeap(const std::string& file_name, LoadedTexture& loaded_texture) const;
+  void DecodeIntoUploadHeap(const std::string& file_name, LoadedTexture& loaded_texture);
+  // Creates loaded_texture.upload_heap and returns it mapped.
+  uint8_t* CreateUploadHeap(UINT64 upload_heap_size, LoadedTexture& loaded_texture) const;
+  // Moves the decoded subresources from staging to a new upload heap, block compressed when possible, and
+  // updates texture_desc and footprints to match. Returns the mapped upload heap.
+  uint8_t* CompressIntoUploadHeap(std::vector<uint8_t>& staging, LoadedTexture& loaded_texture);
+
+  ID3D12Device* device_ = nullptr;
+  std::vector<LoadedTexture> textures_;
+  std::vector<std::future<void>> completions_;  // per texture, invalid for skipped ones
+  bool generate_mip_chains_ = false;
+  MipChainGenerator::Options mip_chain_options_;
+  bool compress_textures_ = false;
+  BlockCompressor::Format block_compression_format_ = BlockCompressor::Format::kBC1;
+
+  // Last, so the workers are joined before the textures they write go away.
+  ThreadPool thread_pool_;
+};  // class TextureLoadQueue
@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t worker_number)
+{
+  if (worker_number == 0) {
+    worker_number = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  workers_.reserve(worker_number);
+  for (size_t i = 0; i < worker_number; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    stopping_ = true;
+  }
+  jobs_condition_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> job)
+{
+  std::packaged_task<void()> task(std::move(job));
+  std::future<void> result = task.get_future();
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.emplace(std::move(task));
+  }
+  jobs_condition_.notify_one();
+
+  return result;
+}
+
+void ThreadPool::ParallelFor(size_t job_count, const std::function<void(size_t, size_t)>& job)
+{
+  if (job_count == 0) {
+    return;
+  }
+
+  // Shared with the helpers, so a helper that only gets scheduled after all jobs are done
+  // (e.g. when ParallelFor is called from inside a worker) finds nothing to do and never
+  // touches the caller's stack.
+  struct ParallelForState {
+    std::function<void(size_t, size_t)> job;
+    size_t job_count = 0;
+    std::atomic<size_t> next_index{ 0 };
+    std::atomic<size_t> finished_number{ 0 };
+    std::mutex finished_mutex;
+    std::condition_variable finished_condition;
+    std::exception_ptr first_exception;  // guarded by finished_mutex
+
+    void RunJobs(size_t worker_index) {
+      for (size_t index = next_index.fetch_add(1); index < job_count; index = next_index.fetch_add(1)) {
+        // A job that throws still counts as finished, so the caller stops waiting only once no job runs anymore.
+        try {
+          job(index, worker_index);
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> lock(finished_mutex);
+          if (!first_exception) {
+            first_exception = std::current_exception();
+          }
+        }
+        if (finished_number.fetch_add(1) + 1 == job_count) {
+          std::lock_guard<std::mutex> lock(finished_mutex);
+          finished_condition.notify_all();
+        }
+      }
+    }
+  };  // struct ParallelForState
+
+  auto state = std::make_shared<ParallelForState>();
+  state->job = job;
+  state->job_count = job_count;
+
+  // No point waking more helpers than there are jobs left after the caller takes one.
+  const size_t helper_number = std::min(workers_.size(), job_count - 1);
+  for (size_t i = 0; i < helper_number; ++i) {
+    Submit([state, i]() {
+      state->RunJobs(i);
+    });
+  }
+
+  state->RunJobs(workers_.size());
+
+  std::unique_lock<std::mutex> lock(state->finished_mutex);
+  state->finished_condition.wait(lock, [&state]() {
+    return state->finished_number.load() == state->job_count;
+  });
+  if (state->first_exception) {
+    std::rethrow_exception(state->first_exception);
+  }
+}
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex_);
+      jobs_condition_.wait(lock, [this]() {
+        return stopping_ || !jobs_.empty();
+      });
+
+      if (stopping_ && jobs_.empty()) {
+        return;
+      }
+
+      task = std::move(jobs_.front());
+      jobs_.pop();
+    }
+
+    task();
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads. Work is either submitted as single jobs
+// (Submit) or spread over an index range (ParallelFor), where workers pull the
+// next index from a shared atomic counter so uneven jobs balance themselves.
+class ThreadPool {
+ public:
+  // worker_number == 0 means one worker per hardware thread.
+  explicit ThreadPool(size_t worker_number = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t GetWorkerNumber() const {
+    return workers_.size();
+  }
+
+  std::future<void> Submit(std::function<void()> job);
+
+  // Calls job(index, worker_index) for every index in [0, job_count) and blocks until all are done.
+  // worker_index is in [0, GetWorkerNumber()] (the calling thread takes part as the last worker),
+  // so callers can keep per-worker scratch data without locking. If jobs throw, the remaining jobs still run and
+  // the first exception is rethrown on the calling thread once all of them are done.
+  void ParallelFor(size_t job_count, const std::function<void(size_t, size_t)>& job);
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::packaged_task<void()>> jobs_;
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_condition_;
+  bool stopping_ = false;
+};  // class ThreadPool
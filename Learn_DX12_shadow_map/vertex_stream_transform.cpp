@@ -0,0 +1,132 @@
+#include "vertex_stream_transform.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+
+// transform with every element splatted into its own register, shared by all iterations of a kernel.
+struct SplattedTransform {
+  XMVECTOR m[4][4];
+
+  explicit SplattedTransform(FXMMATRIX transform) {
+    for (int row = 0; row < 4; ++row) {
+      m[row][0] = XMVectorSplatX(transform.r[row]);
+      m[row][1] = XMVectorSplatY(transform.r[row]);
+      m[row][2] = XMVectorSplatZ(transform.r[row]);
+      m[row][3] = XMVectorSplatW(transform.r[row]);
+    }
+  }
+};  // struct SplattedTransform
+
+// xs, ys and zs hold the coordinates of four positions (w = 1); writes the four transformed positions.
+inline void TransformFour(FXMVECTOR xs, FXMVECTOR ys, FXMVECTOR zs, const SplattedTransform& transform, XMFLOAT4* transformed_positions)
+{
+  XMMATRIX result;
+  for (int column = 0; column < 4; ++column) {
+    XMVECTOR value = XMVectorMultiplyAdd(xs, transform.m[0][column], transform.m[3][column]);
+    value = XMVectorMultiplyAdd(ys, transform.m[1][column], value);
+    result.r[column] = XMVectorMultiplyAdd(zs, transform.m[2][column], value);
+  }
+
+  // Back from one register per component to one register per position.
+  result = XMMatrixTranspose(result);
+  for (int i = 0; i < 4; ++i) {
+    XMStoreFloat4(&transformed_positions[i], result.r[i]);
+  }
+}
+
+}  // namespace
+
+VertexStreamTransform::BenchmarkReport VertexStreamTransform::Benchmark(size_t vertex_number, UINT iteration_number)
+{
+  BenchmarkReport report{};
+  if (vertex_number == 0 || iteration_number == 0) {
+    return report;
+  }
+
+  std::mt19937 random_engine(static_cast<unsigned int>(vertex_number));
+  std::uniform_real_distribution<float> coordinate_distribution(-100.0f, 100.0f);
+  std::vector<Asset::Model::Vertex> vertices(vertex_number);
+  std::vector<XMFLOAT3> positions(vertex_number);
+  for (size_t i = 0; i < vertex_number; ++i) {
+    positions[i] = XMFLOAT3(coordinate_distribution(random_engine), coordinate_distribution(random_engine), coordinate_distribution(random_engine));
+    vertices[i] = Asset::Model::Vertex{ positions[i], XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+  }
+  std::vector<XMFLOAT4> transformed_positions(vertex_number);
+  const XMMATRIX transform = XMMatrixMultiply(XMMatrixLookAtLH(XMVectorSet(0.0f, 50.0f, -50.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+    XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.1f, 500.0f));
+
+  // One pass each first, so neither pays for first touching the output.
+  TransformVertexPositions(vertices.data(), vertex_number, transform, transformed_positions.data());
+  TransformPositions(positions.data(), vertex_number, transform, transformed_positions.data());
+
+  auto start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    TransformVertexPositions(vertices.data(), vertex_number, transform, transformed_positions.data());
+  }
+  report.interleaved_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+
+  start_time = std::chrono::steady_clock::now();
+  for (UINT i = 0; i < iteration_number; ++i) {
+    TransformPositions(positions.data(), vertex_number, transform, transformed_positions.data());
+  }
+  report.deinterleaved_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count() / iteration_number;
+
+  if (report.interleaved_milliseconds > 0.0) {
+    report.interleaved_gigabytes_per_second = GetVertexPositionsReadSize(vertex_number) / (report.interleaved_milliseconds * 1e6);
+  }
+  if (report.deinterleaved_milliseconds > 0.0) {
+    report.deinterleaved_gigabytes_per_second = GetPositionsReadSize(vertex_number) / (report.deinterleaved_milliseconds * 1e6);
+  }
+  return report;
+}
+
+void VertexStreamTransform::TransformPositions(const XMFLOAT3* positions, size_t position_number, FXMMATRIX transform, XMFLOAT4* transformed_positions)
+{
+  const SplattedTransform splatted_transform(transform);
+
+  size_t i = 0;
+  for (; i + 4 <= position_number; i += 4) {
+    // Four packed positions are exactly three vectors: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+    const XMFLOAT4* source = reinterpret_cast<const XMFLOAT4*>(&positions[i]);
+    const XMVECTOR v0 = XMLoadFloat4(source);
+    const XMVECTOR v1 = XMLoadFloat4(source + 1);
+    const XMVECTOR v2 = XMLoadFloat4(source + 2);
+
+    XMVECTOR xs = XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0W, XM_PERMUTE_1Z, XM_PERMUTE_1W>(v0, v1);
+    xs = XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0Y, XM_PERMUTE_0Z, XM_PERMUTE_1Y>(xs, v2);
+    XMVECTOR ys = XMVectorPermute<XM_PERMUTE_0Y, XM_PERMUTE_1X, XM_PERMUTE_1W, XM_PERMUTE_0X>(v0, v1);
+    ys = XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0Y, XM_PERMUTE_0Z, XM_PERMUTE_1Z>(ys, v2);
+    XMVECTOR zs = XMVectorPermute<XM_PERMUTE_0Z, XM_PERMUTE_1Y, XM_PERMUTE_0X, XM_PERMUTE_0X>(v0, v1);
+    zs = XMVectorPermute<XM_PERMUTE_0X, XM_PERMUTE_0Y, XM_PERMUTE_1X, XM_PERMUTE_1W>(zs, v2);
+
+    TransformFour(xs, ys, zs, splatted_transform, &transformed_positions[i]);
+  }
+
+  for (; i < position_number; ++i) {
+    XMStoreFloat4(&transformed_positions[i], XMVector3Transform(XMLoadFloat3(&positions[i]), transform));
+  }
+}
+
+void VertexStreamTransform::TransformVertexPositions(const Asset::Model::Vertex* vertices, size_t vertex_number, FXMMATRIX transform, XMFLOAT4* transformed_positions)
+{
+  const SplattedTransform splatted_transform(transform);
+
+  size_t i = 0;
+  for (; i + 4 <= vertex_number; i += 4) {
+    XMMATRIX positions(
+      XMLoadFloat3(&vertices[i].position),
+      XMLoadFloat3(&vertices[i + 1].position),
+      XMLoadFloat3(&vertices[i + 2].position),
+      XMLoadFloat3(&vertices[i + 3].position));
+    positions = XMMatrixTranspose(positions);
+
+    TransformFour(positions.r[0], positions.r[1], positions.r[2], splatted_transform, &transformed_positions[i]);
+  }
+
+  for (; i < vertex_number; ++i) {
+    XMStoreFloat4(&transformed_positions[i], XMVector3Transform(XMLoadFloat3(&vertices[i].position), transform));
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "model.h"
+
+// CPU position transforms for the two vertex stream layouts of AssetsManager, e.g. to get shadow caster
+// positions into light clip space. Both kernels do the same math four vertices at a time (positions
+// transposed into x, y, z registers, then 12 multiply-adds), so they only differ in how much memory
+// they pull in: 12 bytes per vertex from the position stream against a 44 byte stride from Vertex.
+//
+// transform uses DirectXMath's row-vector convention, i.e. the untransposed matrix, not the copy
+// uploaded to constant buffers.
+class VertexStreamTransform {
+public:
+  // Per pass over every vertex.
+  struct BenchmarkReport {
+    double interleaved_milliseconds;
+    double deinterleaved_milliseconds;
+    double interleaved_gigabytes_per_second;  // of source vertex data read, see GetVertexPositionsReadSize
+    double deinterleaved_gigabytes_per_second;  // see GetPositionsReadSize
+  };  // struct BenchmarkReport
+
+  // Transforms the same vertex_number random positions from each layout, iteration_number times.
+  static BenchmarkReport Benchmark(size_t vertex_number, UINT iteration_number);
+
+  // De-interleaved layout: packed positions, one XMFLOAT3 per vertex.
+  static void TransformPositions(const XMFLOAT3* positions, size_t position_number, FXMMATRIX transform, XMFLOAT4* transformed_positions);
+
+  // Interleaved layout: reads only the position of every Vertex.
+  static void TransformVertexPositions(const Asset::Model::Vertex* vertices, size_t vertex_number, FXMMATRIX transform, XMFLOAT4* transformed_positions);
+
+  // Bytes of source vertex data each kernel reads, handy for turning timings into bandwidth.
+  static size_t GetPositionsReadSize(size_t position_number) {
+    return position_number * Asset::Model::GetPositionStride();
+  }
+
+  static size_t GetVertexPositionsReadSize(size_t vertex_number) {
+    return vertex_number * Asset::Model::GetVertexStride();
+  }
+};  // class VertexStreamTransform
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "image_decoder.h"
+
+// Windows Imaging Component backend. Handles every format WIC has a codec for, converting to the closest
+// DXGI format.
+class WicImageDecoder : public ImageDecoder {
+ public:
+  int Decode(const std::string& filename, D3D12_RESOURCE_DESC& texture_desc, int& bytesPerRow, const RowsDestinationAllocator& allocate_rows) override;
+};  // class WicImageDecoder
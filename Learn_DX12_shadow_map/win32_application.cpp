@@ -28,6 +28,13 @@ int Win32Application::Run(DXSample* pSample, HINSTANCE hInstance, int nCmdShow)
     pSample->ParseCommandLineArgs(argv, argc);
     LocalFree(argv);
 
+    // Reports and benchmarks need neither a window nor a device.
+    int headlessExitCode = EXIT_SUCCESS;
+    if (pSample->OnHeadlessRun(headlessExitCode))
+    {
+      return headlessExitCode;
+    }
+
     // Initialize the window class.
     WNDCLASSEX windowClass = { 0 };
     windowClass.cbSize = sizeof(WNDCLASSEX);